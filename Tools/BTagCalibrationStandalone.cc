@@ -3,6 +3,10 @@
 #include <exception>
 #include <algorithm>
 #include <sstream>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 
 
 BTagEntry::Parameters::Parameters(
@@ -366,6 +370,251 @@ std::string BTagCalibration::token(const BTagEntry::Parameters &par)
 
 
 
+namespace {
+
+// Small evaluator for the formulas found in the CSV files (numbers, x,
+// + - * /, comparisons, ?: and a few functions).  The formula is parsed
+// once into an expression tree and evaluated in double precision with the
+// usual C++ precedence rules, which is what TFormula compiles it to.
+// Anything it does not understand makes compile() fail and the caller
+// falls back to TF1.
+class BTagFormula
+{
+public:
+  BTagFormula() : root_(-1) {}
+
+  bool compile(const std::string & formula)
+  {
+    nodes_.clear();
+    str_ = formula;
+    pos_ = 0;
+    ok_ = true;
+    root_ = parseTernary();
+    skipSpace();
+    if (!ok_ || pos_ != str_.size()) {
+      nodes_.clear();
+      root_ = -1;
+    }
+    str_.clear();
+    return root_ >= 0;
+  }
+
+  bool valid() const { return root_ >= 0; }
+
+  double eval(double x) const { return evalNode(root_, x); }
+
+private:
+  enum OpCode { CONST, VAR, NEG, ADD, SUB, MUL, DIV,
+                LT, GT, LE, GE, EQ, NE, SELECT,
+                LOG, EXP, SQRT, ABS, POW };
+
+  struct Node {
+    OpCode op;
+    double value;
+    int a, b, c;
+  };
+
+  std::vector<Node> nodes_;
+  int root_;
+
+  // parser state, only used during compile()
+  std::string str_;
+  size_t pos_;
+  bool ok_;
+
+  double evalNode(int i, double x) const
+  {
+    const Node &n = nodes_[i];
+    switch (n.op) {
+      case CONST:  return n.value;
+      case VAR:    return x;
+      case NEG:    return -evalNode(n.a, x);
+      case ADD:    return evalNode(n.a, x) + evalNode(n.b, x);
+      case SUB:    return evalNode(n.a, x) - evalNode(n.b, x);
+      case MUL:    return evalNode(n.a, x) * evalNode(n.b, x);
+      case DIV:    return evalNode(n.a, x) / evalNode(n.b, x);
+      case LT:     return evalNode(n.a, x) <  evalNode(n.b, x);
+      case GT:     return evalNode(n.a, x) >  evalNode(n.b, x);
+      case LE:     return evalNode(n.a, x) <= evalNode(n.b, x);
+      case GE:     return evalNode(n.a, x) >= evalNode(n.b, x);
+      case EQ:     return evalNode(n.a, x) == evalNode(n.b, x);
+      case NE:     return evalNode(n.a, x) != evalNode(n.b, x);
+      case SELECT: return evalNode(n.a, x) ? evalNode(n.b, x) : evalNode(n.c, x);
+      case LOG:    return std::log(evalNode(n.a, x));
+      case EXP:    return std::exp(evalNode(n.a, x));
+      case SQRT:   return std::sqrt(evalNode(n.a, x));
+      case ABS:    return std::fabs(evalNode(n.a, x));
+      case POW:    return std::pow(evalNode(n.a, x), evalNode(n.b, x));
+    }
+    return 0.;
+  }
+
+  int addNode(OpCode op, int a = -1, int b = -1, int c = -1, double value = 0.)
+  {
+    if ((a == -2) || (b == -2) || (c == -2)) {
+      ok_ = false;
+      return -2;
+    }
+    Node n = {op, value, a, b, c};
+    nodes_.push_back(n);
+    return nodes_.size() - 1;
+  }
+
+  void skipSpace()
+  {
+    while (pos_ < str_.size() && std::isspace(static_cast<unsigned char>(str_[pos_]))) ++pos_;
+  }
+
+  bool accept(const char* tok)
+  {
+    skipSpace();
+    size_t len = std::strlen(tok);
+    if (str_.compare(pos_, len, tok) == 0) {
+      pos_ += len;
+      return true;
+    }
+    return false;
+  }
+
+  int fail()
+  {
+    ok_ = false;
+    return -2;
+  }
+
+  // ternary := equality [ '?' ternary ':' ternary ]
+  int parseTernary()
+  {
+    int cond = parseEquality();
+    if (!ok_) return -2;
+    if (accept("?")) {
+      int t = parseTernary();
+      if (!ok_ || !accept(":")) return fail();
+      int f = parseTernary();
+      return addNode(SELECT, cond, t, f);
+    }
+    return cond;
+  }
+
+  // equality := relational { ('=='|'!=') relational }
+  int parseEquality()
+  {
+    int lhs = parseRelational();
+    while (ok_) {
+      OpCode op;
+      if      (accept("==")) op = EQ;
+      else if (accept("!=")) op = NE;
+      else break;
+      lhs = addNode(op, lhs, parseRelational());
+    }
+    return ok_ ? lhs : -2;
+  }
+
+  // relational := sum { ('<'|'>'|'<='|'>=') sum }, binds tighter than equality
+  int parseRelational()
+  {
+    int lhs = parseSum();
+    while (ok_) {
+      OpCode op;
+      if      (accept("<=")) op = LE;
+      else if (accept(">=")) op = GE;
+      else if (accept("<"))  op = LT;
+      else if (accept(">"))  op = GT;
+      else break;
+      lhs = addNode(op, lhs, parseSum());
+    }
+    return ok_ ? lhs : -2;
+  }
+
+  // sum := product { ('+'|'-') product }
+  int parseSum()
+  {
+    int lhs = parseProduct();
+    while (ok_) {
+      if      (accept("+")) lhs = addNode(ADD, lhs, parseProduct());
+      else if (accept("-")) lhs = addNode(SUB, lhs, parseProduct());
+      else break;
+    }
+    return ok_ ? lhs : -2;
+  }
+
+  // product := unary { ('*'|'/') unary }
+  int parseProduct()
+  {
+    int lhs = parseUnary();
+    while (ok_) {
+      if      (accept("*")) lhs = addNode(MUL, lhs, parseUnary());
+      else if (accept("/")) lhs = addNode(DIV, lhs, parseUnary());
+      else break;
+    }
+    return ok_ ? lhs : -2;
+  }
+
+  // unary := ('-'|'+') unary | primary
+  int parseUnary()
+  {
+    if (accept("-")) return addNode(NEG, parseUnary());
+    if (accept("+")) return parseUnary();
+    return parsePrimary();
+  }
+
+  // primary := number | 'x' | function '(' args ')' | '(' ternary ')'
+  int parsePrimary()
+  {
+    skipSpace();
+    if (pos_ >= str_.size()) return fail();
+
+    if (accept("(")) {
+      int inner = parseTernary();
+      if (!ok_ || !accept(")")) return fail();
+      return inner;
+    }
+
+    char c = str_[pos_];
+    if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+      const char* begin = str_.c_str() + pos_;
+      char* end = nullptr;
+      double value = std::strtod(begin, &end);
+      if (end == begin) return fail();
+      pos_ += end - begin;
+      return addNode(CONST, -1, -1, -1, value);
+    }
+
+    size_t start = pos_;
+    // a ':' is only part of a name as "::", a single one ends the ternary
+    while (pos_ < str_.size()) {
+      if (std::isalnum(static_cast<unsigned char>(str_[pos_])) || str_[pos_] == '_') ++pos_;
+      else if (str_.compare(pos_, 2, "::") == 0) pos_ += 2;
+      else break;
+    }
+    std::string name = str_.substr(start, pos_ - start);
+
+    if (name == "x") return addNode(VAR);
+
+    OpCode op;
+    int nArgs = 1;
+    if      (name == "log"  || name == "TMath::Log")  op = LOG;
+    else if (name == "exp"  || name == "TMath::Exp")  op = EXP;
+    else if (name == "sqrt" || name == "TMath::Sqrt") op = SQRT;
+    else if (name == "abs"  || name == "fabs" || name == "TMath::Abs") op = ABS;
+    else if (name == "pow"  || name == "TMath::Power") { op = POW; nArgs = 2; }
+    else return fail();
+
+    if (!accept("(")) return fail();
+    int a = parseTernary();
+    int b = -1;
+    if (nArgs == 2) {
+      if (!ok_ || !accept(",")) return fail();
+      b = parseTernary();
+    }
+    if (!ok_ || !accept(")")) return fail();
+    return addNode(op, a, b);
+  }
+};
+
+}  // namespace
+
+
 class BTagCalibrationReader::BTagCalibrationReaderImpl
 {
   friend class BTagCalibrationReader;
@@ -378,7 +627,31 @@ public:
     float ptMax;
     float discrMin;
     float discrMax;
+    BTagFormula formula;  // compiled formula, TF1 is only used if it fails
     TF1 func;
+
+    double evalFormula(double x) const {
+      return formula.valid() ? formula.eval(x) : func.Eval(x);
+    }
+  };
+
+  // eta x pt lookup built at load time for the non-reshaping operating
+  // points.  Cells are bounded by the sorted range edges of all entries,
+  // [etaEdges[i], etaEdges[i+1]) x (ptEdges[j], ptEdges[j+1]], and store
+  // the index of the first entry the linear search would have found.
+  struct Lookup {
+    std::vector<float> etaEdges;
+    std::vector<float> ptEdges;
+    std::vector<int> cellEntry;                  // nEta x nPt, -1 if empty
+    std::vector<std::pair<float, float> > ptRange;  // min_max_pt per eta cell
+
+    int etaCell(float eta) const {
+      // returns -1 below the first or above the last edge
+      return int(std::upper_bound(etaEdges.begin(), etaEdges.end(), eta) - etaEdges.begin()) - 1;
+    }
+    int ptCell(float pt) const {
+      return int(std::lower_bound(ptEdges.begin(), ptEdges.end(), pt) - ptEdges.begin()) - 1;
+    }
   };
 
 private:
@@ -407,10 +680,37 @@ private:
                                      float eta,
                                      float discr) const;
 
+  void eval_auto_bounds_batch(unsigned n,
+                              const BTagEntry::JetFlavor * jf,
+                              const float * eta,
+                              const float * pt,
+                              float * central,
+                              float * up,
+                              float * down,
+                              const std::string & sysUp,
+                              const std::string & sysDown) const;
+
+  // linear search versions, used for the reshaping operating point and to
+  // fill the lookup tables
+  int findEntry(BTagEntry::JetFlavor jf,
+                float eta,
+                float pt,
+                float discr) const;
+  std::pair<float, float> min_max_pt_linear(BTagEntry::JetFlavor jf,
+                                            float eta,
+                                            float discr) const;
+  void buildLookup(BTagEntry::JetFlavor jf);
+
+  const BTagCalibrationReaderImpl* sysReader(const std::string & sys) const;
+
+  // value of this reader's own sysType with pt clamped to its own bounds
+  float eval_clamped(BTagEntry::JetFlavor jf, float eta, float pt) const;
+
   BTagEntry::OperatingPoint op_;
   std::string sysType_;
   std::vector<std::vector<TmpEntry> > tmpData_;  // first index: jetFlavor
   std::vector<bool> useAbsEta_;                  // first index: jetFlavor
+  std::vector<Lookup> lookup_;                   // first index: jetFlavor
   std::map<std::string, BTagCalibrationReaderImpl*> otherSysTypeReaders_;
 };
 
@@ -420,7 +720,8 @@ BTagCalibrationReader::BTagCalibrationReaderImpl::BTagCalibrationReaderImpl(
   op_(op),
   sysType_(sysType),
   tmpData_(3),
-  useAbsEta_(3, true)
+  useAbsEta_(3, true),
+  lookup_(3)
 {
 }
 
@@ -431,7 +732,8 @@ BTagCalibrationReader::BTagCalibrationReaderImpl::BTagCalibrationReaderImpl(
   op_(op),
   sysType_(sysType),
   tmpData_(3),
-  useAbsEta_(3, true)
+  useAbsEta_(3, true),
+  lookup_(3)
 {
   for (const std::string & ost : otherSysTypes) {
     if (otherSysTypeReaders_.count(ost)) {
@@ -473,12 +775,14 @@ throw std::exception();
     te.discrMin = be.params.discrMin;
     te.discrMax = be.params.discrMax;
 
-    if (op_ == BTagEntry::OP_RESHAPING) {
-      te.func = TF1("", be.formula.c_str(),
-                    be.params.discrMin, be.params.discrMax);
-    } else {
-      te.func = TF1("", be.formula.c_str(),
-                    be.params.ptMin, be.params.ptMax);
+    if (!te.formula.compile(be.formula)) {
+      if (op_ == BTagEntry::OP_RESHAPING) {
+        te.func = TF1("", be.formula.c_str(),
+                      be.params.discrMin, be.params.discrMax);
+      } else {
+        te.func = TF1("", be.formula.c_str(),
+                      be.params.ptMin, be.params.ptMax);
+      }
     }
 
     tmpData_[be.params.jetFlavor].push_back(te);
@@ -487,24 +791,58 @@ throw std::exception();
     }
   }
 
+  if (op_ != BTagEntry::OP_RESHAPING) {
+    buildLookup(jf);
+  }
+
   for (typename std::map<std::string, BTagCalibrationReaderImpl*>::iterator p = otherSysTypeReaders_.begin(); p != otherSysTypeReaders_.end(); ++p) {
     p->second->load(c, jf, measurementType);
   }
 }
 
-float BTagCalibrationReader::BTagCalibrationReaderImpl::eval(
+void BTagCalibrationReader::BTagCalibrationReaderImpl::buildLookup(
+                                             BTagEntry::JetFlavor jf)
+{
+  const std::vector<TmpEntry> &entries = tmpData_.at(jf);
+  Lookup &lu = lookup_.at(jf);
+
+  lu.etaEdges.clear();
+  lu.ptEdges.clear();
+  for (unsigned i=0; i<entries.size(); ++i) {
+    lu.etaEdges.push_back(entries[i].etaMin);
+    lu.etaEdges.push_back(entries[i].etaMax);
+    lu.ptEdges.push_back(entries[i].ptMin);
+    lu.ptEdges.push_back(entries[i].ptMax);
+  }
+  std::sort(lu.etaEdges.begin(), lu.etaEdges.end());
+  lu.etaEdges.erase(std::unique(lu.etaEdges.begin(), lu.etaEdges.end()), lu.etaEdges.end());
+  std::sort(lu.ptEdges.begin(), lu.ptEdges.end());
+  lu.ptEdges.erase(std::unique(lu.ptEdges.begin(), lu.ptEdges.end()), lu.ptEdges.end());
+
+  // every eta in [etaEdges[i], etaEdges[i+1]) and pt in (ptEdges[j], ptEdges[j+1]]
+  // matches the same entries, so one linear search per cell fills the table
+  unsigned nEta = lu.etaEdges.size() > 1 ? lu.etaEdges.size() - 1 : 0;
+  unsigned nPt  = lu.ptEdges.size()  > 1 ? lu.ptEdges.size()  - 1 : 0;
+  lu.cellEntry.assign(nEta * nPt, -1);
+  lu.ptRange.assign(nEta, std::make_pair(-1.f, -1.f));
+  for (unsigned iEta=0; iEta<nEta; ++iEta) {
+    float eta = lu.etaEdges[iEta];
+    lu.ptRange[iEta] = min_max_pt_linear(jf, eta, 0.);
+    for (unsigned iPt=0; iPt<nPt; ++iPt) {
+      lu.cellEntry[iEta*nPt + iPt] = findEntry(jf, eta, lu.ptEdges[iPt+1], 0.);
+    }
+  }
+}
+
+int BTagCalibrationReader::BTagCalibrationReaderImpl::findEntry(
                                              BTagEntry::JetFlavor jf,
                                              float eta,
                                              float pt,
                                              float discr) const
 {
   bool use_discr = (op_ == BTagEntry::OP_RESHAPING);
-  if (useAbsEta_[jf] && eta < 0) {
-    eta = -eta;
-  }
 
-  // search linearly through eta, pt and discr ranges and eval
-  // future: find some clever data structure based on intervals
+  // search linearly through eta, pt and discr ranges
   const std::vector<TmpEntry> &entries = tmpData_.at(jf);
   for (unsigned i=0; i<entries.size(); ++i) {
     const TmpEntry &e = entries.at(i);
@@ -514,15 +852,43 @@ float BTagCalibrationReader::BTagCalibrationReaderImpl::eval(
     ){
       if (use_discr) {                                    // discr. reshaping?
         if (e.discrMin <= discr && discr < e.discrMax) {  // check discr
-          return e.func.Eval(discr);
+          return i;
         }
       } else {
-        return e.func.Eval(pt);
+        return i;
       }
     }
   }
 
-  return 0.;  // default value
+  return -1;
+}
+
+float BTagCalibrationReader::BTagCalibrationReaderImpl::eval(
+                                             BTagEntry::JetFlavor jf,
+                                             float eta,
+                                             float pt,
+                                             float discr) const
+{
+  bool use_discr = (op_ == BTagEntry::OP_RESHAPING);
+  if (useAbsEta_[jf] && eta < 0) {
+    eta = -eta;
+  }
+
+  const std::vector<TmpEntry> &entries = tmpData_.at(jf);
+  if (use_discr) {
+    int i = findEntry(jf, eta, pt, discr);
+    return i >= 0 ? entries[i].evalFormula(discr) : 0.;
+  }
+
+  const Lookup &lu = lookup_[jf];
+  int iEta = lu.etaCell(eta);
+  int iPt = lu.ptCell(pt);
+  int nPt = lu.ptEdges.size() - 1;
+  if (iEta < 0 || iEta >= int(lu.ptRange.size()) || iPt < 0 || iPt >= nPt) {
+    return 0.;  // default value
+  }
+  int i = lu.cellEntry[iEta*nPt + iPt];
+  return i >= 0 ? entries[i].evalFormula(pt) : 0.;
 }
 
 float BTagCalibrationReader::BTagCalibrationReaderImpl::eval_auto_bounds(
@@ -551,13 +917,7 @@ float BTagCalibrationReader::BTagCalibrationReaderImpl::eval_auto_bounds(
   }
 
   // get sys SF (and maybe return)
-  if (!otherSysTypeReaders_.count(sys)) {
-std::cerr << "ERROR in BTagCalibration: "
-        << "sysType not available (maybe not loaded?): "
-        << sys;
-throw std::exception();
-  }
-  float sf_err = otherSysTypeReaders_.at(sys)->eval(jf, eta, pt_for_eval, discr);
+  float sf_err = sysReader(sys)->eval(jf, eta, pt_for_eval, discr);
   if (!is_out_of_bounds) {
     return sf_err;
   }
@@ -567,16 +927,93 @@ throw std::exception();
   return sf_err;
 }
 
+const BTagCalibrationReader::BTagCalibrationReaderImpl*
+BTagCalibrationReader::BTagCalibrationReaderImpl::sysReader(
+                                             const std::string & sys) const
+{
+  std::map<std::string, BTagCalibrationReaderImpl*>::const_iterator it = otherSysTypeReaders_.find(sys);
+  if (it == otherSysTypeReaders_.end()) {
+std::cerr << "ERROR in BTagCalibration: "
+        << "sysType not available (maybe not loaded?): "
+        << sys;
+throw std::exception();
+  }
+  return it->second;
+}
+
+void BTagCalibrationReader::BTagCalibrationReaderImpl::eval_auto_bounds_batch(
+                                             unsigned n,
+                                             const BTagEntry::JetFlavor * jf,
+                                             const float * eta,
+                                             const float * pt,
+                                             float * central,
+                                             float * up,
+                                             float * down,
+                                             const std::string & sysUp,
+                                             const std::string & sysDown) const
+{
+  const BTagCalibrationReaderImpl* upReader = up ? sysReader(sysUp) : nullptr;
+  const BTagCalibrationReaderImpl* downReader = down ? sysReader(sysDown) : nullptr;
+
+  // every variation is evaluated like a reader constructed for that sysType
+  // alone: with its own pt bounds and without the doubled out-of-bounds
+  // uncertainty of eval_auto_bounds
+  for (unsigned i=0; i<n; ++i) {
+    if (central) {
+      central[i] = eval_clamped(jf[i], eta[i], pt[i]);
+    }
+    if (upReader) {
+      up[i] = upReader->eval_clamped(jf[i], eta[i], pt[i]);
+    }
+    if (downReader) {
+      down[i] = downReader->eval_clamped(jf[i], eta[i], pt[i]);
+    }
+  }
+}
+
+float BTagCalibrationReader::BTagCalibrationReaderImpl::eval_clamped(
+                                             BTagEntry::JetFlavor jf,
+                                             float eta,
+                                             float pt) const
+{
+  std::pair<float, float> sf_bounds = min_max_pt(jf, eta, 0.);
+  float pt_for_eval = pt;
+  if (pt < sf_bounds.first) {
+    pt_for_eval = sf_bounds.first + .0001;
+  } else if (pt > sf_bounds.second) {
+    pt_for_eval = sf_bounds.second - .0001;
+  }
+  return eval(jf, eta, pt_for_eval, 0.);
+}
+
 std::pair<float, float> BTagCalibrationReader::BTagCalibrationReaderImpl::min_max_pt(
                                                BTagEntry::JetFlavor jf,
                                                float eta,
                                                float discr) const
 {
-  bool use_discr = (op_ == BTagEntry::OP_RESHAPING);
   if (useAbsEta_[jf] && eta < 0) {
     eta = -eta;
   }
 
+  if (op_ == BTagEntry::OP_RESHAPING) {
+    return min_max_pt_linear(jf, eta, discr);
+  }
+
+  const Lookup &lu = lookup_[jf];
+  int iEta = lu.etaCell(eta);
+  if (iEta < 0 || iEta >= int(lu.ptRange.size())) {
+    return std::make_pair(-1.f, -1.f);
+  }
+  return lu.ptRange[iEta];
+}
+
+std::pair<float, float> BTagCalibrationReader::BTagCalibrationReaderImpl::min_max_pt_linear(
+                                               BTagEntry::JetFlavor jf,
+                                               float eta,
+                                               float discr) const
+{
+  bool use_discr = (op_ == BTagEntry::OP_RESHAPING);
+
   const std::vector<TmpEntry> &entries = tmpData_.at(jf);
   float min_pt = -1., max_pt = -1.;
   for (unsigned i=0; i<entries.size(); ++i) {
@@ -644,4 +1081,17 @@ std::pair<float, float> BTagCalibrationReader::min_max_pt(BTagEntry::JetFlavor j
   return pimpl->min_max_pt(jf, eta, discr);
 }
 
+void BTagCalibrationReader::eval_auto_bounds_batch(unsigned n,
+                                                   const BTagEntry::JetFlavor * jf,
+                                                   const float * eta,
+                                                   const float * pt,
+                                                   float * central,
+                                                   float * up,
+                                                   float * down,
+                                                   const std::string & sysUp,
+                                                   const std::string & sysDown) const
+{
+  pimpl->eval_auto_bounds_batch(n, jf, eta, pt, central, up, down, sysUp, sysDown);
+}
+
 
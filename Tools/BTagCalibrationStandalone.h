@@ -141,7 +141,9 @@ protected:
  * BTagCalibrationReader
  *
  * Helper class to pull out a specific set of BTagEntry's out of a
- * BTagCalibration. TF1 functions are set up at initialization time.
+ * BTagCalibration. Formulas are compiled and the eta/pt ranges are
+ * binned into a lookup table at initialization time, TF1 is only used for
+ * formulas the built-in evaluator does not understand.
  *
  ************************************************************/
 
@@ -181,6 +183,22 @@ public:
                                      float eta,
                                      float discr=0.) const;
 
+  // Central, up and down values for n jets at once (not for OP_RESHAPING).
+  // Each variation is evaluated as eval_auto_bounds of a reader constructed
+  // for that sysType, i.e. within its own pt bounds and without doubling the
+  // uncertainty out of bounds.  The reader must be constructed with
+  // sysUp/sysDown in otherSysTypes, any of the output arrays may be null if
+  // that variation is not needed.
+  void eval_auto_bounds_batch(unsigned n,
+                              const BTagEntry::JetFlavor * jf,
+                              const float * eta,
+                              const float * pt,
+                              float * central,
+                              float * up=0,
+                              float * down=0,
+                              const std::string & sysUp="up",
+                              const std::string & sysDown="down") const;
+
 protected:
   BTagCalibrationReaderImpl* pimpl;
 };
@@ -19,13 +19,14 @@
 #include <cmath>
 
 #include "customize.h"
+#include "FlatHist.h"
 
 template<typename data_t>
 class BTagCorrectorTemplate 
 {
 public:
     //constructor
-    BTagCorrectorTemplate(std::string file = "allINone_bTagEff.root", std::string CSVFilePath = "", std::string CSVFile = "CSVv2_Moriond17_B_H.csv", bool isFastSim = false, std::string suffix = "TTbarSingleLepT") : debug(false), fastsim(false), btagSFunc(0), mistagSFunc(0), btagCFunc(0), ctagCFunc(0), mistagCFunc(0), h_eff_b(NULL), h_eff_c(NULL), h_eff_udsg(NULL) 
+    BTagCorrectorTemplate(std::string file = "allINone_bTagEff.root", std::string CSVFilePath = "", std::string CSVFile = "CSVv2_Moriond17_B_H.csv", bool isFastSim = false, std::string suffix = "TTbarSingleLepT") : debug(false), fastsim(false), allVariations(false), jetSFEffValid(false), btagSFunc(0), mistagSFunc(0), btagCFunc(0), ctagCFunc(0), mistagCFunc(0), h_eff_b(NULL), h_eff_c(NULL), h_eff_udsg(NULL) 
     {
         //Stops unwanted segfaults.
         TH1::AddDirectory(false);
@@ -64,9 +65,12 @@ public:
 
     //accessors
     void SetDebug(bool d) { debug = d; }
-    void SetFastSim(bool f) { fastsim = f; }
+    void SetFastSim(bool f) { fastsim = f; jetSFEffValid = false; }
+    //Also store the fastsim CF variations on their own in registerVarToNTuples
+    void SetAllVariations(bool a) { allVariations = a; }
     void SetEffs(TFile* file, std::string suffix = "")
     {
+        jetSFEffValid = false;
         if(suffix.size())
         {
             std::string suffix2 = suffix;
@@ -105,6 +109,11 @@ public:
                 h_eff_udsg->Divide(d_eff_udsg);
             }
         }
+
+        //flat copies of the efficiency maps for the per jet lookups
+        eff_b = FlatHist(h_eff_b);
+        eff_c = FlatHist(h_eff_c);
+        eff_udsg = FlatHist(h_eff_udsg);
     }
     void resetEffs(std::string suffix)
     {
@@ -116,24 +125,20 @@ public:
     void SetCalib(std::string cfile)
     {        
         //initialize btag helper classes. Interface has been changed.
+        jetSFEffValid = false;
         calib = BTagCalibration("",cfile);
-        reader = BTagCalibrationReader(BTagEntry::OP_MEDIUM, "central");
+        //one reader holds the central values and the up/down variations, each evaluated like a
+        //reader of its own sysType by eval_auto_bounds_batch
+        reader = BTagCalibrationReader(BTagEntry::OP_MEDIUM, "central", {"up", "down"});
         reader.load(calib, BTagEntry::FLAV_B, "comb"); reader.load(calib, BTagEntry::FLAV_C, "comb");  reader.load(calib, BTagEntry::FLAV_UDSG, "incl");
-        readerUp = BTagCalibrationReader(BTagEntry::OP_MEDIUM, "up");
-        readerUp.load(calib, BTagEntry::FLAV_B, "comb"); readerUp.load(calib, BTagEntry::FLAV_C, "comb");  readerUp.load(calib, BTagEntry::FLAV_UDSG, "incl");
-        readerDown = BTagCalibrationReader(BTagEntry::OP_MEDIUM, "down");
-        readerDown.load(calib, BTagEntry::FLAV_B, "comb"); readerDown.load(calib, BTagEntry::FLAV_C, "comb");  readerDown.load(calib, BTagEntry::FLAV_UDSG, "incl");        
     }
     void SetCalibFastSim(std::string cfile)
     {        
         //read CFs  New 2016 Modifications
+        jetSFEffValid = false;
         calibFast = BTagCalibration("",cfile);
-	readerFast = BTagCalibrationReader(BTagEntry::OP_MEDIUM, "central");
+	readerFast = BTagCalibrationReader(BTagEntry::OP_MEDIUM, "central", {"up", "down"});
 	readerFast.load(calibFast, BTagEntry::FLAV_B, "fastsim"); readerFast.load(calibFast, BTagEntry::FLAV_C, "fastsim");  readerFast.load(calibFast, BTagEntry::FLAV_UDSG, "fastsim");
-	readerFastUp = BTagCalibrationReader(BTagEntry::OP_MEDIUM, "up");
-	readerFastUp.load(calibFast, BTagEntry::FLAV_B, "fastsim"); readerFastUp.load(calibFast, BTagEntry::FLAV_C, "fastsim");  readerFastUp.load(calibFast, BTagEntry::FLAV_UDSG, "fastsim");
-	readerFastDown = BTagCalibrationReader(BTagEntry::OP_MEDIUM, "down");
-	readerFastDown.load(calibFast, BTagEntry::FLAV_B, "fastsim"); readerFastDown.load(calibFast, BTagEntry::FLAV_C, "fastsim");  readerFastDown.load(calibFast, BTagEntry::FLAV_UDSG, "fastsim"); 	
     }
     void SetTreeNames(const NTupleReader& tr)
     {
@@ -178,91 +183,31 @@ public:
         //reset probabilities
         std::vector<data_t> *prob = new std::vector<data_t>(4,0.0);
         (*prob)[0] = 1.0;
-  
-        //first loop over jets
-        std::vector<std::vector<data_t> > sfEffLists = std::vector<std::vector<data_t> >(Jets->size(),std::vector<data_t>());
-        for(unsigned ja = 0; ja < Jets->size(); ++ja){
+
+        //eff, sf and cf of every jet for all variations (only calculated once per event)
+        const JetSFEff& jets = FillJetSFEff(Jets, Jets_flavor);
+
+        //the probabilities for n b-tags are the coefficients of prod_i (1 - eps_i + eps_i*z),
+        //which is built up one jet at a time, case 3 takes the rest
+        for(unsigned ja = 0; ja < jets.size(); ++ja){
             //HT jet cuts
-            if(Jets->at(ja).Pt()< 30.0 || fabs(Jets->at(ja).Eta()) > 2.4) continue;
+            if(!jets.pass[ja]) continue;
+
+            data_t eps_a = jets.eps(ja, btagSFunc, mistagSFunc, btagCFunc, ctagCFunc, mistagCFunc);
 
-            //get sf and eff values (checks if already calculated)
-            InitSFEff(Jets->at(ja).Pt(), Jets->at(ja).Eta(), Jets_flavor->at(ja), sfEffLists[ja]);
-            data_t eps_a = sfEffLists[ja][0]*sfEffLists[ja][1]*sfEffLists[ja][2];
-  
             //jet index, pt, eta, flavor, eff, sf, cf
-	
-            if(debug) std::cout << "Jet " << ja << ": " << Jets->at(ja).Pt() << ", " << fabs(Jets->at(ja).Eta()) << ", " << abs(Jets_flavor->at(ja)) 
-                                << " sfEffLists[ja][0], " << sfEffLists[ja][0] << "  sfEffLists[ja][1], " << sfEffLists[ja][1] << "  sfEffLists[ja][2], " << sfEffLists[ja][2] << std::endl;
-  
-            //calculate prob(0 b-tags)
+            if(debug) std::cout << "Jet " << ja << ": " << Jets->at(ja).Pt() << ", " << fabs(Jets->at(ja).Eta()) << ", " << abs(Jets_flavor->at(ja))
+                                << ", eps " << eps_a << std::endl;
+
+            (*prob)[2] = (*prob)[2]*(1-eps_a) + (*prob)[1]*eps_a;
+            (*prob)[1] = (*prob)[1]*(1-eps_a) + (*prob)[0]*eps_a;
             (*prob)[0] *= (1-eps_a);
-	 
-            //sub-probabilities for following calculations
-            data_t subprob1 = 1.0;
-            data_t subprob2 = 0.0;
-	 
-            //second loop over jets
-            for(unsigned jb = 0; jb < Jets->size(); ++jb){
-                //skip the same jet
-                if(jb==ja) continue;
-	   
-                //HT jet cuts
-	   
-                if(Jets->at(ja).Pt()<30.0 ||fabs(Jets->at(ja).Eta()) > 2.4) continue;
-	   
-	   
-                //get sf and eff values (checks if already calculated)
-                InitSFEff(Jets->at(jb).Pt(), Jets->at(jb).Eta(), Jets_flavor->at(jb), sfEffLists[jb]);
-	   
-                data_t eps_b = sfEffLists[jb][0]*sfEffLists[jb][1]*sfEffLists[jb][2];
-	   
-                //jet index, pt, eta, flavor, eff, sf, cf
-	    
-                if(debug) std::cout << "\tJet " << jb << ": " << Jets->at(jb).Pt() << ", " << fabs(Jets->at(jb).Eta()) << ", " << abs(Jets_flavor->at(jb)) 
-                                    << ", " << sfEffLists[jb][0] << ", " << sfEffLists[jb][1] << ", " << sfEffLists[jb][2] << std::endl;
-	   
-                //calculate prob(1 b-tag)
-                subprob1 *= (1-eps_b);
-	   
-                //sub-sub-probability for following calculations
-                data_t subsubprob2 = 1.0;
-	   
-                //third loop over jets (only for jb>ja)
-                if(jb<ja) continue;
-                for(unsigned jc = 0; jc < Jets->size(); ++jc){
-                    //skip the same jet
-                    if(jc==jb || jc==ja) continue;
-	     
-                    //HT jet cuts
-                    if(Jets->at(ja).Pt()<30.0 ||fabs(Jets->at(ja).Eta()) > 2.4) continue;
-	     
-                    //get sf and eff values (checks if already calculated)
-                    InitSFEff(Jets->at(jc).Pt(), Jets->at(jc).Eta(), Jets_flavor->at(jc), sfEffLists[jc]);
-                    data_t eps_c = sfEffLists[jc][0]*sfEffLists[jc][1]*sfEffLists[jc][2];
-	     
-                    //jet index, pt, eta, flavor, eff, sf, cf
-		
-                    if(debug) std::cout << "\t\tJet " << jc << ": " << Jets->at(jc).Pt() << ", " << fabs(Jets->at(jc).Eta()) << ", " << abs(Jets_flavor->at(jc)) 
-                                        << ", " << sfEffLists[jc][0] << ", " << sfEffLists[jc][1] << ", " << sfEffLists[jc][2] << std::endl;
-	     
-                    //calculate prob(2 b-tags)
-                    subsubprob2 *= (1-eps_c);
-                }
-	   
-                //add up sub-sub-prob
-                subprob2 += eps_b*subsubprob2;
-            }
-	 
-            //add up sub-probs
-            (*prob)[1] += eps_a*subprob1;
-            (*prob)[2] += eps_a*subprob2;
         }
-       
+
         //conserve probability
-       
         (*prob)[3] = 1 - (*prob)[0] -(*prob)[1] - (*prob)[2];
         if(debug) std::cout << (*prob)[0] << ", " << (*prob)[1] << ", " << (*prob)[2] << ", " << (*prob)[3] << std::endl;
-       
+
         return prob;
     }
 
@@ -276,27 +221,23 @@ public:
         data_t mcNoTag = 1.;
         data_t dataTag = 1.;
         data_t dataNoTag = 1.;
-  
+
+        //eff, sf and cf of every jet for all variations (only calculated once per event)
+        const JetSFEff& jets = FillJetSFEff(Jets, Jets_flavor);
+
         //loop over jets
-        std::vector<std::vector<data_t> > sfEffLists = std::vector<std::vector<data_t> >(Jets->size(),std::vector<data_t>());
-        for(unsigned ja = 0; ja < Jets->size(); ++ja){
+        for(unsigned ja = 0; ja < jets.size(); ++ja){
             //HT jet cuts
-            if(Jets->at(ja).Pt()<30.0 || fabs(Jets->at(ja).Eta()) > 2.4) continue;
-    
-            //get sf and eff values (checks if already calculated)
-            InitSFEff(Jets->at(ja).Pt(), Jets->at(ja).Eta(), Jets_flavor->at(ja), sfEffLists[ja]);
-            data_t eff_a = sfEffLists[ja][0]; //eff
-            data_t cf_a = sfEffLists[ja][2]; //CF
-            data_t sf_a = sfEffLists[ja][1];
-    
-            if( sfEffLists[ja][0] ==0 || sfEffLists[ja][1] ==0 || sfEffLists[ja][2] ==0 ){
-                if(debug) std::cout<<"sfEffLists[ja][0] : "<<sfEffLists[ja][0]<<"  sfEffLists[ja][1] : "<<sfEffLists[ja][1]<<"  sfEffLists[ja][2] : "<<sfEffLists[ja][2]<<std::endl;
+            if(!jets.pass[ja]) continue;
+
+            data_t eff_a = jets.eff[ja]; //eff
+            data_t cf_a = jets.getCF(ja, btagCFunc, ctagCFunc, mistagCFunc); //CF
+            data_t sf_a = jets.getSF(ja, btagSFunc, mistagSFunc); //SF
+
+            if( eff_a ==0 || sf_a ==0 || cf_a ==0 ){
+                if(debug) std::cout<<"eff : "<<eff_a<<"  sf : "<<sf_a<<"  cf : "<<cf_a<<std::endl;
             }
 
-            //jet index, pt, eta, flavor, csv, eff, sf, cf
-            // if(debug) std::cout << "Jet " << ja << ": " << Jets->at(ja).Pt() << ", " << fabs(Jets->at(ja).Eta()) << ", " << abs(Jets_flavor->at(ja))  << ", " << Jets_bDiscriminatorCSV->at(ja)
-            //                       << ", " << sfEffLists[ja][0] << ", " << sfEffLists[ja][1] << ", " << sfEffLists[ja][2] << std::endl;
-    
             if(Jets_bDiscriminatorCSV->at(ja) > AnaConsts::cutCSVS){
                 mcTag *= eff_a*cf_a;
                 dataTag *= eff_a*cf_a*sf_a;
@@ -314,88 +255,257 @@ public:
     void InitSFEff(data_t pt, data_t eta, int flav, std::vector<data_t>& sfEffList)
     {
         //avoid rerunning this
-        sfEffList.clear();
         if(sfEffList.size()>0) return;
   
         //use abs(eta) for now
         eta = fabs(eta);
-        //use abs(flav) always
-        flav = abs(flav);
     
         sfEffList = std::vector<data_t>(3,1.0); //eff, sf (central, up, or down), cf (central, up, or down)
 
-        const data_t max_btagSF_pt = 670.0, max_fastsim_btagCF_pt = 800.0;
-        const data_t max_ctagSF_pt = 670.0, max_fastsim_ctagCF_pt = 800.0;
-        const data_t max_udsgSF_pt = 1000.0, max_fastsim_udsgCF_pt = 800.0;
-
-        /********************************************************************/  
-        if(flav==5)
-        { //b-tag
-            // data_t Uncertainty are now taken care automaticall with method eval_auto_bounds
-            //in new interface.
-            int pt_bin = h_eff_b->GetXaxis()->FindBin(pt); 
-            if( pt_bin > h_eff_b->GetXaxis()->GetNbins() ) pt_bin = h_eff_b->GetXaxis()->GetNbins(); 
-            int eta_bin = h_eff_b->GetYaxis()->FindBin(eta); 
-            if ( eta_bin > h_eff_b->GetYaxis()->GetNbins() ) eta_bin = h_eff_b->GetYaxis()->GetNbins();
-
-            sfEffList[0] = h_eff_b->GetBinContent(pt_bin, eta_bin);
-
-            sfEffList[1] = (btagSFunc==0 ? reader.eval_auto_bounds("central",BTagEntry::FLAV_B,eta,pt) :
-                            (btagSFunc==1 ? readerUp.eval_auto_bounds("up",BTagEntry::FLAV_B,eta,pt) :
-                             readerDown.eval_auto_bounds("down",BTagEntry::FLAV_B,eta,pt) ) );
-       
-            if(fastsim)
+        int type = JetType(flav);
+        if(type == JET_OTHER) return;
+
+        sfEffList[0] = GetEff(type, pt, eta);
+        sfEffList[1] = EvalSF(type, (type == JET_UDSG) ? mistagSFunc : btagSFunc, false, pt, eta);
+        if(fastsim) sfEffList[2] = EvalSF(type, (type == JET_B) ? btagCFunc : ((type == JET_C) ? ctagCFunc : mistagCFunc), true, pt, eta);
+    }
+
+    //Flavour classes used for the efficiency maps and calibration readers
+    enum JetTypes { JET_B = 0, JET_C, JET_UDSG, JET_OTHER };
+
+    static int JetType(int flav)
+    {
+        //use abs(flav) always
+        flav = abs(flav);
+        if(flav == 5)              return JET_B;
+        else if(flav == 4)         return JET_C;
+        else if(flav < 4 || flav == 21) return JET_UDSG;
+        return JET_OTHER;
+    }
+
+    //Index into the central, up, down arrays for a SF/CF switch (central = 0, up = 1, down = else)
+    static int VarIndex(int u) { return (u == 0) ? 0 : ((u == 1) ? 1 : 2); }
+
+    data_t GetEff(int type, data_t pt, data_t eta) const
+    {
+        // data_t Uncertainty are now taken care automaticall with method eval_auto_bounds
+        //in new interface.
+        const FlatHist& h_eff = (type == JET_B) ? eff_b : ((type == JET_C) ? eff_c : eff_udsg);
+        int pt_bin = h_eff.xAxis().findBin(pt);
+        if( pt_bin > h_eff.xAxis().getNbins() ) pt_bin = h_eff.xAxis().getNbins();
+        int eta_bin = h_eff.yAxis().findBin(eta);
+        if ( eta_bin > h_eff.yAxis().getNbins() ) eta_bin = h_eff.yAxis().getNbins();
+        return h_eff.getBinContent(pt_bin, eta_bin);
+    }
+
+    static BTagEntry::JetFlavor CalibFlavor(int type)
+    {
+        static const BTagEntry::JetFlavor flavors[] = {BTagEntry::FLAV_B, BTagEntry::FLAV_C, BTagEntry::FLAV_UDSG};
+        return flavors[type];
+    }
+
+    //SF (or fastsim CF if fast is set) for switch value u, up and down as the central value of
+    //their own sysType like FillJetSFEff
+    data_t EvalSF(int type, int u, bool fast, data_t pt, data_t eta) const
+    {
+        const BTagEntry::JetFlavor flav = CalibFlavor(type);
+        const float fPt = pt, fEta = eta;
+        float sf[3];
+        const int iVar = VarIndex(u);
+        (fast ? readerFast : reader).eval_auto_bounds_batch(1, &flav, &fEta, &fPt, iVar == 0 ? &sf[0] : 0, iVar == 1 ? &sf[1] : 0, iVar == 2 ? &sf[2] : 0);
+        return sf[iVar];
+    }
+
+    //Per jet efficiencies, SFs and CFs of one event for all variations, stored as
+    //flat arrays indexed by jet.  sf[i] and cf[i] hold the central, up and down values.
+    struct JetSFEff
+    {
+        std::vector<data_t> pt, eta;
+        std::vector<int> flav, type;
+        std::vector<char> pass;
+        std::vector<data_t> eff;
+        std::vector<data_t> sf[3], cf[3];
+
+        unsigned size() const { return pt.size(); }
+
+        data_t getSF(unsigned i, int btagU, int mistagU) const
+        {
+            return sf[VarIndex((type[i] == JET_UDSG) ? mistagU : btagU)][i];
+        }
+
+        data_t getCF(unsigned i, int btagU, int ctagU, int mistagU) const
+        {
+            return cf[VarIndex((type[i] == JET_B) ? btagU : ((type[i] == JET_C) ? ctagU : mistagU))][i];
+        }
+
+        data_t eps(unsigned i, int btagSFu, int mistagSFu, int btagCFu, int ctagCFu, int mistagCFu) const
+        {
+            return eff[i]*getSF(i, btagSFu, mistagSFu)*getCF(i, btagCFu, ctagCFu, mistagCFu);
+        }
+    };
+
+    //Fill jetSFEff for this set of jets, nothing is recalculated if it was already filled
+    //for the same jets (e.g. when looping over the systematic variations of one event)
+    const JetSFEff& FillJetSFEff(const std::vector<TLorentzVector> *Jets, const std::vector<int> *Jets_flavor)
+    {
+        JetSFEff& c = jetSFEff;
+        unsigned nJets = Jets->size();
+
+        if(jetSFEffValid && c.size() == nJets)
+        {
+            bool same = true;
+            for(unsigned i = 0; i < nJets && same; ++i)
             {
-                sfEffList[2] = (btagCFunc==0 ? readerFast.eval_auto_bounds("central",BTagEntry::FLAV_B,eta,pt) :
-                                (btagCFunc==1 ? readerFastUp.eval_auto_bounds("up",BTagEntry::FLAV_B,eta,pt) :
-                                 readerFastDown.eval_auto_bounds("down", BTagEntry::FLAV_B,eta,pt) ) );
-           
+                same = (c.pt[i] == data_t(Jets->at(i).Pt())) && (c.eta[i] == data_t(Jets->at(i).Eta())) && (c.flav[i] == Jets_flavor->at(i));
             }
+            if(same) return c;
         }
-        /********************************************************************/
-        else if(flav==4)
-        { //charm mistag
-            int pt_bin = h_eff_c->GetXaxis()->FindBin(pt); 
-            if( pt_bin > h_eff_c->GetXaxis()->GetNbins() ) pt_bin = h_eff_c->GetXaxis()->GetNbins();
-            int eta_bin = h_eff_c->GetYaxis()->FindBin(eta); 
-            if ( eta_bin > h_eff_c->GetYaxis()->GetNbins() ) eta_bin = h_eff_c->GetYaxis()->GetNbins();
-            sfEffList[0] =h_eff_c->GetBinContent(pt_bin, eta_bin);
-
-            sfEffList[1] = (btagSFunc==0 ? reader.eval_auto_bounds("central",BTagEntry::FLAV_C,eta,pt) :
-                            (btagSFunc==1 ? readerUp.eval_auto_bounds("up",BTagEntry::FLAV_C,eta,pt) :
-                             readerDown.eval_auto_bounds("down", BTagEntry::FLAV_C,eta,pt) ) );
-            if(fastsim)
-            {
-                sfEffList[2] = (ctagCFunc==0 ? readerFast.eval_auto_bounds("central",BTagEntry::FLAV_C,eta,pt) :
-                                (ctagCFunc==1 ? readerFastUp.eval_auto_bounds("up",BTagEntry::FLAV_C,eta,pt) :
-                                 readerFastDown.eval_auto_bounds("down", BTagEntry::FLAV_C,eta,pt) ) );
 
+        c.pt.resize(nJets);
+        c.eta.resize(nJets);
+        c.flav.resize(nJets);
+        c.type.resize(nJets);
+        c.pass.resize(nJets);
+        c.eff.assign(nJets, 1.0);
+        for(int iVar = 0; iVar < 3; ++iVar)
+        {
+            c.sf[iVar].assign(nJets, 1.0);
+            c.cf[iVar].assign(nJets, 1.0);
+        }
+
+        batchIdx.clear();
+        batchFlav.clear();
+        batchPt.clear();
+        batchEta.clear();
+        for(unsigned i = 0; i < nJets; ++i)
+        {
+            data_t pt = Jets->at(i).Pt();
+            data_t eta = Jets->at(i).Eta();
+            c.pt[i] = pt;
+            c.eta[i] = eta;
+            c.flav[i] = Jets_flavor->at(i);
+            c.type[i] = JetType(c.flav[i]);
+
+            //HT jet cuts
+            c.pass[i] = !(pt < 30.0 || fabs(eta) > 2.4);
+            if(!c.pass[i] || c.type[i] == JET_OTHER) continue;
+
+            //use abs(eta) for now
+            eta = fabs(eta);
+            c.eff[i] = GetEff(c.type[i], pt, eta);
+            batchIdx.push_back(i);
+            batchFlav.push_back(CalibFlavor(c.type[i]));
+            batchPt.push_back(pt);
+            batchEta.push_back(eta);
+        }
+
+        //central, up and down SFs (and CFs) of all selected jets in one call per reader
+        const unsigned nBatch = batchIdx.size();
+        for(int iVar = 0; iVar < 3; ++iVar) batchSF[iVar].resize(nBatch);
+        reader.eval_auto_bounds_batch(nBatch, batchFlav.data(), batchEta.data(), batchPt.data(), batchSF[0].data(), batchSF[1].data(), batchSF[2].data());
+        for(int iVar = 0; iVar < 3; ++iVar)
+        {
+            for(unsigned k = 0; k < nBatch; ++k) c.sf[iVar][batchIdx[k]] = batchSF[iVar][k];
+        }
+        if(fastsim)
+        {
+            readerFast.eval_auto_bounds_batch(nBatch, batchFlav.data(), batchEta.data(), batchPt.data(), batchSF[0].data(), batchSF[1].data(), batchSF[2].data());
+            for(int iVar = 0; iVar < 3; ++iVar)
+            {
+                for(unsigned k = 0; k < nBatch; ++k) c.cf[iVar][batchIdx[k]] = batchSF[iVar][k];
             }
         }
-        /********************************************************************/
-        else if(flav<4 || flav==21)
-        { //udsg mistag
-            int pt_bin = h_eff_udsg->GetXaxis()->FindBin(pt); 
-            if( pt_bin > h_eff_udsg->GetXaxis()->GetNbins() ) pt_bin = h_eff_udsg->GetXaxis()->GetNbins(); 
-            int eta_bin = h_eff_udsg->GetYaxis()->FindBin(eta); 
-            if ( eta_bin > h_eff_udsg->GetYaxis()->GetNbins() ) eta_bin = h_eff_udsg->GetYaxis()->GetNbins();
-
-            sfEffList[0] = h_eff_udsg->GetBinContent( pt_bin, eta_bin);
-
-            sfEffList[1] = (mistagSFunc==0 ? reader.eval_auto_bounds("central",BTagEntry::FLAV_UDSG,eta,pt) :
-                            (mistagSFunc==1 ? readerUp.eval_auto_bounds("up",BTagEntry::FLAV_UDSG,eta,pt) :
-                             readerDown.eval_auto_bounds("down", BTagEntry::FLAV_UDSG,eta,pt) ) );
-       
-    
-            if(fastsim)
+
+        jetSFEffValid = true;
+        return c;
+    }
+
+    //One set of SF/CF switch values (central = 0, up = 1, down = else) and the name the
+    //resulting weights are stored under, e.g. bTagSF_EventWeightSimple_Up
+    struct Variation
+    {
+        std::string prefix, suffix;
+        int btagSF, mistagSF, btagCF, ctagCF, mistagCF;
+    };
+
+    //The variations stored by registerVarToNTuples.  With SetAllVariations(true) the fastsim
+    //CFs are also varied on their own (only for fastsim samples)
+    std::vector<Variation> GetVariations() const
+    {
+        std::vector<Variation> vars = {
+            {"bTagSF",   "Central",  0,  0,  0,  0,  0},
+            {"bTagSF",   "Up",       1,  0,  1,  1,  0},
+            {"bTagSF",   "Down",    -1,  0, -1, -1,  0},
+            {"mistagSF", "Up",       0,  1,  0,  0,  1},
+            {"mistagSF", "Down",     0, -1,  0,  0, -1},
+        };
+        if(allVariations && fastsim)
+        {
+            vars.push_back({"bTagCF",   "Up",    0, 0,  1,  1,  0});
+            vars.push_back({"bTagCF",   "Down",  0, 0, -1, -1,  0});
+            vars.push_back({"mistagCF", "Up",    0, 0,  0,  0,  1});
+            vars.push_back({"mistagCF", "Down",  0, 0,  0,  0, -1});
+        }
+        return vars;
+    }
+
+    //Method 1a) and 1b) weights for several variations in one pass over the jets.  simple[i]
+    //and prob[i] are what GetSimpleCorrection and GetCorrections return with the switches of
+    //vars[i] (with nan/inf simple weights replaced by 1)
+    void GetAllCorrections(const std::vector<TLorentzVector> *Jets, const std::vector<int> *Jets_flavor, const std::vector<data_t> *Jets_bDiscriminatorCSV,
+                           const std::vector<Variation>& vars, std::vector<data_t>& simple, std::vector<std::vector<data_t> >& prob)
+    {
+        const JetSFEff& jets = FillJetSFEff(Jets, Jets_flavor);
+        unsigned nVars = vars.size();
+
+        std::vector<data_t> mcTag(nVars, 1.0), mcNoTag(nVars, 1.0), dataTag(nVars, 1.0), dataNoTag(nVars, 1.0);
+        prob.assign(nVars, std::vector<data_t>(4, 0.0));
+        for(auto& p : prob) p[0] = 1.0;
+
+        for(unsigned ja = 0; ja < jets.size(); ++ja)
+        {
+            //HT jet cuts
+            if(!jets.pass[ja]) continue;
+
+            bool tagged = Jets_bDiscriminatorCSV->at(ja) > AnaConsts::cutCSVS;
+            for(unsigned iVar = 0; iVar < nVars; ++iVar)
             {
-                sfEffList[2] = (mistagCFunc==0 ? readerFast.eval_auto_bounds("central", BTagEntry::FLAV_UDSG,eta,pt) :
-                                (mistagCFunc==1 ? readerFastUp.eval_auto_bounds("up",BTagEntry::FLAV_UDSG,eta,pt) :
-                                 readerFastDown.eval_auto_bounds("down", BTagEntry::FLAV_UDSG,eta,pt) ) );
-    
+                const Variation& v = vars[iVar];
+                data_t eff_a = jets.eff[ja];
+                data_t cf_a = jets.getCF(ja, v.btagCF, v.ctagCF, v.mistagCF);
+                data_t sf_a = jets.getSF(ja, v.btagSF, v.mistagSF);
+
+                //method 1a)
+                if(tagged)
+                {
+                    mcTag[iVar] *= eff_a*cf_a;
+                    dataTag[iVar] *= eff_a*cf_a*sf_a;
+                }
+                else
+                {
+                    mcNoTag[iVar] *= (1-eff_a*cf_a);
+                    dataNoTag[iVar] *= (1-eff_a*cf_a*sf_a);
+                }
+
+                //method 1b)
+                data_t eps_a = eff_a*sf_a*cf_a;
+                std::vector<data_t>& p = prob[iVar];
+                p[2] = p[2]*(1-eps_a) + p[1]*eps_a;
+                p[1] = p[1]*(1-eps_a) + p[0]*eps_a;
+                p[0] *= (1-eps_a);
             }
         }
-  
+
+        simple.resize(nVars);
+        for(unsigned iVar = 0; iVar < nVars; ++iVar)
+        {
+            simple[iVar] = (mcNoTag[iVar] * mcTag[iVar] ==0) ? 1.0 : (dataNoTag[iVar] * dataTag[iVar])/(mcNoTag[iVar] * mcTag[iVar]);
+            if( std::isnan(simple[iVar]) || std::isinf(simple[iVar]) ) simple[iVar] = 1.0;
+
+            //conserve probability
+            std::vector<data_t>& p = prob[iVar];
+            p[3] = 1 - p[0] - p[1] - p[2];
+        }
     }
 
     // To register Event weights/ Probabilities to FlatTuples
@@ -408,100 +518,24 @@ public:
         const auto& recoJetsFlavor = tr.getVec<int>(JetsFlavor);
 
         /*************************************************/
-        // Here we define which(up, down or central
-        // to be stored central = 0, up = 1 down = else
-        /*************************************************/
-    
-        /*************************************************/
-        // Case 0: Central value;
+        // All variations (central, b-tag up/down, mistag
+        // up/down and optionally the fastsim CFs) are
+        // calculated in a single pass over the jets
         /*************************************************/
+        std::vector<Variation> vars = GetVariations();
+        std::vector<data_t> evtWeightSimple;
+        std::vector<std::vector<data_t> > evtWeightProb;
+        GetAllCorrections(&inputJets, &recoJetsFlavor, &recoJetsBtag, vars, evtWeightSimple, evtWeightProb);
 
-        int switch_Unc = 0, switch_udsg_Unc = 0;
-        SetBtagSFunc(switch_Unc); SetBtagCFunc(switch_Unc);
-        SetCtagSFunc(switch_Unc); SetCtagCFunc(switch_Unc);
-        SetMistagSFunc(switch_udsg_Unc); SetMistagCFunc(switch_udsg_Unc);
-        //Method 1a) ignoring b-tag status 
-        data_t evtWeightSimple_Central  = GetSimpleCorrection(&inputJets ,&recoJetsFlavor,&recoJetsBtag);
-        if( std::isnan( evtWeightSimple_Central) || std::isinf(evtWeightSimple_Central) ){
-            evtWeightSimple_Central = 1.0;
-        } 
-
-        // Method 1b) in different b-jet mullticipity bins.
-        std::vector<data_t> *evtWeightProb_Central = GetCorrections(&inputJets, &recoJetsFlavor);
         //Register derived quantities to nTuples.
-        tr.registerDerivedVar("bTagSF_EventWeightSimple_Central", evtWeightSimple_Central);
         //evtWeightProb[0] = probability of 0 Btags...... evtWeightProb[3] = probability of 3 Btags
         //put event in each btag bin, weighted by evtWeightprob[0], evtWeightprob[1],
         // evtWeightprob[2], evtWeightprob[3] for nb = 0, 1, 2, 3+
-        tr.registerDerivedVec("bTagSF_EventWeightProb_Central", evtWeightProb_Central);
-
-
-        /*************************************************/
-        // Case 1: Up  value;                            
-        /*************************************************/
-
-        switch_Unc = 1; switch_udsg_Unc = 0;
-        SetBtagSFunc(switch_Unc); SetBtagCFunc(switch_Unc);
-        SetCtagSFunc(switch_Unc); SetCtagCFunc(switch_Unc);
-        SetMistagSFunc(switch_udsg_Unc); SetMistagCFunc(switch_udsg_Unc);
-        data_t evtWeightSimple_Up  = GetSimpleCorrection(&inputJets ,&recoJetsFlavor,&recoJetsBtag);
-        if( std::isnan( evtWeightSimple_Up) || std::isinf(evtWeightSimple_Up) ){
-            evtWeightSimple_Up= 1.0;
-        }
-        std::vector<data_t> *evtWeightProb_Up = GetCorrections(&inputJets, &recoJetsFlavor);
-        tr.registerDerivedVar("bTagSF_EventWeightSimple_Up", evtWeightSimple_Up);
-        tr.registerDerivedVec("bTagSF_EventWeightProb_Up", evtWeightProb_Up);
-
-
-        /*************************************************/
-        // Case -1:Down  value;                            
-        /*************************************************/
-
-        switch_Unc = -1; switch_udsg_Unc = 0;
-        SetBtagSFunc(switch_Unc); SetBtagCFunc(switch_Unc);
-        SetCtagSFunc(switch_Unc); SetCtagCFunc(switch_Unc);
-        SetMistagSFunc(switch_udsg_Unc); SetMistagCFunc(switch_udsg_Unc);
-        data_t evtWeightSimple_Down  = GetSimpleCorrection(&inputJets ,&recoJetsFlavor,&recoJetsBtag);
-        if( std::isnan( evtWeightSimple_Down) || std::isinf(evtWeightSimple_Down) ){
-            evtWeightSimple_Down= 1.0;
-        }
-        std::vector<data_t> *evtWeightProb_Down = GetCorrections(&inputJets, &recoJetsFlavor);
-        tr.registerDerivedVar("bTagSF_EventWeightSimple_Down", evtWeightSimple_Down);
-        tr.registerDerivedVec("bTagSF_EventWeightProb_Down", evtWeightProb_Down);
-
-   
-        /*************************************************/
-        // Mistag (udsg) Case 1: Up  value;                            
-        /*************************************************/
-
-        switch_Unc = 0; switch_udsg_Unc = 1;
-        SetBtagSFunc(switch_Unc); SetBtagCFunc(switch_Unc);
-        SetCtagSFunc(switch_Unc); SetCtagCFunc(switch_Unc);
-        SetMistagSFunc(switch_udsg_Unc); SetMistagCFunc(switch_udsg_Unc);
-        data_t evtWeightSimple_mistag_Up  = GetSimpleCorrection(&inputJets ,&recoJetsFlavor,&recoJetsBtag);
-        if( std::isnan( evtWeightSimple_mistag_Up) || std::isinf(evtWeightSimple_mistag_Up) ){
-            evtWeightSimple_mistag_Up= 1.0;
-        }
-        std::vector<data_t> *evtWeightProb_mistag_Up =  GetCorrections(&inputJets, &recoJetsFlavor);
-        tr.registerDerivedVar("mistagSF_EventWeightSimple_Up", evtWeightSimple_mistag_Up);
-        tr.registerDerivedVec("mistagSF_EventWeightProb_Up", evtWeightProb_mistag_Up);
-
-
-        /*************************************************/
-        // Case -1:Down  value;                            
-        /*************************************************/
-
-        switch_Unc = 0; switch_udsg_Unc = -1;
-        SetBtagSFunc(switch_Unc); SetBtagCFunc(switch_Unc);
-        SetCtagSFunc(switch_Unc); SetCtagCFunc(switch_Unc);
-        SetMistagSFunc(switch_udsg_Unc); SetMistagCFunc(switch_udsg_Unc);
-        data_t evtWeightSimple_mistag_Down  = GetSimpleCorrection(&inputJets ,&recoJetsFlavor,&recoJetsBtag);
-        if( std::isnan( evtWeightSimple_mistag_Down) || std::isinf(evtWeightSimple_mistag_Down) ){
-            evtWeightSimple_mistag_Down= 1.0;
+        for(unsigned iVar = 0; iVar < vars.size(); ++iVar)
+        {
+            tr.registerDerivedVar(vars[iVar].prefix + "_EventWeightSimple_" + vars[iVar].suffix, evtWeightSimple[iVar]);
+            tr.derivedVec<data_t>(vars[iVar].prefix + "_EventWeightProb_" + vars[iVar].suffix) = evtWeightProb[iVar];
         }
-        std::vector<data_t> *evtWeightProb_mistag_Down = GetCorrections(&inputJets, &recoJetsFlavor);
-        tr.registerDerivedVar("mistagSF_EventWeightSimple_Down", evtWeightSimple_mistag_Down);
-        tr.registerDerivedVec("mistagSF_EventWeightProb_Down", evtWeightProb_mistag_Down);
 
         /*************************************************/
         // Example to use these variables are in
@@ -518,12 +552,18 @@ public:
 
     //member variables
     bool debug, fastsim, isData;
+    bool allVariations, jetSFEffValid;
+    JetSFEff jetSFEff;
     int btagSFunc, mistagSFunc;
     int btagCFunc, ctagCFunc, mistagCFunc;
     BTagCalibration calib, calibFast;
-    BTagCalibrationReader reader, readerUp, readerDown;
-    BTagCalibrationReader readerFast, readerFastUp, readerFastDown;
+    BTagCalibrationReader reader, readerFast;
+    //inputs and outputs of the batch SF lookups in FillJetSFEff, reused every event
+    std::vector<unsigned> batchIdx;
+    std::vector<BTagEntry::JetFlavor> batchFlav;
+    std::vector<float> batchPt, batchEta, batchSF[3];
     TH2F *h_eff_b, *h_eff_c, *h_eff_udsg;
+    FlatHist eff_b, eff_c, eff_udsg;
     TFile *inFile;
     std::string JetsVec, BJetsVec, JetsFlavor;
 };
@@ -0,0 +1,360 @@
+#ifndef COLUMNAR_TUPLE_READER_H
+#define COLUMNAR_TUPLE_READER_H
+
+#include "SATException.h"
+
+#include "RZip.h"
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Flat columnar skim format written by ColumnarTupleWriter.
+
+   Events are stored in chunks of a fixed number of entries.  Within a chunk every column is one
+   contiguous array of values, vector columns have a second array with the nEntries + 1 element
+   offsets of each event.  Arrays are either stored raw or byte shuffled and compressed with
+   R__zip, the footer at the end of the file holds the column list and the location of every
+   array, followed by the footer offset and the magic string again:
+
+       "SATCOL01" | chunk arrays ... | footer | uint64 footer offset | "SATCOL01"
+
+   The file is memory mapped, raw arrays are used in place and compressed arrays are unpacked
+   one chunk at a time into a buffer per column, so repeated passes over a skim only cost the
+   memory bandwidth of the columns actually read.  NTupleReader reads such a file directly:
+
+   ColumnarTupleReader columns("skim.col");
+   NTupleReader tr(&columns);
+   while(tr.getNextEvent()) { ... tr.getVar<float>("met") ... }
+ */
+
+namespace ColumnarFormat
+{
+    enum ElementType : uint8_t
+    {
+        kDouble, kFloat, kInt, kUInt, kShort, kUShort, kChar, kUChar, kBool, kLong, kULong, kTLorentzVector
+    };
+
+    enum Codec : uint8_t
+    {
+        kRaw = 0,
+        kZip = 1,
+    };
+
+    static const char* const magic = "SATCOL01";
+    static const unsigned int magicSize = 8;
+    //R__zip works on at most 16 MB at a time, arrays are compressed in pieces of this size
+    static const unsigned int zipPieceSize = 1 << 20;
+
+    //element size in bytes, a TLorentzVector is stored as px, py, pz, E doubles
+    inline unsigned int elementSize(const uint8_t type)
+    {
+        switch(type)
+        {
+        case kDouble:         return sizeof(double);
+        case kFloat:          return sizeof(float);
+        case kInt:            return sizeof(int);
+        case kUInt:           return sizeof(unsigned int);
+        case kShort:          return sizeof(short);
+        case kUShort:         return sizeof(unsigned short);
+        case kChar:           return sizeof(char);
+        case kUChar:          return sizeof(unsigned char);
+        case kBool:           return 1;
+        case kLong:           return sizeof(long);
+        case kULong:          return sizeof(unsigned long);
+        case kTLorentzVector: return 4*sizeof(double);
+        }
+        THROW_SATEXCEPTION("ColumnarFormat::elementSize(...): unknown element type!!!");
+    }
+
+    //location of one stored array
+    struct Block
+    {
+        uint64_t offset, storedSize, rawSize;
+        uint8_t codec;
+        uint8_t elemSize;
+
+        Block() : offset(0), storedSize(0), rawSize(0), codec(kRaw), elemSize(1) {}
+    };
+
+    //byte shuffling puts the nth byte of all elements next to each other, which compresses much better for floats
+    inline void shuffle(const char* src, char* dst, const size_t nBytes, const unsigned int elemSize)
+    {
+        const size_t n = nBytes/elemSize;
+        for(unsigned int b = 0; b < elemSize; ++b)
+        {
+            for(size_t i = 0; i < n; ++i) dst[b*n + i] = src[i*elemSize + b];
+        }
+    }
+
+    inline void unshuffle(const char* src, char* dst, const size_t nBytes, const unsigned int elemSize)
+    {
+        const size_t n = nBytes/elemSize;
+        for(unsigned int b = 0; b < elemSize; ++b)
+        {
+            for(size_t i = 0; i < n; ++i) dst[i*elemSize + b] = src[b*n + i];
+        }
+    }
+
+    //Append nBytes of src to out, compressed when level > 0 and it pays off, and return the codec used
+    inline uint8_t compress(const char* src, const size_t nBytes, const unsigned int elemSize, const int level, std::vector<char>& out)
+    {
+        const size_t start = out.size();
+        if(level > 0 && nBytes > 0 && nBytes % elemSize == 0)
+        {
+            std::vector<char> shuffled(nBytes);
+            shuffle(src, shuffled.data(), nBytes, elemSize);
+
+            bool ok = true;
+            for(size_t pos = 0; ok && pos < nBytes; pos += zipPieceSize)
+            {
+                int srcSize = std::min<size_t>(zipPieceSize, nBytes - pos);
+                int tgtSize = srcSize;
+                int irep = 0;
+                size_t outPos = out.size();
+                out.resize(outPos + tgtSize);
+                R__zip(level, &srcSize, shuffled.data() + pos, &tgtSize, out.data() + outPos, &irep);
+                //irep is 0 when the piece did not compress
+                ok = irep > 0 && irep < srcSize;
+                out.resize(outPos + (ok ? irep : 0));
+            }
+            if(ok && out.size() - start < nBytes) return kZip;
+            out.resize(start);
+        }
+        out.insert(out.end(), src, src + nBytes);
+        return kRaw;
+    }
+
+    //Unpack a kZip block starting at src into dst, which must hold block.rawSize bytes
+    inline void decompress(const Block& block, const unsigned char* src, char* dst, std::vector<char>& scratch)
+    {
+        scratch.resize(block.rawSize);
+        uint64_t inPos = 0, outPos = 0;
+        while(inPos < block.storedSize && outPos < block.rawSize)
+        {
+            int srcSize = 0, tgtSize = 0, irep = 0;
+            if(R__unzip_header(&srcSize, const_cast<unsigned char*>(src + inPos), &tgtSize) != 0 || outPos + tgtSize > block.rawSize)
+            {
+                THROW_SATEXCEPTION("ColumnarFormat::decompress(...): corrupt compressed block!!!");
+            }
+            R__unzip(&srcSize, const_cast<unsigned char*>(src + inPos), &tgtSize, reinterpret_cast<unsigned char*>(scratch.data() + outPos), &irep);
+            if(irep != tgtSize) THROW_SATEXCEPTION("ColumnarFormat::decompress(...): failed to unpack block!!!");
+            inPos += srcSize;
+            outPos += tgtSize;
+        }
+        if(outPos != block.rawSize) THROW_SATEXCEPTION("ColumnarFormat::decompress(...): truncated compressed block!!!");
+        unshuffle(scratch.data(), dst, block.rawSize, block.elemSize);
+    }
+}
+
+class ColumnarTupleReader
+{
+public:
+    struct Column
+    {
+        std::string name;
+        uint8_t type;
+        bool isVector;
+    };
+
+    explicit ColumnarTupleReader(const std::string& fileName) : fileName_(fileName), base_(nullptr), size_(0), nEntries_(0)
+    {
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if(fd < 0) THROW_SATEXCEPTION("ColumnarTupleReader(...): could not open file \"" + fileName + "\"!!!");
+        struct stat st;
+        if(fstat(fd, &st) != 0 || size_t(st.st_size) < 2*ColumnarFormat::magicSize + sizeof(uint64_t))
+        {
+            close(fd);
+            THROW_SATEXCEPTION("ColumnarTupleReader(...): \"" + fileName + "\" is not a columnar tuple!!!");
+        }
+        size_ = st.st_size;
+        void* addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(addr == MAP_FAILED) THROW_SATEXCEPTION("ColumnarTupleReader(...): could not map file \"" + fileName + "\"!!!");
+        base_ = static_cast<const unsigned char*>(addr);
+
+        try
+        {
+            readFooter();
+        }
+        catch(...)
+        {
+            munmap(const_cast<unsigned char*>(base_), size_);
+            throw;
+        }
+    }
+
+    ~ColumnarTupleReader()
+    {
+        if(base_) munmap(const_cast<unsigned char*>(base_), size_);
+    }
+
+    ColumnarTupleReader(const ColumnarTupleReader&) = delete;
+    ColumnarTupleReader& operator=(const ColumnarTupleReader&) = delete;
+
+    const std::string& getFileName() const { return fileName_; }
+    long long getEntries() const { return nEntries_; }
+    const std::vector<Column>& getColumns() const { return columns_; }
+
+    int findColumn(const std::string& name) const
+    {
+        for(unsigned int i = 0; i < columns_.size(); ++i)
+        {
+            if(columns_[i].name == name) return i;
+        }
+        return -1;
+    }
+
+    //Data of column iCol for entry, n is set to the number of elements (1 for a scalar column).
+    //The pointer stays valid until an entry of another chunk is requested for the same column
+    const char* getData(const unsigned int iCol, const long long entry, unsigned int& n)
+    {
+        ColumnState& state = state_[iCol];
+        if(state.chunk < 0 || entry < chunks_[state.chunk].firstEntry || entry >= chunks_[state.chunk].firstEntry + chunks_[state.chunk].nEntries)
+        {
+            loadChunk(iCol, findChunk(entry));
+        }
+
+        const long long i = entry - chunks_[state.chunk].firstEntry;
+        const unsigned int elemSize = ColumnarFormat::elementSize(columns_[iCol].type);
+        if(!columns_[iCol].isVector)
+        {
+            n = 1;
+            return state.values + i*elemSize;
+        }
+        uint32_t begin, end;
+        memcpy(&begin, state.offsets + i*sizeof(uint32_t), sizeof(uint32_t));
+        memcpy(&end, state.offsets + (i + 1)*sizeof(uint32_t), sizeof(uint32_t));
+        n = end - begin;
+        return state.values + size_t(begin)*elemSize;
+    }
+
+private:
+    struct Chunk
+    {
+        long long firstEntry;
+        unsigned int nEntries;
+        //one values block per column, and one offsets block per column (empty for scalars)
+        std::vector<ColumnarFormat::Block> values, offsets;
+    };
+
+    //currently unpacked chunk of a column
+    struct ColumnState
+    {
+        int chunk;
+        const char *values, *offsets;
+        std::vector<char> valueBuf, offsetBuf, scratch;
+
+        ColumnState() : chunk(-1), values(nullptr), offsets(nullptr) {}
+    };
+
+    std::string fileName_;
+    const unsigned char* base_;
+    size_t size_;
+    long long nEntries_;
+    std::vector<Column> columns_;
+    std::vector<Chunk> chunks_;
+    std::vector<ColumnState> state_;
+
+    template<typename T> T readValue(size_t& pos) const
+    {
+        if(pos + sizeof(T) > size_) THROW_SATEXCEPTION("ColumnarTupleReader: footer of \"" + fileName_ + "\" is truncated!!!");
+        T value;
+        memcpy(&value, base_ + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    ColumnarFormat::Block readBlock(size_t& pos) const
+    {
+        ColumnarFormat::Block block;
+        block.offset     = readValue<uint64_t>(pos);
+        block.storedSize = readValue<uint64_t>(pos);
+        block.rawSize    = readValue<uint64_t>(pos);
+        block.codec      = readValue<uint8_t>(pos);
+        block.elemSize   = readValue<uint8_t>(pos);
+        if(block.offset + block.storedSize > size_ || block.elemSize == 0) THROW_SATEXCEPTION("ColumnarTupleReader: invalid block in \"" + fileName_ + "\"!!!");
+        return block;
+    }
+
+    void readFooter()
+    {
+        using ColumnarFormat::magic;
+        using ColumnarFormat::magicSize;
+
+        if(memcmp(base_, magic, magicSize) != 0 || memcmp(base_ + size_ - magicSize, magic, magicSize) != 0)
+        {
+            THROW_SATEXCEPTION("ColumnarTupleReader(...): \"" + fileName_ + "\" is not a columnar tuple or was not closed properly!!!");
+        }
+
+        size_t pos = size_ - magicSize - sizeof(uint64_t);
+        pos = readValue<uint64_t>(pos);
+
+        uint32_t nColumns = readValue<uint32_t>(pos);
+        columns_.resize(nColumns);
+        for(auto& column : columns_)
+        {
+            uint16_t nameSize = readValue<uint16_t>(pos);
+            if(pos + nameSize > size_) THROW_SATEXCEPTION("ColumnarTupleReader: footer of \"" + fileName_ + "\" is truncated!!!");
+            column.name.assign(reinterpret_cast<const char*>(base_ + pos), nameSize);
+            pos += nameSize;
+            column.type = readValue<uint8_t>(pos);
+            column.isVector = readValue<uint8_t>(pos) != 0;
+            ColumnarFormat::elementSize(column.type);
+        }
+
+        uint32_t nChunks = readValue<uint32_t>(pos);
+        chunks_.resize(nChunks);
+        nEntries_ = 0;
+        for(auto& chunk : chunks_)
+        {
+            chunk.firstEntry = nEntries_;
+            chunk.nEntries = readValue<uint32_t>(pos);
+            nEntries_ += chunk.nEntries;
+            for(const auto& column : columns_)
+            {
+                chunk.values.push_back(readBlock(pos));
+                chunk.offsets.push_back(column.isVector ? readBlock(pos) : ColumnarFormat::Block());
+            }
+        }
+
+        state_.resize(nColumns);
+    }
+
+    int findChunk(const long long entry) const
+    {
+        if(entry < 0 || entry >= nEntries_) THROW_SATEXCEPTION("ColumnarTupleReader::getData(...): entry out of range!!!");
+        auto iter = std::upper_bound(chunks_.begin(), chunks_.end(), entry, [](long long e, const Chunk& c) { return e < c.firstEntry; });
+        return (iter - chunks_.begin()) - 1;
+    }
+
+    const char* blockData(const ColumnarFormat::Block& block, std::vector<char>& buf, std::vector<char>& scratch) const
+    {
+        if(block.codec == ColumnarFormat::kRaw) return reinterpret_cast<const char*>(base_ + block.offset);
+        buf.resize(block.rawSize);
+        ColumnarFormat::decompress(block, base_ + block.offset, buf.data(), scratch);
+        return buf.data();
+    }
+
+    void loadChunk(const unsigned int iCol, const int iChunk)
+    {
+        ColumnState& state = state_[iCol];
+        const Chunk& chunk = chunks_[iChunk];
+        state.values = blockData(chunk.values[iCol], state.valueBuf, state.scratch);
+        if(columns_[iCol].isVector)
+        {
+            state.offsets = blockData(chunk.offsets[iCol], state.offsetBuf, state.scratch);
+            if(chunk.offsets[iCol].rawSize != (chunk.nEntries + 1)*sizeof(uint32_t)) THROW_SATEXCEPTION("ColumnarTupleReader: invalid offsets in \"" + fileName_ + "\"!!!");
+        }
+        state.chunk = iChunk;
+    }
+};
+
+#endif
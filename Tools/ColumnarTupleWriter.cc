@@ -0,0 +1,155 @@
+#include "ColumnarTupleWriter.h"
+#include "NTupleTypes.h"
+
+ColumnarTupleWriter::ColumnarTupleWriter(const std::string& fileName, const unsigned int entriesPerChunk, const int compressionLevel) : file_(nullptr), fileName_(fileName), entriesPerChunk_(entriesPerChunk), compressionLevel_(compressionLevel), nEntries_(0), chunkEntries_(0), fileOffset_(0)
+{
+    if(entriesPerChunk_ < 1) entriesPerChunk_ = 1;
+
+    file_ = fopen(fileName_.c_str(), "wb");
+    if(!file_) THROW_SATEXCEPTION("ColumnarTupleWriter(...): could not open file \"" + fileName_ + "\" for writing!!!");
+    write(ColumnarFormat::magic, ColumnarFormat::magicSize);
+}
+
+ColumnarTupleWriter::~ColumnarTupleWriter()
+{
+    if(file_)
+    {
+        try
+        {
+            close();
+        }
+        catch(const SATException& e)
+        {
+            e.print();
+        }
+    }
+}
+
+void ColumnarTupleWriter::setTupleVars(const std::set<std::string>& vars)
+{
+    for(auto& var : vars) tupleVars_.insert(var);
+}
+
+//Adds a column with the C++ type found for the variable in the NTupleTypes table
+struct ColumnarTupleWriter::ColumnAdder
+{
+    ColumnarTupleWriter& writer;
+    const NTupleReader& tr;
+    const std::string& var;
+
+    template<typename T> void operator()() const { writer.addType(tr, var, static_cast<T*>(nullptr)); }
+};
+
+void ColumnarTupleWriter::initBranches(const NTupleReader& tr)
+{
+    if(!columns_.empty()) THROW_SATEXCEPTION("ColumnarTupleWriter::initBranches(...): branches are already initialized!!!");
+
+    for(auto& var : tupleVars_)
+    {
+        std::string type;
+        tr.getType(var, type);
+
+        if(!NTupleTypes::dispatch(NTupleTypes::findType(type), ColumnAdder{*this, tr, var}))
+        {
+            THROW_SATEXCEPTION("ColumnarTupleWriter::initBranches(...): Variable type unknown!!! var: " + var + ", type: " + type);
+        }
+    }
+}
+
+void ColumnarTupleWriter::fill()
+{
+    if(!file_) THROW_SATEXCEPTION("ColumnarTupleWriter::fill(): file \"" + fileName_ + "\" is already closed!!!");
+
+    for(auto& column : columns_) column->append();
+    ++nEntries_;
+    if(++chunkEntries_ >= entriesPerChunk_) writeChunk();
+}
+
+void ColumnarTupleWriter::close()
+{
+    if(!file_) return;
+
+    if(chunkEntries_ > 0) writeChunk();
+
+    //footer: column list, then per chunk its size and the blocks of every column
+    const uint64_t footerOffset = fileOffset_;
+    std::vector<char> footer;
+    auto put = [&footer](const void* data, const size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        footer.insert(footer.end(), bytes, bytes + size);
+    };
+
+    const uint32_t nColumns = columns_.size();
+    put(&nColumns, sizeof(nColumns));
+    for(const auto& column : columns_)
+    {
+        const uint16_t nameSize = column->name.size();
+        const uint8_t isVector = column->isVector ? 1 : 0;
+        put(&nameSize, sizeof(nameSize));
+        put(column->name.data(), nameSize);
+        put(&column->type, sizeof(column->type));
+        put(&isVector, sizeof(isVector));
+    }
+
+    const uint32_t nChunks = chunkSizes_.size();
+    put(&nChunks, sizeof(nChunks));
+    unsigned int iBlock = 0;
+    for(const auto& chunkSize : chunkSizes_)
+    {
+        const uint32_t nEntries = chunkSize;
+        put(&nEntries, sizeof(nEntries));
+        for(const auto& column : columns_)
+        {
+            for(int i = 0; i < (column->isVector ? 2 : 1); ++i)
+            {
+                const ColumnarFormat::Block& block = blocks_[iBlock++];
+                put(&block.offset, sizeof(block.offset));
+                put(&block.storedSize, sizeof(block.storedSize));
+                put(&block.rawSize, sizeof(block.rawSize));
+                put(&block.codec, sizeof(block.codec));
+                put(&block.elemSize, sizeof(block.elemSize));
+            }
+        }
+    }
+
+    write(footer.data(), footer.size());
+    write(&footerOffset, sizeof(footerOffset));
+    write(ColumnarFormat::magic, ColumnarFormat::magicSize);
+
+    bool ok = fclose(file_) == 0;
+    file_ = nullptr;
+    if(!ok) THROW_SATEXCEPTION("ColumnarTupleWriter::close(): error closing file \"" + fileName_ + "\"!!!");
+}
+
+void ColumnarTupleWriter::write(const void* data, const size_t size)
+{
+    if(size > 0 && fwrite(data, 1, size, file_) != size) THROW_SATEXCEPTION("ColumnarTupleWriter: error writing file \"" + fileName_ + "\"!!!");
+    fileOffset_ += size;
+}
+
+ColumnarFormat::Block ColumnarTupleWriter::writeBlock(const char* data, const size_t size, const unsigned int elemSize)
+{
+    ColumnarFormat::Block block;
+    std::vector<char> stored;
+    block.codec = ColumnarFormat::compress(data, size, elemSize, compressionLevel_, stored);
+    block.offset = fileOffset_;
+    block.storedSize = stored.size();
+    block.rawSize = size;
+    block.elemSize = elemSize;
+    write(stored.data(), stored.size());
+    return block;
+}
+
+void ColumnarTupleWriter::writeChunk()
+{
+    //values then offsets of each column, in the order the footer lists them
+    for(auto& column : columns_)
+    {
+        blocks_.push_back(writeBlock(column->values.data(), column->values.size(), ColumnarFormat::elementSize(column->type)));
+        if(column->isVector) blocks_.push_back(writeBlock(reinterpret_cast<const char*>(column->offsets.data()), column->offsets.size()*sizeof(uint32_t), sizeof(uint32_t)));
+        column->clear();
+    }
+    chunkSizes_.push_back(chunkEntries_);
+    chunkEntries_ = 0;
+}
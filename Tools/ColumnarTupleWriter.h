@@ -0,0 +1,193 @@
+#ifndef COLUMNAR_TUPLE_WRITER_H
+#define COLUMNAR_TUPLE_WRITER_H
+
+#include "NTupleReader.h"
+#include "ColumnarTupleReader.h"
+
+#include "TLorentzVector.h"
+
+#include <vector>
+#include <set>
+#include <string>
+#include <memory>
+#include <cstdio>
+
+/* Writes the requested variables of an NTupleReader into the columnar format read by
+   ColumnarTupleReader, it is used in the same way as MiniTupleMaker
+
+   ColumnarTupleWriter writer("skim.col");
+   writer.setTupleVars({"met", "jetsLVec", "passBaseline"});
+   while(tr.getNextEvent())
+   {
+       if(tr.isFirstEvent()) writer.initBranches(tr);
+       if(pass) writer.fill();
+   }
+   writer.close();
+
+   Only the listed variables are written, one array per variable and chunk of entriesPerChunk
+   entries.  compressionLevel 0 stores the arrays raw so the reader uses the mapped file in
+   place, higher levels are handed to R__zip after byte shuffling (1 is light and fast).
+ */
+
+class ColumnarTupleWriter
+{
+public:
+    ColumnarTupleWriter(const std::string& fileName, const unsigned int entriesPerChunk = 10000, const int compressionLevel = 1);
+    ~ColumnarTupleWriter();
+
+    void setTupleVars(const std::set<std::string>& vars);
+
+    //To use derived variables initBranches must be called after the first tuple event is read
+    void initBranches(const NTupleReader& tr);
+
+    void fill();
+
+    //Write the last chunk and the footer, called by the destructor if needed
+    void close();
+
+    long long getEntries() const { return nEntries_; }
+
+private:
+    //one output column, holds the values (and offsets for vectors) of the current chunk
+    class ColumnBase
+    {
+    public:
+        std::string name;
+        uint8_t type;
+        bool isVector;
+        std::vector<char> values;
+        std::vector<uint32_t> offsets;
+
+        ColumnBase(const std::string& name, const uint8_t type, const bool isVector) : name(name), type(type), isVector(isVector) {}
+        virtual ~ColumnBase() {}
+        virtual void append() = 0;
+
+        void clear()
+        {
+            values.clear();
+            offsets.clear();
+            if(isVector) offsets.push_back(0);
+        }
+    };
+
+    template<typename T> static uint8_t elementType();
+
+    template<typename T> static void appendValue(std::vector<char>& out, const T& value)
+    {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    template<typename T> static void appendValues(std::vector<char>& out, const std::vector<T>& values)
+    {
+        const char* bytes = reinterpret_cast<const char*>(values.data());
+        out.insert(out.end(), bytes, bytes + values.size()*sizeof(T));
+    }
+
+    template<typename T> class ScalarColumn : public ColumnBase
+    {
+    private:
+        NTupleReader::VarHandle<T> var_;
+    public:
+        ScalarColumn(const NTupleReader& tr, const std::string& name) : ColumnBase(name, elementType<T>(), false), var_(tr, name) { clear(); }
+        void append() { appendValue(values, var_.get()); }
+    };
+
+    template<typename T> class VectorColumn : public ColumnBase
+    {
+    private:
+        NTupleReader::VecHandle<T> vec_;
+    public:
+        VectorColumn(const NTupleReader& tr, const std::string& name) : ColumnBase(name, elementType<T>(), true), vec_(tr, name) { clear(); }
+        void append()
+        {
+            const std::vector<T>& vec = vec_.get();
+            appendValues(values, vec);
+            offsets.push_back(offsets.back() + vec.size());
+        }
+    };
+
+    FILE* file_;
+    std::string fileName_;
+    unsigned int entriesPerChunk_;
+    int compressionLevel_;
+    std::set<std::string> tupleVars_;
+    std::vector<std::unique_ptr<ColumnBase>> columns_;
+    long long nEntries_;
+    unsigned int chunkEntries_;
+    uint64_t fileOffset_;
+
+    //footer content
+    std::vector<unsigned int> chunkSizes_;
+    std::vector<ColumnarFormat::Block> blocks_;
+
+    //Columns are added by the type of the variable in the NTupleTypes table, only scalars and
+    //flat vectors of the types with an elementType can be stored
+    struct ColumnAdder;
+    template<typename T> void addType(const NTupleReader& tr, const std::string& name, T*) { addVar<T>(tr, name); }
+    template<typename T> void addType(const NTupleReader& tr, const std::string& name, std::vector<T>*) { addVec<T>(tr, name); }
+    template<typename T> void addType(const NTupleReader&, const std::string& name, std::vector<std::vector<T>>*)
+    {
+        THROW_SATEXCEPTION("ColumnarTupleWriter::initBranches(...): only flat vectors of simple types can be written!!! var: " + name);
+    }
+    void addType(const NTupleReader&, const std::string& name, std::string*)
+    {
+        THROW_SATEXCEPTION("ColumnarTupleWriter::initBranches(...): strings can not be written!!! var: " + name);
+    }
+    void addType(const NTupleReader&, const std::string& name, std::vector<std::string>*)
+    {
+        THROW_SATEXCEPTION("ColumnarTupleWriter::initBranches(...): strings can not be written!!! var: " + name);
+    }
+
+    template<typename T> void addVar(const NTupleReader& tr, const std::string& name)
+    {
+        columns_.emplace_back(new ScalarColumn<T>(tr, name));
+    }
+
+    template<typename T> void addVec(const NTupleReader& tr, const std::string& name)
+    {
+        columns_.emplace_back(new VectorColumn<T>(tr, name));
+    }
+
+    void write(const void* data, const size_t size);
+    ColumnarFormat::Block writeBlock(const char* data, const size_t size, const unsigned int elemSize);
+    void writeChunk();
+};
+
+//bool and TLorentzVector are not stored as their in memory representation
+template<> inline void ColumnarTupleWriter::appendValue<bool>(std::vector<char>& out, const bool& value)
+{
+    out.push_back(value ? 1 : 0);
+}
+
+template<> inline void ColumnarTupleWriter::appendValue<TLorentzVector>(std::vector<char>& out, const TLorentzVector& value)
+{
+    const double p[4] = {value.Px(), value.Py(), value.Pz(), value.E()};
+    const char* bytes = reinterpret_cast<const char*>(p);
+    out.insert(out.end(), bytes, bytes + sizeof(p));
+}
+
+template<> inline void ColumnarTupleWriter::appendValues<bool>(std::vector<char>& out, const std::vector<bool>& values)
+{
+    for(bool value : values) appendValue<bool>(out, value);
+}
+
+template<> inline void ColumnarTupleWriter::appendValues<TLorentzVector>(std::vector<char>& out, const std::vector<TLorentzVector>& values)
+{
+    for(const auto& value : values) appendValue<TLorentzVector>(out, value);
+}
+
+template<> inline uint8_t ColumnarTupleWriter::elementType<double>()         { return ColumnarFormat::kDouble; }
+template<> inline uint8_t ColumnarTupleWriter::elementType<float>()          { return ColumnarFormat::kFloat; }
+template<> inline uint8_t ColumnarTupleWriter::elementType<int>()            { return ColumnarFormat::kInt; }
+template<> inline uint8_t ColumnarTupleWriter::elementType<unsigned int>()   { return ColumnarFormat::kUInt; }
+template<> inline uint8_t ColumnarTupleWriter::elementType<short>()          { return ColumnarFormat::kShort; }
+template<> inline uint8_t ColumnarTupleWriter::elementType<unsigned short>() { return ColumnarFormat::kUShort; }
+template<> inline uint8_t ColumnarTupleWriter::elementType<char>()           { return ColumnarFormat::kChar; }
+template<> inline uint8_t ColumnarTupleWriter::elementType<unsigned char>()  { return ColumnarFormat::kUChar; }
+template<> inline uint8_t ColumnarTupleWriter::elementType<bool>()           { return ColumnarFormat::kBool; }
+template<> inline uint8_t ColumnarTupleWriter::elementType<long>()           { return ColumnarFormat::kLong; }
+template<> inline uint8_t ColumnarTupleWriter::elementType<unsigned long>()  { return ColumnarFormat::kULong; }
+template<> inline uint8_t ColumnarTupleWriter::elementType<TLorentzVector>() { return ColumnarFormat::kTLorentzVector; }
+
+#endif
@@ -11,10 +11,68 @@
 #include "SusyAnaTools/Tools/NTupleReader.h"
 #include "SusyAnaTools/Tools/baselineDef.h"
 #include "SusyAnaTools/Tools/samples.h"
+#include "SusyAnaTools/Tools/ColumnarTupleWriter.h"
 
 #include "DeepTrim.h"
 
 #include <iostream>
+#include <sstream>
+#include <set>
+#include <map>
+#include <functional>
+
+static const std::string spec = "";
+
+typedef std::function<bool(NTupleReader&)> SkimSelection;
+
+//Named skim selections on the BaselineVessel output, several may be written in one pass with -S
+const std::map<std::string, SkimSelection>& skimSelections()
+{
+    static const std::map<std::string, SkimSelection> selections = {
+        //the original DeepTrim selection
+        {"deepTrim", [](NTupleReader& tr)
+            {
+                return ( tr.getVar<float>("met") > 200 )
+                    && tr.getVar<bool>("passnJets"+spec)
+                    && tr.getVar<bool>("passHT"+spec)
+                    && tr.getVar<bool>("passMT2"+spec)
+                    && tr.getVar<bool>("passTagger"+spec)
+                    && (!tr.getVar<bool>("passBJets"+spec))
+                    && tr.getVar<bool>("passNoiseEventFilter"+spec);
+            }},
+        {"baseline", [](NTupleReader& tr) { return tr.getVar<bool>("passBaseline"+spec); }},
+        {"baselineNoTag", [](NTupleReader& tr) { return tr.getVar<bool>("passBaselineNoTag"+spec); }},
+        //baseline with the dPhi cut inverted
+        {"qcdControl", [](NTupleReader& tr)
+            {
+                return tr.getVar<bool>("passNoiseEventFilter"+spec)
+                    && tr.getVar<bool>("passLeptVeto"+spec)
+                    && tr.getVar<bool>("passnJets"+spec)
+                    && tr.getVar<bool>("passBJets"+spec)
+                    && tr.getVar<bool>("passMET"+spec)
+                    && tr.getVar<bool>("passHT"+spec)
+                    && tr.getVar<bool>("passMT2"+spec)
+                    && tr.getVar<bool>("passTagger"+spec)
+                    && (!tr.getVar<bool>("passdPhis"+spec));
+            }},
+        //baseline with the lepton veto inverted
+        {"lostLepton", [](NTupleReader& tr)
+            {
+                return tr.getVar<bool>("passBaselineNoLepVeto"+spec) && (!tr.getVar<bool>("passLeptVeto"+spec));
+            }},
+    };
+    return selections;
+}
+
+struct SkimOutput
+{
+    std::string name;
+    SkimSelection pass;
+    TFile* file;
+    TTree* tree;
+    ColumnarTupleWriter* columnar;
+    long long nSelected;
+};
 
 int main(int argc, char* argv[])
 {
@@ -28,11 +86,19 @@ int main(int argc, char* argv[])
         {"numFiles",   required_argument, 0, 'N'},
         {"startFile",  required_argument, 0, 'M'},
         {"numEvts",    required_argument, 0, 'E'},
+        {"columnar",   required_argument, 0, 'V'},
+        {"selections", required_argument, 0, 'S'},
+        {"threads",    required_argument, 0, 't'},
     };
 
     bool runOnCondor = false;
     string outputFile = "skimmedStopNTuple.root", dataSets = "", sampleloc = AnaSamples::fileDir, plotDir = "top_plots";
     int nFiles = -1, startFile = 0, nEvts = -1;
+    //comma separated variables for an additional columnar skim, e.g. -V met,jetsLVec,passBaseline
+    string columnarVars = "";
+    //comma separated selections from skimSelections(), each is written to its own file
+    string selections = "deepTrim";
+    int nThreads = 1;
 
     char optionCharacters[128] = "";
 
@@ -65,6 +131,18 @@ int main(int argc, char* argv[])
         case 'E':
             nEvts = int(atoi(optarg));
             break;
+
+        case 'V':
+            columnarVars = optarg;
+            break;
+
+        case 'S':
+            selections = optarg;
+            break;
+
+        case 't':
+            nThreads = int(atoi(optarg));
+            break;
         }
     }
 
@@ -88,18 +166,67 @@ int main(int argc, char* argv[])
         return 0;
     }
 
+    std::vector<std::string> selectionNames;
+    {
+        std::stringstream ssSel(selections);
+        std::string sel;
+        while(std::getline(ssSel, sel, ',')) if(sel.size()) selectionNames.push_back(sel);
+    }
+
+    const std::map<std::string, SkimSelection>& knownSelections = skimSelections();
+    for(const auto& sel : selectionNames)
+    {
+        if(!knownSelections.count(sel))
+        {
+            printf("Unknown selection %s, available selections are:", sel.c_str());
+            for(const auto& known : knownSelections) printf(" %s", known.first.c_str());
+            printf("\n");
+            return 0;
+        }
+    }
+
+    //baskets of all outputs are compressed by ROOT's thread pool while the loop keeps reading
+    if(nThreads > 1) ROOT::EnableImplicitMT(nThreads);
+
     TChain *originalTree = new TChain("stopTreeMaker/AUX");
     sample.addFilesToChain(originalTree, startFile, nFiles);
     originalTree->SetBranchStatus("*", 1);
-   
-    TFile* output = new TFile(outputFile.c_str(), "RECREATE");
-    TDirectory *mydict = output->mkdir("stopTreeMaker");
-    mydict->cd();
-    TTree* selectedTree = originalTree->CloneTree(0);
+
+    std::set<std::string> vars;
+    if(columnarVars.size())
+    {
+        std::stringstream ssVars(columnarVars);
+        std::string var;
+        while(std::getline(ssVars, var, ',')) if(var.size()) vars.insert(var);
+    }
+
+    //one output file per selection, all filled from a single read of the input
+    std::vector<SkimOutput> outputs;
+    for(const auto& sel : selectionNames)
+    {
+        SkimOutput out;
+        out.name = sel;
+        out.pass = knownSelections.at(sel);
+        std::string fileName = (selectionNames.size() > 1) ? outputFile.substr(0, outputFile.rfind(".root")) + "_" + sel + ".root" : outputFile;
+        out.file = new TFile(fileName.c_str(), "RECREATE");
+        TDirectory *mydict = out.file->mkdir("stopTreeMaker");
+        mydict->cd();
+        out.tree = originalTree->CloneTree(0);
+        if(nThreads > 1) out.tree->SetImplicitMT(true);
+
+        //Only the requested variables go to the columnar skim, next to the ROOT output
+        out.columnar = nullptr;
+        if(vars.size())
+        {
+            out.columnar = new ColumnarTupleWriter(fileName.substr(0, fileName.rfind(".root")) + ".col");
+            out.columnar->setTupleVars(vars);
+        }
+        out.nSelected = 0;
+        outputs.push_back(out);
+    }
 
     NTupleReader tr(originalTree);
 
-    const std::string spec = "";
     BaselineVessel myBaselineVessel(tr, spec);
     //The passBaseline is registered here
     tr.registerFunction(myBaselineVessel);
@@ -108,39 +235,36 @@ int main(int argc, char* argv[])
     {
         if(nEvts > 0 && tr.getEvtNum() > nEvts) break;
 
-        float met = tr.getVar<float>("met");
-
-        //bool passLeptVeto = tr.getVar<bool>("passLeptVeto"+spec);
-        bool passnJets = tr.getVar<bool>("passnJets"+spec);
-        //bool passMET = tr.getVar<bool>("passMET"+spec);
-        bool passHT = tr.getVar<bool>("passHT"+spec);
-        bool passMT2 = tr.getVar<bool>("passMT2"+spec);
-        bool passTagger = tr.getVar<bool>("passTagger"+spec);
-        bool passBJets = tr.getVar<bool>("passBJets"+spec);
-        bool passNoiseEventFilter = tr.getVar<bool>("passNoiseEventFilter"+spec);
-        bool passQCDHighMETFilter = tr.getVar<bool>("passQCDHighMETFilter"+spec);
-        bool passdPhis = tr.getVar<bool>("passdPhis"+spec);
-
-        bool passDeepTrim = false;
-        passDeepTrim = ( met > 200 )
-            && passnJets
-            && passHT
-            && passMT2
-            && passTagger
-            && (!passBJets)
-            && passNoiseEventFilter;
-
-        if(passDeepTrim) selectedTree->Fill();
-        else continue;
+        for(auto& out : outputs)
+        {
+            if(out.columnar && tr.isFirstEvent()) out.columnar->initBranches(tr);
+
+            if(out.pass(tr))
+            {
+                out.tree->Fill();
+                if(out.columnar) out.columnar->fill();
+                ++out.nSelected;
+            }
+        }
     }
 
-    selectedTree->Write();
-    output->Write(); 
-    output->Close();
+    for(auto& out : outputs)
+    {
+        if(out.columnar)
+        {
+            out.columnar->close();
+            delete out.columnar;
+        }
+
+        out.file->cd("stopTreeMaker");
+        out.tree->Write();
+        out.file->Write();
+        out.file->Close();
+        printf("Selection %s: %lld events written to %s\n", out.name.c_str(), out.nSelected, out.file->GetName());
+        delete out.file;
+    }
 
     if(originalTree) delete originalTree;
-    if(output) delete output;
-    if(selectedTree) delete selectedTree;
 
     //std::string d = "root://cmseos.fnal.gov//store/group/lpcsusyhad/hua/Skimmed_2015Nov15";
     //std::system(("xrdcp " + output_str + " " + d).c_str());
@@ -1,90 +1,190 @@
 #ifndef EVENTLISTFILTER_H
 #define EVENTLISTFILTER_H
 
-#include <set>
 #include <utility>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <fstream>
-#include <sstream>
+#include <algorithm>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 class EventListFilter {
 public:
-    //internal representation of an event
-    typedef std::pair<std::pair<unsigned,unsigned>,unsigned long long> Triple;
-    
+    //internal representation of an event, ordered by run, lumi section then event
+    struct Triple {
+        uint32_t run;
+        uint32_t ls;
+        uint64_t evt;
+
+        bool operator<(const Triple& other) const {
+            if(run != other.run) return run < other.run;
+            if(ls != other.ls) return ls < other.ls;
+            return evt < other.evt;
+        }
+        bool operator==(const Triple& other) const { return run == other.run && ls == other.ls && evt == other.evt; }
+    };
+
     //constructor
-    EventListFilter() : initialized(false) {}
-    EventListFilter(std::string inputFileList){
+    EventListFilter() : initialized(false), events(nullptr), nEvents(0) {}
+    //inputFileList is either the text list (one run:ls:event per line) or a binary list written
+    //by WriteBinary(), the latter is memory mapped read only so its pages are shared between jobs
+    EventListFilter(std::string inputFileList) : initialized(false), events(nullptr), nEvents(0) {
         using namespace std;
 
-        //initialize the set of events
+        //initialize the list of events
         if(inputFileList.size()>0){
-            ifstream infile(inputFileList.c_str());
-            if(infile.is_open()){
-                string line;
-                while(getline(infile,line)){
-                    vector<string> items;
-                    process(line,':',items);
-                    //convert input to proper types
-                    if(items.size()==3){
-                        unsigned run_tmp;
-                        stringstream s0(items[0]);
-                        s0 >> run_tmp;
-                        
-                        unsigned ls_tmp;
-                        stringstream s1(items[1]);
-                        s1 >> ls_tmp;
-                        
-                        unsigned long long evt_tmp;
-                        stringstream s2(items[2]);
-                        s2 >> evt_tmp;
-                        
-                        //insert into set
-                        eventList.insert(make_triple(run_tmp,ls_tmp,evt_tmp));
-                    }
-                }
-                initialized = true;
-            }
-            else {
+            if(!loadBinary(inputFileList) && !loadText(inputFileList)){
                 cout << "EventListFilter: could not open file: " << inputFileList << endl;
                 initialized = false;
             }
         }
     }
-    
-    //filter
-    bool CheckEvent(unsigned run, unsigned ls, unsigned long long evt){
-        using namespace std;
 
+    //events points into eventList or the mapping, so copies take care to repoint it
+    EventListFilter(const EventListFilter& other) : initialized(other.initialized), eventList(other.eventList), mapping(other.mapping),
+                                                    events(mapping ? other.events : eventList.data()), nEvents(other.nEvents) {}
+    EventListFilter& operator=(const EventListFilter& other){
+        if(this != &other){
+            initialized = other.initialized;
+            eventList = other.eventList;
+            mapping = other.mapping;
+            events = mapping ? other.events : eventList.data();
+            nEvents = other.nEvents;
+        }
+        return *this;
+    }
+
+    //filter
+    bool CheckEvent(unsigned run, unsigned ls, unsigned long long evt) const {
         if(!initialized) return true;
-        set<Triple>::iterator itr = eventList.find(make_triple(run,ls,evt));
-        return (itr==eventList.end());
+        Triple t = make_triple(run,ls,evt);
+        const Triple* itr = std::lower_bound(events, events + nEvents, t);
+        return !(itr != events + nEvents && *itr == t);
     }
-    
+
+    //write the list in the binary format, which loads without parsing
+    bool WriteBinary(const std::string& outputFile) const {
+        std::ofstream outfile(outputFile.c_str(), std::ios::binary);
+        if(!outfile.is_open()) return false;
+        uint64_t n = nEvents;
+        outfile.write(binaryMagic(), 8);
+        outfile.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        outfile.write(reinterpret_cast<const char*>(events), nEvents*sizeof(Triple));
+        return outfile.good();
+    }
+
     //accessors
     bool Initialized() const { return initialized; }
-    
+    size_t Size() const { return nEvents; }
+
 private:
+    //unmaps the binary list once the last filter using it is gone
+    struct MappedFile {
+        void* addr;
+        size_t size;
+        MappedFile(void* a, size_t s) : addr(a), size(s) {}
+        ~MappedFile() { munmap(addr, size); }
+    };
+
     //helpers
-    Triple make_triple(unsigned a, unsigned b, unsigned long long c){
-        return std::make_pair(std::make_pair(a,b),c);
+    static Triple make_triple(unsigned a, unsigned b, unsigned long long c){
+        Triple t;
+        t.run = a;
+        t.ls = b;
+        t.evt = c;
+        return t;
+    }
+    static const char* binaryMagic() { return "SATEVL01"; }
+
+    //parses the unsigned number in [begin, end), ignoring surrounding blanks as operator>> did
+    static bool parseField(const char* begin, const char* end, unsigned long long& value){
+        while(begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+        if(begin == end || *begin < '0' || *begin > '9') return false;
+        value = 0;
+        while(begin < end && *begin >= '0' && *begin <= '9') value = value*10 + (*begin++ - '0');
+        return true;
     }
-    //generalization for processing a line
-    void process(std::string line, char delim, std::vector<std::string>& fields){
-        using namespace std;
 
-        stringstream ss(line);
-        string field;
-        while(getline(ss,field,delim)){
-            fields.push_back(field);
+    bool loadText(const std::string& fileName){
+        std::ifstream infile(fileName.c_str(), std::ios::binary);
+        if(!infile.is_open()) return false;
+        std::string buffer((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+
+        //lines with exactly three ':' separated fields are events, anything else is skipped.  As
+        //with the getline based parser a single trailing ':' does not start a fourth field
+        const char* pos = buffer.data();
+        const char* bufEnd = pos + buffer.size();
+        while(pos < bufEnd){
+            const char* lineEnd = static_cast<const char*>(memchr(pos, '\n', bufEnd - pos));
+            if(!lineEnd) lineEnd = bufEnd;
+            const char* fields[4] = {pos, nullptr, nullptr, nullptr};
+            int nSep = 0;
+            for(const char* c = pos; c < lineEnd && nSep < 3; ++c){
+                if(*c == ':') fields[++nSep] = c + 1;
+            }
+            if(nSep == 2 || (nSep == 3 && fields[3] == lineEnd)){
+                const char* evtEnd = (nSep == 3) ? fields[3] - 1 : lineEnd;
+                unsigned long long run_tmp, ls_tmp, evt_tmp;
+                if(parseField(fields[0], fields[1] - 1, run_tmp) &&
+                   parseField(fields[1], fields[2] - 1, ls_tmp) &&
+                   parseField(fields[2], evtEnd, evt_tmp)){
+                    eventList.push_back(make_triple(run_tmp,ls_tmp,evt_tmp));
+                }
+            }
+            pos = lineEnd + 1;
         }
+
+        std::sort(eventList.begin(), eventList.end());
+        eventList.erase(std::unique(eventList.begin(), eventList.end()), eventList.end());
+        events = eventList.data();
+        nEvents = eventList.size();
+        initialized = true;
+        return true;
     }
-    
+
+    bool loadBinary(const std::string& fileName){
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        struct stat st;
+        char magic[8];
+        uint64_t n = 0;
+        const size_t headerSize = sizeof(magic) + sizeof(n);
+        bool isBinary = fstat(fd, &st) == 0 && size_t(st.st_size) >= headerSize &&
+                        pread(fd, magic, sizeof(magic), 0) == ssize_t(sizeof(magic)) && memcmp(magic, binaryMagic(), sizeof(magic)) == 0 &&
+                        pread(fd, &n, sizeof(n), sizeof(magic)) == ssize_t(sizeof(n)) && size_t(st.st_size) == headerSize + n*sizeof(Triple);
+        if(!isBinary){
+            close(fd);
+            return false;
+        }
+
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(addr == MAP_FAILED){
+            std::cout << "EventListFilter: could not map file: " << fileName << std::endl;
+            return false;
+        }
+        mapping = std::make_shared<MappedFile>(addr, st.st_size);
+        events = reinterpret_cast<const Triple*>(static_cast<const char*>(addr) + headerSize);
+        nEvents = n;
+        initialized = true;
+        return true;
+    }
+
     //member variables
     bool initialized;
-    std::set<Triple> eventList;
+    //sorted list, owned by eventList for text input or by mapping for binary input
+    std::vector<Triple> eventList;
+    std::shared_ptr<MappedFile> mapping;
+    const Triple* events;
+    size_t nEvents;
 };
 
 /*USAGE:
@@ -96,6 +196,8 @@ tar -xvf HTMHT_Nov14.tar.gz
 EventListFilter filter("TreeMaker/Production/test/data/HTMHT_csc2015.txt");
 //in event loop
 bool CSCTightHaloFilterUpdate = filter.CheckEvent(RunNum,LumiBlockNum,EvtNum);
+//optionally convert the list once, later jobs load HTMHT_csc2015.bin without parsing
+filter.WriteBinary("HTMHT_csc2015.bin");
 */
 
 #endif
@@ -0,0 +1,129 @@
+#ifndef FLATHIST_H
+#define FLATHIST_H
+
+#include "TH1.h"
+#include "TAxis.h"
+#include "TArrayD.h"
+
+#include <vector>
+#include <algorithm>
+
+/* Lightweight copy of the binning and contents of a TH1/TH2 for lookups on the hot path.
+   Build it once from the ROOT histogram (after any Divide/Scale) and use it in place of
+   FindBin + GetBinContent, it lives in contiguous arrays and avoids the virtual TAxis calls.
+   Bin numbering is the ROOT one (0 is the underflow, nBins + 1 the overflow) and findBin
+   returns exactly what TAxis::FindBin does for a non extendable axis.
+
+   FlatHist eff(h_eff_b);
+   double e = eff.getBinContent(eff.xAxis().findBinClamped(pt), eff.yAxis().findBinClamped(eta));
+ */
+
+class FlatAxis
+{
+public:
+    FlatAxis() : nBins_(1), xMin_(0.0), xMax_(1.0) {}
+
+    FlatAxis(int nBins, double xMin, double xMax) : nBins_(nBins), xMin_(xMin), xMax_(xMax) {}
+
+    //Variable binning, edges holds the nBins + 1 bin edges in increasing order
+    explicit FlatAxis(const std::vector<double>& edges) : nBins_(int(edges.size()) - 1), xMin_(edges.front()), xMax_(edges.back()), edges_(edges) {}
+
+    explicit FlatAxis(const TAxis* axis) : nBins_(axis->GetNbins()), xMin_(axis->GetXmin()), xMax_(axis->GetXmax())
+    {
+        const TArrayD* bins = axis->GetXbins();
+        if(bins && bins->GetSize() > 0) edges_.assign(bins->GetArray(), bins->GetArray() + bins->GetSize());
+    }
+
+    int getNbins() const { return nBins_; }
+    double getXmin() const { return xMin_; }
+    double getXmax() const { return xMax_; }
+    bool isUniform() const { return edges_.empty(); }
+    const std::vector<double>& getEdges() const { return edges_; }
+
+    //Same as TAxis::FindBin
+    int findBin(double x) const
+    {
+        if(x < xMin_)         return 0;
+        else if(!(x < xMax_)) return nBins_ + 1;
+        else if(edges_.empty()) return 1 + int(nBins_*(x - xMin_)/(xMax_ - xMin_));
+        //last edge <= x, as TMath::BinarySearch
+        return int(std::upper_bound(edges_.begin(), edges_.end(), x) - edges_.begin());
+    }
+
+    //findBin with the under and overflow moved into the first and last bin
+    int findBinClamped(double x) const
+    {
+        int bin = findBin(x);
+        if(bin < 1)       return 1;
+        if(bin > nBins_)  return nBins_;
+        return bin;
+    }
+
+    //Same as TAxis::GetBinLowEdge
+    double getBinLowEdge(int bin) const
+    {
+        if(!edges_.empty() && bin > 0 && bin <= nBins_) return edges_[bin - 1];
+        return xMin_ + (bin - 1)*((xMax_ - xMin_)/double(nBins_));
+    }
+
+private:
+    int nBins_;
+    double xMin_, xMax_;
+    std::vector<double> edges_;  //empty for uniform binning
+};
+
+class FlatHist
+{
+public:
+    FlatHist() : valid_(false), stride_(1) {}
+
+    //1D and 2D histograms are supported, the contents are copied so h can be deleted afterwards
+    explicit FlatHist(const TH1* h) : valid_(false), stride_(1)
+    {
+        if(h) set(h);
+    }
+
+    void set(const TH1* h)
+    {
+        xAxis_ = FlatAxis(h->GetXaxis());
+        if(h->GetDimension() > 1) yAxis_ = FlatAxis(h->GetYaxis());
+        else                      yAxis_ = FlatAxis();
+
+        int nx = xAxis_.getNbins() + 2;
+        int ny = (h->GetDimension() > 1) ? yAxis_.getNbins() + 2 : 1;
+        stride_ = nx;
+        values_.resize(nx*ny);
+        for(int iy = 0; iy < ny; ++iy)
+        {
+            for(int ix = 0; ix < nx; ++ix)
+            {
+                values_[ix + nx*iy] = (ny > 1) ? h->GetBinContent(ix, iy) : h->GetBinContent(ix);
+            }
+        }
+        valid_ = true;
+    }
+
+    bool valid() const { return valid_; }
+
+    const FlatAxis& xAxis() const { return xAxis_; }
+    const FlatAxis& yAxis() const { return yAxis_; }
+
+    double getBinContent(int bin) const { return values_[bin]; }
+    double getBinContent(int binx, int biny) const { return values_[binx + stride_*biny]; }
+
+    //Content of the bin holding x (y), under and overflow included as in ROOT
+    double getValue(double x) const { return values_[xAxis_.findBin(x)]; }
+    double getValue(double x, double y) const { return getBinContent(xAxis_.findBin(x), yAxis_.findBin(y)); }
+
+    //Content with x (y) beyond the axis range taken from the first or last bin
+    double getValueClamped(double x) const { return values_[xAxis_.findBinClamped(x)]; }
+    double getValueClamped(double x, double y) const { return getBinContent(xAxis_.findBinClamped(x), yAxis_.findBinClamped(y)); }
+
+private:
+    bool valid_;
+    FlatAxis xAxis_, yAxis_;
+    int stride_;
+    std::vector<double> values_;
+};
+
+#endif
@@ -0,0 +1,234 @@
+#include "HistBooker.h"
+
+#include "TH1D.h"
+#include "TH2D.h"
+
+#include <cmath>
+#include <algorithm>
+
+HistBooker::HistBooker() : event_(0)
+{
+}
+
+void HistBooker::addWeight(const std::string& name, const Value& weight)
+{
+    for(const auto& w : weightNames_)
+    {
+        if(w == name) THROW_SATEXCEPTION("HistBooker::addWeight(...): weight \"" + name + "\" is already defined!!!");
+    }
+    weightNames_.push_back(name);
+    weights_.push_back(weight);
+    weightValues_.push_back(0.0);
+    weightStamps_.push_back(0);
+}
+
+void HistBooker::addCut(const std::string& name, const Cut& cut)
+{
+    for(const auto& c : cutNames_)
+    {
+        if(c == name) THROW_SATEXCEPTION("HistBooker::addCut(...): cut \"" + name + "\" is already defined!!!");
+    }
+    cutNames_.push_back(name);
+    cuts_.push_back(cut);
+    cutValues_.push_back(0);
+    cutStamps_.push_back(0);
+}
+
+void HistBooker::book(Booking& b, const std::vector<std::string>& weights, const std::string& cut)
+{
+    for(const auto& booked : bookings_)
+    {
+        if(booked.name == b.name) THROW_SATEXCEPTION("HistBooker::book(...): histogram \"" + b.name + "\" is already booked!!!");
+    }
+
+    //no weight defined means a single unit weight
+    if(weights_.empty()) addWeight("", constant(1.0));
+
+    if(weights.empty())
+    {
+        for(unsigned int i = 0; i < weights_.size(); ++i) b.weights.push_back(i);
+    }
+    else
+    {
+        for(const auto& w : weights)
+        {
+            auto iter = std::find(weightNames_.begin(), weightNames_.end(), w);
+            if(iter == weightNames_.end()) THROW_SATEXCEPTION("HistBooker::book(...): unknown weight \"" + w + "\" for histogram \"" + b.name + "\"!!!");
+            b.weights.push_back(iter - weightNames_.begin());
+        }
+    }
+
+    b.cut = -1;
+    if(cut.size())
+    {
+        auto iter = std::find(cutNames_.begin(), cutNames_.end(), cut);
+        if(iter == cutNames_.end()) THROW_SATEXCEPTION("HistBooker::book(...): unknown cut \"" + cut + "\" for histogram \"" + b.name + "\"!!!");
+        b.cut = iter - cutNames_.begin();
+    }
+
+    b.nCells = (b.xAxis.getNbins() + 2)*(b.is2D ? b.yAxis.getNbins() + 2 : 1);
+    b.offset = sumW_.size();
+    sumW_.resize(sumW_.size() + b.nCells*b.weights.size(), 0.0);
+    sumW2_.resize(sumW_.size(), 0.0);
+    entries_.push_back(0.0);
+    bookings_.push_back(b);
+}
+
+void HistBooker::book1D(const std::string& name, const std::string& title, const Value& x, int nBins, double xMin, double xMax, const std::vector<std::string>& weights, const std::string& cut)
+{
+    Booking b;
+    b.name = name;
+    b.title = title;
+    b.x = x;
+    b.xAxis = FlatAxis(nBins, xMin, xMax);
+    b.is2D = false;
+    book(b, weights, cut);
+}
+
+void HistBooker::book1D(const std::string& name, const std::string& title, const Value& x, const std::vector<double>& edges, const std::vector<std::string>& weights, const std::string& cut)
+{
+    if(edges.size() < 2) THROW_SATEXCEPTION("HistBooker::book1D(...): histogram \"" + name + "\" needs at least two bin edges!!!");
+    Booking b;
+    b.name = name;
+    b.title = title;
+    b.x = x;
+    b.xAxis = FlatAxis(edges);
+    b.is2D = false;
+    book(b, weights, cut);
+}
+
+void HistBooker::book1D(const std::string& name, const std::string& title, const Values& x, int nBins, double xMin, double xMax, const std::vector<std::string>& weights, const std::string& cut)
+{
+    Booking b;
+    b.name = name;
+    b.title = title;
+    b.xs = x;
+    b.xAxis = FlatAxis(nBins, xMin, xMax);
+    b.is2D = false;
+    book(b, weights, cut);
+}
+
+void HistBooker::book2D(const std::string& name, const std::string& title, const Value& x, int nBinsX, double xMin, double xMax, const Value& y, int nBinsY, double yMin, double yMax, const std::vector<std::string>& weights, const std::string& cut)
+{
+    Booking b;
+    b.name = name;
+    b.title = title;
+    b.x = x;
+    b.y = y;
+    b.xAxis = FlatAxis(nBinsX, xMin, xMax);
+    b.yAxis = FlatAxis(nBinsY, yMin, yMax);
+    b.is2D = true;
+    book(b, weights, cut);
+}
+
+inline void HistBooker::fillCell(const Booking& b, int cell)
+{
+    double* sumW = &sumW_[b.offset + cell];
+    double* sumW2 = &sumW2_[b.offset + cell];
+    for(unsigned int i = 0; i < eventWeights_.size(); ++i)
+    {
+        const double w = eventWeights_[i];
+        sumW[i*b.nCells] += w;
+        sumW2[i*b.nCells] += w*w;
+    }
+}
+
+void HistBooker::fill(const NTupleReader& tr, double weight)
+{
+    ++event_;
+    for(unsigned int iBooking = 0; iBooking < bookings_.size(); ++iBooking)
+    {
+        const Booking& b = bookings_[iBooking];
+
+        if(b.cut >= 0)
+        {
+            if(cutStamps_[b.cut] != event_)
+            {
+                cutValues_[b.cut] = cuts_[b.cut](tr) ? 1 : 0;
+                cutStamps_[b.cut] = event_;
+            }
+            if(!cutValues_[b.cut]) continue;
+        }
+
+        eventWeights_.resize(b.weights.size());
+        for(unsigned int i = 0; i < b.weights.size(); ++i)
+        {
+            const int iWeight = b.weights[i];
+            if(weightStamps_[iWeight] != event_)
+            {
+                weightValues_[iWeight] = weights_[iWeight](tr);
+                weightStamps_[iWeight] = event_;
+            }
+            eventWeights_[i] = weight*weightValues_[iWeight];
+        }
+
+        if(b.xs)
+        {
+            values_.clear();
+            b.xs(tr, values_);
+            for(const double x : values_) fillCell(b, b.xAxis.findBin(x));
+            entries_[iBooking] += values_.size();
+        }
+        else
+        {
+            int cell = b.xAxis.findBin(b.x(tr));
+            if(b.is2D) cell += (b.xAxis.getNbins() + 2)*b.yAxis.findBin(b.y(tr));
+            fillCell(b, cell);
+            entries_[iBooking] += 1;
+        }
+    }
+}
+
+void HistBooker::merge(const HistBooker& other)
+{
+    if(other.bookings_.size() != bookings_.size() || other.sumW_.size() != sumW_.size())
+    {
+        THROW_SATEXCEPTION("HistBooker::merge(...): bookers do not hold the same histograms!!!");
+    }
+
+    for(size_t i = 0; i < sumW_.size(); ++i)
+    {
+        sumW_[i] += other.sumW_[i];
+        sumW2_[i] += other.sumW2_[i];
+    }
+    for(size_t i = 0; i < entries_.size(); ++i) entries_[i] += other.entries_[i];
+}
+
+std::vector<TH1*> HistBooker::makeHistograms() const
+{
+    std::vector<TH1*> hists;
+    for(unsigned int iBooking = 0; iBooking < bookings_.size(); ++iBooking)
+    {
+        const Booking& b = bookings_[iBooking];
+        for(unsigned int i = 0; i < b.weights.size(); ++i)
+        {
+            const std::string name = b.name + weightNames_[b.weights[i]];
+            TH1* h;
+            if(b.is2D)                   h = new TH2D(name.c_str(), b.title.c_str(), b.xAxis.getNbins(), b.xAxis.getXmin(), b.xAxis.getXmax(), b.yAxis.getNbins(), b.yAxis.getXmin(), b.yAxis.getXmax());
+            else if(b.xAxis.isUniform()) h = new TH1D(name.c_str(), b.title.c_str(), b.xAxis.getNbins(), b.xAxis.getXmin(), b.xAxis.getXmax());
+            else                         h = new TH1D(name.c_str(), b.title.c_str(), b.xAxis.getNbins(), b.xAxis.getEdges().data());
+            h->SetDirectory(0);
+            h->Sumw2();
+
+            //cells use the ROOT global bin numbering
+            const double* sumW = &sumW_[b.offset + i*b.nCells];
+            const double* sumW2 = &sumW2_[b.offset + i*b.nCells];
+            for(int cell = 0; cell < b.nCells; ++cell)
+            {
+                if(sumW[cell] == 0.0 && sumW2[cell] == 0.0) continue;
+                h->SetBinContent(cell, sumW[cell]);
+                h->SetBinError(cell, std::sqrt(sumW2[cell]));
+            }
+            h->SetEntries(entries_[iBooking]);
+            hists.push_back(h);
+        }
+    }
+    return hists;
+}
+
+unsigned int HistBooker::getNHistograms() const
+{
+    unsigned int n = 0;
+    for(const auto& b : bookings_) n += b.weights.size();
+    return n;
+}
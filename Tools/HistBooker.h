@@ -0,0 +1,139 @@
+#ifndef HIST_BOOKER_H
+#define HIST_BOOKER_H
+
+#include "NTupleReader.h"
+#include "FlatHist.h"
+
+#include <vector>
+#include <map>
+#include <string>
+#include <functional>
+
+class TH1;
+
+/* Declarative histogram booking with one fill call per event, in place of vectors of TH1D*
+   filled one by one as in basicHists.h
+
+   HistBooker booker;
+   booker.addCut("baseline", HistBooker::var<bool>("passBaseline"));
+   booker.addWeight("",          HistBooker::constant(1.0));
+   booker.addWeight("_bTagUp",   HistBooker::var<double>("bTagSF_up"));
+   booker.addWeight("_bTagDown", HistBooker::var<double>("bTagSF_down"));
+   booker.book1D("h1_met_baseline", "MET", HistBooker::var<float>("met"), 100, 0, 1000, {"", "_bTagUp", "_bTagDown"}, "baseline");
+   booker.book1D("h1_jetPt", "jet p_{T}", HistBooker::vec<TLorentzVector>("jetsLVec", [](const TLorentzVector& j) { return j.Pt(); }), 100, 0, 1000);
+   booker.book2D("h2_MT2_vs_met", "MT2 vs MET", HistBooker::var<float>("met"), 50, 0, 1000, HistBooker::var<float>("best_had_brJet_MT2"), 50, 0, 1000);
+
+   while(tr.getNextEvent()) booker.fill(tr, evtWeight);
+
+   for(TH1* h : booker.makeHistograms()) h->Write();
+
+   A histogram is booked once per weight variation, the variation name is appended to the
+   histogram name.  A weight or cut is evaluated at most once per event however many
+   histograms use it, the bin of a histogram is found once and all its variations are filled
+   with the same bin.  Sums of weights and squared weights live in one contiguous array, no
+   ROOT object is touched until makeHistograms().
+
+   A HistBooker is not thread safe, for multithreaded running book one per thread (e.g. in a
+   ParallelWorker) and add them with merge(), which only sums arrays.
+ */
+
+class HistBooker
+{
+public:
+    typedef std::function<double(const NTupleReader&)> Value;
+    //fills values with every entry to histogram for this event
+    typedef std::function<void(const NTupleReader&, std::vector<double>& values)> Values;
+    typedef std::function<bool(const NTupleReader&)> Cut;
+
+    HistBooker();
+
+    void addWeight(const std::string& name, const Value& weight);
+    void addCut(const std::string& name, const Cut& cut);
+
+    //weights are names given to addWeight (all of them if empty), cut a name given to addCut ("" for none)
+    void book1D(const std::string& name, const std::string& title, const Value& x, int nBins, double xMin, double xMax, const std::vector<std::string>& weights = std::vector<std::string>(), const std::string& cut = "");
+    void book1D(const std::string& name, const std::string& title, const Value& x, const std::vector<double>& edges, const std::vector<std::string>& weights = std::vector<std::string>(), const std::string& cut = "");
+    void book1D(const std::string& name, const std::string& title, const Values& x, int nBins, double xMin, double xMax, const std::vector<std::string>& weights = std::vector<std::string>(), const std::string& cut = "");
+    void book2D(const std::string& name, const std::string& title, const Value& x, int nBinsX, double xMin, double xMax, const Value& y, int nBinsY, double yMin, double yMax, const std::vector<std::string>& weights = std::vector<std::string>(), const std::string& cut = "");
+
+    //Fill every booked histogram whose cut passes, all weights are multiplied by weight
+    void fill(const NTupleReader& tr, double weight = 1.0);
+
+    //Add the contents of a booker with exactly the same bookings
+    void merge(const HistBooker& other);
+
+    //New TH1D/TH2D (not attached to any directory) for every histogram and variation in booking order
+    std::vector<TH1*> makeHistograms() const;
+
+    unsigned int getNHistograms() const;
+
+    //Value helpers for scalar and vector tuple variables, the variable is looked up once per
+    //reader and then read through a handle.  Readers are told apart by getInstanceId(), a new
+    //reader constructed at the address of a destroyed one still gets its own handle
+    template<typename T> static Value var(const std::string& name)
+    {
+        unsigned long long reader = 0;
+        NTupleReader::VarHandle<T> h;
+        return [name, reader, h](const NTupleReader& tr) mutable
+        {
+            if(reader != tr.getInstanceId()) { reader = tr.getInstanceId(); h = tr.handle<T>(name); }
+            return double(h.get());
+        };
+    }
+
+    template<typename T> static Values vec(const std::string& name)
+    {
+        return vec<T>(name, [](const T& v) { return double(v); });
+    }
+
+    template<typename T, typename F> static Values vec(const std::string& name, F f)
+    {
+        unsigned long long reader = 0;
+        NTupleReader::VecHandle<T> h;
+        return [name, f, reader, h](const NTupleReader& tr, std::vector<double>& values) mutable
+        {
+            if(reader != tr.getInstanceId()) { reader = tr.getInstanceId(); h = tr.vecHandle<T>(name); }
+            for(const auto& v : h.get()) values.push_back(f(v));
+        };
+    }
+
+    static Value constant(const double value)
+    {
+        return [value](const NTupleReader&) { return value; };
+    }
+
+private:
+    struct Booking
+    {
+        std::string name, title;
+        Value x, y;
+        Values xs;
+        FlatAxis xAxis, yAxis;
+        bool is2D;
+        int cut;                   //index in cuts_, -1 for none
+        std::vector<int> weights;  //indices in weights_
+        int nCells;                //(nBinsX + 2)*(nBinsY + 2), under and overflow included
+        size_t offset;             //first cell in sumW_, the variations follow each other
+    };
+
+    std::vector<std::string> weightNames_, cutNames_;
+    std::vector<Value> weights_;
+    std::vector<Cut> cuts_;
+    std::vector<Booking> bookings_;
+
+    //per event caches, valid when the stamp equals event_
+    unsigned long long event_;
+    std::vector<double> weightValues_;
+    std::vector<unsigned long long> weightStamps_;
+    std::vector<char> cutValues_;
+    std::vector<unsigned long long> cutStamps_;
+    std::vector<double> values_, eventWeights_;
+
+    std::vector<double> sumW_, sumW2_;
+    std::vector<double> entries_;
+
+    void book(Booking& b, const std::vector<std::string>& weights, const std::string& cut);
+    void fillCell(const Booking& b, int cell);
+};
+
+#endif
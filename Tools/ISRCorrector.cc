@@ -26,6 +26,7 @@ void ISRCorrector::SetWeights_Up(TH1D* weights, TH1D* all){
   h_njetsisrW->Multiply(h_weights_up);
   float A_NLO = h_njetsisrW->Integral(0,h_njetsisrW->GetNbinsX()+1);
   h_weights_up->Scale(A_LO/A_NLO);
+  weights_up = FlatHist(h_weights_up);
 //  std::cout << "COrrection Up: " << A_LO/A_NLO << std::endl;
 }
 
@@ -40,6 +41,7 @@ void ISRCorrector::SetWeights_Cent(TH1D* weights, TH1D* all){
   h_njetsisrW->Multiply(h_weights_central);
   float A_NLO = h_njetsisrW->Integral(0,h_njetsisrW->GetNbinsX()+1);
   h_weights_central->Scale(A_LO/A_NLO);
+  weights_central = FlatHist(h_weights_central);
 //  std::cout << "COrrection Cent: " << A_LO/A_NLO << std::endl;
 }
 
@@ -54,19 +56,31 @@ void ISRCorrector::SetWeights_Down(TH1D* weights, TH1D* all){
   h_njetsisrW->Multiply(h_weights_down);
   float A_NLO = h_njetsisrW->Integral(0,h_njetsisrW->GetNbinsX()+1);
   h_weights_down->Scale(A_LO/A_NLO);
+  weights_down = FlatHist(h_weights_down);
 //  std::cout << "COrrection Down: " << A_LO/A_NLO << std::endl;
 }
 
+namespace
+{
+  //NJetsISR is clamped to the low edge of the last bin, the last bin holds NJetsISR >= its low edge
+  float ISRWeight(const FlatHist& weights, int NJetsISR)
+  {
+    if(!weights.valid()) return 1.;
+    const FlatAxis& axis = weights.xAxis();
+    return weights.getValue(min(Double_t(NJetsISR), axis.getBinLowEdge(axis.getNbins())));
+  }
+}
+
 float ISRCorrector::GetCorrection_Up(int NJetsISR){
-  return h_weights_up ? h_weights_up->GetBinContent(h_weights_up->GetXaxis()->FindBin(min(Double_t(NJetsISR), h_weights_up->GetBinLowEdge(h_weights_up->GetNbinsX())))) : 1.;
+  return ISRWeight(weights_up, NJetsISR);
 }
 
 float ISRCorrector::GetCorrection_Cent(int NJetsISR){
-  return h_weights_central ? h_weights_central->GetBinContent(h_weights_central->GetXaxis()->FindBin(min(Double_t(NJetsISR),h_weights_central->GetBinLowEdge(h_weights_central->GetNbinsX())))) :1.;
+  return ISRWeight(weights_central, NJetsISR);
 }
 
 float ISRCorrector::GetCorrection_Down(int NJetsISR){
-  return h_weights_down ? h_weights_down->GetBinContent(h_weights_down->GetXaxis()->FindBin(min(Double_t(NJetsISR),h_weights_down->GetBinLowEdge(h_weights_down->GetNbinsX())))) :1.;
+  return ISRWeight(weights_down, NJetsISR);
 }
 
 
@@ -6,6 +6,7 @@
 #include "TFile.h"
 #include <iostream>
 #include "NTupleReader.h"
+#include "FlatHist.h"
 #include <string>
 
 class ISRCorrector {
@@ -92,6 +93,8 @@ ISRCorrector(std::string fnISR = "Signal_fastsim_T1tttt_scan_ISR.root", std::str
   //member variables
   TH1D *h_njetsisr, *h_weights_central, *h_weights_up, *h_weights_down;
   TH1D *h_isr_up, *h_isr_central, *h_isr_down;
+  //flat copies of the normalized weights used by GetCorrection_*
+  FlatHist weights_central, weights_up, weights_down;
   TFile *fnISR_,  *fISRWght;
   TString massPoint_;
   std::string suffix;
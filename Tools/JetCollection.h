@@ -0,0 +1,125 @@
+#ifndef JETCOLLECTION_H
+#define JETCOLLECTION_H
+
+#include "TLorentzVector.h"
+
+#include <vector>
+
+/* Structure of arrays jet container.  Every jet quantity lives in its own contiguous float
+   array so cuts can be evaluated without recomputing Pt()/Eta() from px/py/pz, and jets are
+   removed with compact(keep) instead of erasing from the middle of several vectors.
+   pt, eta and phi hold exactly the float values AnaFunctions::jetPassCuts would compute from
+   the TLorentzVector, so cut decisions made on the collection are the same.
+
+   The optional per jet quantities (btag and the energy fractions) are empty unless they were
+   given to fill().  TLorentzVectors are only built on request with lorentzVector(i) or
+   fillLorentzVectors(), or kept alongside with fill(..., true) when they must be passed on
+   unchanged.
+ */
+
+class JetCollection
+{
+public:
+    std::vector<float> pt, eta, phi, mass;
+    std::vector<float> btag;
+    std::vector<float> chargedHadEFrac, neutralEMEFrac, chargedEMEFrac;
+    //the input four vectors, only filled when requested in fill()
+    std::vector<TLorentzVector> lvec;
+
+    unsigned int size() const { return pt.size(); }
+    bool empty() const { return pt.empty(); }
+
+    void clear()
+    {
+        for(auto* v : floatArrays()) v->clear();
+        lvec.clear();
+    }
+
+    //Fill from the usual set of parallel vectors, any of the optional inputs may be null
+    void fill(const std::vector<TLorentzVector>& jets, const std::vector<float>* bTag = nullptr,
+              const std::vector<float>* chf = nullptr, const std::vector<float>* nemf = nullptr, const std::vector<float>* cemf = nullptr,
+              bool keepLorentzVectors = false)
+    {
+        unsigned int n = jets.size();
+        pt.resize(n);
+        eta.resize(n);
+        phi.resize(n);
+        mass.resize(n);
+        for(unsigned int i = 0; i < n; ++i)
+        {
+            pt[i]   = jets[i].Pt();
+            eta[i]  = jets[i].Eta();
+            phi[i]  = jets[i].Phi();
+            mass[i] = jets[i].M();
+        }
+
+        assignOptional(btag, bTag);
+        assignOptional(chargedHadEFrac, chf);
+        assignOptional(neutralEMEFrac, nemf);
+        assignOptional(chargedEMEFrac, cemf);
+
+        if(keepLorentzVectors) lvec.assign(jets.begin(), jets.end());
+        else                   lvec.clear();
+    }
+
+    //Keep only the jets with keep[i] set, preserving their order.  Every array is compacted
+    //in a single pass, returns the number of jets left
+    template<typename Mask> unsigned int compact(const Mask& keep)
+    {
+        unsigned int n = size(), nKept = 0;
+        std::vector<std::vector<float>*> arrays = floatArrays();
+        for(unsigned int i = 0; i < n; ++i)
+        {
+            if(!keep[i]) continue;
+            if(nKept != i)
+            {
+                for(auto* v : arrays)
+                {
+                    if(!v->empty()) (*v)[nKept] = (*v)[i];
+                }
+                if(!lvec.empty()) lvec[nKept] = lvec[i];
+            }
+            ++nKept;
+        }
+        for(auto* v : arrays)
+        {
+            if(!v->empty()) v->resize(nKept);
+        }
+        if(!lvec.empty()) lvec.resize(nKept);
+        return nKept;
+    }
+
+    //Four vector of jet i, the stored one if fill() kept them
+    TLorentzVector lorentzVector(unsigned int i) const
+    {
+        if(!lvec.empty()) return lvec[i];
+        TLorentzVector v;
+        v.SetPtEtaPhiM(pt[i], eta[i], phi[i], mass[i]);
+        return v;
+    }
+
+    void fillLorentzVectors(std::vector<TLorentzVector>& out) const
+    {
+        if(!lvec.empty())
+        {
+            out.assign(lvec.begin(), lvec.end());
+            return;
+        }
+        out.resize(size());
+        for(unsigned int i = 0; i < size(); ++i) out[i].SetPtEtaPhiM(pt[i], eta[i], phi[i], mass[i]);
+    }
+
+private:
+    std::vector<std::vector<float>*> floatArrays()
+    {
+        return {&pt, &eta, &phi, &mass, &btag, &chargedHadEFrac, &neutralEMEFrac, &chargedEMEFrac};
+    }
+
+    static void assignOptional(std::vector<float>& dest, const std::vector<float>* src)
+    {
+        if(src) dest.assign(src->begin(), src->end());
+        else    dest.clear();
+    }
+};
+
+#endif
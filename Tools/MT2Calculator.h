@@ -0,0 +1,163 @@
+#ifndef MT2CALCULATOR_H
+#define MT2CALCULATOR_H
+
+#include "TLorentzVector.h"
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+/* MT2 engine wrapping asymm_mt2_lester_bisect (the bisection itself is in baselineDef.cc, as
+   lester_mt2_bisect.h can only be included in one translation unit).
+   The inputs are converted to float exactly as BaselineVessel::coreMT2calc did, both invisible
+   masses are taken from the MET four vector.
+
+   - minOverPairs() returns the smallest MT2 over all pairs of visible objects.  The bisection
+     never returns less than max(mVisA, mVisB) + mInvis, so pairs are tried in order of that
+     lower bound and the remaining ones are skipped once it exceeds the current minimum.
+   - The precision handed to the bisection can be set, 0 (default) aims for machine precision.
+   - The last few results are kept keyed on the exact float inputs, so when the same event is
+     evaluated again (systematic variations which leave the tops and MET unchanged) the
+     bisection is not rerun.  The cache only ever returns a value computed from identical
+     inputs, the result does not depend on whether it was hit.
+ */
+
+class MT2Calculator
+{
+public:
+    MT2Calculator(float precision = 0, unsigned int cacheSize = 16) : precision_(precision), next_(0), nEval_(0), nCacheHit_(0), nSkipped_(0)
+    {
+        cache_.resize(cacheSize);
+    }
+
+    //Absolute precision on MT2 in GeV, must be >= 0
+    void setPrecision(float precision) { precision_ = (precision > 0) ? precision : 0; }
+    float getPrecision() const { return precision_; }
+
+    float get(const TLorentzVector& visA, const TLorentzVector& visB, const TLorentzVector& met)
+    {
+        Inputs in;
+        setSide(in, 0, visA);
+        setSide(in, 3, visB);
+        setMET(in, met);
+        return get(in);
+    }
+
+    //Minimum MT2 over all pairs (i < j) of vis, 0 if there are less than two objects
+    float minOverPairs(const std::vector<TLorentzVector>& vis, const TLorentzVector& met)
+    {
+        unsigned int n = vis.size();
+        if(n < 2) return 0.0;
+
+        sides_.resize(n);
+        for(unsigned int i = 0; i < n; ++i) setSide(sides_[i], 0, vis[i]);
+
+        //lower bound of each pair as the bisection computes it
+        const float invis = static_cast<float>(met.M());
+        pairs_.clear();
+        for(unsigned int i = 0; i < n; ++i)
+        {
+            for(unsigned int j = i + 1; j < n; ++j)
+            {
+                float lb = std::max(sides_[i].v[0] + invis, sides_[j].v[0] + invis);
+                pairs_.push_back(std::make_pair(lb, i*n + j));
+            }
+        }
+        std::sort(pairs_.begin(), pairs_.end());
+
+        float minMT2 = 0.0;
+        bool first = true;
+        for(const auto& pair : pairs_)
+        {
+            //the final sqrt may round the result one ulp below the bound, hence the margin
+            if(!first && pair.first*(1.0f - 1.0e-6f) > minMT2)
+            {
+                nSkipped_ += pairs_.size() - (&pair - &pairs_[0]);
+                break;
+            }
+
+            Inputs in;
+            unsigned int i = pair.second / n, j = pair.second % n;
+            std::copy(sides_[i].v, sides_[i].v + 3, in.v);
+            std::copy(sides_[j].v, sides_[j].v + 3, in.v + 3);
+            setMET(in, met);
+            float mt2 = get(in);
+
+            if(first || mt2 < minMT2) minMT2 = mt2;
+            first = false;
+        }
+        return minMT2;
+    }
+
+    //Bookkeeping: bisections run, results taken from the cache and pairs skipped by the bound
+    unsigned long long getNEvaluations() const { return nEval_; }
+    unsigned long long getNCacheHits() const { return nCacheHit_; }
+    unsigned long long getNSkipped() const { return nSkipped_; }
+
+private:
+    //mA, pxA, pyA, mB, pxB, pyB, pxMiss, pyMiss, mInvis, precision
+    struct Inputs
+    {
+        float v[10];
+        bool operator==(const Inputs& other) const { return std::equal(v, v + 10, other.v); }
+    };
+
+    struct Entry
+    {
+        bool filled;
+        Inputs in;
+        float mt2;
+        Entry() : filled(false), mt2(0) {}
+    };
+
+    float precision_;
+    std::vector<Entry> cache_;
+    unsigned int next_;
+    std::vector<Inputs> sides_;
+    std::vector<std::pair<float, unsigned int>> pairs_;
+    unsigned long long nEval_, nCacheHit_, nSkipped_;
+
+    //asymm_mt2_lester_bisect::get_mT2 on the 10 inputs
+    static float bisect(const float* in);
+
+    static void setSide(Inputs& in, int offset, const TLorentzVector& vis)
+    {
+        in.v[offset]     = vis.M();
+        in.v[offset + 1] = vis.Px();
+        in.v[offset + 2] = vis.Py();
+    }
+
+    void setMET(Inputs& in, const TLorentzVector& met) const
+    {
+        in.v[6] = met.Px();
+        in.v[7] = met.Py();
+        in.v[8] = met.M();
+        in.v[9] = precision_;
+    }
+
+    float get(const Inputs& in)
+    {
+        for(const auto& entry : cache_)
+        {
+            if(entry.filled && entry.in == in)
+            {
+                ++nCacheHit_;
+                return entry.mt2;
+            }
+        }
+
+        ++nEval_;
+        float mt2 = bisect(in.v);
+
+        if(!cache_.empty())
+        {
+            cache_[next_].filled = true;
+            cache_[next_].in = in;
+            cache_[next_].mt2 = mt2;
+            next_ = (next_ + 1) % cache_.size();
+        }
+        return mt2;
+    }
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "MiniTupleMaker.h"
+#include "NTupleTypes.h"
 
 #include "TLorentzVector.h"
 #include <iostream>
@@ -26,55 +27,37 @@ void MiniTupleMaker::setTupleVars(const std::set<std::string> tv)
     for(auto& var : tv) tupleVars_.insert(var);
 }
 
+//Prepares a branch with the C++ type found for the variable in the NTupleTypes table
+struct MiniTupleMaker::BranchPreparer
+{
+    MiniTupleMaker& maker;
+    const NTupleReader& tr;
+    const std::string& var;
+
+    template<typename T> void operator()() const { maker.prepType(tr, var, static_cast<T*>(nullptr)); }
+};
+
 void MiniTupleMaker::initBranches(const NTupleReader& tr)
 {
+    refresh_.clear();
     for(auto& var : tupleVars_)
     {
         std::string type;
         tr.getType(var, type);
 
-        if(type.find("vector") != std::string::npos)
+        if(type.find("vector") != std::string::npos && type.find("*") != std::string::npos)
         {
-            if(type.find("*") != std::string::npos)
-            {
-                throw "MiniTupleMaker::initBranches(...): Vectors of pointers are not allowed in MiniTuples!!!";
-            }
-            else
-            {
-                //Anyone reading this please forgive me, but root made me do it
-                if     (type.find("TLorentzVector") != std::string::npos) prepVec<TLorentzVector>(tr, var);
-                else if(type.find("double")         != std::string::npos) prepVec<double>(tr, var);
-                else if(type.find("float")          != std::string::npos) prepVec<float>(tr, var);
-                else if(type.find("int")            != std::string::npos) prepVec<int>(tr, var);
-                else
-                {
-                    throw "MiniTupleMaker::initBranches(...): Variable type unknown!!! var: " + var + ", type: " + type;           
-                }
-            }
+            throw "MiniTupleMaker::initBranches(...): Vectors of pointers are not allowed in MiniTuples!!!";
         }
-        else
+        if(!NTupleTypes::dispatch(NTupleTypes::findType(type), BranchPreparer{*this, tr, var}))
         {
-            if     (type.find("unsigned int")   != std::string::npos) prepVar<unsigned int>(tr, var);
-            else if(type.find("int")            != std::string::npos) prepVar<int>(tr, var);
-            else if(type.find("double")         != std::string::npos) prepVar<double>(tr, var);
-            else if(type.find("float")          != std::string::npos) prepVar<float>(tr, var);
-            else if(type.find("unsigned short") != std::string::npos) prepVar<unsigned short>(tr, var);
-            else if(type.find("short")          != std::string::npos) prepVar<short>(tr, var);
-            else if(type.find("unsigned char")  != std::string::npos) prepVar<unsigned char>(tr, var);
-            else if(type.find("char")           != std::string::npos) prepVar<char>(tr, var);
-            else if(type.find("bool")           != std::string::npos) prepVar<bool>(tr, var);
-            else if(type.find("unsigned long")  != std::string::npos) prepVar<unsigned long>(tr, var);
-            else if(type.find("long")           != std::string::npos) prepVar<long>(tr, var);
-            else if(type.find("TLorentzVector") != std::string::npos) prepVar<TLorentzVector>(tr, var);
-            else
-            {
-                throw "MiniTupleMaker::initBranches(...): Variable type unknown!!! var: " + var + ", type: " + type;
-            }
+            throw "MiniTupleMaker::initBranches(...): Variable type unknown!!! var: " + var + ", type: " + type;
         }
     }
 }
 
 void MiniTupleMaker::fill()
 {
+    for(auto& refresh : refresh_) refresh();
     tree_->Fill();
 }
@@ -35,12 +35,22 @@ private:
     TFile* const file_;
     TTree* const tree_;
     std::set<std::string> tupleVars_;
+    //bring lazy, converted and columnar variables up to date before each fill
+    std::vector<std::function<void()>> refresh_;
+
+    //Variables are written by their type in the NTupleTypes table
+    struct BranchPreparer;
+    template<typename T> void prepType(const NTupleReader& tr, const std::string& name, T*) { prepVar<T>(tr, name); }
+    template<typename T> void prepType(const NTupleReader& tr, const std::string& name, std::vector<T>*) { prepVec<T>(tr, name); }
 
     template<typename T> void prepVar(const NTupleReader& tr, const std::string& name)
     {
         TBranch *tb = tree_->GetBranch(name.c_str());
         if(!tb) tree_->Branch(name.c_str(), static_cast<T*>(const_cast<void*>(tr.getPtr(name))));
         else       tb->SetAddress(const_cast<void*>(tr.getPtr(name)));
+
+        NTupleReader::VarHandle<T> h = tr.handle<T>(name);
+        refresh_.push_back([h]() { h.get(); });
     }
 
     template<typename T> void prepVec(const NTupleReader& tr, const std::string& name)
@@ -48,6 +58,9 @@ private:
         TBranch *tb = tree_->GetBranch(name.c_str());
         if(!tb) tree_->Branch(name.c_str(), static_cast<std::vector<T>**>(const_cast<void*>(tr.getVecPtr(name))));
         else       tb->SetAddress(const_cast<void*>(tr.getVecPtr(name)));
+
+        NTupleReader::VecHandle<T> h = tr.vecHandle<T>(name);
+        refresh_.push_back([h]() { h.get(); });
     }
 };
 
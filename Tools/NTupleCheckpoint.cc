@@ -0,0 +1,131 @@
+#include "NTupleCheckpoint.h"
+
+#include "TFile.h"
+#include "TH1.h"
+#include "TRandom3.h"
+#include "TParameter.h"
+
+#include <cstdio>
+#include <memory>
+
+NTupleCheckpoint::NTupleCheckpoint(const std::string& fileName, const long long nEvents, const int nSeconds) : fileName_(fileName), nEvents_(nEvents), nSeconds_(nSeconds), eventsSinceWrite_(0), eventsSinceClock_(0), lastWrite_(std::chrono::steady_clock::now()), finished_(false), resumeEntry_(-1)
+{
+}
+
+void NTupleCheckpoint::addHistogram(TH1* hist)
+{
+    if(!hist) THROW_SATEXCEPTION("NTupleCheckpoint::addHistogram(...): null histogram!!!");
+    hists_.push_back(hist);
+}
+
+void NTupleCheckpoint::addHistograms(const std::vector<TH1*>& hists)
+{
+    for(TH1* hist : hists) addHistogram(hist);
+}
+
+void NTupleCheckpoint::addAccumulator(const std::string& name, double* value)
+{
+    if(!value) THROW_SATEXCEPTION("NTupleCheckpoint::addAccumulator(...): null accumulator \"" + name + "\"!!!");
+    accumulators_.emplace_back(name, value);
+}
+
+void NTupleCheckpoint::addRandom(TRandom3* rndm)
+{
+    if(!rndm) THROW_SATEXCEPTION("NTupleCheckpoint::addRandom(...): null random number generator!!!");
+    rndms_.push_back(rndm);
+}
+
+bool NTupleCheckpoint::resume(NTupleReader& tr)
+{
+    FILE* test = fopen(fileName_.c_str(), "r");
+    if(!test) return false;
+    fclose(test);
+
+    std::unique_ptr<TFile> f(TFile::Open(fileName_.c_str(), "READ"));
+    if(!f || f->IsZombie()) THROW_SATEXCEPTION("NTupleCheckpoint::resume(...): could not open checkpoint \"" + fileName_ + "\"!!!");
+
+    TParameter<Long64_t>* nextEntry = nullptr;
+    TParameter<int>* finished = nullptr;
+    TParameter<int>* nHists = nullptr;
+    f->GetObject("nextEntry", nextEntry);
+    f->GetObject("finished", finished);
+    f->GetObject("nHists", nHists);
+    if(!nextEntry || !finished || !nHists) THROW_SATEXCEPTION("NTupleCheckpoint::resume(...): \"" + fileName_ + "\" is not a checkpoint!!!");
+    if(nHists->GetVal() != int(hists_.size())) THROW_SATEXCEPTION("NTupleCheckpoint::resume(...): checkpoint \"" + fileName_ + "\" holds " + std::to_string(nHists->GetVal()) + " histograms but " + std::to_string(hists_.size()) + " are registered!!!");
+
+    for(unsigned int i = 0; i < hists_.size(); ++i)
+    {
+        TH1* saved = nullptr;
+        f->GetObject(("hist" + std::to_string(i)).c_str(), saved);
+        if(!saved || saved->GetNbinsX() != hists_[i]->GetNbinsX() || saved->GetNbinsY() != hists_[i]->GetNbinsY() || saved->GetNbinsZ() != hists_[i]->GetNbinsZ())
+        {
+            THROW_SATEXCEPTION("NTupleCheckpoint::resume(...): histogram " + std::to_string(i) + " of checkpoint \"" + fileName_ + "\" does not match the registered histogram!!!");
+        }
+        hists_[i]->Reset();
+        hists_[i]->Add(saved);
+    }
+
+    for(auto& acc : accumulators_)
+    {
+        TParameter<double>* saved = nullptr;
+        f->GetObject(("acc_" + acc.first).c_str(), saved);
+        if(!saved) THROW_SATEXCEPTION("NTupleCheckpoint::resume(...): accumulator \"" + acc.first + "\" is missing in checkpoint \"" + fileName_ + "\"!!!");
+        *acc.second = saved->GetVal();
+    }
+
+    for(unsigned int i = 0; i < rndms_.size(); ++i)
+    {
+        TRandom3* saved = nullptr;
+        f->GetObject(("rndm" + std::to_string(i)).c_str(), saved);
+        if(!saved) THROW_SATEXCEPTION("NTupleCheckpoint::resume(...): random number generator " + std::to_string(i) + " is missing in checkpoint \"" + fileName_ + "\"!!!");
+        *rndms_[i] = *saved;
+    }
+
+    finished_ = finished->GetVal() != 0;
+    resumeEntry_ = nextEntry->GetVal();
+    f->Close();
+
+    //keep the end of the range this job was given, a finished job reads nothing more
+    int last = tr.getEntryRangeEnd();
+    if(last >= 0 && resumeEntry_ > last) THROW_SATEXCEPTION("NTupleCheckpoint::resume(...): checkpoint \"" + fileName_ + "\" is beyond the entry range of the reader!!!");
+    tr.setEntryRange(resumeEntry_, finished_ ? resumeEntry_ : last);
+
+    eventsSinceWrite_ = eventsSinceClock_ = 0;
+    lastWrite_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+void NTupleCheckpoint::write(const int nextEntry, const bool finished)
+{
+    const std::string tmpName = fileName_ + ".tmp";
+    {
+        std::unique_ptr<TFile> f(TFile::Open(tmpName.c_str(), "RECREATE"));
+        if(!f || f->IsZombie()) THROW_SATEXCEPTION("NTupleCheckpoint::write(...): could not open \"" + tmpName + "\" for writing!!!");
+
+        TParameter<Long64_t> pNextEntry("nextEntry", nextEntry);
+        TParameter<int> pFinished("finished", finished ? 1 : 0);
+        TParameter<int> pNHists("nHists", hists_.size());
+        f->WriteTObject(&pNextEntry);
+        f->WriteTObject(&pFinished);
+        f->WriteTObject(&pNHists);
+
+        //WriteTObject does not move the histograms out of their directory
+        for(unsigned int i = 0; i < hists_.size(); ++i) f->WriteTObject(hists_[i], ("hist" + std::to_string(i)).c_str());
+
+        for(auto& acc : accumulators_)
+        {
+            TParameter<double> pAcc(("acc_" + acc.first).c_str(), *acc.second);
+            f->WriteTObject(&pAcc);
+        }
+
+        for(unsigned int i = 0; i < rndms_.size(); ++i) f->WriteTObject(rndms_[i], ("rndm" + std::to_string(i)).c_str());
+
+        f->Close();
+    }
+
+    if(std::rename(tmpName.c_str(), fileName_.c_str()) != 0) THROW_SATEXCEPTION("NTupleCheckpoint::write(...): could not move \"" + tmpName + "\" to \"" + fileName_ + "\"!!!");
+
+    finished_ = finished;
+    eventsSinceWrite_ = eventsSinceClock_ = 0;
+    lastWrite_ = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,93 @@
+#ifndef NTUPLE_CHECKPOINT_H
+#define NTUPLE_CHECKPOINT_H
+
+#include "NTupleReader.h"
+
+#include <vector>
+#include <string>
+#include <chrono>
+
+class TH1;
+class TRandom3;
+
+/* Periodically saves the state of an event loop so a preempted job picks up where it stopped
+   instead of starting again from the first entry of its chunk
+
+   NTupleCheckpoint checkpoint("/scratch/job_3.ckpt.root", 50000, 600);
+   checkpoint.addHistogram(hMET);
+   checkpoint.addAccumulator("nSelected", &nSelected);
+   checkpoint.addRandom(&rndm);
+   checkpoint.resume(tr);
+   while(tr.getNextEvent())
+   {
+       ... fill ...
+       checkpoint.update(tr);
+   }
+   checkpoint.finish(tr);
+
+   A checkpoint is written after every nEvents processed entries or every nSeconds seconds,
+   whichever comes first (0 disables that trigger).  It holds the next entry to be read, the
+   content of the registered histograms, the registered accumulators and the state of the
+   registered random number generators.  It is first written to <file>.tmp and then renamed,
+   so a job killed while writing leaves the previous checkpoint intact.
+
+   resume() restores all registered objects from an existing checkpoint and moves the reader
+   to the saved entry, keeping the entry range end set on the reader.  finish() marks the job
+   as done, resuming a finished checkpoint restores the final state and reads no event.
+   Everything must be registered before resume(), in the same order as when it was written.
+ */
+
+class NTupleCheckpoint
+{
+public:
+    NTupleCheckpoint(const std::string& fileName, const long long nEvents = 100000, const int nSeconds = 0);
+
+    void addHistogram(TH1* hist);
+    void addHistograms(const std::vector<TH1*>& hists);
+    void addAccumulator(const std::string& name, double* value);
+    void addRandom(TRandom3* rndm);
+
+    //Restore the saved state if a checkpoint exists, returns false if the job starts from scratch
+    bool resume(NTupleReader& tr);
+
+    //Call once per processed event, cheap unless a checkpoint is due
+    inline void update(const NTupleReader& tr)
+    {
+        if(nEvents_ > 0 && ++eventsSinceWrite_ >= nEvents_) write(tr.getEvtNum(), false);
+        else if(nSeconds_ > 0 && ++eventsSinceClock_ >= clockInterval_)
+        {
+            eventsSinceClock_ = 0;
+            if(std::chrono::steady_clock::now() - lastWrite_ >= std::chrono::seconds(nSeconds_)) write(tr.getEvtNum(), false);
+        }
+    }
+
+    //Write the final state, marked as finished
+    void finish(const NTupleReader& tr) { write(tr.getEvtNum(), true); }
+
+    //Write a checkpoint now
+    void write(const int nextEntry, const bool finished);
+
+    bool isFinished() const { return finished_; }
+    int getResumeEntry() const { return resumeEntry_; }
+    const std::string& getFileName() const { return fileName_; }
+
+private:
+    //the clock is looked at only every clockInterval_ events
+    static const int clockInterval_ = 1000;
+
+    std::string fileName_;
+    long long nEvents_;
+    int nSeconds_;
+    long long eventsSinceWrite_;
+    int eventsSinceClock_;
+    std::chrono::steady_clock::time_point lastWrite_;
+
+    std::vector<TH1*> hists_;
+    std::vector<std::pair<std::string, double*>> accumulators_;
+    std::vector<TRandom3*> rndms_;
+
+    bool finished_;
+    int resumeEntry_;
+};
+
+#endif
@@ -1,11 +1,27 @@
 #include "NTupleReader.h"
+#include "ColumnarTupleReader.h"
+#include "NTupleTypes.h"
 
 #include "TROOT.h"
 #include "TInterpreter.h"
 #include "TObjArray.h"
+#include "TList.h"
+#include "TFriendElement.h"
 #include "TLeaf.h"
+#include "TBasket.h"
+#include "TEnv.h"
+#include "TTreeCacheUnzip.h"
 
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+#include <new>
 
 //specialization for bool return value
 template<>
@@ -22,6 +38,148 @@ public:
     FuncWrapperImpl(std::function<bool(NTupleReader&)> f) : func_(f) {}
 };
 
+//Workers take the functions of a level by index, the calling thread runs the first one
+class NTupleReader::FunctionPool
+{
+private:
+    NTupleReader& tr_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_, done_;
+    const std::vector<FuncWrapper*>* level_;
+    size_t next_, remaining_;
+    bool passFilters_, stop_;
+    std::exception_ptr error_;
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while(true)
+        {
+            wake_.wait(lock, [this]() { return stop_ || (level_ && next_ < level_->size()); });
+            if(stop_) return;
+
+            FuncWrapper* func = (*level_)[next_++];
+            lock.unlock();
+            bool pass = false;
+            std::exception_ptr error;
+            try
+            {
+                pass = tr_.runFunction(func);
+            }
+            catch(...)
+            {
+                error = std::current_exception();
+            }
+            lock.lock();
+
+            passFilters_ = passFilters_ && pass;
+            if(error && !error_) error_ = error;
+            if(--remaining_ == 0) done_.notify_one();
+        }
+    }
+
+public:
+    FunctionPool(NTupleReader& tr) : tr_(tr), level_(nullptr), next_(0), remaining_(0), passFilters_(true), stop_(false) {}
+
+    ~FunctionPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for(auto& thread : threads_) thread.join();
+    }
+
+    //Run every function of the level, returns once all of them finished.  The first exception
+    //thrown by any of them is rethrown
+    bool run(const std::vector<FuncWrapper*>& level)
+    {
+        while(threads_.size() + 1 < level.size()) threads_.emplace_back(&FunctionPool::work, this);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            level_ = &level;
+            next_ = 1;
+            remaining_ = level.size() - 1;
+            passFilters_ = true;
+            error_ = nullptr;
+        }
+        wake_.notify_all();
+
+        bool pass = false;
+        std::exception_ptr error;
+        try
+        {
+            pass = tr_.runFunction(level.front());
+        }
+        catch(...)
+        {
+            error = std::current_exception();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]() { return remaining_ == 0; });
+        level_ = nullptr;
+        if(error) std::rethrow_exception(error);
+        if(error_) std::rethrow_exception(error_);
+        return pass && passFilters_;
+    }
+};
+
+namespace
+{
+    //operator new calls and bytes of the calling thread, only counted with SAT_COUNT_ALLOCATIONS
+    thread_local long long threadAllocations = 0;
+    thread_local long long threadAllocatedBytes = 0;
+#ifdef SAT_COUNT_ALLOCATIONS
+    const bool countingAllocations = true;
+#else
+    const bool countingAllocations = false;
+#endif
+
+    inline double wallClock()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //CPU time of the calling thread, so functions running in parallel are accounted correctly
+    inline double cpuClock()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec + 1e-9*ts.tv_nsec;
+    }
+}
+
+#ifdef SAT_COUNT_ALLOCATIONS
+//Counting global operator new for the allocations of the timing summary.  It replaces operator new
+//of the whole program, so it is only built with -DSAT_COUNT_ALLOCATIONS
+void* operator new(size_t size)
+{
+    ++threadAllocations;
+    threadAllocatedBytes += size;
+    if(void* ptr = malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+#endif
+
 NTupleReader::NTupleReader(TTree * tree, const std::set<std::string>& activeBranches) : activeBranches_(activeBranches)
 {
     tree_ = tree;
@@ -35,6 +193,14 @@ NTupleReader::NTupleReader(TTree * tree)
     init();
 }
 
+NTupleReader::NTupleReader(ColumnarTupleReader * columns)
+{
+    tree_ = nullptr;
+    columns_ = columns;
+    if(!columns_) THROW_SATEXCEPTION("NTupleReader(...): ColumnarTupleReader is invalid!!!!");
+    init();
+}
+
 NTupleReader::NTupleReader()
 {
     tree_ = nullptr;
@@ -43,18 +209,33 @@ NTupleReader::NTupleReader()
 
 NTupleReader::~NTupleReader()
 {
-    //Clean up any remaining dynamic memory
+    //Clean up any remaining dynamic memory, the worker threads are stopped first
+    delete functionPool_;
     for(auto& branch : branchMap_)    if(branch.second.ptr) branch.second.destroy();
     for(auto& branch : branchVecMap_) if(branch.second.ptr) branch.second.destroy();
     for(auto& funcWrapPtr : functionVec_) if(funcWrapPtr) delete funcWrapPtr;
+    for(auto& lazyPtr : lazyVec_) if(lazyPtr) delete lazyPtr;
 }
 
 void NTupleReader::init()
 {
+    static std::atomic<unsigned long long> nextInstanceId(0);
+    instanceId_ = ++nextInstanceId;
     nevt_ = evtProcessed_ = 0;
+    lastEntry_ = -1;
     isUpdateDisabled_ = false;
     reThrow_ = true;
     convertHackActive_ = false;
+    scheduleDirty_ = true;
+    parallelFunctions_ = false;
+    functionPool_ = nullptr;
+    cacheSize_ = 0;
+    cacheLearnEntries_ = 0;
+    cacheTreeNumber_ = -1;
+    maxCacheBytes_ = 0;
+    maxVectorBytes_ = 0;
+    shrinkInterval_ = 0;
+    timingActive_ = false;
 
     if(tree_)
     {
@@ -63,11 +244,15 @@ void NTupleReader::init()
         // Add desired branches to branchMap_/branchVecMap_
         populateBranchList();
     }
+    else if(columns_)
+    {
+        populateColumnList();
+    }
 }
 
 void NTupleReader::setTree(TTree * tree)
 {
-    if(!tree_)
+    if(!tree_ && !columns_)
     {
         tree_ = tree;
         tree_->SetBranchStatus("*", 0);
@@ -83,6 +268,7 @@ void NTupleReader::setTree(TTree * tree)
 
 std::string NTupleReader::getFileName() const
 {
+    if(columns_) return columns_->getFileName();
     return std::string( tree_->GetCurrentFile()->GetName() );
 }
 
@@ -91,6 +277,7 @@ int NTupleReader::getNEntries() const
     try
     {
         if(tree_) return tree_->GetEntries();
+        else if(columns_) return columns_->getEntries();
         else 
         {
             THROW_SATEXCEPTION("NO tree defined yet!!!");
@@ -105,7 +292,21 @@ int NTupleReader::getNEntries() const
 
 void NTupleReader::populateBranchList()
 {
-    TObjArray *lob = tree_->GetListOfBranches();
+    populateBranchList(tree_->GetListOfBranches());
+
+    //branches of friend trees (e.g. the eventFilterBits sidecar) are read through tree_ by name
+    if(TList* friends = tree_->GetListOfFriends())
+    {
+        TIter nextFriend(friends);
+        while(TFriendElement* fe = (TFriendElement*)nextFriend())
+        {
+            if(TTree* friendTree = fe->GetTree()) populateBranchList(friendTree->GetListOfBranches());
+        }
+    }
+}
+
+void NTupleReader::populateBranchList(TObjArray* lob)
+{
     TIter next(lob);
     TBranch *branch;
 
@@ -113,6 +314,9 @@ void NTupleReader::populateBranchList()
     {
         std::string name(branch->GetName());
 
+        //a name already found in the main tree shadows the friend branch
+        if(typeMap_.count(name)) continue;
+
         if(activeBranches_.size() > 0 && activeBranches_.count(name) == 0)
         {
             //allow typeMap_ to track that the branch exists without filling type
@@ -124,68 +328,143 @@ void NTupleReader::populateBranchList()
     }
 }
 
+//Registers a branch with the C++ type found for it in the NTupleTypes table
+struct NTupleReader::BranchRegistrar
+{
+    const NTupleReader& tr;
+    const std::string& name;
+
+    template<typename T> void operator()() const { tr.registerBranchOfType(name, static_cast<T*>(nullptr)); }
+};
+
 void NTupleReader::registerBranch(TBranch * const branch) const
 {
-    std::string type(branch->GetTitle());
     std::string name(branch->GetName());
 
-    if(type.compare(name) == 0)
+    if(!NTupleTypes::dispatch(NTupleTypes::findBranchType(branch), BranchRegistrar{*this, name}))
     {
+        std::string type(branch->GetTitle());
         TObjArray *lol = branch->GetListOfLeaves();
-        if (lol->GetEntries() == 1) 
-        {
-            TLeaf *leaf = (TLeaf*)lol->UncheckedAt(0);
-            type = leaf->GetTypeName();
-        }
+        if(type.compare(name) == 0 && lol->GetEntries() == 1) type = ((TLeaf*)lol->UncheckedAt(0))->GetTypeName();
+        THROW_SATEXCEPTION("No type match for branch \"" + name + "\" with type \"" + type + "\"!!!");
+    }
+}
+
+//Lazy variable copying one scalar column of the current entry out of the columnar file
+template<typename T>
+class NTupleReader::ColumnVar : public LazyVarBase
+{
+private:
+    ColumnarTupleReader* columns_;
+    unsigned int iCol_;
+public:
+    ColumnVar(ColumnarTupleReader* columns, const unsigned int iCol) : columns_(columns), iCol_(iCol) {}
+
+    static void read(const char* data, T& value) { memcpy(&value, data, sizeof(T)); }
+
+    virtual void evaluate(NTupleReader& tr, void* loc)
+    {
+        unsigned int n;
+        read(columns_->getData(iCol_, tr.nevt_ - 1, n), *static_cast<T*>(loc));
     }
+};
+
+template<> void NTupleReader::ColumnVar<bool>::read(const char* data, bool& value)
+{
+    value = (data[0] != 0);
+}
+
+template<> void NTupleReader::ColumnVar<TLorentzVector>::read(const char* data, TLorentzVector& value)
+{
+    double p[4];
+    memcpy(p, data, sizeof(p));
+    value.SetPxPyPzE(p[0], p[1], p[2], p[3]);
+}
+
+//Same for vector columns, the vector is reused from event to event
+template<typename T>
+class NTupleReader::ColumnVec : public LazyVarBase
+{
+private:
+    ColumnarTupleReader* columns_;
+    unsigned int iCol_;
+public:
+    ColumnVec(ColumnarTupleReader* columns, const unsigned int iCol) : columns_(columns), iCol_(iCol) {}
+
+    static void read(const char* data, const unsigned int n, std::vector<T>& vec)
+    {
+        vec.resize(n);
+        if(n > 0) memcpy(vec.data(), data, n*sizeof(T));
+    }
+
+    virtual void evaluate(NTupleReader& tr, void* loc)
+    {
+        std::vector<T>*& vec = *static_cast<std::vector<T>**>(loc);
+        if(vec == nullptr) vec = new std::vector<T>();
+        unsigned int n;
+        const char* data = columns_->getData(iCol_, tr.nevt_ - 1, n);
+        read(data, n, *vec);
+    }
+};
+
+template<> void NTupleReader::ColumnVec<bool>::read(const char* data, const unsigned int n, std::vector<bool>& vec)
+{
+    vec.resize(n);
+    for(unsigned int i = 0; i < n; ++i) vec[i] = (data[i] != 0);
+}
 
-    if(type.find("vector<vector") != std::string::npos)
-    {
-        if     (type.find("double")         != std::string::npos) registerVecBranch<std::vector<double>>(name);
-        else if(type.find("unsigned int")   != std::string::npos) registerVecBranch<std::vector<unsigned int>>(name);
-        else if(type.find("unsigned long")  != std::string::npos) registerVecBranch<std::vector<unsigned long>>(name);
-        else if(type.find("unsigned char")  != std::string::npos) registerVecBranch<std::vector<unsigned char>>(name);
-        else if(type.find("unsigned short") != std::string::npos) registerVecBranch<std::vector<unsigned short>>(name);
-        else if(type.find("short")          != std::string::npos) registerVecBranch<std::vector<short>>(name);
-        else if(type.find("char")           != std::string::npos) registerVecBranch<std::vector<char>>(name);
-        else if(type.find("int")            != std::string::npos) registerVecBranch<std::vector<int>>(name);
-        else if(type.find("bool")           != std::string::npos) registerVecBranch<std::vector<bool>>(name);
-        else if(type.find("string")         != std::string::npos) registerVecBranch<std::vector<std::string>>(name);
-        else if(type.find("TLorentzVector") != std::string::npos) registerVecBranch<std::vector<TLorentzVector>>(name);
-        else if(type.find("float")          != std::string::npos) registerVecBranch<std::vector<float>>(name);
-        else THROW_SATEXCEPTION("No type match for branch \"" + name + "\" with type \"" + type + "\"!!!");
-    }
-    else if(type.find("vector") != std::string::npos)
-    {
-        if     (type.find("double")         != std::string::npos) registerVecBranch<double>(name);
-        else if(type.find("unsigned int")   != std::string::npos) registerVecBranch<unsigned int>(name);
-        else if(type.find("unsigned long")  != std::string::npos) registerVecBranch<unsigned long>(name);
-        else if(type.find("unsigned char")  != std::string::npos) registerVecBranch<unsigned char>(name);
-        else if(type.find("unsigned short") != std::string::npos) registerVecBranch<unsigned short>(name);
-        else if(type.find("short")          != std::string::npos) registerVecBranch<short>(name);
-        else if(type.find("char")           != std::string::npos) registerVecBranch<char>(name);
-        else if(type.find("int")            != std::string::npos) registerVecBranch<int>(name);
-        else if(type.find("bool")           != std::string::npos) registerVecBranch<bool>(name);
-        else if(type.find("string")         != std::string::npos) registerVecBranch<std::string>(name);
-        else if(type.find("TLorentzVector") != std::string::npos) registerVecBranch<TLorentzVector>(name);
-        else if(type.find("float")          != std::string::npos) registerVecBranch<float>(name);
-        else THROW_SATEXCEPTION("No type match for branch \"" + name + "\" with type \"" + type + "\"!!!");
+template<> void NTupleReader::ColumnVec<TLorentzVector>::read(const char* data, const unsigned int n, std::vector<TLorentzVector>& vec)
+{
+    vec.resize(n);
+    for(unsigned int i = 0; i < n; ++i) ColumnVar<TLorentzVector>::read(data + i*4*sizeof(double), vec[i]);
+}
+
+template<typename T> void NTupleReader::registerColumn(const std::string& name, const unsigned int iCol, const bool isVector)
+{
+    if(isVector)
+    {
+        lazyVec_.push_back(new ColumnVec<T>(columns_, iCol));
+        Handle h = createVecHandle(new std::vector<T>*());
+        h.lazy = lazyVec_.back();
+        branchVecMap_.insert(std::make_pair(name, h));
+
+        typeMap_[name] = demangle<std::vector<T>>();
     }
     else
     {
-        if     (type.find("/D") != std::string::npos) registerBranch<double>(name);
-        else if(type.find("/I") != std::string::npos) registerBranch<int>(name);
-        else if(type.find("/i") != std::string::npos) registerBranch<unsigned int>(name);
-        else if(type.find("/F") != std::string::npos) registerBranch<float>(name);
-        else if(type.find("/C") != std::string::npos) registerBranch<char>(name);
-        else if(type.find("/c") != std::string::npos) registerBranch<unsigned char>(name);
-        else if(type.find("/S") != std::string::npos) registerBranch<short>(name);
-        else if(type.find("/s") != std::string::npos) registerBranch<unsigned short>(name);
-        else if(type.find("/O") != std::string::npos) registerBranch<bool>(name);
-        else if(type.find("/L") != std::string::npos) registerBranch<unsigned long>(name);
-        else if(type.find("/l") != std::string::npos) registerBranch<long>(name);
-        else if(type.find("/b") != std::string::npos) registerBranch<bool>(name);
-        else THROW_SATEXCEPTION("No type match for branch \"" + name + "\" with type \"" + type + "\"!!!");
+        lazyVec_.push_back(new ColumnVar<T>(columns_, iCol));
+        Handle h = createHandle(new T());
+        h.lazy = lazyVec_.back();
+        branchMap_.insert(std::make_pair(name, h));
+
+        typeMap_[name] = demangle<T>();
+    }
+    activatedBranches_.push_back(name);
+}
+
+void NTupleReader::populateColumnList()
+{
+    const std::vector<ColumnarTupleReader::Column>& columns = columns_->getColumns();
+    for(unsigned int iCol = 0; iCol < columns.size(); ++iCol)
+    {
+        const std::string& name = columns[iCol].name;
+        const bool isVector = columns[iCol].isVector;
+        switch(columns[iCol].type)
+        {
+        case ColumnarFormat::kDouble:         registerColumn<double>(name, iCol, isVector);         break;
+        case ColumnarFormat::kFloat:          registerColumn<float>(name, iCol, isVector);          break;
+        case ColumnarFormat::kInt:            registerColumn<int>(name, iCol, isVector);            break;
+        case ColumnarFormat::kUInt:           registerColumn<unsigned int>(name, iCol, isVector);   break;
+        case ColumnarFormat::kShort:          registerColumn<short>(name, iCol, isVector);          break;
+        case ColumnarFormat::kUShort:         registerColumn<unsigned short>(name, iCol, isVector); break;
+        case ColumnarFormat::kChar:           registerColumn<char>(name, iCol, isVector);           break;
+        case ColumnarFormat::kUChar:          registerColumn<unsigned char>(name, iCol, isVector);  break;
+        case ColumnarFormat::kBool:           registerColumn<bool>(name, iCol, isVector);           break;
+        case ColumnarFormat::kLong:           registerColumn<long>(name, iCol, isVector);           break;
+        case ColumnarFormat::kULong:          registerColumn<unsigned long>(name, iCol, isVector);  break;
+        case ColumnarFormat::kTLorentzVector: registerColumn<TLorentzVector>(name, iCol, isVector); break;
+        default: THROW_SATEXCEPTION("No type match for column \"" + name + "\"!!!");
+        }
     }
 }
 
@@ -200,7 +479,33 @@ bool NTupleReader::goToEventInternal(int evt, const bool filter)
     bool passFilters = false;
     do
     {
-        status = tree_->GetEntry(evt);
+        if(lastEntry_ >= 0 && evt >= lastEntry_) return false;
+        //the previous event is done with, so its buffers may be reallocated
+        if(shrinkInterval_ > 0 && evtProcessed_ > 0 && evtProcessed_%shrinkInterval_ == 0) shrinkBuffers(maxVectorBytes_);
+        if(cacheSize_ > 0)
+        {
+            //load the tree first so the cache can be refreshed when a TChain opens a new file
+            tree_->LoadTree(evt);
+            if(tree_->GetTreeNumber() != cacheTreeNumber_) updateCache();
+        }
+        if(columns_)
+        {
+            //columns are read when accessed, so there is nothing to load here
+            status = (evt < columns_->getEntries()) ? 1 : 0;
+        }
+        else if(timingActive_)
+        {
+            double wall = wallClock(), cpu = cpuClock();
+            status = tree_->GetEntry(evt);
+            timingReadWall_ += wallClock() - wall;
+            timingReadCpu_  += cpuClock() - cpu;
+            if(status > 0)
+            {
+                timingBytesUnzipped_ += status;
+                ++timingEvents_;
+            }
+        }
+        else status = tree_->GetEntry(evt);
         if (status == 0) return false;
         nevt_ = evt + 1;
         ++evtProcessed_;
@@ -215,6 +520,15 @@ bool NTupleReader::getNextEvent()
     return goToEventInternal(nevt_, true);
 }
 
+void NTupleReader::setEntryRange(int first, int last)
+{
+    if(first < 0 || (last >= 0 && last < first)) THROW_SATEXCEPTION("NTupleReader::setEntryRange(...): invalid entry range!!!");
+    nevt_ = first;
+    lastEntry_ = last;
+    //keep the cache from prefetching baskets of the entries of other jobs
+    if(tree_ && cacheSize_ > 0 && lastEntry_ >= 0) tree_->SetCacheEntryRange(nevt_, lastEntry_);
+}
+
 void NTupleReader::disableUpdate()
 {
     isUpdateDisabled_ = true;
@@ -223,26 +537,176 @@ void NTupleReader::disableUpdate()
 
 bool NTupleReader::calculateDerivedVariables()
 {
-    for(auto& func : functionVec_)
+    if(scheduleDirty_) buildSchedule();
+
+    for(auto& level : schedule_)
     {
-        if(!(*func)(*this))
+        //the first event always runs serially as it registers the derived variables
+        if(parallelFunctions_ && level.size() > 1 && !isFirstEvent())
         {
-            return false;
+            if(!functionPool_) functionPool_ = new FunctionPool(*this);
+            if(!functionPool_->run(level)) return false;
+        }
+        else
+        {
+            for(auto& func : level)
+            {
+                if(!runFunction(func))
+                {
+                    return false;
+                }
+            }
         }
     }
 
     return true;
 }
 
+bool NTupleReader::runFunction(FuncWrapper* func)
+{
+    if(!timingActive_) return (*func)(*this);
+
+    const long long allocations = threadAllocations, allocatedBytes = threadAllocatedBytes;
+    double wall = wallClock(), cpu = cpuClock();
+    bool passFilters = (*func)(*this);
+    func->wallTime += wallClock() - wall;
+    func->cpuTime  += cpuClock() - cpu;
+    func->allocations    += threadAllocations - allocations;
+    func->allocatedBytes += threadAllocatedBytes - allocatedBytes;
+    ++func->nCalls;
+
+    return passFilters;
+}
+
+void NTupleReader::addFunction(FuncWrapper* func, const FuncDeps& deps, const std::string& name)
+{
+    func->name = name;
+    functionVec_.emplace_back(func);
+    functionDeps_.push_back(deps);
+    scheduleDirty_ = true;
+}
+
+void NTupleReader::buildSchedule()
+{
+    const int nFunc = functionVec_.size();
+
+    //find the function producing each declared variable
+    std::unordered_map<std::string, int> producers;
+    for(int i = 0; i < nFunc; ++i)
+    {
+        for(const auto& var : functionDeps_[i].produces)
+        {
+            if(!producers.insert(std::make_pair(var, i)).second) THROW_SATEXCEPTION("Variable \"" + var + "\" is declared as produced by more than one function!!!");
+        }
+    }
+
+    //data dependencies from declared reads, and ordering constraints from undeclared functions
+    std::vector<std::set<int>> dataDeps(nFunc), orderDeps(nFunc);
+    int lastBarrier = -1;
+    for(int i = 0; i < nFunc; ++i)
+    {
+        if(functionDeps_[i].declared)
+        {
+            if(lastBarrier >= 0) orderDeps[i].insert(lastBarrier);
+            for(const auto& var : functionDeps_[i].reads)
+            {
+                auto producer = producers.find(var);
+                if(producer != producers.end() && producer->second != i) dataDeps[i].insert(producer->second);
+            }
+        }
+        else
+        {
+            for(int j = 0; j < i; ++j) orderDeps[i].insert(j);
+            lastBarrier = i;
+        }
+    }
+
+    //undeclared functions always run, declared ones only if their products are needed
+    std::vector<bool> needed(nFunc, requestedVars_.empty());
+    if(!requestedVars_.empty())
+    {
+        std::vector<int> toVisit;
+        for(int i = 0; i < nFunc; ++i) if(!functionDeps_[i].declared) toVisit.push_back(i);
+        for(const auto& var : requestedVars_)
+        {
+            auto producer = producers.find(var);
+            if(producer != producers.end()) toVisit.push_back(producer->second);
+        }
+        while(!toVisit.empty())
+        {
+            int i = toVisit.back();
+            toVisit.pop_back();
+            if(needed[i]) continue;
+            needed[i] = true;
+            for(int j : dataDeps[i]) toVisit.push_back(j);
+        }
+    }
+
+    //topological sort into levels, ties are resolved by registration order
+    std::vector<int> level(nFunc, -1);
+    int nNeeded = 0, nPlaced = 0;
+    for(int i = 0; i < nFunc; ++i) if(needed[i]) ++nNeeded;
+    bool progress = true;
+    while(nPlaced < nNeeded && progress)
+    {
+        progress = false;
+        for(int i = 0; i < nFunc; ++i)
+        {
+            if(!needed[i] || level[i] >= 0) continue;
+
+            int iLevel = 0;
+            bool ready = true;
+            for(const std::set<int>* deps : {&dataDeps[i], &orderDeps[i]})
+            {
+                for(int j : *deps)
+                {
+                    if(!needed[j]) continue;
+                    if(level[j] < 0) ready = false;
+                    else if(level[j] + 1 > iLevel) iLevel = level[j] + 1;
+                }
+            }
+
+            if(ready)
+            {
+                level[i] = iLevel;
+                ++nPlaced;
+                progress = true;
+            }
+        }
+    }
+    if(nPlaced < nNeeded) THROW_SATEXCEPTION("The declared reads/produces of the registered functions form a cycle!!!");
+
+    schedule_.clear();
+    for(int i = 0; i < nFunc; ++i)
+    {
+        if(level[i] < 0) continue;
+        if(level[i] >= static_cast<int>(schedule_.size())) schedule_.resize(level[i] + 1);
+        schedule_[level[i]].push_back(functionVec_[i]);
+    }
+
+    scheduleDirty_ = false;
+}
+
+void NTupleReader::setRequestedVars(const std::set<std::string>& vars)
+{
+    requestedVars_ = vars;
+    scheduleDirty_ = true;
+}
+
+void NTupleReader::setParallelFunctions(const bool parallel)
+{
+    parallelFunctions_ = parallel;
+}
+
 void NTupleReader::registerFunction(void (*f)(NTupleReader&))
 {
-    if(isFirstEvent()) functionVec_.emplace_back(new FuncWrapperImpl<std::function<void(NTupleReader&)>>(std::function<void(NTupleReader&)>(f)));
+    if(isFirstEvent()) addFunction(new FuncWrapperImpl<std::function<void(NTupleReader&)>>(std::function<void(NTupleReader&)>(f)), FuncDeps(), "void (*)(NTupleReader&)");
     else THROW_SATEXCEPTION("new functions cannot be registered after tuple reading begins!");
 }
 
 void NTupleReader::registerFunction(bool (*f)(NTupleReader&))
 {
-    if(isFirstEvent()) functionVec_.emplace_back(new FuncWrapperImpl<std::function<bool(NTupleReader&)>>(std::function<bool(NTupleReader&)>(f)));
+    if(isFirstEvent()) addFunction(new FuncWrapperImpl<std::function<bool(NTupleReader&)>>(std::function<bool(NTupleReader&)>(f)), FuncDeps(), "bool (*)(NTupleReader&)");
     else THROW_SATEXCEPTION("new functions cannot be registered after tuple reading begins!");
 }
 
@@ -279,8 +743,8 @@ void NTupleReader::addAlias(const std::string& name, const std::string& alias)
         //Check if this variable is already registered and register it if not 
         if(branch_iter == branchMap_.end() && branchVec_iter == branchVecMap_.end())
         {
-            //If found in typeMap_, it can be added on the fly
-            TBranch *branch = tree_->FindBranch(name.c_str());
+            //If found in typeMap_, it can be added on the fly (columns are all registered already)
+            TBranch *branch = tree_ ? tree_->FindBranch(name.c_str()) : nullptr;
         
             //If branch not found continue on to throw exception
             if(branch != nullptr)
@@ -295,16 +759,18 @@ void NTupleReader::addAlias(const std::string& name, const std::string& alias)
         branch_iter = branchMap_.find(name);
         branchVec_iter = branchVecMap_.find(name);
 
+        aliasMap_[alias] = name;
+
         //Set the "fake" handle for the alias 
         //Check branchMap for "name"
         if(branch_iter != branchMap_.end())
         {
-            branchMap_[alias] = Handle(branch_iter->second.ptr, nullptr, branch_iter->second.type);
+            branchMap_[alias] = Handle(branch_iter->second.ptr, nullptr, branch_iter->second.type, branch_iter->second.lazy);
         }
         //If the variable name is not in branchMap, check branchVecMap
         else if(branchVec_iter != branchVecMap_.end())
         {
-            branchVecMap_[alias] = Handle(branchVec_iter->second.ptr, nullptr, branchVec_iter->second.type);
+            branchVecMap_[alias] = Handle(branchVec_iter->second.ptr, nullptr, branchVec_iter->second.type, branchVec_iter->second.lazy);
         }
     }
     else
@@ -321,6 +787,8 @@ const void* NTupleReader::getPtr(const std::string& var) const
         auto tuple_iter = branchMap_.find(var);
         if(tuple_iter != branchMap_.end())
         {
+            tuple_iter->second.accessed = true;
+            if(tuple_iter->second.lazy) updateLazy(tuple_iter->second);
             return tuple_iter->second.ptr;
         }
 
@@ -342,6 +810,8 @@ const void* NTupleReader::getVecPtr(const std::string& var) const
         auto tuple_iter = branchVecMap_.find(var);
         if(tuple_iter != branchVecMap_.end())
         {
+            tuple_iter->second.accessed = true;
+            if(tuple_iter->second.lazy) updateLazy(tuple_iter->second);
             return tuple_iter->second.ptr;
         }
 
@@ -362,157 +832,326 @@ void NTupleReader::printTupleMembers(FILE *f) const
     }
 }
 
-std::vector<std::string> NTupleReader::getTupleMembers() const
+void NTupleReader::setIOCache(const long long cacheSize, const int learnEntries, const bool asyncPrefetch)
 {
-    std::vector<std::string> members;
-    for(auto& iVar : typeMap_)
+    if(!tree_) THROW_SATEXCEPTION("NTupleReader::setIOCache(...): NO tree defined yet!!!");
+
+    if(asyncPrefetch)
     {
-        members.push_back(iVar.first);
+        gEnv->SetValue("TFile.AsyncPrefetching", 1);
+        TTreeCacheUnzip::SetParallelUnzip(TTreeCacheUnzip::kEnable);
     }
-    return members;
+
+    cacheSize_ = (cacheSize > 0) ? cacheSize : 0;
+    if(maxCacheBytes_ > 0 && cacheSize_ > maxCacheBytes_) cacheSize_ = maxCacheBytes_;
+    cacheLearnEntries_ = learnEntries;
+    cacheTreeNumber_ = -1;
+
+    tree_->SetCacheSize(cacheSize_);
+    if(cacheSize_ > 0) updateCache();
+    if(cacheSize_ > 0 && lastEntry_ >= 0) tree_->SetCacheEntryRange(nevt_, lastEntry_);
 }
 
-std::vector<std::string> NTupleReader::getTupleSpecs(const std::string& varName) const
+void NTupleReader::updateCache()
 {
-    std::vector<std::string> members = getTupleMembers();
-    std::vector<std::string> specs;
-    for(auto &member : members)
+    cacheTreeNumber_ = tree_->GetTreeNumber();
+
+    if(cacheLearnEntries_ > 0)
     {
-        std::string::size_type t= member.find(varName);
-        if (t != std::string::npos)
-        {
-            specs.push_back(member.erase(t, varName.length()));
-        }
+        tree_->SetCacheLearnEntries(cacheLearnEntries_);
+    }
+    else
+    {
+        for(const auto& name : activatedBranches_) tree_->AddBranchToCache(name.c_str(), true);
+        tree_->StopCacheLearningPhase();
     }
-  
-    return specs;
 }
 
-void NTupleReader::setConvertFloatingPointVectors(const bool doubleToFloat, const bool floatToDouble, const bool intToInt, const bool floatToInt)
+void NTupleReader::addBranchToCache(const std::string& name) const
+{
+    //branches activated during the loop are added to the cache explicitly, while learning ROOT picks them up itself
+    if(cacheSize_ > 0 && cacheLearnEntries_ <= 0) tree_->AddBranchToCache(name.c_str(), true);
+}
+
+std::vector<NTupleReader::MemoryUsage> NTupleReader::getMemoryUsage() const
 {
-    if(doubleToFloat) 
+    std::set<std::string> tupleBranches(activatedBranches_.begin(), activatedBranches_.end());
+
+    std::vector<MemoryUsage> usage;
+    for(const auto* map : {&branchMap_, &branchVecMap_})
     {
-        convertHackActive_ = true;
-        for(const auto& i : branchVecMap_)
+        for(const auto& var : *map)
         {
-            if (i.second.type == typeid(std::vector<double>))
+            //aliases share the buffer of their variable and have no deleter
+            if(!var.second.deleter) continue;
+
+            MemoryUsage u;
+            u.name = var.first;
+            auto type = typeMap_.find(var.first);
+            u.type = (type != typeMap_.end()) ? type->second : "";
+            u.bufferBytes = var.second.deleter->bytes(var.second.ptr);
+            u.basketBytes = 0;
+            u.derived = !tupleBranches.count(var.first);
+            if(!u.derived && tree_)
             {
-                registerFunction(std::bind(&NTupleReader::castVector<double, float>, std::placeholders::_1, i.first, 'f'));
+                TBranch* branch = tree_->GetBranch(var.first.c_str());
+                //the baskets currently loaded, not the configured basket size
+                TObjArray* baskets = branch ? branch->GetListOfBaskets() : nullptr;
+                for(int i = 0; baskets && i < baskets->GetEntriesFast(); ++i)
+                {
+                    if(TBasket* basket = static_cast<TBasket*>(baskets->UncheckedAt(i))) u.basketBytes += basket->GetBufferSize();
+                }
             }
+            usage.push_back(u);
         }
     }
 
-    if(floatToDouble) 
+    std::sort(usage.begin(), usage.end(), [](const MemoryUsage& a, const MemoryUsage& b) { return a.bufferBytes + a.basketBytes > b.bufferBytes + b.basketBytes; });
+    return usage;
+}
+
+long long NTupleReader::getTotalMemory() const
+{
+    long long total = cacheSize_;
+    for(const auto& u : getMemoryUsage()) total += u.bufferBytes + u.basketBytes;
+    return total;
+}
+
+void NTupleReader::printMemoryUsage(FILE *f, const unsigned int nLargest) const
+{
+    const std::vector<MemoryUsage> usage = getMemoryUsage();
+
+    long long buffers = 0, baskets = 0, derived = 0;
+    for(const auto& u : usage)
     {
-        convertHackActive_ = true;
-        for(const auto& i : branchVecMap_)
-        {
-            if (i.second.type == typeid(std::vector<float>))
-                registerFunction(std::bind(&NTupleReader::castVector<float, double>, std::placeholders::_1, i.first, 'd'));
-        }
+        buffers += u.bufferBytes;
+        baskets += u.basketBytes;
+        if(u.derived) derived += u.bufferBytes;
     }
 
-    if(intToInt) 
+    fprintf(f, "NTupleReader memory usage: %.1f MB in %zu variables (buffers %.1f MB of which derived %.1f MB, baskets %.1f MB, TTreeCache %.1f MB)\n",
+            (buffers + baskets + cacheSize_)/1048576.0, usage.size(), buffers/1048576.0, derived/1048576.0, baskets/1048576.0, cacheSize_/1048576.0);
+    fprintf(f, "    %-60s %12s %12s %8s %s\n", "variable", "buffer [B]", "basket [B]", "", "type");
+    for(unsigned int i = 0; i < usage.size() && (nLargest == 0 || i < nLargest); ++i)
     {
-        convertHackActive_ = true;
-        for(const auto& i : branchVecMap_)
-        {
-            if (i.second.type == typeid(std::vector<unsigned int>))
-                registerFunction(std::bind(&NTupleReader::castVector<unsigned int, int>, std::placeholders::_1, i.first, 'i'));
-        }
+        const MemoryUsage& u = usage[i];
+        fprintf(f, "    %-60s %12zu %12lld %8s %s\n", u.name.c_str(), u.bufferBytes, u.basketBytes, u.derived ? "derived" : "tuple", u.type.c_str());
     }
+}
 
-    if(floatToInt) 
+void NTupleReader::setMemoryPolicy(const long long maxBasketBytes, const long long maxCacheBytes, const size_t maxVectorBytes, const int shrinkInterval)
+{
+    if(maxBasketBytes > 0 && tree_) tree_->SetMaxVirtualSize(maxBasketBytes);
+
+    maxCacheBytes_ = (maxCacheBytes > 0) ? maxCacheBytes : 0;
+    if(maxCacheBytes_ > 0 && cacheSize_ > maxCacheBytes_)
     {
-        convertHackActive_ = true;
-        for(const auto& i : branchVecMap_)
+        cacheSize_ = maxCacheBytes_;
+        tree_->SetCacheSize(cacheSize_);
+        updateCache();
+    }
+
+    maxVectorBytes_ = maxVectorBytes;
+    shrinkInterval_ = (maxVectorBytes > 0 && shrinkInterval > 0) ? shrinkInterval : 0;
+}
+
+int NTupleReader::shrinkBuffers(const size_t maxVectorBytes)
+{
+    int nShrunk = 0;
+    for(auto* map : {&branchMap_, &branchVecMap_})
+    {
+        for(auto& var : *map)
         {
-            if (i.second.type == typeid(std::vector<float>))
-                registerFunction(std::bind(&NTupleReader::castVector<float, int>, std::placeholders::_1, i.first, 'a'));
+            if(var.second.deleter && var.second.deleter->shrink(var.second.ptr, maxVectorBytes)) ++nShrunk;
         }
     }
+    return nShrunk;
 }
 
-template <typename Tfrom, typename Tto>
-void NTupleReader::setVectorAlias(const std::string& varFrom, const std::string& varAlias)
+void NTupleReader::setTiming(const bool timing)
 {
-    registerFunction(std::bind(&NTupleReader::addVectorAlias<Tfrom, Tto>, std::placeholders::_1, varFrom, varAlias));
+    timingActive_ = timing;
+
+    timingEvents_ = timingBytesUnzipped_ = 0;
+    timingReadWall_ = timingReadCpu_ = 0.0;
+    timingStartWall_ = wallClock();
+    timingStartCpu_ = cpuClock();
+    timingFileBytesStart_ = TFile::GetFileBytesRead();
+    for(auto& func : functionVec_) 
+    {
+        func->nCalls = func->allocations = func->allocatedBytes = 0;
+        func->wallTime = func->cpuTime = 0.0;
+    }
 }
 
-void NTupleReader::setConvertFloatingPointScalars(const bool doubleToFloat, const bool floatToDouble, const bool intToFloat)
+void NTupleReader::printTimingSummary(FILE *f) const
 {
-    if(doubleToFloat) 
+    if(!timingActive_)
     {
-        convertHackActive_ = true;
-        for(const auto& i : branchMap_)
-        {
-            if (i.second.type == typeid(double))
-            {
-                //std::cout << "Converting " << i.first << std::endl;
-                registerFunction(std::bind(&NTupleReader::castScalar<double, float>, std::placeholders::_1, i.first, 'f'));
-            }
-        }
+        fprintf(f, "NTupleReader::printTimingSummary(): timing was not enabled, call setTiming(true) before the event loop\n");
+        return;
+    }
+
+    const double totalWall = wallClock() - timingStartWall_;
+    const double nEvt = (timingEvents_ > 0) ? timingEvents_ : 1;
+
+    fprintf(f, "NTupleReader timing summary: %lld events in %.2f s (%.1f events/s), %.2f s CPU on the reading thread\n", timingEvents_, totalWall, timingEvents_/((totalWall > 0) ? totalWall : 1), cpuClock() - timingStartCpu_);
+    fprintf(f, "    %-64s %10s %12s %12s %13s %7s", "module", "calls", "wall [s]", "cpu [s]", "wall/evt [us]", "frac");
+    if(countingAllocations) fprintf(f, " %11s %11s", "allocs/evt", "bytes/evt");
+    fprintf(f, "\n    %-64s %10lld %12.3f %12.3f %13.2f %6.1f%%\n", "TTree::GetEntry", timingEvents_, timingReadWall_, timingReadCpu_, 1e6*timingReadWall_/nEvt, 100*timingReadWall_/((totalWall > 0) ? totalWall : 1));
+    for(unsigned int i = 0; i < functionVec_.size(); ++i)
+    {
+        const FuncWrapper* func = functionVec_[i];
+        std::string name = (func->name.size() > 58) ? func->name.substr(0, 55) + "..." : func->name;
+        fprintf(f, "    [%2u] %-59s %10lld %12.3f %12.3f %13.2f %6.1f%%", i, name.c_str(), func->nCalls, func->wallTime, func->cpuTime, 1e6*func->wallTime/nEvt, 100*func->wallTime/((totalWall > 0) ? totalWall : 1));
+        if(countingAllocations) fprintf(f, " %11.1f %11.0f", func->allocations/nEvt, func->allocatedBytes/nEvt);
+        fprintf(f, "\n");
+    }
+    if(!countingAllocations) fprintf(f, "    allocations are not counted, build with -DSAT_COUNT_ALLOCATIONS to count them\n");
+    fprintf(f, "    bytes read from files: %lld, bytes unzipped: %lld\n", TFile::GetFileBytesRead() - timingFileBytesStart_, timingBytesUnzipped_);
+}
+
+void NTupleReader::writeTimingJSON(const std::string& fileName) const
+{
+    FILE *f = fopen(fileName.c_str(), "w");
+    if(!f) THROW_SATEXCEPTION("NTupleReader::writeTimingJSON(...): cannot open file \"" + fileName + "\" for writing!!!");
+
+    const double totalWall = wallClock() - timingStartWall_;
+    fprintf(f, "{\n  \"events\": %lld,\n  \"wallTime\": %.6f,\n  \"cpuTime\": %.6f,\n", timingEvents_, totalWall, cpuClock() - timingStartCpu_);
+    fprintf(f, "  \"fileBytesRead\": %lld,\n  \"bytesUnzipped\": %lld,\n", TFile::GetFileBytesRead() - timingFileBytesStart_, timingBytesUnzipped_);
+    fprintf(f, "  \"read\": {\"wallTime\": %.6f, \"cpuTime\": %.6f},\n  \"modules\": [", timingReadWall_, timingReadCpu_);
+    for(unsigned int i = 0; i < functionVec_.size(); ++i)
+    {
+        const FuncWrapper* func = functionVec_[i];
+        fprintf(f, "%s\n    {\"name\": \"%s\", \"calls\": %lld, \"wallTime\": %.6f, \"cpuTime\": %.6f", (i ? "," : ""), func->name.c_str(), func->nCalls, func->wallTime, func->cpuTime);
+        if(countingAllocations) fprintf(f, ", \"allocations\": %lld, \"allocatedBytes\": %lld", func->allocations, func->allocatedBytes);
+        fprintf(f, "}");
     }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+}
 
-    if(intToFloat) 
+std::set<std::string> NTupleReader::readBranchProfile(const std::string& fileName)
+{
+    std::set<std::string> branches;
+
+    FILE *f = fopen(fileName.c_str(), "r");
+    if(!f) return branches;
+
+    char buf[1024];
+    while(fgets(buf, sizeof(buf), f))
     {
-        convertHackActive_ = true;
-        for(const auto& i : branchMap_)
+        std::string name(buf);
+        name.erase(name.find_last_not_of(" \t\r\n") + 1);
+        if(name.size() && name[0] != '#') branches.insert(name);
+    }
+    fclose(f);
+
+    return branches;
+}
+
+std::set<std::string> NTupleReader::getAccessedBranches() const
+{
+    std::set<std::string> branches;
+    for(const auto* vmap : {&branchMap_, &branchVecMap_})
+    {
+        for(const auto& var : *vmap)
         {
-            if (i.second.type == typeid(int) )
-            {
-                //std::cout << "Converting " << i.first << std::endl;
-                registerFunction(std::bind(&NTupleReader::castScalar<int, float>, std::placeholders::_1, i.first, 'i'));
-            }
-            else if (i.second.type == typeid(unsigned int))
-            {
-                //std::cout << "Converting " << i.first << std::endl;
-                registerFunction(std::bind(&NTupleReader::castScalar<unsigned int, float>, std::placeholders::_1, i.first, 'i'));
-            }
-            else if (i.second.type == typeid(long))
-            {
-                //std::cout << "Converting " << i.first << std::endl;
-                registerFunction(std::bind(&NTupleReader::castScalar<long, float>, std::placeholders::_1, i.first, 'i'));
-            }
+            if(!var.second.accessed) continue;
+
+            //aliases count as a read of the aliased variable
+            auto alias = aliasMap_.find(var.first);
+            const std::string& name = (alias != aliasMap_.end()) ? alias->second : var.first;
+
+            //only keep real tuple branches, not derived variables
+            if(tree_ && tree_->FindBranch(name.c_str())) branches.insert(name);
         }
     }
+    return branches;
+}
+
+void NTupleReader::writeBranchProfile(const std::string& fileName) const
+{
+    FILE *f = fopen(fileName.c_str(), "w");
+    if(!f) THROW_SATEXCEPTION("NTupleReader::writeBranchProfile(...): cannot open file \"" + fileName + "\" for writing!!!");
+
+    fprintf(f, "# branches read by the last job, used as NTupleReader active branch list\n");
+    for(const auto& name : getAccessedBranches()) fprintf(f, "%s\n", name.c_str());
+    fclose(f);
+}
 
-    if(floatToDouble) 
+std::vector<std::string> NTupleReader::getTupleMembers() const
+{
+    std::vector<std::string> members;
+    for(auto& iVar : typeMap_)
+    {
+        members.push_back(iVar.first);
+    }
+    return members;
+}
+
+std::vector<std::string> NTupleReader::getTupleSpecs(const std::string& varName) const
+{
+    std::vector<std::string> members = getTupleMembers();
+    std::vector<std::string> specs;
+    for(auto &member : members)
     {
-        convertHackActive_ = true;
-        for(const auto& i : branchMap_)
+        std::string::size_type t= member.find(varName);
+        if (t != std::string::npos)
         {
-            if (i.second.type == typeid(float)){
-                //std::cout << "Converting " << i.first << std::endl;
-                registerFunction(std::bind(&NTupleReader::castScalar<float, double>, std::placeholders::_1, i.first, 'd'));
-            }
+            specs.push_back(member.erase(t, varName.length()));
         }
     }
+  
+    return specs;
 }
 
+void NTupleReader::setConvertFloatingPointVectors(const bool doubleToFloat, const bool floatToDouble, const bool intToInt, const bool floatToInt)
+{
+    //The converted vectors are lazy variables, so a conversion is only done in events where the converted vector is read.
+    //Collect the names first as registering the conversions inserts into branchVecMap_
+    std::vector<std::pair<std::string, std::type_index>> vecs;
+    for(const auto& i : branchVecMap_) if(i.first.find("___") == std::string::npos) vecs.push_back(std::make_pair(i.first, i.second.type));
 
+    if(doubleToFloat || floatToDouble || intToInt || floatToInt) convertHackActive_ = true;
 
-// ===  FUNCTION  ============================================================
-//         Name:  NTupleReader::CastVector
-//  Description:  /* cursor */
-// ===========================================================================
-template <class Tfrom, class Tto>
-void NTupleReader::castVector(NTupleReader& tr, const std::string& var, const char typen)
+    for(const auto& i : vecs)
+    {
+        if(doubleToFloat && i.second == typeid(std::vector<double>))       registerConvertedVec<double, float>(i.first, 'f');
+        if(floatToDouble && i.second == typeid(std::vector<float>))        registerConvertedVec<float, double>(i.first, 'd');
+        if(intToInt      && i.second == typeid(std::vector<unsigned int>)) registerConvertedVec<unsigned int, int>(i.first, 'i');
+        if(floatToInt    && i.second == typeid(std::vector<float>))        registerConvertedVec<float, int>(i.first, 'a');
+    }
+}
+
+template <typename Tfrom, typename Tto>
+void NTupleReader::setVectorAlias(const std::string& varFrom, const std::string& varAlias)
 {
-    const std::vector<Tfrom> &obj = tr.getVec<Tfrom>(var);
+    registerFunction(std::bind(&NTupleReader::addVectorAlias<Tfrom, Tto>, std::placeholders::_1, varFrom, varAlias));
+}
 
-    std::vector<Tto> *objs = new std::vector<Tto>();
-    objs->reserve(obj.size());
+void NTupleReader::setConvertFloatingPointScalars(const bool doubleToFloat, const bool floatToDouble, const bool intToFloat)
+{
+    //As for vectors, the converted scalars are computed on first access in each event
+    std::vector<std::pair<std::string, std::type_index>> vars;
+    for(const auto& i : branchMap_) if(i.first.find("___") == std::string::npos) vars.push_back(std::make_pair(i.first, i.second.type));
 
-    std::string newname = var+"___" + typen;
+    if(doubleToFloat || floatToDouble || intToFloat) convertHackActive_ = true;
 
-    for(auto& i : obj)
+    for(const auto& i : vars)
     {
-        objs->push_back(static_cast<Tto>(i));
+        if(doubleToFloat && i.second == typeid(double)) registerConvertedVar<double, float>(i.first, 'f');
+        if(intToFloat)
+        {
+            if     (i.second == typeid(int))          registerConvertedVar<int, float>(i.first, 'i');
+            else if(i.second == typeid(unsigned int)) registerConvertedVar<unsigned int, float>(i.first, 'i');
+            else if(i.second == typeid(long))         registerConvertedVar<long, float>(i.first, 'i');
+        }
+        if(floatToDouble && i.second == typeid(float))  registerConvertedVar<float, double>(i.first, 'd');
     }
+}
+
 
-    tr.registerDerivedVec(newname, objs);
-}// -----  end of function NTupleReader::CastVector  -----
 
 // ===  FUNCTION  ============================================================
 //         Name:  NTupleReader::CastVector
@@ -523,30 +1162,11 @@ void NTupleReader::addVectorAlias(NTupleReader& tr, const std::string& varFrom,
 {
     const std::vector<Tfrom> &obj = tr.getVec<Tfrom>(varFrom);
 
-    std::vector<Tto> *objs = new std::vector<Tto>();
-    objs->reserve(obj.size());
+    std::vector<Tto>& objs = tr.derivedVec<Tto>(varAlias);
+    objs.reserve(obj.size());
 
     for(auto& i : obj)
     {
-        objs->push_back(static_cast<Tto>(i));
+        objs.push_back(static_cast<Tto>(i));
     }
-
-    tr.registerDerivedVec(varAlias, objs);
 }// -----  end of function NTupleReader::CastVector  -----
-
-
-// ===  FUNCTION  ============================================================
-//         Name:  NTupleReader::CastScalar
-//  Description:  /* cursor */
-// ===========================================================================
-template <class Tfrom, class Tto>
-void NTupleReader::castScalar(NTupleReader& tr, const std::string& var, const char typen)
-{
-
-    Tto objs = static_cast<Tto>(tr.getVar<Tfrom>(var));
-
-    std::string newname = var+"___" + typen;
-
-    tr.registerDerivedVar(newname, objs);
-}       // -----  end of function NTupleReader::CastVector  -----
-
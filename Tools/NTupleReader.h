@@ -9,6 +9,8 @@
 #include "TLorentzVector.h"
 
 #include <cstdio>
+#include <climits>
+#include <atomic>
 #include <vector>
 #include <map>
 #include <unordered_map>
@@ -43,10 +45,28 @@
        const int& run = tr.getVar<unsigned int>("run");
    }
 
-   and so on.  
+   and so on.
+
+   A columnar skim written by ColumnarTupleWriter can be read in the same way by passing its
+   ColumnarTupleReader instead of the tree.  Its columns are only copied out of the mapped file
+   when they are accessed in an event
+
+   ColumnarTupleReader columns("skim.col");
+   NTupleReader tr(&columns);
+
+   For variables read in every event the lookup by name can be done once by
+   requesting a handle, after which access is a simple pointer dereference
+
+   NTupleReader::VarHandle<float> met = tr.handle<float>("met");
+   NTupleReader::VecHandle<TLorentzVector> jets = tr.vecHandle<TLorentzVector>("jetsLVec");
+   while(tr.getNextEvent())
+   {
+       if(met.get() > 200 && jets.get().size() > 4) ...
+   }
  */
 
 class NTupleReader;
+class ColumnarTupleReader;
 
 void baselineUpdate(NTupleReader& tr);
 
@@ -62,9 +82,39 @@ private:
     {
     public:
         virtual void destroy(void *) = 0;
+        //bytes held by the object, and release the spare capacity of vectors above maxBytes
+        virtual size_t bytes(void *) const = 0;
+        virtual bool shrink(void *, size_t maxBytes) = 0;
         virtual ~deleter_base() {}
     };
 
+    //Heap bytes behind an object, the full capacity of vectors and of their elements counts
+    template<typename T> static size_t heapBytes(const T&) { return 0; }
+    static size_t heapBytes(const std::string& s) { return (s.capacity() > 15) ? s.capacity() + 1 : 0; }
+    static size_t heapBytes(const std::vector<bool>& v) { return v.capacity()/8; }
+    template<typename T> static size_t heapBytes(const std::vector<T>& v)
+    {
+        size_t n = v.capacity()*sizeof(T);
+        for(const auto& e : v) n += heapBytes(e);
+        return n;
+    }
+    template<typename K, typename V> static size_t heapBytes(const std::map<K, V>& m)
+    {
+        //node overhead of the usual red-black tree implementation
+        size_t n = m.size()*(sizeof(std::pair<const K, V>) + 4*sizeof(void*));
+        for(const auto& e : m) n += heapBytes(e.first) + heapBytes(e.second);
+        return n;
+    }
+
+    //Only vectors using less than half of a capacity above maxBytes are shrunk
+    template<typename T> static bool shrinkBuffer(T&, size_t) { return false; }
+    template<typename T> static bool shrinkBuffer(std::vector<T>& v, size_t maxBytes)
+    {
+        if(v.capacity()*sizeof(T) <= maxBytes || 2*v.size() >= v.capacity()) return false;
+        v.shrink_to_fit();
+        return true;
+    }
+
     //Templated class to create/store simple object deleter 
     template<typename T> 
     class deleter : public deleter_base
@@ -74,6 +124,16 @@ private:
         {
             delete static_cast<T*>(ptr);
         }
+
+        virtual size_t bytes(void *ptr) const
+        {
+            return sizeof(T) + heapBytes(*static_cast<T*>(ptr));
+        }
+
+        virtual bool shrink(void *ptr, size_t maxBytes)
+        {
+            return shrinkBuffer(*static_cast<T*>(ptr), maxBytes);
+        }
     };
 
     //Templated class to create/store vector object deleter 
@@ -90,6 +150,64 @@ private:
             //depete pointer to vector
             delete static_cast<T*>(ptr);
         }
+
+        virtual size_t bytes(void *ptr) const
+        {
+            T *vecptr = *static_cast<T**>(ptr);
+            return sizeof(T*) + ((vecptr != nullptr) ? sizeof(T) + heapBytes(*vecptr) : 0);
+        }
+
+        virtual bool shrink(void *ptr, size_t maxBytes)
+        {
+            T *vecptr = *static_cast<T**>(ptr);
+            return vecptr != nullptr && shrinkBuffer(*vecptr, maxBytes);
+        }
+    };
+
+    //Machinery for variables computed on first access
+    //Generic base class to obfiscate the type of the callable
+    class LazyVarBase
+    {
+    public:
+        //event (evtProcessed_) for which the stored value was computed
+        int evaluatedEvt;
+
+        LazyVarBase() : evaluatedEvt(-1) {}
+        virtual void evaluate(NTupleReader& tr, void* loc) = 0;
+        virtual ~LazyVarBase() {}
+    };
+
+    //Lazy single variable, the callable returns the value
+    template<typename T, typename F>
+    class LazyVarImpl : public LazyVarBase
+    {
+    private:
+        F func_;
+    public:
+        LazyVarImpl(F f) : func_(f) {}
+
+        virtual void evaluate(NTupleReader& tr, void* loc)
+        {
+            *static_cast<T*>(loc) = func_(tr);
+        }
+    };
+
+    //Lazy vector, the callable returns a new vector which the reader takes ownership of as in registerDerivedVec
+    template<typename T, typename F>
+    class LazyVecImpl : public LazyVarBase
+    {
+    private:
+        F func_;
+    public:
+        LazyVecImpl(F f) : func_(f) {}
+
+        virtual void evaluate(NTupleReader& tr, void* loc)
+        {
+            T* vecptr = func_(tr);
+            T*& slot = *static_cast<T**>(loc);
+            if(slot != nullptr) delete slot;
+            slot = vecptr;
+        }
     };
 
     //Handle class to hold pointer and deleter
@@ -99,12 +217,16 @@ private:
         void* ptr;
         deleter_base* deleter;
         std::type_index type;
+        //non-null for lazy variables, owned by lazyVec_
+        LazyVarBase* lazy;
+        //set when the variable is read, used to learn the branches a job needs
+        mutable bool accessed;
 
-        Handle() : ptr(nullptr), deleter(nullptr), type(typeid(nullptr)) {}
+        Handle() : ptr(nullptr), deleter(nullptr), type(typeid(nullptr)), lazy(nullptr), accessed(false) {}
 
-        Handle(const Handle& h) : ptr(h.ptr), deleter(h.deleter), type(h.type) {}
+        Handle(const Handle& h) : ptr(h.ptr), deleter(h.deleter), type(h.type), lazy(h.lazy), accessed(h.accessed) {}
 
-        Handle(void* ptr, deleter_base* deleter = nullptr, const std::type_index& type = typeid(nullptr)) :  ptr(ptr), deleter(deleter), type(type) {}
+        Handle(void* ptr, deleter_base* deleter = nullptr, const std::type_index& type = typeid(nullptr), LazyVarBase* lazy = nullptr) :  ptr(ptr), deleter(deleter), type(type), lazy(lazy), accessed(false) {}
 
         void destroy()
         {
@@ -135,6 +257,15 @@ private:
     class FuncWrapper
     {
     public:
+        //name and accumulated run time, the latter only filled when timing is enabled.  The operator
+        //new calls and bytes of the function are only counted in builds with SAT_COUNT_ALLOCATIONS
+        std::string name;
+        long long nCalls, allocations, allocatedBytes;
+        double wallTime, cpuTime;
+
+        FuncWrapper() : nCalls(0), allocations(0), allocatedBytes(0), wallTime(0.0), cpuTime(0.0) {}
+        virtual ~FuncWrapper() {}
+
         virtual bool operator()(NTupleReader& tr) = 0;
     };
 
@@ -154,23 +285,23 @@ private:
         FuncWrapperImpl(T f) : func_(f) {}
     };
 
-    template <class Tfrom, class Tto> 
-    static void castVector(NTupleReader& tr, const std::string& var, const char typen);
-
-    template <class Tfrom, class Tto> 
-    static void castScalar(NTupleReader& tr, const std::string& var, const char typen);
-
     template <class Tfrom, class Tto> 
     static void addVectorAlias(NTupleReader& tr, const std::string& varFrom, const std::string& varAlias);
 
 public:
     NTupleReader(TTree * tree, const std::set<std::string>& activeBranches_);
     NTupleReader(TTree * tree);
+    //Read a columnar skim, the ColumnarTupleReader must outlive the NTupleReader
+    NTupleReader(ColumnarTupleReader * columns);
     NTupleReader();
     ~NTupleReader();
 
     std::string getFileName() const;
 
+    //Number unique to this reader within the job, never reused by a later reader even at the same
+    //address, for code caching handles of a reader
+    unsigned long long getInstanceId() const { return instanceId_; }
+
     int getEvtNum() const
     {
         return nevt_;
@@ -191,9 +322,75 @@ public:
 
     bool goToEvent(int evt);
     bool getNextEvent();
+
+    //Restrict getNextEvent() to entries [first, last), last < 0 means until the end of the tree
+    void setEntryRange(int first, int last = -1);
+    int getEntryRangeEnd() const { return lastEntry_; }
+    //Process one AnaSamples::WorkUnit of FileSummary::splitByEvents, the tree must be the chain filled
+    //with FileSummary::addFilesToChain(chain, unit).  The reader counts entries as int, a unit reaching
+    //beyond INT_MAX entries of its chain is rejected
+    template<class U> void setWorkUnit(const U& unit)
+    {
+        if(unit.firstEntry > INT_MAX || unit.lastEntry > INT_MAX)
+        {
+            THROW_SATEXCEPTION("NTupleReader::setWorkUnit(...): entry range [" + std::to_string(unit.firstEntry) + ", " + std::to_string(unit.lastEntry) + ") exceeds the int entry numbers of the reader!!!");
+        }
+        setEntryRange(static_cast<int>(unit.firstEntry), static_cast<int>(unit.lastEntry));
+    }
+
     void disableUpdate();
     void printTupleMembers(FILE *f = stdout) const;
 
+    //Enable a TTreeCache of cacheSize bytes for the tree (0 disables it).  With learnEntries = 0 exactly the
+    //activated branches are put in the cache, including branches activated later in the job, and the branch
+    //list is refreshed when a TChain moves to the next file.  With learnEntries > 0 ROOT instead learns the
+    //branches to cache from the first learnEntries entries.  asyncPrefetch enables asynchronous prefetching
+    //of the next cache block and parallel unzipping; it must be set before the first file is opened to be
+    //effective for remote reads
+    void setIOCache(const long long cacheSize = 30000000, const int learnEntries = 0, const bool asyncPrefetch = false);
+
+    //Accumulate wall and CPU time for every registered function and for reading the tree, together with the
+    //bytes read.  The overhead is a few clock reads per function per event, so it can be left on in production.
+    //Builds with -DSAT_COUNT_ALLOCATIONS also count the operator new calls and bytes of every function
+    void setTiming(const bool timing);
+    //Summary table of the timing information, and the same information as a JSON file for monitoring
+    void printTimingSummary(FILE *f = stdout) const;
+    void writeTimingJSON(const std::string& fileName) const;
+
+    //Memory held by one variable: its buffer, with the capacity of vectors, and for tuple branches the
+    //buffers of the baskets ROOT currently holds in memory for the branch
+    struct MemoryUsage
+    {
+        std::string name, type;
+        size_t bufferBytes;
+        long long basketBytes;
+        bool derived;
+    };
+    //Usage of every registered branch and derived variable, largest first, and the total with the TTreeCache
+    std::vector<MemoryUsage> getMemoryUsage() const;
+    long long getTotalMemory() const;
+    void printMemoryUsage(FILE *f = stdout, const unsigned int nLargest = 20) const;
+
+    //Memory caps, 0 leaves a setting alone.  maxBasketBytes bounds the baskets ROOT keeps in memory
+    //(TTree::SetMaxVirtualSize) and maxCacheBytes the TTreeCache.  Every shrinkInterval events, vectors
+    //whose capacity is above maxVectorBytes and which are less than half full are shrunk, so a single
+    //outlier event does not keep its buffers for the rest of the job
+    void setMemoryPolicy(const long long maxBasketBytes, const long long maxCacheBytes = 0, const size_t maxVectorBytes = 0, const int shrinkInterval = 1000);
+    //Shrink the oversized vector buffers now, returns the number of buffers shrunk
+    int shrinkBuffers(const size_t maxVectorBytes);
+
+    //Learned branch profile: writeBranchProfile records the tuple branches which were actually read
+    //in this job (one name per line), and readBranchProfile returns them for use as the active branch
+    //list of the next job, e.g.
+    //    NTupleReader tr(tree, NTupleReader::readBranchProfile("basicCheck.branches"));
+    //    ...
+    //    tr.writeBranchProfile("basicCheck.branches");
+    //Branches outside the profile are still activated on the fly when requested.  A missing profile
+    //gives an empty list, meaning all branches are activated
+    static std::set<std::string> readBranchProfile(const std::string& fileName);
+    void writeBranchProfile(const std::string& fileName) const;
+    std::set<std::string> getAccessedBranches() const;
+
     void setConvertFloatingPointVectors(const bool doubleToFloat = true, const bool floatToDouble = false, const bool intToInt = false, const bool floatToInt = false);
 
     void setConvertFloatingPointScalars(const bool doubleToFloat = true, const bool floatToDouble = false, const bool intToFloat = true);
@@ -205,7 +402,18 @@ public:
 
     template<typename T> void registerFunction(T f)
     {
-        if(isFirstEvent()) functionVec_.emplace_back(new FuncWrapperImpl<T>(f));
+        if(isFirstEvent()) addFunction(new FuncWrapperImpl<T>(f), FuncDeps(), demangle<T>());
+        else THROW_SATEXCEPTION("New functions cannot be registered after tuple reading begins!\n");
+    }
+
+    //Register a function together with the variables it reads and the derived variables it produces.
+    //Declared functions are ordered by their dependencies instead of by registration order and are
+    //skipped if none of their products are needed (see setRequestedVars).  Functions registered
+    //without declarations always run and act as barriers: they run after everything registered
+    //before them and before everything registered after them
+    template<typename T> void registerFunction(T f, const std::set<std::string>& reads, const std::set<std::string>& produces)
+    {
+        if(isFirstEvent()) addFunction(new FuncWrapperImpl<T>(f), FuncDeps(reads, produces), demangle<T>());
         else THROW_SATEXCEPTION("New functions cannot be registered after tuple reading begins!\n");
     }
 
@@ -213,6 +421,13 @@ public:
     void registerFunction(void (*f)(NTupleReader&));
     void registerFunction(bool (*f)(NTupleReader&));
 
+    //Only run the declared functions needed to produce these variables, empty means run everything
+    void setRequestedVars(const std::set<std::string>& vars);
+
+    //Run independent declared functions of the schedule concurrently (from the second event on, once
+    //all variables are registered).  Functions run this way must not share state with each other
+    void setParallelFunctions(const bool parallel);
+
     void getType(const std::string& name, std::string& type) const;
 
     void setReThrow(const bool);
@@ -273,8 +488,115 @@ public:
         }
     }
 
+    //Register a variable which is only computed the first time it is accessed in an event, e.g.
+    //    tr.registerLazyVar<double>("best_had_brJet_MT2", [](NTupleReader& tr) { return calcMT2(tr); });
+    //The value is cached until the next event is read.  Lazy variables are computed on the thread
+    //accessing them, so they must not be read concurrently from parallel functions
+    template<typename T, typename F> void registerLazyVar(const std::string& name, F func)
+    {
+        try
+        {
+            if(typeMap_.find(name) != typeMap_.end())
+            {
+                THROW_SATEXCEPTION("You are trying to redefine a tuple var: \"" + name + "\".  This is not allowed!  Please choose a unique name.");
+            }
+            lazyVec_.push_back(new LazyVarImpl<T, F>(func));
+            Handle h = createHandle(new T());
+            h.lazy = lazyVec_.back();
+            branchMap_.insert(std::make_pair(name, h));
+
+            typeMap_[name] = demangle<T>();
+        }
+        catch(const SATException& e)
+        {
+            e.print();
+            if(reThrow_) throw;
+        }
+    }
+
+    //Lazy version of registerDerivedVec, func returns a new std::vector<T>* which the reader takes ownership of
+    template<typename T, typename F> void registerLazyVec(const std::string& name, F func)
+    {
+        try
+        {
+            if(typeMap_.find(name) != typeMap_.end())
+            {
+                THROW_SATEXCEPTION("You are trying to redefine a tuple var: \"" + name + "\".  This is not allowed!  Please choose a unique name.");
+            }
+            lazyVec_.push_back(new LazyVecImpl<std::vector<T>, F>(func));
+            Handle h = createVecHandle(new std::vector<T>*());
+            h.lazy = lazyVec_.back();
+            branchVecMap_.insert(std::make_pair(name, h));
+
+            typeMap_[name] = demangle<std::vector<T>>();
+        }
+        catch(const SATException& e)
+        {
+            e.print();
+            if(reThrow_) throw;
+        }
+    }
+
+    //Reader owned buffer for the derived vector "name", returned cleared so it can be filled in place.
+    //The same vector is handed back every event so its capacity is kept, unlike registerDerivedVec
+    //which replaces the stored vector
+    template<typename T> std::vector<T>& derivedVec(const std::string& name)
+    {
+        return derivedObject<std::vector<T>>(name);
+    }
+
+    //As derivedVec for any other container registered through registerDerivedVec, e.g. a std::map
+    template<typename T> T& derivedObject(const std::string& name)
+    {
+        auto handleItr = branchVecMap_.find(name);
+        if(handleItr == branchVecMap_.end())
+        {
+            if(typeMap_.find(name) != typeMap_.end())
+            {
+                THROW_SATEXCEPTION("You are trying to redefine a tuple var: \"" + name + "\".  This is not allowed!  Please choose a unique name.");
+            }
+            handleItr = branchVecMap_.insert(std::make_pair(name, createVecHandle(new T*()))).first;
+
+            typeMap_[name] = demangle<T>();
+        }
+        else if(handleItr->second.type != typeid(T))
+        {
+            THROW_SATEXCEPTION("Derived vector \"" + name + "\" is already registered with type \"" + typeMap_[name] + "\"!!!");
+        }
+
+        T*& objptr = *static_cast<T**>(handleItr->second.ptr);
+        if(objptr == nullptr) objptr = new T();
+        else                  objptr->clear();
+        return *objptr;
+    }
+
+    //Reader owned storage for the derived scalar "name", registered on the first call.  The reference
+    //stays valid for the life of the reader, so a producer can keep it and assign the value every event
+    template<typename T> T& derivedVar(const std::string& name)
+    {
+        auto handleItr = branchMap_.find(name);
+        if(handleItr == branchMap_.end())
+        {
+            if(typeMap_.find(name) != typeMap_.end())
+            {
+                THROW_SATEXCEPTION("You are trying to redefine a tuple var: \"" + name + "\".  This is not allowed!  Please choose a unique name.");
+            }
+            handleItr = branchMap_.insert(std::make_pair(name, createHandle(new T()))).first;
+
+            typeMap_[name] = demangle<T>();
+        }
+        else if(handleItr->second.type != typeid(T))
+        {
+            THROW_SATEXCEPTION("Derived variable \"" + name + "\" is already registered with type \"" + typeMap_[name] + "\"!!!");
+        }
+
+        return *static_cast<T*>(handleItr->second.ptr);
+    }
+
     void addAlias(const std::string& name, const std::string& alias);
 
+    //Raw storage of a variable (for vectors the location of the vector pointer), lazy variables are
+    //brought up to date for the current event first
     const void* getPtr(const std::string& var) const;
     const void* getVecPtr(const std::string& var) const;
 
@@ -329,11 +651,192 @@ public:
     void setPrefix(std::string pre){
         prefix_ = pre;
     }
- 
+
+    //Handle to a single variable which caches the reader's handle of the variable after the first lookup.
+    //It is resolved like getVar, so a handle of another type than the branch points at the converted copy
+    //made by setConvertFloatingPointScalars.  Handles are stored in node based maps and are never
+    //moved once created, so the cached pointer remains valid, and lazy variables are brought up to date
+    //on every access.  A missing variable gives a value initialised T if errors are not rethrown
+    template<typename T> class VarHandle
+    {
+    private:
+        const NTupleReader* tr_;
+        std::string name_;
+        mutable const Handle* handle_;
+
+        void resolve() const
+        {
+            if(!tr_) THROW_SATEXCEPTION("NTupleReader::VarHandle: \"" + name_ + "\" is not attached to a reader!!!");
+            try
+            {
+                handle_ = &tr_->findHandle<T>(name_, tr_->branchMap_);
+                handle_->accessed = true;
+            }
+            catch(const SATException& e)
+            {
+                if(tr_->isFirstEvent()) e.print();
+                if(tr_->reThrow_) throw;
+            }
+        }
+
+    public:
+        VarHandle() : tr_(nullptr), name_(""), handle_(nullptr) {}
+        VarHandle(const NTupleReader& tr, const std::string& name) : tr_(&tr), name_(name), handle_(nullptr) {}
+
+        //Lookup is deferred to the first access so handles may be requested before derived variables are registered
+        inline const T& get() const
+        {
+            if(!handle_)
+            {
+                resolve();
+                //the variable is missing and the error was not rethrown
+                if(!handle_)
+                {
+                    static const T empty = T();
+                    return empty;
+                }
+            }
+            if(handle_->lazy) tr_->updateLazy(*handle_);
+            return *static_cast<const T*>(handle_->ptr);
+        }
+
+        inline const T& operator*() const { return get(); }
+
+        const std::string& name() const { return name_; }
+    };
+
+    //Handle to a vector variable, resolved like getVec (including the converted copies made by
+    //setConvertFloatingPointVectors).  The reader's handle holds the location of the vector pointer which
+    //is updated in place by ROOT or registerDerivedVec, so the handle follows reallocation of the vector itself.
+    //A missing vector gives an empty vector if errors are not rethrown
+    template<typename T> class VecHandle
+    {
+    private:
+        const NTupleReader* tr_;
+        std::string name_;
+        mutable const Handle* handle_;
+
+        void resolve() const
+        {
+            if(!tr_) THROW_SATEXCEPTION("NTupleReader::VecHandle: \"" + name_ + "\" is not attached to a reader!!!");
+            try
+            {
+                handle_ = &tr_->findHandle<std::vector<T>*>(name_, tr_->branchVecMap_);
+                handle_->accessed = true;
+            }
+            catch(const SATException& e)
+            {
+                if(tr_->isFirstEvent()) e.print();
+                if(tr_->reThrow_) throw;
+            }
+        }
+
+    public:
+        VecHandle() : tr_(nullptr), name_(""), handle_(nullptr) {}
+        VecHandle(const NTupleReader& tr, const std::string& name) : tr_(&tr), name_(name), handle_(nullptr) {}
+
+        inline const std::vector<T>& get() const
+        {
+            if(!handle_)
+            {
+                resolve();
+                //the variable is missing and the error was not rethrown
+                if(!handle_)
+                {
+                    static const std::vector<T> empty;
+                    return empty;
+                }
+            }
+            if(handle_->lazy) tr_->updateLazy(*handle_);
+            return **static_cast<std::vector<T>* const*>(handle_->ptr);
+        }
+
+        inline const std::vector<T>& operator*() const { return get(); }
+
+        const std::string& name() const { return name_; }
+    };
+
+    template<typename T> VarHandle<T> handle(const std::string& var) const
+    {
+        return VarHandle<T>(*this, var);
+    }
+
+    template<typename T> VecHandle<T> vecHandle(const std::string& var) const
+    {
+        return VecHandle<T>(*this, var);
+    }
+
+private:
+    //Converted copy of a tuple vector, only filled when the converted vector is requested
+    template<typename Tfrom, typename Tto>
+    class LazyConvertVec : public LazyVarBase
+    {
+    private:
+        VecHandle<Tfrom> from_;
+    public:
+        LazyConvertVec(const NTupleReader& tr, const std::string& var) : from_(tr, var) {}
+
+        virtual void evaluate(NTupleReader& tr, void* loc)
+        {
+            const std::vector<Tfrom>& from = from_.get();
+            std::vector<Tto>*& to = *static_cast<std::vector<Tto>**>(loc);
+            if(to == nullptr) to = new std::vector<Tto>();
+
+            //the buffer is reused, and this simple loop over contiguous data is vectorised by the compiler
+            to->resize(from.size());
+            const Tfrom* src = from.data();
+            Tto* dst = to->data();
+            for(unsigned int i = 0; i < from.size(); ++i) dst[i] = static_cast<Tto>(src[i]);
+        }
+    };
+
+    //Converted copy of a tuple scalar
+    template<typename Tfrom, typename Tto>
+    class LazyConvertVar : public LazyVarBase
+    {
+    private:
+        VarHandle<Tfrom> from_;
+    public:
+        LazyConvertVar(const NTupleReader& tr, const std::string& var) : from_(tr, var) {}
+
+        virtual void evaluate(NTupleReader& tr, void* loc)
+        {
+            *static_cast<Tto*>(loc) = static_cast<Tto>(from_.get());
+        }
+    };
+
+    template<typename Tfrom, typename Tto> void registerConvertedVec(const std::string& var, const char typen)
+    {
+        const std::string name = var + "___" + typen;
+        if(typeMap_.find(name) != typeMap_.end()) return;
+
+        lazyVec_.push_back(new LazyConvertVec<Tfrom, Tto>(*this, var));
+        Handle h = createVecHandle(new std::vector<Tto>*());
+        h.lazy = lazyVec_.back();
+        branchVecMap_.insert(std::make_pair(name, h));
+
+        typeMap_[name] = demangle<std::vector<Tto>>();
+    }
+
+    template<typename Tfrom, typename Tto> void registerConvertedVar(const std::string& var, const char typen)
+    {
+        const std::string name = var + "___" + typen;
+        if(typeMap_.find(name) != typeMap_.end()) return;
+
+        lazyVec_.push_back(new LazyConvertVar<Tfrom, Tto>(*this, var));
+        Handle h = createHandle(new Tto());
+        h.lazy = lazyVec_.back();
+        branchMap_.insert(std::make_pair(name, h));
+
+        typeMap_[name] = demangle<Tto>();
+    }
+
 private:
     // private variables for internal use
     TTree *tree_;
-    int nevt_, evtProcessed_;
+    ColumnarTupleReader *columns_ = nullptr;
+    int nevt_, evtProcessed_, lastEntry_;
+    unsigned long long instanceId_;
     bool isUpdateDisabled_, reThrow_, convertHackActive_;
 
     std::string prefix_ = "";
@@ -342,19 +845,74 @@ private:
     mutable std::unordered_map<std::string, Handle> branchMap_;
     mutable std::unordered_map<std::string, Handle> branchVecMap_;
     std::vector<FuncWrapper*> functionVec_;
+    std::vector<LazyVarBase*> lazyVec_;
+
+    //declared inputs and outputs of a registered function
+    struct FuncDeps
+    {
+        bool declared;
+        std::set<std::string> reads, produces;
+
+        FuncDeps() : declared(false) {}
+        FuncDeps(const std::set<std::string>& r, const std::set<std::string>& p) : declared(true), reads(r), produces(p) {}
+    };
+    std::vector<FuncDeps> functionDeps_;
+    std::set<std::string> requestedVars_;
+    //functions to run grouped into levels, functions within a level do not depend on each other
+    std::vector<std::vector<FuncWrapper*>> schedule_;
+    bool scheduleDirty_, parallelFunctions_;
     mutable std::unordered_map<std::string, std::string> typeMap_;
     std::set<std::string> activeBranches_;
+    std::unordered_map<std::string, std::string> aliasMap_;
+
+    //tuple branches which have been activated, in order, and the TTreeCache configuration
+    mutable std::vector<std::string> activatedBranches_;
+    long long cacheSize_;
+    int cacheLearnEntries_, cacheTreeNumber_;
+
+    void addBranchToCache(const std::string& name) const;
+    void updateCache();
+
+    //memory policy
+    long long maxCacheBytes_;
+    size_t maxVectorBytes_;
+    int shrinkInterval_;
+
+    //job instrumentation
+    bool timingActive_;
+    long long timingEvents_, timingBytesUnzipped_, timingFileBytesStart_;
+    double timingReadWall_, timingReadCpu_, timingStartWall_, timingStartCpu_;
 
     void init();
 
     void setTree(TTree * tree);
 
     void populateBranchList();
+    void populateBranchList(TObjArray* lob);
+
+    //columns of a ColumnarTupleReader are registered as lazy variables read on first access
+    template<typename T> class ColumnVar;
+    template<typename T> class ColumnVec;
+    void populateColumnList();
+    template<typename T> void registerColumn(const std::string& name, const unsigned int iCol, const bool isVector);
     
+    //Branches are registered by their type in the NTupleTypes table
+    struct BranchRegistrar;
     void registerBranch(TBranch * const branch) const;
 
     bool calculateDerivedVariables();
 
+    void addFunction(FuncWrapper* func, const FuncDeps& deps, const std::string& name);
+
+    bool runFunction(FuncWrapper* func);
+
+    //threads running the functions of a schedule level concurrently, started on first use and
+    //kept for the life of the reader
+    class FunctionPool;
+    FunctionPool* functionPool_;
+
+    void buildSchedule();
+
     bool goToEventInternal(int evt, const bool filter);
 
     template<typename T> void registerBranch(const std::string& name) const
@@ -365,6 +923,9 @@ private:
 
         tree_->SetBranchStatus(name.c_str(), 1);
         tree_->SetBranchAddress(name.c_str(), branchMap_[name].ptr);
+
+        activatedBranches_.push_back(name);
+        addBranchToCache(name);
     }
     
     template<typename T> void registerVecBranch(const std::string& name) const
@@ -375,15 +936,22 @@ private:
 
         tree_->SetBranchStatus(name.c_str(), 1);
         tree_->SetBranchAddress(name.c_str(), branchVecMap_[name].ptr);
+
+        activatedBranches_.push_back(name);
+        addBranchToCache(name);
     }
 
+    //Scalars are read into a T, vectors through a std::vector<T>* as ROOT requires
+    template<typename T> void registerBranchOfType(const std::string& name, T*) const { registerBranch<T>(name); }
+    template<typename T> void registerBranchOfType(const std::string& name, std::vector<T>*) const { registerVecBranch<T>(name); }
+
     template<typename T> void updateTupleVar(const std::string& name, const T& var)
     {
         if(isFirstEvent())
         {
             if(branchMap_.find(name) == branchMap_.end())
             {
-                branchMap_[name] = createVecHandle(new T());
+                branchMap_[name] = createHandle(new T());
                 
                 typeMap_[name] = demangle<T>();
             }
@@ -397,77 +965,34 @@ private:
         else THROW_SATEXCEPTION("Variable not found: \"" + name + "\"!!!\n");
     }
 
-    template<typename T, typename V> T& getTupleObj(const std::string& var, const V& v_tuple, bool forceLoad = false) const
+    //Reader handle of var read as type T (std::vector<X>* for vectors): the variable itself, its converted
+    //copy var___<f|d|i|a> when the types differ and conversions are enabled, or a tuple branch activated
+    //on the fly.  getTupleObj and the typed handles both resolve through here so they see the same storage
+    template<typename T, typename V> const Handle& findHandle(const std::string& var, const V& v_tuple, bool forceLoad = false) const
     {
-        std::string varName;
+        typedef typename std::remove_pointer<T>::type Tvar;
 
-        if(checkBranch(prefix_+var)){
-            varName = prefix_+var;
-        } else {
-            varName = var;
-        }
+        const std::string varName = checkBranch(prefix_+var) ? prefix_+var : var;
 
         //Find variable in the main tuple map 
         auto tuple_iter = v_tuple.find(varName);
         bool intuple = tuple_iter != v_tuple.end() ;
 
         //Check that the variable exists and the requested type matches the true variable type
-        if(intuple && ( (tuple_iter->second.type == typeid(typename std::remove_pointer<T>::type)) || forceLoad ))
-        {
-            return *static_cast<T*>(tuple_iter->second.ptr);
-        }
-        else if(convertHackActive_ && intuple) //else check if it is a vector<float> or vector<double>
-        {
-            //hack to get vector<double> as vector<float>, requires DuplicateFDVector() to be run
-            char typen;
-            if( typeid(typename std::remove_pointer<T>::type) == typeid(std::vector<float>) && tuple_iter->second.type == typeid(std::vector<double>))
-                typen='f';
-            if( typeid(typename std::remove_pointer<T>::type) == typeid(std::vector<double>) && tuple_iter->second.type == typeid(std::vector<float>))
-                typen='d';
-            if( typeid(typename std::remove_pointer<T>::type) == typeid(std::vector<int>) && tuple_iter->second.type == typeid(std::vector<unsigned int>))
-                typen='i';
-            if( typeid(typename std::remove_pointer<T>::type) == typeid(std::vector<int>) && tuple_iter->second.type == typeid(std::vector<float>))
-                typen='a';
-
-            std::string newname = varName+"___" + typen;
-            auto tuple_iter = branchVecMap_.find(newname);
-            if (tuple_iter != branchVecMap_.end()){
-                //std::cout << "Providing converted vector for " << varName << ", " << newname << std::endl;
-                return *static_cast<T*>(tuple_iter->second.ptr);
+        if(intuple && (tuple_iter->second.type == typeid(Tvar) || forceLoad))
+        {
+            return tuple_iter->second;
+        }
+        else if(convertHackActive_ && intuple)
+        {
+            //converted copy of the requested type, requires setConvertFloatingPointVectors/Scalars
+            for(const char typen : {'f', 'd', 'i', 'a'})
+            {
+                auto conv_iter = v_tuple.find(varName + "___" + typen);
+                if(conv_iter != v_tuple.end() && conv_iter->second.type == typeid(Tvar)) return conv_iter->second;
             }
-
-            std::string varType;
-            getType(varName,varType);
-            //std::cout << "Looking for doubles/floats for " << varName << " with type: " << varType << std::endl;
-
-/*
-            if( typeid(typename std::remove_pointer<T>::type) == typeid(float) && tuple_iter->second.type == typeid(double))
-                typen='f';
-            if( typeid(typename std::remove_pointer<T>::type) == typeid(double) && tuple_iter->second.type == typeid(float))
-                typen='d';
-            if( typeid(typename std::remove_pointer<T>::type) == typeid(float) && tuple_iter->second.type == typeid(int))
-                typen='i';
-
-            newname = varName+"___" + typen;
-            auto tuple_iter2 = branchMap_.find(newname);
-            if (tuple_iter2 != branchMap_.end())
-                return *static_cast<T*>(tuple_iter2->second.ptr);
-*/
-
-            auto tuple_iter2 = branchMap_.find(varName+"___d");
-            if (tuple_iter2 != branchMap_.end())
-                return *static_cast<T*>(tuple_iter2->second.ptr);
-
-            auto tuple_iter3 = branchMap_.find(varName+"___f");
-            if (tuple_iter3 != branchMap_.end())
-                return *static_cast<T*>(tuple_iter3->second.ptr);
-
-            auto tuple_iter4 = branchMap_.find(varName+"___i");
-            if (tuple_iter4 != branchMap_.end())
-                return *static_cast<T*>(tuple_iter4->second.ptr);
-
         }
-        else if( !intuple && (typeMap_.find(varName) != typeMap_.end())) //If it is not loaded, but is a branch in tuple
+        else if(!intuple && tree_ && typeMap_.find(varName) != typeMap_.end()) //If it is not loaded, but is a branch in tuple
         {
             //If found in typeMap_, it can be added on the fly
             TBranch *branch = tree_->FindBranch(varName.c_str());
@@ -477,20 +1002,12 @@ private:
             {
                 registerBranch(branch);
         
-                //get iterator
-                tuple_iter = v_tuple.find(varName);
-        
                 //force read just this branch
                 branch->GetEvent(nevt_ - 1);
         
-                intuple = true;
-
                 //If it is the same type as requested, we can simply return the result
-                if(tuple_iter->second.type == typeid(typename std::remove_pointer<T>::type))
-                {
-                    //return value
-                    return *static_cast<T*>(tuple_iter->second.ptr);
-                }
+                tuple_iter = v_tuple.find(varName);
+                if(tuple_iter != v_tuple.end() && tuple_iter->second.type == typeid(Tvar)) return tuple_iter->second;
             }
         } 
 
@@ -498,11 +1015,29 @@ private:
         auto typeIter = typeMap_.find(var);
         if(typeIter != typeMap_.end())
         {
-            THROW_SATEXCEPTION("Variable not found: \"" + var + "\" with type \"" + demangle<typename std::remove_pointer<T>::type>() +"\", but is found with type \"" + typeIter->second + "\"!!!");
+            THROW_SATEXCEPTION("Variable not found: \"" + var + "\" with type \"" + demangle<Tvar>() +"\", but is found with type \"" + typeIter->second + "\"!!!");
         }
         else
         {
-            THROW_SATEXCEPTION("Variable not found: \"" + var + "\" with type \"" + demangle<typename std::remove_pointer<T>::type>() +"\"!!!");
+            THROW_SATEXCEPTION("Variable not found: \"" + var + "\" with type \"" + demangle<Tvar>() +"\"!!!");
+        }
+    }
+
+    template<typename T, typename V> T& getTupleObj(const std::string& var, const V& v_tuple, bool forceLoad = false) const
+    {
+        const Handle& h = findHandle<T>(var, v_tuple, forceLoad);
+        h.accessed = true;
+        if(h.lazy) updateLazy(h);
+        return *static_cast<T*>(h.ptr);
+    }
+
+    //Compute a lazy variable if it is not yet up to date for the current event
+    inline void updateLazy(const Handle& h) const
+    {
+        if(h.lazy->evaluatedEvt != evtProcessed_)
+        {
+            h.lazy->evaluate(const_cast<NTupleReader&>(*this), h.ptr);
+            h.lazy->evaluatedEvt = evtProcessed_;
         }
     }
 
@@ -0,0 +1,189 @@
+#ifndef NTUPLE_TYPES_H
+#define NTUPLE_TYPES_H
+
+#include "TBranch.h"
+#include "TClass.h"
+#include "TDataType.h"
+#include "TLeaf.h"
+#include "TLeafC.h"
+#include "TObjArray.h"
+#include "TVirtualCollectionProxy.h"
+#include "TLorentzVector.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <typeinfo>
+#include <cstdlib>
+#include <cxxabi.h>
+
+/* Table of the variable types of our tuples, shared by NTupleReader, which registers the tree
+   branches through it, and MiniTupleMaker, which writes reader variables back into a tree, so
+   both accept the same types
+
+   struct Register
+   {
+       template<typename T> void operator()() const { ... T is e.g. int or std::vector<std::vector<float>> ... }
+   };
+   NTupleTypes::TypeId id = NTupleTypes::findBranchType(branch);
+   if(!NTupleTypes::dispatch(id, Register())) THROW_SATEXCEPTION(...);
+
+   A type is one of the BaseTypes nested in up to MAX_DEPTH std::vectors.  Branches are identified
+   from the EDataType of their leaf or, for STL collections, the value type of their collection
+   proxy, instead of matching the branch title or class name.  Reader variables are identified
+   from their demangled type name (NTupleReader::getType) by exact lookup.  dispatch() calls the
+   functor with the C++ type of the id
+ */
+
+namespace NTupleTypes
+{
+    template<typename... Ts> struct TypeList {};
+
+    typedef TypeList<double, float, int, unsigned int, long, unsigned long, short, unsigned short, char, unsigned char, bool, std::string, TLorentzVector> BaseTypes;
+
+    //number of std::vector levels around a base type, vector<vector<T>> is the deepest
+    static const int MAX_DEPTH = 2;
+
+    struct TypeId
+    {
+        //index in BaseTypes, -1 for a type not in the table
+        int base;
+        int depth;
+
+        TypeId(int base = -1, int depth = 0) : base(base), depth(depth) {}
+        bool valid() const { return base >= 0 && depth >= 0 && depth <= MAX_DEPTH; }
+    };
+
+    //Index of T in the list, -1 if it is not in it
+    template<typename T, typename L> struct IndexOf;
+    template<typename T> struct IndexOf<T, TypeList<>> { static const int value = -1; };
+    template<typename T, typename... Ts> struct IndexOf<T, TypeList<T, Ts...>> { static const int value = 0; };
+    template<typename T, typename U, typename... Ts> struct IndexOf<T, TypeList<U, Ts...>>
+    {
+        static const int value = (IndexOf<T, TypeList<Ts...>>::value < 0) ? -1 : 1 + IndexOf<T, TypeList<Ts...>>::value;
+    };
+
+    template<typename T> inline int baseIndex() { return IndexOf<T, BaseTypes>::value; }
+
+    //Base type of a ROOT leaf type, Long64_t and ULong64_t are read as long and unsigned long.
+    //Unsigned char ("/b") is used for flags in our tuples, as a plain leaf it is read as bool
+    //as it always was, inside a std::vector it stays unsigned char
+    inline int baseIndex(const EDataType type, const bool leaf = false)
+    {
+        switch(type)
+        {
+        case kDouble_t:
+        case kDouble32_t: return baseIndex<double>();
+        case kFloat_t:
+        case kFloat16_t:  return baseIndex<float>();
+        case kInt_t:      return baseIndex<int>();
+        case kUInt_t:     return baseIndex<unsigned int>();
+        case kLong_t:
+        case kLong64_t:   return baseIndex<long>();
+        case kULong_t:
+        case kULong64_t:  return baseIndex<unsigned long>();
+        case kShort_t:    return baseIndex<short>();
+        case kUShort_t:   return baseIndex<unsigned short>();
+        case kChar_t:     return baseIndex<char>();
+        case kUChar_t:    return leaf ? baseIndex<bool>() : baseIndex<unsigned char>();
+        case kBool_t:     return baseIndex<bool>();
+        default:          return -1;
+        }
+    }
+
+    //Base type of a ROOT class held in a collection
+    inline int baseIndex(const TClass* cl)
+    {
+        const std::string name(cl->GetName());
+        if(name == "string" || name == "std::string") return baseIndex<std::string>();
+        if(name == "TLorentzVector")                  return baseIndex<TLorentzVector>();
+        return -1;
+    }
+
+    //Type of a tree branch.  Only single scalar leaf branches and (nested) std::vectors are supported,
+    //the reader gives the branch the address of the variable itself, which does not work for object
+    //branches, leaf lists or arrays.  C strings ("/C") report kChar_t and are rejected by their leaf
+    inline TypeId findBranchType(TBranch* const branch)
+    {
+        TClass* cl = nullptr;
+        EDataType type = kOther_t;
+        if(branch->GetExpectedType(cl, type) != 0) return TypeId();
+        if(!cl)
+        {
+            TObjArray* leaves = branch->GetListOfLeaves();
+            if(!leaves || leaves->GetEntries() != 1) return TypeId();
+            TLeaf* leaf = static_cast<TLeaf*>(leaves->UncheckedAt(0));
+            if(dynamic_cast<TLeafC*>(leaf) || leaf->GetLeafCount() || leaf->GetLenStatic() != 1) return TypeId();
+            return TypeId(baseIndex(type, true), 0);
+        }
+
+        for(int depth = 1; depth <= MAX_DEPTH; ++depth)
+        {
+            TVirtualCollectionProxy* proxy = cl->GetCollectionProxy();
+            if(!proxy || proxy->GetCollectionType() != ROOT::kSTLvector) return TypeId();
+
+            cl = proxy->GetValueClass();
+            if(!cl) return TypeId(baseIndex(proxy->GetType()), depth);
+            if(!cl->GetCollectionProxy()) return TypeId(baseIndex(cl), depth);
+        }
+        return TypeId();
+    }
+
+    inline std::string demangle(const std::type_info& type)
+    {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(type.name(), 0, 0, &status);
+        std::string s = demangled ? demangled : type.name();
+        free(demangled);
+        return s;
+    }
+
+    namespace detail
+    {
+        inline void addNames(std::unordered_map<std::string, TypeId>&, TypeList<>) {}
+        template<typename T, typename... Ts> void addNames(std::unordered_map<std::string, TypeId>& names, TypeList<T, Ts...>)
+        {
+            const int base = baseIndex<T>();
+            names[demangle(typeid(T))] = TypeId(base, 0);
+            names[demangle(typeid(std::vector<T>))] = TypeId(base, 1);
+            names[demangle(typeid(std::vector<std::vector<T>>))] = TypeId(base, 2);
+            addNames(names, TypeList<Ts...>());
+        }
+
+        template<typename F> bool dispatch(const TypeId&, F&, TypeList<>, int) { return false; }
+        template<typename F, typename T, typename... Ts> bool dispatch(const TypeId& id, F& f, TypeList<T, Ts...>, int i)
+        {
+            if(i != id.base) return dispatch(id, f, TypeList<Ts...>(), i + 1);
+            switch(id.depth)
+            {
+            case 0: f.template operator()<T>(); return true;
+            case 1: f.template operator()<std::vector<T>>(); return true;
+            case 2: f.template operator()<std::vector<std::vector<T>>>(); return true;
+            default: return false;
+            }
+        }
+    }
+
+    //Type of a reader variable from the demangled name of its C++ type
+    inline TypeId findType(const std::string& typeName)
+    {
+        static const std::unordered_map<std::string, TypeId> names = []()
+        {
+            std::unordered_map<std::string, TypeId> n;
+            detail::addNames(n, BaseTypes());
+            return n;
+        }();
+
+        auto iter = names.find(typeName);
+        return (iter != names.end()) ? iter->second : TypeId();
+    }
+
+    //Call f.template operator()<T>() with the C++ type T of id, false if id is not in the table
+    template<typename F> bool dispatch(const TypeId& id, F&& f)
+    {
+        if(!id.valid()) return false;
+        return detail::dispatch(id, f, BaseTypes(), 0);
+    }
+}
+
+#endif
@@ -1,27 +1,40 @@
 #include "PDFUncertainty.h"
 #include <cmath>
 #include "TMath.h"
+#include <algorithm>
 
+const char* const PDFUncertainty::outputNames[PDFUncertainty::N_OUTPUTS] = {
+    "PDF_Unc_Central", "PDF_Unc_Sys", "PDF_Unc_Up", "PDF_Unc_Down",
+    "Scaled_Variations_Up", "Scaled_Variations_Down", "Scaled_Variations_Nominal",
+    "NNPDF_Unc_Up", "NNPDF_Unc_Down", "NNPDF_Unc_ErrSym", "NNPDF_Unc_Central",
+    "NNPDF_Unc_Env_Up", "NNPDF_Unc_Env_Down",
+    "NNPDF_From_Median_Up", "NNPDF_From_Median_Down", "NNPDF_From_Median_Central"
+};
 
 PDFUncertainty::PDFUncertainty()
 {
 
         //Initialize all pdf sets
-        for(int in = 0; in < 53; in++){
+        for(int in = 0; in < nCT10; in++){
 
             pdf1.push_back(LHAPDF::mkPDF("CT10nlo", in));
 
         }
-        for(int in = 0; in < 51; in++){
+        for(int in = 0; in < nMMHT2014; in++){
 
             pdf2.push_back(LHAPDF::mkPDF("MMHT2014nlo68cl", in));
 
         }
-        for(int in = 0; in < 101; in++){
+        for(int in = 0; in < nNNPDF; in++){
 
             pdf3.push_back(LHAPDF::mkPDF("NNPDF30_nlo_as_0118", in));
 
         }
+
+        wgh_CT10.resize(nCT10);
+        wgh_MMHT2014.resize(nMMHT2014);
+        wgh_NNPDF.resize(nNNPDF);
+        sorted.resize(nNNPDF);
 }
 
 
@@ -31,6 +44,31 @@ PDFUncertainty::~PDFUncertainty()
 }
 
 
+void PDFUncertainty::memberWeights(const std::vector<LHAPDF::PDF*>& pdfs, int id1, float x1, int id2, float x2, float Q, std::vector<float>& weights)
+{
+        const int nMembers = pdfs.size();
+        for(int i = 0; i < nMembers; i++){
+          float xfx_1 = pdfs[i]->xfxQ(id1, x1, Q);
+          float xfx_2 = pdfs[i]->xfxQ(id2, x2, Q);
+          weights[i] = xfx_1*xfx_2;
+        }
+        //member 0 is evaluated once and normalises all members
+        const float w0 = weights[0];
+        for(int i = 0; i < nMembers; i++) weights[i] /= w0;
+}
+
+
+float PDFUncertainty::hessianVariance(const float* weights, int nPairs)
+{
+        float var = 0.0;
+        for (int k= 1; k <= nPairs; k++){
+            const float d = weights[2*k]-weights[2*k-1];
+            var += 0.25*d*d;
+        }
+        return var;
+}
+
+
 void PDFUncertainty::getPDFUncertainty(NTupleReader& tr)
 {
   //This is how we get variables from nTuple 
@@ -48,7 +86,6 @@ void PDFUncertainty::getPDFUncertainty(NTupleReader& tr)
         }
 
 	//For Scale Variations
-	std::vector<float> ScaleWeights;
         /*                                                                                                                         
           Compute the envelope of your observable for weight                                                                       
           indices 1,2,3,4,6,8 (index 0 corresponds to nominal                                                                      
@@ -57,105 +94,68 @@ void PDFUncertainty::getPDFUncertainty(NTupleReader& tr)
 	*/
         if( ScaleWeightsMiniAOD.size() == 9 )
         {
-            ScaleWeights.push_back(ScaleWeightsMiniAOD.at(1));
-            ScaleWeights.push_back(ScaleWeightsMiniAOD.at(2));
-            ScaleWeights.push_back(ScaleWeightsMiniAOD.at(3));
-            ScaleWeights.push_back(ScaleWeightsMiniAOD.at(4));
-            ScaleWeights.push_back(ScaleWeightsMiniAOD.at(6));
-            ScaleWeights.push_back(ScaleWeightsMiniAOD.at(8));
+            const float* sw = ScaleWeightsMiniAOD.data();
+            outputs[SCALE_UP]      = std::max(std::max(std::max(sw[1], sw[2]), std::max(sw[3], sw[4])), std::max(sw[6], sw[8]));
+            outputs[SCALE_DOWN]    = std::min(std::min(std::min(sw[1], sw[2]), std::min(sw[3], sw[4])), std::min(sw[6], sw[8]));
+            outputs[SCALE_NOMINAL] = sw[0];
         }
         else
         {
-            ScaleWeights.clear(); 
-            ScaleWeights.resize(6, 1.0);
+            outputs[SCALE_UP] = outputs[SCALE_DOWN] = outputs[SCALE_NOMINAL] = 1.0;
         }
 
-	auto biggest1 = std::max_element(std::begin(ScaleWeights), std::end(ScaleWeights));
-        auto smallest1 = std::min_element(std::begin(ScaleWeights), std::end(ScaleWeights));
-
-        float upperBound = *biggest1;
-	float lowerBound = *smallest1;
-        float scaleNominal = ScaleWeightsMiniAOD.size() == 9 ? ScaleWeightsMiniAOD.at(0) : 1.0;
-
 
 	//This Part for calculating PDF Uncertainty
-        //Vector to be stored.
-        std::vector<float> pdfweights;
-        std::vector<int> pdfids;
-
-
 	//	// weirdo LHA conventions, gluons are 0
 	//if (id1 == 21) id1 = 0;
 	//if (id2 == 21) id2 = 0;
 
-        //Variables to be registered after calculation.
-        float pdf_unc_sys;
-        float pdf_unc_central;
-        float pdf_unc_up;
-        float pdf_unc_down;
 	//Claculating PDF weights for each PDF Sets
-        //Set 1
-        int pdfid1 = -99;
-        float xfx1_1 = pdf1.at(0)->xfxQ(id1,  x1, Q);
-        float xfx2_1 = pdf1.at(0)->xfxQ(id2,  x2, Q);
-        float w01 = xfx1_1*xfx2_1;
-        float lhaweight1 = 0.0;
-        for(int i = 0; i < pdf1.size(); i++){
-          float      xfx_1_1 = pdf1.at(i)->xfxQ(id1, x1, Q);
-          float      xfx_2_1 = pdf1.at(i)->xfxQ(id2, x2, Q);
-          float w_new1 = xfx_1_1*xfx_2_1;
-          lhaweight1  = w_new1/w01;
-          pdfid1 = 1000 + i+1;
-          pdfweights.push_back(lhaweight1);
-          pdfids.push_back(pdfid1);
-        }
-        //Set 2
-        int pdfid2 = -99;
-        float xfx1_2 = pdf2.at(0)->xfxQ(id1,  x1, Q);
-        float xfx2_2 = pdf2.at(0)->xfxQ(id2,  x2, Q);
-        float w02 = xfx1_2*xfx2_2;
-        float lhaweight2 = 0.0;
-        for(int i = 0; i < pdf2.size(); i++){
-          float      xfx_1_2 = pdf2.at(i)->xfxQ(id1, x1, Q);
-          float      xfx_2_2 = pdf2.at(i)->xfxQ(id2, x2, Q);
-          float w_new2 = xfx_1_2*xfx_2_2;
-          lhaweight2  = w_new2/w02;
-          pdfid2 = 2000 + i+1;
-          pdfweights.push_back(lhaweight2);
-          pdfids.push_back(pdfid2);
-        }
-
-
-        //Set 3
-        int pdfid3 = -99;
-        float xfx1_3 = pdf3.at(0)->xfxQ(id1,  x1, Q);
-        float xfx2_3 = pdf3.at(0)->xfxQ(id2,  x2, Q);
-        float w03 = xfx1_3*xfx2_3;
-        float lhaweight3 = 0.0;
-        for(int i = 0; i < pdf3.size(); i++){
-          float      xfx_1_3 = pdf3.at(i)->xfxQ(id1, x1, Q);
-          float      xfx_2_3 = pdf3.at(i)->xfxQ(id2, x2, Q);
-          float w_new3 = xfx_1_3*xfx_2_3;
-          lhaweight3  = w_new3/w03;
-          pdfid3 = 3000 + i+1;
-          pdfweights.push_back(lhaweight3);
-          pdfids.push_back(pdfid3);
-        }
+        //PDF 1 CT10nlo....
+        //PDF 2 MMHT2014
+        //PDF 3 NNPDF...
+        memberWeights(pdf1, id1, x1, id2, x2, Q, wgh_CT10);
+        memberWeights(pdf2, id1, x1, id2, x2, Q, wgh_MMHT2014);
+        memberWeights(pdf3, id1, x1, id2, x2, Q, wgh_NNPDF);
+        const float* wNNPDF = wgh_NNPDF.data();
 
 
 	/********************************************************************/
-	//Now Envelope Method for NNPDF Set.
+	//Now Envelope Method for NNPDF Set, and NNPDF error from Mean
 	/********************************************************************/
-	std::vector<float> NNPDFWeights;
-	for(int nn = 0; nn < 101; nn++){
-	  NNPDFWeights.push_back(pdfweights.at(nn+104));
+
+	 /*
+	  *Alternatively since NNPDF is mc replica set best estimate will be
+	  *this one. 
+	  *Will follow the procedure 
+	  *to calculate the  average and standard deviation using Eqs. (2.3) and (2.4) of arXiv:1106.5788v2.
+	  */
+
+	//One pass over the replicas for the envelope (member 0 included) and the mean and spread (replicas only)
+	float upper_NNPDF = wNNPDF[0];
+	float lower_NNPDF = wNNPDF[0];
+	float av = 0.0;
+        float sd = 0.0;
+	for (int imem = 1; imem < nNNPDF; imem++) {
+	  const float w = wNNPDF[imem];
+	  upper_NNPDF = std::max(upper_NNPDF, w);
+	  lower_NNPDF = std::min(lower_NNPDF, w);
+	  av += w;
+	  sd += w*w;
 	}
-	
-	auto NNPDF_Up = std::max_element(std::begin(NNPDFWeights), std::end(NNPDFWeights));
-        auto NNPDF_Down = std::min_element(std::begin(NNPDFWeights), std::end(NNPDFWeights));
 
-        float upper_NNPDF = *NNPDF_Up;
-	float lower_NNPDF = *NNPDF_Down;
+	av /= 100.0; sd /= 100.0;
+	sd = 100/(100.0-1.0)*(sd-std::pow(av, 2));
+	sd = (sd > 0.0 && 100  > 1) ? std::sqrt(sd) : 0.0;
+
+	//Scaled to Mean(central value)
+	outputs[NNPDF_UNC_UP] = (av + sd)/av;
+	outputs[NNPDF_UNC_DOWN] = (av - sd)/av;
+	outputs[NNPDF_UNC_ERRSYM] = sd;
+	outputs[NNPDF_UNC_CENTRAL] = av;
+
+	outputs[NNPDF_ENV_UP] = upper_NNPDF;
+	outputs[NNPDF_ENV_DOWN] = lower_NNPDF;
 
 	/********************************************************************/
 	//NNPDF error from Median                            
@@ -169,29 +169,27 @@ void PDFUncertainty::getPDFUncertainty(NTupleReader& tr)
 
 	//	const float setCL = boost::math::erf(1/sqrt(2));
 	const float reqCL = 0.68;
-       
 
-	std::vector<float> sorted = NNPDFWeights;
+	std::copy(wgh_NNPDF.begin(), wgh_NNPDF.end(), sorted.begin());
 	std::sort(sorted.begin()+1, sorted.end());
 	int nmem = 100;   //Hard coded as (101 sets -1)
 	
-	float central;
-	float errminus;
-	float errplus;
-	float errsymm;
-
 	// even nmem => average of two middle values
-	central = 0.5*(sorted[nmem/2] + sorted[nmem/2 + 1]);
+	float central = 0.5*(sorted[nmem/2] + sorted[nmem/2 + 1]);
        
-	
 	// Define uncertainties via quantiles with a CL given by reqCL.
 	const int upper = std::round(0.5*(1+reqCL)*nmem); // round to nearest integer
 	const int lower = 1 + std::round(0.5*(1-reqCL)*nmem); // round to nearest integer
-	errplus = sorted[upper] - central;
-	errminus = central - sorted[lower];
-	errsymm = 0.5*(errplus + errminus); // symmetrised
-
+	float errplus = sorted[upper] - central;
+	float errminus = central - sorted[lower];
 
+	//NNPDF by median 68% cl
+	float NNPDF_from_median_up = central + errplus;
+	float NNPDF_from_median_down = central - errminus;
+	//Up and down are Scaled to central value
+	outputs[NNPDF_MEDIAN_UP] = NNPDF_from_median_up/central>2.0? 1.0 : NNPDF_from_median_up/central<-2.0? 1.0 : NNPDF_from_median_up/central;
+	outputs[NNPDF_MEDIAN_DOWN] = NNPDF_from_median_down/central>2.0? 1.0 : NNPDF_from_median_down/central<-2.0? 1.0 : NNPDF_from_median_down/central;
+	outputs[NNPDF_MEDIAN_CENTRAL] = central;
 
 
 	/********************************************************************/
@@ -199,151 +197,32 @@ void PDFUncertainty::getPDFUncertainty(NTupleReader& tr)
 	//Now calculate pdf uncertainities
 	/********************************************************************/
 
-
-
-	// All Variations Initialize to zero.
         float var_Weight[3];
-        for(int i = 0; i < 3; i++) var_Weight[i] = 0.0;
-
-
-        //PDF 1 CT10nlo....
-        //PDF 2 MMHT2014
-        //PDF 3 NNPDF...
-        float wgh_CT10[53];
-        float wgh_MMHT2014[51];
-        float wgh_NNPDF[101];
-
-        //Average central value for particular Pdf For each event.
-        for(int ic =0; ic < 53; ic++){
-            wgh_CT10[ic] = -1.0;
-            if(pdfids.at(ic) < 1200)  wgh_CT10[ic] = pdfweights.at(ic);
-        }
-
-        //***********************
-        for(int im =0; im < 51; im++){
-            wgh_MMHT2014[im] = -1.0;
-            if(pdfids.at(im+53) > 2000 && pdfids.at(im+53) < 2060)  wgh_MMHT2014[im] = pdfweights.at(im+53);
-        }
-
-
-        //*************************
-        for(int in =0; in < 101; in++){
-            wgh_NNPDF[in] = 0.0;
-            if(pdfids.at(in+104) > 2999) wgh_NNPDF[in] = pdfweights.at(in +104);
-
-        }
-
-
-	//********************************************************** 
-       
-
-
-
-        //**************************
-
-        //PDF 1 CT10 ....
-        for (int k= 1; k <= 26; k++){
-            var_Weight[0] += 0.25*(wgh_CT10[2*k]-wgh_CT10[2*k-1])*(wgh_CT10[2*k]-wgh_CT10[2*k-1]);
-        }
-
-        //MMHT2014
-        for (int k= 1; k <= 25; k++){
-            var_Weight[1] += 0.25*(wgh_MMHT2014[2*k]-wgh_MMHT2014[2*k-1])*(wgh_MMHT2014[2*k]-wgh_MMHT2014[2*k-1]);
-        }
-
-        //NNPDF
-        for (int k= 1; k <= 50; k++){
-            var_Weight[2] += 0.25*(wgh_NNPDF[2*k]-wgh_NNPDF[2*k-1])*(wgh_NNPDF[2*k]-wgh_NNPDF[2*k-1]);
-        }
-
-
+        var_Weight[0] = hessianVariance(wgh_CT10.data(), 26);
+        var_Weight[1] = hessianVariance(wgh_MMHT2014.data(), 25);
+        var_Weight[2] = hessianVariance(wNNPDF, 50);
 
       //Get std error
         for (int k=0;k<3;k++) var_Weight[k] = std::sqrt(var_Weight[k]);
         var_Weight[0] /= 1.645;            //----CTEQ6 variations correspond to 68% CL, so this factor extrapolates to 90%CL
         var_Weight[2]/= std::sqrt(50.0);   //----NNPDF variations are sampled from a Gaussian, so divide by sqrt(N)
 
-        pdf_unc_central = 0.5*(TMath::Max(wgh_NNPDF[0]+var_Weight[2],TMath::Max(wgh_CT10[0]+var_Weight[0],wgh_MMHT2014[0]+var_Weight[1])) + TMath::Min(wgh_NNPDF[0]-var_Weight[2],TMath::Min(wgh_CT10[0]-var_Weight[0],wgh_MMHT2014[0]-var_Weight[1])));
-        pdf_unc_sys = 0.5*(TMath::Max(wgh_NNPDF[0]+var_Weight[2],TMath::Max(wgh_CT10[0]+var_Weight[0],wgh_MMHT2014[0]+var_Weight[1])) - TMath::Min(wgh_NNPDF[0]-var_Weight[2],TMath::Min(wgh_CT10[0]-var_Weight[0],wgh_MMHT2014[0]-var_Weight[1])));
-
-        pdf_unc_up = (pdf_unc_central + pdf_unc_sys)/pdf_unc_central ;
-        pdf_unc_down = (pdf_unc_central - pdf_unc_sys)/pdf_unc_central ;
-
-
-
-
-
-
-	/********************************************************************/
-	//NNPDF error from Mean
-	/********************************************************************/
-
-
-	 /*
-	  *Alternatively since NNPDF is mc replica set best estimate will be
-	  *this one not done above. 
-	  *Will follow the procedure 
-	  *to calculate the  average and standard deviation using Eqs. (2.3) and (2.4) of arXiv:1106.5788v2.
-	  */
-
-	float av = 0.0;
-        float sd = 0.0;
-	for (size_t imem = 1; imem <= 100; imem++) {
-	  av += wgh_NNPDF[imem];
-	  sd += std::pow(wgh_NNPDF[imem],2);
-	}
-	
-	av /= 100.0; sd /= 100.0;
-	sd = 100/(100.0-1.0)*(sd-std::pow(av, 2));
-	sd = (sd > 0.0 && 100  > 1) ? std::sqrt(sd) : 0.0;
-	
-	float NNPDF_unc_up = av + sd;
-        float NNPDF_unc_down = av - sd;
-	float NNPDF_unc_errsym = sd;
-	float NNPDF_unc_central = av;
-	NNPDF_unc_up = NNPDF_unc_up/av;
-	NNPDF_unc_down =NNPDF_unc_down/av;
+        const float upperEnv = TMath::Max(wNNPDF[0]+var_Weight[2],TMath::Max(wgh_CT10[0]+var_Weight[0],wgh_MMHT2014[0]+var_Weight[1]));
+        const float lowerEnv = TMath::Min(wNNPDF[0]-var_Weight[2],TMath::Min(wgh_CT10[0]-var_Weight[0],wgh_MMHT2014[0]-var_Weight[1]));
+        const float pdf_unc_central = 0.5*(upperEnv + lowerEnv);
+        const float pdf_unc_sys = 0.5*(upperEnv - lowerEnv);
 
-
-
-	//register derived variables back to ntuples
-        tr.registerDerivedVar("PDF_Unc_Central", pdf_unc_central);
-        tr.registerDerivedVar("PDF_Unc_Sys", pdf_unc_sys);
-        
+        outputs[PDF_UNC_CENTRAL] = pdf_unc_central;
+        outputs[PDF_UNC_SYS] = pdf_unc_sys;
 	//Scaled up and low Value
-	tr.registerDerivedVar("PDF_Unc_Up", pdf_unc_up);
-        tr.registerDerivedVar("PDF_Unc_Down", pdf_unc_down);
+        outputs[PDF_UNC_UP] = (pdf_unc_central + pdf_unc_sys)/pdf_unc_central;
+        outputs[PDF_UNC_DOWN] = (pdf_unc_central - pdf_unc_sys)/pdf_unc_central;
 
-	//For Scale Variations
-	tr.registerDerivedVar("Scaled_Variations_Up",upperBound);
-	tr.registerDerivedVar("Scaled_Variations_Down",lowerBound);
-        tr.registerDerivedVar("Scaled_Variations_Nominal",scaleNominal);
-
-	// NNPDF from Mean
-	//Scaled to Mean(central value)
-        tr.registerDerivedVar("NNPDF_Unc_Up", NNPDF_unc_up);
-        tr.registerDerivedVar("NNPDF_Unc_Down", NNPDF_unc_down);
-
-	tr.registerDerivedVar("NNPDF_Unc_ErrSym", NNPDF_unc_errsym);
-	tr.registerDerivedVar("NNPDF_Unc_Central", NNPDF_unc_central);
-	
-	// NNPDF by envelope method
-	float NNPDF_Env_up = upper_NNPDF;
-	float NNPDF_Env_down = lower_NNPDF;
-	tr.registerDerivedVar("NNPDF_Unc_Env_Up", NNPDF_Env_up);
-	tr.registerDerivedVar("NNPDF_Unc_Env_Down", NNPDF_Env_down);
-
-	//NNPDF by median 68% cl
-	float NNPDF_from_median_up = central + errplus;
-	float NNPDF_from_median_down = central - errminus;
-	NNPDF_from_median_up = NNPDF_from_median_up/central>2.0? 1.0 : NNPDF_from_median_up/central<-2.0? 1.0 : NNPDF_from_median_up/central;
-	NNPDF_from_median_down = NNPDF_from_median_down/central>2.0? 1.0 : NNPDF_from_median_down/central<-2.0? 1.0 : NNPDF_from_median_down/central;
-	//Up and down are Scaled to central value
-	tr.registerDerivedVar("NNPDF_From_Median_Up", NNPDF_from_median_up);
-       	tr.registerDerivedVar("NNPDF_From_Median_Down", NNPDF_from_median_down);
-	
-	tr.registerDerivedVar("NNPDF_From_Median_Central", central);
 
+	//register derived variables back to ntuples
+        std::vector<float>& allOutputs = tr.derivedVec<float>("PDFUncertaintyWeights");
+        allOutputs.assign(outputs, outputs + N_OUTPUTS);
+        for(int i = 0; i < N_OUTPUTS; i++) tr.registerDerivedVar(outputNames[i], outputs[i]);
 }
 
 void PDFUncertainty::operator()(NTupleReader& tr)
@@ -351,5 +230,3 @@ void PDFUncertainty::operator()(NTupleReader& tr)
   //
     getPDFUncertainty(tr);
 }
-
-
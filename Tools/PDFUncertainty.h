@@ -5,9 +5,23 @@
 #include "NTupleReader.h"
 #include <vector>
 
+//All results are registered together in the fixed size vector "PDFUncertaintyWeights",
+//indexed by Output, as well as under their individual names (e.g. "PDF_Unc_Up")
 class PDFUncertainty
 {
  public:
+  enum Output
+  {
+    PDF_UNC_CENTRAL, PDF_UNC_SYS, PDF_UNC_UP, PDF_UNC_DOWN,
+    SCALE_UP, SCALE_DOWN, SCALE_NOMINAL,
+    NNPDF_UNC_UP, NNPDF_UNC_DOWN, NNPDF_UNC_ERRSYM, NNPDF_UNC_CENTRAL,
+    NNPDF_ENV_UP, NNPDF_ENV_DOWN,
+    NNPDF_MEDIAN_UP, NNPDF_MEDIAN_DOWN, NNPDF_MEDIAN_CENTRAL,
+    N_OUTPUTS
+  };
+  //Variable name of each Output
+  static const char* const outputNames[N_OUTPUTS];
+
   PDFUncertainty();
   virtual ~PDFUncertainty();
   void getPDFUncertainty(NTupleReader& tr);
@@ -15,9 +29,21 @@ class PDFUncertainty
 
  protected:
  private:
+  static const int nCT10 = 53, nMMHT2014 = 51, nNNPDF = 101;
+
   std::vector<LHAPDF::PDF*> pdf1;
   std::vector<LHAPDF::PDF*> pdf2;
   std::vector<LHAPDF::PDF*> pdf3;
+
+  //per event buffers, allocated once
+  std::vector<float> wgh_CT10, wgh_MMHT2014, wgh_NNPDF;
+  std::vector<float> sorted;
+  float outputs[N_OUTPUTS];
+
+  //weights of all members of a set relative to its member 0
+  static void memberWeights(const std::vector<LHAPDF::PDF*>& pdfs, int id1, float x1, int id2, float x2, float Q, std::vector<float>& weights);
+  //sum over the eigenvector pairs of 0.25*(w[2k] - w[2k-1])^2
+  static float hessianVariance(const float* weights, int nPairs);
 };
 
 #endif // PDFUNCERTAINTY_H
@@ -0,0 +1,127 @@
+#include "ParallelEventLoop.h"
+
+#include "TChain.h"
+#include "TH1.h"
+#include "TROOT.h"
+
+#include <thread>
+#include <exception>
+
+void ParallelWorker::merge(ParallelWorker& other)
+{
+    std::vector<TH1*> hists = getHistograms();
+    std::vector<TH1*> otherHists = other.getHistograms();
+
+    if(hists.size() != otherHists.size()) THROW_SATEXCEPTION("ParallelWorker::merge(...): workers do not provide the same number of histograms!!!");
+
+    for(unsigned int i = 0; i < hists.size(); ++i)
+    {
+        if(hists[i] && otherHists[i]) hists[i]->Add(otherHists[i]);
+    }
+}
+
+ParallelEventLoop::ParallelEventLoop(TChain* chain, int nThreads, const std::set<std::string>& activeBranches) : chain_(chain), nThreads_(nThreads), activeBranches_(activeBranches)
+{
+    if(!chain_) THROW_SATEXCEPTION("ParallelEventLoop(...): TChain is invalid!!!");
+    if(nThreads_ < 1) nThreads_ = 1;
+}
+
+ParallelEventLoop::~ParallelEventLoop()
+{
+    //workers may hold readers pointing to the chains, so they go first
+    workers_.clear();
+    for(auto& chain : threadChains_) delete chain;
+}
+
+void ParallelEventLoop::processRange(ParallelWorker& worker, TTree* tree, int first, int last) const
+{
+    NTupleReader tr(tree, activeBranches_);
+    tr.setEntryRange(first, last);
+    worker.setup(tr);
+
+    while(tr.getNextEvent())
+    {
+        worker.analyze(tr);
+    }
+}
+
+void ParallelEventLoop::run(const WorkerFactory& factory, int maxEvents)
+{
+    workers_.clear();
+    for(auto& chain : threadChains_) delete chain;
+    threadChains_.clear();
+
+    int nEntries = chain_->GetEntries();
+    if(maxEvents >= 0 && maxEvents < nEntries) nEntries = maxEvents;
+
+    //never use more threads than entries
+    int nThreads = (nThreads_ < nEntries) ? nThreads_ : ((nEntries > 0) ? nEntries : 1);
+
+    //workers are built serially and in order so their construction is reproducible
+    for(int iThread = 0; iThread < nThreads; ++iThread)
+    {
+        workers_.emplace_back(factory(iThread));
+        if(!workers_.back()) THROW_SATEXCEPTION("ParallelEventLoop::run(...): worker factory returned a null worker!!!");
+    }
+
+    if(nThreads == 1)
+    {
+        processRange(*workers_[0], chain_, 0, nEntries);
+        return;
+    }
+
+    ROOT::EnableThreadSafety();
+
+    //each thread reads through its own copy of the chain
+    for(int iThread = 0; iThread < nThreads; ++iThread)
+    {
+        TChain* chain = new TChain(chain_->GetName(), chain_->GetTitle());
+        chain->Add(chain_);
+        threadChains_.push_back(chain);
+    }
+
+    std::vector<std::exception_ptr> errors(nThreads);
+    std::vector<std::thread> threads;
+    for(int iThread = 0; iThread < nThreads; ++iThread)
+    {
+        //contiguous ranges, the ith thread reads [i*N/n, (i+1)*N/n)
+        int first = static_cast<int>((static_cast<long long>(nEntries) * iThread) / nThreads);
+        int last  = static_cast<int>((static_cast<long long>(nEntries) * (iThread + 1)) / nThreads);
+
+        threads.emplace_back([this, &errors, iThread, first, last]()
+        {
+            try
+            {
+                processRange(*workers_[iThread], threadChains_[iThread], first, last);
+            }
+            catch(...)
+            {
+                errors[iThread] = std::current_exception();
+            }
+        });
+    }
+
+    for(auto& thread : threads) thread.join();
+
+    for(auto& error : errors)
+    {
+        if(error) std::rethrow_exception(error);
+    }
+
+    //merge in thread order to keep the result independent of scheduling
+    for(int iThread = 1; iThread < nThreads; ++iThread)
+    {
+        workers_[0]->merge(*workers_[iThread]);
+    }
+}
+
+ParallelWorker& ParallelEventLoop::getMergedWorker()
+{
+    if(workers_.empty()) THROW_SATEXCEPTION("ParallelEventLoop::getMergedWorker(): run() has not been called yet!!!");
+    return *workers_[0];
+}
+
+std::vector<TH1*> ParallelEventLoop::getHistograms()
+{
+    return getMergedWorker().getHistograms();
+}
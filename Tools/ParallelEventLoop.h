@@ -0,0 +1,94 @@
+#ifndef PARALLEL_EVENT_LOOP_H
+#define PARALLEL_EVENT_LOOP_H
+
+#include "NTupleReader.h"
+
+#include <vector>
+#include <set>
+#include <string>
+#include <functional>
+#include <memory>
+
+class TChain;
+class TH1;
+
+/* Opt-in multi-threaded replacement for the usual
+
+   NTupleReader tr(chain);
+   BaselineVessel blv(tr);
+   tr.registerFunction(blv);
+   while(tr.getNextEvent()) { ... fill histograms ... }
+
+   The entries of the chain are split into nThreads contiguous ranges and each range is
+   processed by its own copy of the chain with its own NTupleReader.  Everything which
+   holds per event state (BaselineVessel, BTagCorrector, output histograms ...) must be
+   created per thread through a ParallelWorker, e.g.
+
+   class MyWorker : public ParallelWorker
+   {
+       BaselineVessel* blv;
+       TH1D* hMET;
+   public:
+       MyWorker() : blv(nullptr) { hMET = new TH1D("met", "met", 100, 0, 1000); hMET->SetDirectory(0); }
+       void setup(NTupleReader& tr) { blv = new BaselineVessel(tr); tr.registerFunction(*blv); }
+       void analyze(NTupleReader& tr) { hMET->Fill(tr.getVar<double>("met")); }
+       std::vector<TH1*> getHistograms() { return {hMET}; }
+   };
+
+   ParallelEventLoop loop(chain, 8);
+   loop.run([](int iThread) { return new MyWorker(); });
+   loop.getHistograms()[0]->Write();
+
+   Workers are constructed serially on the calling thread in thread order and merged in the
+   same order after all threads are done, so for a given number of threads the merged
+   output does not depend on thread scheduling.
+ */
+
+class ParallelWorker
+{
+public:
+    virtual ~ParallelWorker() {}
+
+    //Called on the worker thread with the thread local reader before the first event is read,
+    //this is the place to register functions such as BaselineVessel
+    virtual void setup(NTupleReader& tr) {}
+
+    //Called for every event passing the registered filters
+    virtual void analyze(NTupleReader& tr) = 0;
+
+    //Histograms to be summed across workers, every worker must return them in the same order
+    virtual std::vector<TH1*> getHistograms() = 0;
+
+    //Add the output of another worker to this one, by default this sums getHistograms()
+    virtual void merge(ParallelWorker& other);
+};
+
+class ParallelEventLoop
+{
+public:
+    typedef std::function<ParallelWorker*(int)> WorkerFactory;
+
+    ParallelEventLoop(TChain* chain, int nThreads = 1, const std::set<std::string>& activeBranches = std::set<std::string>());
+    ~ParallelEventLoop();
+
+    //Process maxEvents entries (all if < 0) with one worker per thread.  With one thread
+    //the original chain is read on the calling thread exactly like a serial loop
+    void run(const WorkerFactory& factory, int maxEvents = -1);
+
+    //Worker holding the merged output, valid after run()
+    ParallelWorker& getMergedWorker();
+    std::vector<TH1*> getHistograms();
+
+    int getNThreads() const { return nThreads_; }
+
+private:
+    TChain* chain_;
+    int nThreads_;
+    std::set<std::string> activeBranches_;
+    std::vector<std::unique_ptr<ParallelWorker>> workers_;
+    std::vector<TChain*> threadChains_;
+
+    void processRange(ParallelWorker& worker, TTree* tree, int first, int last) const;
+};
+
+#endif
@@ -0,0 +1,210 @@
+#include "ParallelSampleDriver.h"
+#include "NTupleCheckpoint.h"
+
+#include "TChain.h"
+#include "TH1.h"
+#include "TROOT.h"
+
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <exception>
+#include <algorithm>
+
+void SampleAnalyzer::merge(SampleAnalyzer& other)
+{
+    std::vector<TH1*> hists = getHistograms();
+    std::vector<TH1*> otherHists = other.getHistograms();
+
+    if(hists.size() != otherHists.size()) THROW_SATEXCEPTION("SampleAnalyzer::merge(...): analyzers do not provide the same number of histograms!!!");
+
+    for(unsigned int i = 0; i < hists.size(); ++i)
+    {
+        if(hists[i] && otherHists[i]) hists[i]->Add(otherHists[i]);
+    }
+}
+
+namespace
+{
+    //One chunk of the file list of a sample
+    struct SampleTask
+    {
+        const AnaSamples::FileSummary* fs;
+        int startFile, nFiles;
+        std::unique_ptr<SampleAnalyzer> analyzer;
+        std::exception_ptr error;
+    };
+
+    //Per thread queues of task indices, a thread takes from the front of its own queue and
+    //steals from the back of the others once it runs dry
+    class TaskQueues
+    {
+    public:
+        TaskQueues(int nThreads) : queues_(nThreads), mutexes_(nThreads) {}
+
+        void push(int iThread, int task) { queues_[iThread].push_back(task); }
+
+        bool next(int iThread, int& task)
+        {
+            int n = queues_.size();
+            for(int i = 0; i < n; ++i)
+            {
+                int iQueue = (iThread + i) % n;
+                std::lock_guard<std::mutex> lock(mutexes_[iQueue]);
+                std::deque<int>& queue = queues_[iQueue];
+                if(queue.empty()) continue;
+                if(i == 0)
+                {
+                    task = queue.front();
+                    queue.pop_front();
+                }
+                else
+                {
+                    task = queue.back();
+                    queue.pop_back();
+                }
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        std::vector<std::deque<int>> queues_;
+        std::vector<std::mutex> mutexes_;
+    };
+
+    void processTask(SampleTask& task, const std::set<std::string>& activeBranches, int maxEvents, const std::string& checkpointDir, long long checkpointEvents)
+    {
+        TChain chain(task.fs->treePath.c_str());
+        task.fs->addFilesToChain(&chain, task.startFile, task.nFiles);
+
+        NTupleReader tr(&chain, activeBranches);
+        if(maxEvents >= 0) tr.setEntryRange(0, maxEvents);
+        task.analyzer->setup(tr, *task.fs);
+
+        std::unique_ptr<NTupleCheckpoint> checkpoint;
+        if(checkpointDir.size())
+        {
+            checkpoint.reset(new NTupleCheckpoint(checkpointDir + "/" + task.fs->tag + "_" + std::to_string(task.startFile) + ".ckpt.root", checkpointEvents));
+            checkpoint->addHistograms(task.analyzer->getHistograms());
+            checkpoint->resume(tr);
+        }
+
+        const double weight = task.fs->getWeight();
+        while(tr.getNextEvent())
+        {
+            task.analyzer->analyze(tr, weight);
+            if(checkpoint) checkpoint->update(tr);
+        }
+
+        if(checkpoint && !checkpoint->isFinished()) checkpoint->finish(tr);
+    }
+}
+
+ParallelSampleDriver::ParallelSampleDriver(AnaSamples::SampleCollection& samples, int nThreads, int filesPerTask, const std::set<std::string>& activeBranches) : samples_(samples), nThreads_(nThreads), filesPerTask_(filesPerTask), nTasks_(0), activeBranches_(activeBranches), checkpointEvents_(100000)
+{
+    if(nThreads_ < 1) nThreads_ = 1;
+    if(filesPerTask_ < 1) filesPerTask_ = 1;
+}
+
+void ParallelSampleDriver::run(const std::string& collection, const AnalyzerFactory& factory, int maxEventsPerTask)
+{
+    sampleTags_.clear();
+    results_.clear();
+
+    const std::vector<AnaSamples::FileSummary>& fsVec = samples_[collection];
+    if(fsVec.empty()) THROW_SATEXCEPTION("ParallelSampleDriver::run(...): sample collection \"" + collection + "\" is empty or does not exist!!!");
+
+    //the file lists are read here, reading them lazily from several threads would race
+    std::vector<SampleTask> tasks;
+    for(const auto& fs : fsVec)
+    {
+        if(std::find(sampleTags_.begin(), sampleTags_.end(), fs.tag) == sampleTags_.end()) sampleTags_.push_back(fs.tag);
+        fs.readFileList();
+        int nFiles = fs.getFilelist().size();
+        for(int startFile = 0; startFile < nFiles; startFile += filesPerTask_)
+        {
+            tasks.emplace_back();
+            tasks.back().fs = &fs;
+            tasks.back().startFile = startFile;
+            tasks.back().nFiles = filesPerTask_;
+        }
+    }
+    nTasks_ = tasks.size();
+
+    //analyzers are built serially and in order so their construction is reproducible
+    for(auto& task : tasks)
+    {
+        task.analyzer.reset(factory(task.fs->tag));
+        if(!task.analyzer) THROW_SATEXCEPTION("ParallelSampleDriver::run(...): analyzer factory returned a null analyzer!!!");
+    }
+
+    int nThreads = (nThreads_ < nTasks_) ? nThreads_ : ((nTasks_ > 0) ? nTasks_ : 1);
+
+    if(nThreads == 1)
+    {
+        for(auto& task : tasks) processTask(task, activeBranches_, maxEventsPerTask, checkpointDir_, checkpointEvents_);
+    }
+    else
+    {
+        ROOT::EnableThreadSafety();
+
+        //deal the tasks round robin, neighbouring chunks usually cost about the same
+        TaskQueues queues(nThreads);
+        for(int iTask = 0; iTask < nTasks_; ++iTask) queues.push(iTask % nThreads, iTask);
+
+        std::vector<std::thread> threads;
+        for(int iThread = 0; iThread < nThreads; ++iThread)
+        {
+            threads.emplace_back([this, &tasks, &queues, iThread, maxEventsPerTask]()
+            {
+                int iTask;
+                while(queues.next(iThread, iTask))
+                {
+                    try
+                    {
+                        processTask(tasks[iTask], activeBranches_, maxEventsPerTask, checkpointDir_, checkpointEvents_);
+                    }
+                    catch(...)
+                    {
+                        tasks[iTask].error = std::current_exception();
+                    }
+                }
+            });
+        }
+
+        for(auto& thread : threads) thread.join();
+
+        for(auto& task : tasks)
+        {
+            if(task.error) std::rethrow_exception(task.error);
+        }
+    }
+
+    //merge the tasks of each sample in task order to keep the result independent of scheduling
+    for(auto& task : tasks)
+    {
+        std::unique_ptr<SampleAnalyzer>& result = results_[task.fs->tag];
+        if(!result) result = std::move(task.analyzer);
+        else        result->merge(*task.analyzer);
+    }
+
+    //samples without any file still get an (empty) result
+    for(const auto& fs : fsVec)
+    {
+        std::unique_ptr<SampleAnalyzer>& result = results_[fs.tag];
+        if(!result) result.reset(factory(fs.tag));
+    }
+}
+
+SampleAnalyzer& ParallelSampleDriver::getResult(const std::string& tag)
+{
+    auto iter = results_.find(tag);
+    if(iter == results_.end() || !iter->second) THROW_SATEXCEPTION("ParallelSampleDriver::getResult(...): no result for sample \"" + tag + "\", has run() been called?");
+    return *iter->second;
+}
+
+std::vector<TH1*> ParallelSampleDriver::getHistograms(const std::string& tag)
+{
+    return getResult(tag).getHistograms();
+}
@@ -0,0 +1,106 @@
+#ifndef PARALLEL_SAMPLE_DRIVER_H
+#define PARALLEL_SAMPLE_DRIVER_H
+
+#include "NTupleReader.h"
+#include "samples.h"
+
+#include <vector>
+#include <set>
+#include <map>
+#include <string>
+#include <functional>
+#include <memory>
+
+class TH1;
+
+/* Runs an analysis over every sample of a SampleCollection in parallel, replacing loops like
+
+   for(auto& fs : sc["ZJetsToNuNu"])
+   {
+       TChain* t = new TChain(fs.treePath.c_str());
+       fs.addFilesToChain(t);
+       NTupleReader tr(t);
+       while(tr.getNextEvent()) hMET->Fill(tr.getVar<double>("met"), fs.getWeight());
+   }
+
+   The file list of each sample is cut into chunks of filesPerTask files and every
+   (sample, chunk) pair becomes a task.  Tasks run on a fixed set of threads, each thread works
+   through its own queue and takes tasks from the others once it is empty.  Every task gets
+   its own SampleAnalyzer, e.g.
+
+   class MyAnalyzer : public SampleAnalyzer
+   {
+       TH1D* hMET;
+   public:
+       MyAnalyzer(const std::string& tag) { hMET = new TH1D(("met_" + tag).c_str(), "met", 100, 0, 1000); hMET->SetDirectory(0); }
+       void setup(NTupleReader& tr, const AnaSamples::FileSummary& fs) { tr.registerFunction(...); }
+       void analyze(NTupleReader& tr, double weight) { hMET->Fill(tr.getVar<double>("met"), weight); }
+       std::vector<TH1*> getHistograms() { return {hMET}; }
+   };
+
+   ParallelSampleDriver driver(sc, 8);
+   driver.run("ZJetsToNuNu", [](const std::string& tag) { return new MyAnalyzer(tag); });
+   for(auto& tag : driver.getSampleTags()) for(TH1* h : driver.getHistograms(tag)) h->Write();
+
+   analyze() is given FileSummary::getWeight() of the sample being processed.  Analyzers are
+   constructed serially on the calling thread in task order and the tasks of each sample are
+   merged in that same order, so the output does not depend on thread scheduling.
+
+   With setCheckpoint(dir) every task keeps an NTupleCheckpoint of its histograms in dir, a
+   rerun of a preempted job restores finished tasks without reading them and continues the
+   others from their last checkpoint.  Analyzer state outside getHistograms() is not saved.
+ */
+
+class SampleAnalyzer
+{
+public:
+    virtual ~SampleAnalyzer() {}
+
+    //Called on the worker thread with the task's reader before the first event is read
+    virtual void setup(NTupleReader& tr, const AnaSamples::FileSummary& fs) {}
+
+    //Called for every event passing the registered filters, weight is fs.getWeight()
+    virtual void analyze(NTupleReader& tr, double weight) = 0;
+
+    //Histograms to be summed across the tasks of a sample, always in the same order
+    virtual std::vector<TH1*> getHistograms() = 0;
+
+    //Add the output of another task of the same sample, by default this sums getHistograms()
+    virtual void merge(SampleAnalyzer& other);
+};
+
+class ParallelSampleDriver
+{
+public:
+    //Builds the analyzer for one task of the sample with the given FileSummary tag
+    typedef std::function<SampleAnalyzer*(const std::string&)> AnalyzerFactory;
+
+    ParallelSampleDriver(AnaSamples::SampleCollection& samples, int nThreads = 1, int filesPerTask = 1, const std::set<std::string>& activeBranches = std::set<std::string>());
+
+    //Process every sample of the collection, at most maxEventsPerTask events per task (all if < 0)
+    void run(const std::string& collection, const AnalyzerFactory& factory, int maxEventsPerTask = -1);
+
+    //Results of the last run(), one merged analyzer per sample in collection order
+    const std::vector<std::string>& getSampleTags() const { return sampleTags_; }
+    SampleAnalyzer& getResult(const std::string& tag);
+    std::vector<TH1*> getHistograms(const std::string& tag);
+
+    //Checkpoint each task in dir every nEvents events, an empty dir disables checkpointing
+    void setCheckpoint(const std::string& dir, long long nEvents = 100000) { checkpointDir_ = dir; checkpointEvents_ = nEvents; }
+
+    int getNThreads() const { return nThreads_; }
+    int getNTasks() const { return nTasks_; }
+
+private:
+    AnaSamples::SampleCollection& samples_;
+    int nThreads_;
+    int filesPerTask_;
+    int nTasks_;
+    std::set<std::string> activeBranches_;
+    std::string checkpointDir_;
+    long long checkpointEvents_;
+    std::vector<std::string> sampleTags_;
+    std::map<std::string, std::unique_ptr<SampleAnalyzer>> results_;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define PILEUPWEIGHTS_H
 
 #include "NTupleReader.h"
+#include "FlatHist.h"
 #include "TH1.h"
 
 template<typename data_t>
@@ -14,9 +15,10 @@ public:
         //Calling the Jasn file from RA2b currently
         TFile Pileup_Jasn(filename.c_str());
         //These are the historgrams currently in the Jasn file
-        pu_central  = (TH1F*)Pileup_Jasn.Get("pu_weights_central");
-        pu_up  = (TH1F*)Pileup_Jasn.Get("pu_weights_up");
-        pu_down  = (TH1F*)Pileup_Jasn.Get("pu_weights_down");
+        //Only flat copies are kept for the per event lookups
+        pu_central = FlatHist((TH1F*)Pileup_Jasn.Get("pu_weights_central"));
+        pu_up = FlatHist((TH1F*)Pileup_Jasn.Get("pu_weights_up"));
+        pu_down = FlatHist((TH1F*)Pileup_Jasn.Get("pu_weights_down"));
 
         Pileup_Jasn.Close();
     }
@@ -24,9 +26,7 @@ public:
     ~Pileup_SysTemplate()
     {
         //dtor Was going to delet histograms after use but this segfaulted the code need second magic incantation
-        //delete pu_central;
-        //delete pu_up;
-        //delete pu_down;
+        //the ROOT histograms are still not deleted, only the flat copies are owned here
     }
 
     void getPileup_Sys(NTupleReader& tr)
@@ -57,29 +57,29 @@ public:
         //const int    npv      = tr.getVar<int>("npv");
 
         //This is going through and calculating the wieght 
-        if (tru_npv < pu_central->GetBinLowEdge(pu_central->GetNbinsX()+1)) {
-            _PUweightFactor = pu_central->GetBinContent(pu_central->GetXaxis()->FindBin(tru_npv));
+        if (tru_npv < pu_central.xAxis().getBinLowEdge(pu_central.xAxis().getNbins()+1)) {
+            _PUweightFactor = pu_central.getValue(tru_npv);
         } else {
             std::cerr << "WARNING in WeightProcessor::getPUWeight: Number of interactions = " << tru_npv
                       << " out of histogram binning." << std::endl;
-            _PUweightFactor = pu_central->GetBinContent(pu_central->GetNbinsX());
+            _PUweightFactor = pu_central.getBinContent(pu_central.xAxis().getNbins());
         }
 
-        if (tru_npv < pu_up->GetBinLowEdge(pu_up->GetNbinsX()+1)) {
-            _PUSysUp = pu_up->GetBinContent(pu_up->GetXaxis()->FindBin(tru_npv));
+        if (tru_npv < pu_up.xAxis().getBinLowEdge(pu_up.xAxis().getNbins()+1)) {
+            _PUSysUp = pu_up.getValue(tru_npv);
         } else {
             std::cerr << "WARNING in WeightProcessor::getPUWeight: Number of interactions = " << tru_npv
                       << " out of histogram binning." << std::endl;
-            _PUSysUp = pu_up->GetBinContent(pu_up->GetNbinsX());
+            _PUSysUp = pu_up.getBinContent(pu_up.xAxis().getNbins());
         }
 
 
-        if (tru_npv < pu_down->GetBinLowEdge(pu_down->GetNbinsX()+1)) {
-            _PUSysDown = pu_down->GetBinContent(pu_down->GetXaxis()->FindBin(tru_npv));
+        if (tru_npv < pu_down.xAxis().getBinLowEdge(pu_down.xAxis().getNbins()+1)) {
+            _PUSysDown = pu_down.getValue(tru_npv);
         } else {
             std::cerr << "WARNING in WeightProcessor::getPUWeight: Number of interactions = " << tru_npv
                       << " out of histogram binning." << std::endl;
-            _PUSysDown = pu_down->GetBinContent(pu_down->GetNbinsX());
+            _PUSysDown = pu_down.getBinContent(pu_down.xAxis().getNbins());
         }
 
         tr.registerDerivedVar("_PUweightFactor", _PUweightFactor);
@@ -96,10 +96,10 @@ public:
 protected:
     
 private: 
-    //need to define the histogram but not fill it till the c file
-    TH1F * pu_central;
-    TH1F * pu_up;
-    TH1F * pu_down;
+    //flattened copies of the weight histograms
+    FlatHist pu_central;
+    FlatHist pu_up;
+    FlatHist pu_down;
 
 };
 
@@ -0,0 +1,213 @@
+#include "SignalScanDemux.h"
+
+#include "TFile.h"
+#include "TKey.h"
+#include "TList.h"
+#include "TH1D.h"
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <memory>
+
+SignalScanDemux::SignalScanDemux(int nBins, const std::string& prefix, const std::string& motherMassVar, const std::string& lspMassVar) : nBins_(nBins), prefix_(prefix), motherMassVar_(motherMassVar), lspMassVar_(lspMassVar), fixedPoints_(false), lastPoint_(-1), lastKey_(0), nUnknown_(0), filled_(false)
+{
+    if(nBins_ < 1) THROW_SATEXCEPTION("SignalScanDemux(...): at least one bin is needed!!!");
+}
+
+void SignalScanDemux::addVariation(const std::string& name, const BinFunc& bin, const WeightFunc& weight)
+{
+    if(filled_) THROW_SATEXCEPTION("SignalScanDemux::addVariation(...): variation \"" + name + "\" added after the first fill!!!");
+    for(const auto& v : variations_)
+    {
+        if(v.name == name) THROW_SATEXCEPTION("SignalScanDemux::addVariation(...): variation \"" + name + "\" is already defined!!!");
+    }
+    variations_.push_back({name, bin, weight});
+    sumW_.assign(points_.size()*variations_.size()*nBins_, 0.0);
+    sumW2_.assign(sumW_.size(), 0.0);
+}
+
+void SignalScanDemux::setMassPoints(const std::vector<std::pair<int, int>>& points)
+{
+    if(filled_) THROW_SATEXCEPTION("SignalScanDemux::setMassPoints(...): mass points set after the first fill!!!");
+
+    points_.clear();
+    index_.clear();
+    nEvents_.clear();
+    nEventsWeighted_.clear();
+    sumW_.clear();
+    sumW2_.clear();
+    lastPoint_ = -1;
+    for(const auto& point : points)
+    {
+        if(findPoint(point.first, point.second) < 0) addPoint(point.first, point.second);
+    }
+    fixedPoints_ = true;
+}
+
+std::vector<std::pair<int, int>> SignalScanDemux::readMassPoints(const std::string& gridFile, const std::string& prefix)
+{
+    std::unique_ptr<TFile> f(TFile::Open(gridFile.c_str()));
+    if(!f || f->IsZombie()) THROW_SATEXCEPTION("SignalScanDemux::readMassPoints(...): could not open \"" + gridFile + "\"!!!");
+
+    std::vector<std::pair<int, int>> points;
+    TIter next(f->GetListOfKeys());
+    while(TKey* key = static_cast<TKey*>(next()))
+    {
+        const std::string name = key->GetName();
+        if(name.compare(0, prefix.size(), prefix) != 0) continue;
+
+        int mMother, mLSP;
+        char extra;
+        if(sscanf(name.c_str() + prefix.size(), "%d_%d%c", &mMother, &mLSP, &extra) == 2) points.emplace_back(mMother, mLSP);
+    }
+    f->Close();
+
+    std::sort(points.begin(), points.end());
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+    if(points.empty()) THROW_SATEXCEPTION("SignalScanDemux::readMassPoints(...): no " + prefix + "<mMother>_<mLSP> objects in \"" + gridFile + "\"!!!");
+    return points;
+}
+
+int SignalScanDemux::findPoint(int mMother, int mLSP)
+{
+    //scans are usually sorted by mass point, so most events hit the last point
+    const uint64_t key = packKey(mMother, mLSP);
+    if(lastPoint_ >= 0 && key == lastKey_) return lastPoint_;
+
+    auto iter = std::lower_bound(index_.begin(), index_.end(), std::make_pair(key, -1));
+    if(iter == index_.end() || iter->first != key) return -1;
+    lastKey_ = key;
+    lastPoint_ = iter->second;
+    return lastPoint_;
+}
+
+int SignalScanDemux::addPoint(int mMother, int mLSP)
+{
+    const uint64_t key = packKey(mMother, mLSP);
+    const int iPoint = points_.size();
+    points_.emplace_back(mMother, mLSP);
+    index_.insert(std::lower_bound(index_.begin(), index_.end(), std::make_pair(key, -1)), std::make_pair(key, iPoint));
+    nEvents_.push_back(0.0);
+    nEventsWeighted_.push_back(0.0);
+    sumW_.resize(points_.size()*variations_.size()*nBins_, 0.0);
+    sumW2_.resize(sumW_.size(), 0.0);
+    lastKey_ = key;
+    lastPoint_ = iPoint;
+    return iPoint;
+}
+
+void SignalScanDemux::fill(const NTupleReader& tr, double weight)
+{
+    filled_ = true;
+
+    //truncated as in signalScan and makeSignalHistograms so the mass points agree
+    const int mMother = (int)tr.getVar<double>(motherMassVar_);
+    const int mLSP = (int)tr.getVar<double>(lspMassVar_);
+
+    int iPoint = findPoint(mMother, mLSP);
+    if(iPoint < 0)
+    {
+        if(fixedPoints_)
+        {
+            ++nUnknown_;
+            return;
+        }
+        iPoint = addPoint(mMother, mLSP);
+    }
+
+    nEvents_[iPoint] += 1;
+    nEventsWeighted_[iPoint] += weight;
+
+    for(unsigned int iVar = 0; iVar < variations_.size(); ++iVar)
+    {
+        const Variation& v = variations_[iVar];
+        const int bin = v.bin(tr);
+        if(bin < 0) continue;
+        if(bin >= nBins_) THROW_SATEXCEPTION("SignalScanDemux::fill(...): bin " + std::to_string(bin) + " of variation \"" + v.name + "\" is out of range!!!");
+
+        const double w = weight*v.weight(tr);
+        const size_t c = cell(iPoint, iVar) + bin;
+        sumW_[c] += w;
+        sumW2_[c] += w*w;
+    }
+}
+
+void SignalScanDemux::merge(const SignalScanDemux& other)
+{
+    if(other.variations_.size() != variations_.size() || other.nBins_ != nBins_) THROW_SATEXCEPTION("SignalScanDemux::merge(...): demultiplexers do not have the same variations!!!");
+    filled_ = true;
+
+    for(unsigned int iOther = 0; iOther < other.points_.size(); ++iOther)
+    {
+        const std::pair<int, int>& point = other.points_[iOther];
+        int iPoint = findPoint(point.first, point.second);
+        if(iPoint < 0) iPoint = addPoint(point.first, point.second);
+
+        nEvents_[iPoint] += other.nEvents_[iOther];
+        nEventsWeighted_[iPoint] += other.nEventsWeighted_[iOther];
+        const size_t n = variations_.size()*nBins_;
+        for(size_t i = 0; i < n; ++i)
+        {
+            sumW_[cell(iPoint, 0) + i] += other.sumW_[other.cell(iOther, 0) + i];
+            sumW2_[cell(iPoint, 0) + i] += other.sumW2_[other.cell(iOther, 0) + i];
+        }
+    }
+    nUnknown_ += other.nUnknown_;
+}
+
+void SignalScanDemux::writeHistograms(TFile* f) const
+{
+    if(!f) THROW_SATEXCEPTION("SignalScanDemux::writeHistograms(...): null file!!!");
+
+    char hname[256];
+    for(unsigned int iPoint = 0; iPoint < points_.size(); ++iPoint)
+    {
+        const int mMother = points_[iPoint].first, mLSP = points_[iPoint].second;
+
+        sprintf(hname, "%s_nEvents_%d_%d", prefix_.c_str(), mMother, mLSP);
+        TH1D hEvents(hname, hname, 2, 0, 2);
+        hEvents.SetDirectory(0);
+        hEvents.SetBinContent(1, nEvents_[iPoint]);
+        hEvents.SetBinContent(2, nEventsWeighted_[iPoint]);
+        f->WriteTObject(&hEvents);
+
+        for(unsigned int iVar = 0; iVar < variations_.size(); ++iVar)
+        {
+            sprintf(hname, "%s_%s_%d_%d", prefix_.c_str(), variations_[iVar].name.c_str(), mMother, mLSP);
+            TH1D h(hname, hname, nBins_, 0, nBins_);
+            h.SetDirectory(0);
+            h.Sumw2();
+            const size_t c = cell(iPoint, iVar);
+            for(int bin = 0; bin < nBins_; ++bin)
+            {
+                h.SetBinContent(bin + 1, sumW_[c + bin]);
+                h.SetBinError(bin + 1, std::sqrt(sumW2_[c + bin]));
+            }
+            h.SetEntries(nEvents_[iPoint]);
+            f->WriteTObject(&h);
+        }
+    }
+}
+
+void SignalScanDemux::writeTable(const std::string& fileName) const
+{
+    FILE* f = fopen(fileName.c_str(), "w");
+    if(!f) THROW_SATEXCEPTION("SignalScanDemux::writeTable(...): could not open \"" + fileName + "\" for writing!!!");
+
+    fprintf(f, "# %s yields, per point: mMother mLSP nEvents raw weighted, then mMother mLSP variation nBins (yield error) per bin\n", prefix_.c_str());
+    for(unsigned int iPoint = 0; iPoint < points_.size(); ++iPoint)
+    {
+        const int mMother = points_[iPoint].first, mLSP = points_[iPoint].second;
+        fprintf(f, "%d %d nEvents %.0f %.10g\n", mMother, mLSP, nEvents_[iPoint], nEventsWeighted_[iPoint]);
+        for(unsigned int iVar = 0; iVar < variations_.size(); ++iVar)
+        {
+            fprintf(f, "%d %d %s %d", mMother, mLSP, variations_[iVar].name.c_str(), nBins_);
+            const size_t c = cell(iPoint, iVar);
+            for(int bin = 0; bin < nBins_; ++bin) fprintf(f, " %.10g %.10g", sumW_[c + bin], std::sqrt(sumW2_[c + bin]));
+            fprintf(f, "\n");
+        }
+    }
+
+    if(fclose(f) != 0) THROW_SATEXCEPTION("SignalScanDemux::writeTable(...): error writing \"" + fileName + "\"!!!");
+}
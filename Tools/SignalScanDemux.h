@@ -0,0 +1,102 @@
+#ifndef SIGNAL_SCAN_DEMUX_H
+#define SIGNAL_SCAN_DEMUX_H
+
+#include "NTupleReader.h"
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <functional>
+#include <cstdint>
+
+class TFile;
+
+/* Splits a fastsim scan by mass point in a single pass, in place of a map of per point
+   histogram containers filled event by event
+
+   auto bin = [](const NTupleReader& tr) { return tr.getVar<bool>("passBaseline") ? tr.getVar<int>("nSearchBin") : -1; };
+   SignalScanDemux demux(sb.nSearchBins(), "baseline");
+   demux.addVariation("nSearchBin", bin, SignalScanDemux::unitWeight());
+   demux.addVariation("bTagSFUp",   bin, [](const NTupleReader& tr) { return tr.getVar<double>("bTagSF_EventWeightSimple_Up"); });
+   demux.addVariation("jetJECUp",   [](const NTupleReader& tr) { return tr.getVar<int>("nSearchBin_jecUp"); }, SignalScanDemux::unitWeight());
+   demux.setMassPoints(SignalScanDemux::readMassPoints("signalScan_fastsim_T2tt_bTagEff_ISR.root"));
+   while(tr.getNextEvent()) demux.fill(tr, evtWeight);
+   demux.writeHistograms(outFile);
+   demux.writeTable("T2tt_yields.txt");
+
+   Each variation gives the search bin of the event (< 0 when it fails the selection) and its
+   weight, so shape (JEC, MET) and weight (b-tag, ISR, PDF ...) variations are filled alike, all
+   variations must be added before the first fill.  The mass point of an event is looked up once
+   and all variations are added to the dense block of that point, mass points are indexed from
+   the list given to setMassPoints (the NJetsISR_<mMother>_<mLSP> histograms of the bTagEff_ISR
+   grid files) or, if none is given, as they are first seen.
+
+   writeHistograms() writes <prefix>_<variation>_<mMother>_<mLSP> TH1Ds, the names read by
+   makeSignalCards.C, and <prefix>_nEvents_<mMother>_<mLSP> with the raw and weighted number
+   of events of the point in its two bins.  writeTable() writes everything in one text table,
+   per point a line "mMother mLSP nEvents raw weighted" followed by one line per variation
+   "mMother mLSP variation nBins y_0 e_0 ... y_n-1 e_n-1".
+ */
+
+class SignalScanDemux
+{
+public:
+    typedef std::function<int(const NTupleReader&)> BinFunc;
+    typedef std::function<double(const NTupleReader&)> WeightFunc;
+
+    SignalScanDemux(int nBins, const std::string& prefix = "baseline", const std::string& motherMassVar = "SusyMotherMass", const std::string& lspMassVar = "SusyLSPMass");
+
+    void addVariation(const std::string& name, const BinFunc& bin, const WeightFunc& weight);
+
+    //Fix the mass points, events of other points are counted by getNUnknown() and dropped
+    void setMassPoints(const std::vector<std::pair<int, int>>& points);
+
+    //Mass points of a scan grid file, from the histogram names <prefix><mMother>_<mLSP>
+    static std::vector<std::pair<int, int>> readMassPoints(const std::string& gridFile, const std::string& prefix = "NJetsISR_");
+
+    void fill(const NTupleReader& tr, double weight = 1.0);
+
+    //Add the yields of another demultiplexer with the same variations
+    void merge(const SignalScanDemux& other);
+
+    void writeHistograms(TFile* f) const;
+    void writeTable(const std::string& fileName) const;
+
+    const std::vector<std::pair<int, int>>& getMassPoints() const { return points_; }
+    double getYield(int iPoint, int iVariation, int bin) const { return sumW_[cell(iPoint, iVariation) + bin]; }
+    long long getNUnknown() const { return nUnknown_; }
+
+    static WeightFunc unitWeight() { return [](const NTupleReader&) { return 1.0; }; }
+
+private:
+    struct Variation
+    {
+        std::string name;
+        BinFunc bin;
+        WeightFunc weight;
+    };
+
+    int nBins_;
+    std::string prefix_, motherMassVar_, lspMassVar_;
+    std::vector<Variation> variations_;
+
+    bool fixedPoints_;
+    std::vector<std::pair<int, int>> points_;
+    //sorted (packed mass point, point index) for the lookup
+    std::vector<std::pair<uint64_t, int>> index_;
+    int lastPoint_;
+    uint64_t lastKey_;
+    long long nUnknown_;
+
+    //per point nVariations blocks of nBins sums
+    bool filled_;
+    std::vector<double> sumW_, sumW2_;
+    std::vector<double> nEvents_, nEventsWeighted_;
+
+    static uint64_t packKey(int mMother, int mLSP) { return (uint64_t(uint32_t(mMother)) << 32) | uint32_t(mLSP); }
+    size_t cell(int iPoint, int iVariation) const { return (size_t(iPoint)*variations_.size() + iVariation)*nBins_; }
+    int findPoint(int mMother, int mLSP);
+    int addPoint(int mMother, int mLSP);
+};
+
+#endif
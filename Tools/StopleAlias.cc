@@ -24,30 +24,37 @@
 StopleAlias::StopleAlias ()
 {
   tr=NULL;
+  resolved=false;
 }  // -----  end of method StopleAlias::StopleAlias  (constructor)  -----
 
 void StopleAlias::operator()(NTupleReader& tr_)
 {
   tr = &tr_;
 
-  MapGlobalVar();
-  MapFilter();
-  MapGen();
-  
-  MapMuon();
-  MapElectron();
-  MapIsoTrack();
+  // Build the mapping table only for the first event
+  if (!resolved)
+  {
+    MapGlobalVar();
+    MapFilter();
+    MapGen();
 
-  MapMET();
-  MapJets();
+    MapMuon();
+    MapElectron();
+    MapIsoTrack();
+
+    MapMET();
+    MapJets();
 
-  // Apply AliasMap only for the first event
-  if (tr->isFirstEvent())
-  {
     for(auto i : AliasMap)
     {
       tr->addAlias(i.second, i.first);
     }
+    resolved = true;
+  }
+
+  for(auto& step : steps)
+  {
+    step();
   }
 }
 
@@ -169,63 +176,80 @@ bool StopleAlias::MapIsoTrack()
 // ===========================================================================
 bool StopleAlias::MapVectorTLV(std::string prefix, std::string outname ,
     const std::string s_pt , const std::string s_eta ,
-    const std::string s_phi , const std::string s_mass ) const
+    const std::string s_phi , const std::string s_mass )
 {
-  std::stringstream ss("");
-  ss<<prefix<<"_" <<s_eta;
-  const std::vector<float>& eta=tr->getVec<float>(ss.str());
-  ss.str("");
-  ss<<prefix<<"_"<<s_phi;
-  const  std::vector<float>& phi=tr->getVec<float>(ss.str());
-  ss.str("");
-  ss<<prefix<<"_"<<s_pt;
-  const std::vector<float>& pt=tr->getVec<float>(ss.str());
-  ss.str("");
-  ss<<prefix<<"_"<<s_mass;
-  const std::vector<float>& mass=tr->getVec<float>(ss.str());
-
-  std::vector<TLorentzVector> *objs = new std::vector<TLorentzVector>();
-  for(unsigned int i=0; i < pt.size(); ++i)
+  NTupleReader::VecHandle<float> pt = tr->vecHandle<float>(prefix + "_" + s_pt);
+  NTupleReader::VecHandle<float> eta = tr->vecHandle<float>(prefix + "_" + s_eta);
+  NTupleReader::VecHandle<float> phi = tr->vecHandle<float>(prefix + "_" + s_phi);
+  NTupleReader::VecHandle<float> mass = tr->vecHandle<float>(prefix + "_" + s_mass);
+
+  // The reader keeps the same buffer, so it is cleared and refilled in place
+  std::vector<TLorentzVector> *objs = &tr->derivedVec<TLorentzVector>(outname);
+  steps.push_back([=]()
   {
-    TLorentzVector obj(0, 0, 0, 0);
-    obj.SetPtEtaPhiM(pt.at(i), eta.at(i), phi.at(i), mass.at(i));
-    objs->push_back(obj);
-  }
+    const std::vector<float>& vpt = pt.get();
+    const std::vector<float>& veta = eta.get();
+    const std::vector<float>& vphi = phi.get();
+    const std::vector<float>& vmass = mass.get();
+
+    objs->resize(vpt.size());
+    for(unsigned int i=0; i < vpt.size(); ++i)
+    {
+      (*objs)[i].SetPtEtaPhiM(vpt[i], veta.at(i), vphi.at(i), vmass.at(i));
+    }
+  });
 
-  tr->registerDerivedVec(outname, objs);
   return true;
 }       // -----  end of function StopleAlias::MapVectorTLV  -----
 
 
 // ===  FUNCTION  ============================================================
 //         Name:  StopleAlias::MapSingleObj
-//  Description:  
+//  Description:  Same type variables are aliased, others converted per event
 // ===========================================================================
 template <class Tfrom, class Tto>
-bool StopleAlias::MapSingleObj(const std::string Sfrom, const std::string Sto) const
+bool StopleAlias::MapSingleObj(const std::string Sfrom, const std::string Sto)
 {
-  Tto obj = tr->getVar<Tfrom>(Sfrom);
-  tr->registerDerivedVar(Sto, obj);
+  if (std::is_same<Tfrom, Tto>::value)
+  {
+    AliasMap[Sto] = Sfrom;
+    return true;
+  }
+
+  NTupleReader::VarHandle<Tfrom> obj = tr->handle<Tfrom>(Sfrom);
+  Tto *out = &tr->derivedVar<Tto>(Sto);
+  steps.push_back([=]()
+  {
+    *out = static_cast<Tto>(obj.get());
+  });
   return true;
 }       // -----  end of function StopleAlias::MapSingleObj  -----
 
 // ===  FUNCTION  ============================================================
 //         Name:  StopleAlias::MapVectorObj
-//  Description:  
+//  Description:  Same type vectors are aliased, others converted per event
 // ===========================================================================
 template <class Tfrom, class Tto>
-bool StopleAlias::MapVectorObj(const std::string Sfrom, const std::string Sto) const
+bool StopleAlias::MapVectorObj(const std::string Sfrom, const std::string Sto)
 {
-  const std::vector<Tfrom> &obj = tr->getVec<Tfrom>(Sfrom);
-
-  std::vector<Tto> *objs = new std::vector<Tto>();
-
-  for(auto i : obj)
+  if (std::is_same<Tfrom, Tto>::value)
   {
-    objs->push_back(Tto(i));
+    AliasMap[Sto] = Sfrom;
+    return true;
   }
 
-  tr->registerDerivedVec(Sto, objs);
+  NTupleReader::VecHandle<Tfrom> obj = tr->vecHandle<Tfrom>(Sfrom);
+  std::vector<Tto> *objs = &tr->derivedVec<Tto>(Sto);
+  steps.push_back([=]()
+  {
+    const std::vector<Tfrom> &from = obj.get();
+    objs->resize(from.size());
+    for(unsigned int i=0; i < from.size(); ++i)
+    {
+      (*objs)[i] = static_cast<Tto>(from[i]);
+    }
+  });
+
   return true;
 }       // -----  end of function StopleAlias::MapVectorObj  -----
 
@@ -236,28 +260,28 @@ bool StopleAlias::MapVectorObj(const std::string Sfrom, const std::string Sto) c
 //  
 // ===========================================================================
 bool StopleAlias::ProdLepMtw(const std::string &lep, const std::string &outname,
-    const std::string s_pt , const std::string s_phi ) const
+    const std::string s_pt , const std::string s_phi )
 {
-  const float &met = tr->getVar<float>("met_pt");
-  const float &metphi = tr->getVar<float>("met_phi");
-
-  std::stringstream ss("");
-  ss<<lep<<"_" <<s_pt;
-  const std::vector<float>& leppt=tr->getVec<float>(ss.str());
-  ss.str("");
-  ss<<lep<<"_" <<s_phi;
-  const std::vector<float>& lepphi=tr->getVec<float>(ss.str());
-
-  std::vector<float> *lepMtw = new std::vector<float>();
-  for(unsigned int i=0; i < leppt.size(); ++i)
+  NTupleReader::VarHandle<float> met = tr->handle<float>("met_pt");
+  NTupleReader::VarHandle<float> metphi = tr->handle<float>("met_phi");
+  NTupleReader::VecHandle<float> leppt = tr->vecHandle<float>(lep + "_" + s_pt);
+  NTupleReader::VecHandle<float> lepphi = tr->vecHandle<float>(lep + "_" + s_phi);
+
+  std::vector<float> *lepMtw = &tr->derivedVec<float>(outname);
+  steps.push_back([=]()
   {
-    float lpt = leppt.at(i);
-    float lphi = lepphi.at(i);
-    float mtw = sqrt(2 * met * lpt * (1 - cos(lphi -metphi)));
-    lepMtw->push_back(mtw);
-  }
+    const float vmet = met.get();
+    const float vmetphi = metphi.get();
+    const std::vector<float>& vpt = leppt.get();
+    const std::vector<float>& vphi = lepphi.get();
+
+    lepMtw->resize(vpt.size());
+    for(unsigned int i=0; i < vpt.size(); ++i)
+    {
+      (*lepMtw)[i] = sqrt(2 * vmet * vpt[i] * (1 - cos(vphi.at(i) - vmetphi)));
+    }
+  });
 
-  tr->registerDerivedVec(outname, lepMtw);
   return true;
 }       // -----  end of function StopleAlias::ProdLepMtw  -----
 
@@ -268,7 +292,7 @@ bool StopleAlias::ProdLepMtw(const std::string &lep, const std::string &outname,
 // ===========================================================================
 bool StopleAlias::addAlias(const std::string &Sfrom, const std::string &Sto) 
 {
-  if (!tr->isFirstEvent()) return false;
+  if (resolved) return false;
   AliasMap[Sto] =Sfrom;
   return true;
 }       // -----  end of function StopleAlias::addAlias  -----
@@ -18,10 +18,17 @@
 #include "TLorentzVector.h"
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <functional>
+#include <type_traits>
 
 // ===========================================================================
 //        Class:  StopleAlias
-//  Description:  
+//  Description:  The Map* functions are run once, at the first event, to build
+//  the mapping table.  Variables of the same type become aliases through
+//  NTupleReader::addAlias, every other mapping becomes a conversion step with
+//  its source handles and target buffer resolved up front, so each event only
+//  runs the conversions into the reused buffers.
 // ===========================================================================
 class StopleAlias
 {
@@ -48,6 +55,8 @@ class StopleAlias
     // ====================  METHODS       ===============================
     NTupleReader *tr;
     std::map<std::string, std::string> AliasMap;
+    bool resolved;
+    std::vector<std::function<void()> > steps;
 
 
     bool MapGlobalVar();
@@ -61,15 +70,15 @@ class StopleAlias
 
     bool addAlias(const std::string &Sfrom, const std::string &Sto);
     template <class Tfrom, class Tto>
-    bool MapSingleObj(const std::string Sfrom, const std::string Sto) const;
+    bool MapSingleObj(const std::string Sfrom, const std::string Sto);
     template <class Tfrom, class Tto>
-    bool MapVectorObj(const std::string Sfrom, const std::string Sto) const;
+    bool MapVectorObj(const std::string Sfrom, const std::string Sto);
 
     bool ProdLepMtw(const std::string &lep, const std::string &outname,
-        const std::string s_pt = "pt" , const std::string s_phi  = "phi") const;
+        const std::string s_pt = "pt" , const std::string s_phi  = "phi");
     bool MapVectorTLV(const std::string prefix, const std::string outname,
         const std::string s_pt = "pt", const std::string s_eta = "eta",
-        const std::string s_phi = "phi", const std::string s_mass = "mass") const;
+        const std::string s_phi = "phi", const std::string s_mass = "mass");
 
     // ====================  DATA MEMBERS  ===============================
 
@@ -2,8 +2,44 @@
 
 #include "TFile.h"
 #include "TF1.h"
+#include "TTree.h"
 
 #include "lester_mt2_bisect.h"
+#include "MT2Calculator.h"
+
+//**************************************************************************//
+//                               BaselineCore                               //
+//**************************************************************************//
+
+void BaselineCore::update(const NTupleReader& tr)
+{
+  if( tr_ == &tr && evt_ == tr.getEvtNum() ) return;
+  tr_ = &tr;
+  evt_ = tr.getEvtNum();
+  flags_.clear();
+  leptons_.clear();
+  taggerRuns_.clear();
+}
+
+bool BaselineCore::getFlag(const std::string& key, bool& value) const
+{
+  auto iter = flags_.find(key);
+  if( iter == flags_.end() ) return false;
+  value = iter->second;
+  return true;
+}
+
+const BaselineCore::LeptonCounts* BaselineCore::getLeptons(const std::string& key) const
+{
+  auto iter = leptons_.find(key);
+  return (iter == leptons_.end()) ? nullptr : &iter->second;
+}
+
+int BaselineCore::getTaggerRun(const std::string& key) const
+{
+  auto iter = taggerRuns_.find(key);
+  return (iter == taggerRuns_.end()) ? 0 : iter->second;
+}
 
 //**************************************************************************//
 //                              BaselineVessel                              //
@@ -29,6 +65,7 @@ BaselineVessel::BaselineVessel(NTupleReader &tr_, const std::string specializati
   muonsFlagIDLabel      = "muonsFlagMedium";  //TODO: moving to loose ID for 2017
   elesFlagIDLabel       = "elesFlagVeto";
   toptaggerCfgFile      = "TopTagger.cfg";
+  eventFilterBitsLabel  = "eventFilterBits";
   doIsoTrksVeto         = true;
   doMuonVeto            = true;
   doEleVeto             = true;
@@ -38,6 +75,8 @@ BaselineVessel::BaselineVessel(NTupleReader &tr_, const std::string specializati
   passBaselineNoTagMT2  = true;
   passBaselineNoTag     = true;
   passBaselineNoLepVeto = true;
+  mt2Precision          = 0;
+  skipTaggerOnFailedCuts = false;
   metLVec.SetPtEtaPhiM(0, 0, 0, 0);
 
   if(filterString.compare("fastsim") ==0) isfastsim = true; else isfastsim = false; 
@@ -115,34 +154,40 @@ bool BaselineVessel::SetupTopTagger(std::string CfgFile_)
 
   ttPtr.reset(new TopTagger);
   ttPtr->setCfgFile(toptaggerCfgFile);
+  ownTtPtr = ttPtr;
   OpenWMassCorrFile();
   
   return true;
 }       // -----  end of function BaselineVessel::SetupTopTagger  -----
 
+void BaselineVessel::clearTaggerInputs()
+{
+  // the buffers are owned by the reader and refilled in place every event
+  jetsLVec_forTagger     = &tr->derivedVec<TLorentzVector>("jetsLVec_forTagger" + firstSpec);
+  recoJetsBtag_forTagger = &tr->derivedVec<float>("recoJetsBtag_forTagger" + firstSpec);
+  qgLikelihood_forTagger = &tr->derivedVec<float>("qgLikelihood_forTagger" + firstSpec);
+}
+
 void BaselineVessel::prepareTopTagger()
 {
 // Prepare jets and b-tag working points for top tagger
-  jetsLVec_forTagger     = new std::vector<TLorentzVector>();
-  recoJetsBtag_forTagger = new std::vector<float>();
-  qgLikelihood_forTagger = new std::vector<float>();
-  std::vector<float> qgLikelihood;
+  clearTaggerInputs();
+  static const std::vector<float> noQGLikelihood;
+  const std::vector<float>* qgLikelihood = &noQGLikelihood;
   try
   {
-    qgLikelihood = tr->getVec<float>(qgLikehoodLabel);
+    qgLikelihood = &tr->getVec<float>(qgLikehoodLabel);
   }
   catch (const SATException& e)
   {
     e.print();
-    qgLikelihood.clear();
   }
     
   AnaFunctions::prepareJetsForTagger(tr->getVec<TLorentzVector>(jetVecLabel), tr->getVec<float>(CSVVecLabel), 
-      *jetsLVec_forTagger, *recoJetsBtag_forTagger, qgLikelihood, *qgLikelihood_forTagger);
+      *jetsLVec_forTagger, *recoJetsBtag_forTagger, *qgLikelihood, *qgLikelihood_forTagger);
 
-  tr->registerDerivedVec("jetsLVec_forTagger" + firstSpec, jetsLVec_forTagger);
-  tr->registerDerivedVec("recoJetsBtag_forTagger" + firstSpec, recoJetsBtag_forTagger);
-  tr->registerDerivedVec("qgLikelihood_forTagger" + firstSpec, qgLikelihood_forTagger);
+  std::string taggerKey;
+  if( useSharedTagger(1, taggerKey) ) return;
 
   
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ New TopTagger ~~~~~
@@ -156,11 +201,11 @@ void BaselineVessel::prepareTopTagger()
       };
 
   //Helper function to turn int vectors into float vectors
-  auto convertTofloatandRegister = [](NTupleReader& tr, const std::string& name)
+  auto convertTofloatandRegister = [](NTupleReader& tr, const std::string& name) -> const std::vector<float>&
       {
           const std::vector<int>& intVec = tr.getVec<int>(name);
-          std::vector<float>* floatVec = new std::vector<float>(intVec.begin(), intVec.end());
-          tr.registerDerivedVec(name+"ConvertedTofloat2", floatVec);
+          std::vector<float>& floatVec = tr.derivedVec<float>(name+"ConvertedTofloat2");
+          floatVec.assign(intVec.begin(), intVec.end());
           return floatVec;
       };
 
@@ -205,7 +250,7 @@ void BaselineVessel::prepareTopTagger()
   myConstAK4Inputs.addSupplamentalVector("recoJetsBtag",                         tr->getVec<float>("recoJetsCSVv2"));
 //  myConstAK4Inputs.addSupplamentalVector("recoJetsBtag",                         tr->getVec<float>("recoJetsBtag_0"));
   myConstAK4Inputs.addSupplamentalVector("recoJetsCharge",                       tr->getVec<float>("recoJetsCharge_0"));
-  myConstAK4Inputs.addSupplamentalVector("qgMult",                               *convertTofloatandRegister(*tr, "qgMult"));
+  myConstAK4Inputs.addSupplamentalVector("qgMult",                               convertTofloatandRegister(*tr, "qgMult"));
 
   //ttUtility::ConstAK8Inputs myConstAK8Inputs = ttUtility::ConstAK8Inputs(
   //    tr->getVec<TLorentzVector>(UseLepCleanJet ? "prodJetsNoLep_puppiJetsLVec" : "puppiJetsLVec"), 
@@ -219,9 +264,53 @@ void BaselineVessel::prepareTopTagger()
   //  myConstAK8Inputs.setWMassCorrHistos (puppisd_corrGEN     , puppisd_corrRECO_cen, puppisd_corrRECO_for);
   //}
   //std::vector<Constituent> constituents = ttUtility::packageConstituents(myConstAK4Inputs, myConstAK8Inputs);
-  std::vector<Constituent> constituents = ttUtility::packageConstituents(myConstAK4Inputs);
+  taggerConstituents.clear();
+  myConstAK4Inputs.packageConstituents(taggerConstituents);
   //run tagger
-  ttPtr->runTagger(constituents);
+  ttPtr->runTagger(taggerConstituents);
+  if( core )
+  {
+    core->setTaggerRun(taggerKey, 1);
+    core->setFlag("qgMultConvertedTofloat2", true);
+  }
+}
+
+void BaselineVessel::skipTopTagger()
+{
+  clearTaggerInputs();
+  //the converted qgMult is shared by all vessels, it is kept when one of them ran the tagger
+  bool qgMultFilled = false;
+  if( !(core && core->getFlag("qgMultConvertedTofloat2", qgMultFilled)) ) tr->derivedVec<float>("qgMultConvertedTofloat2");
+
+  std::string taggerKey;
+  if( useSharedTagger(2, taggerKey) ) return;
+
+  //an empty event keeps the tagger results consistent for MT2, the AK8 flags and the combinations
+  taggerConstituents.clear();
+  ttPtr->runTagger(taggerConstituents);
+  if( core ) core->setTaggerRun(taggerKey, 2);
+}
+
+bool BaselineVessel::useSharedTagger(const int run, std::string& key)
+{
+  if( !core ) return false;
+
+  //the supplementary tagger inputs have fixed names, the same for every vessel of the reader, so
+  //the labels identify the input.  Full and empty runs get their own tagger, a vessel running
+  //either one never overwrites the results another vessel reads from its GetTopTaggerPtr()
+  key = toptaggerCfgFile + ":" + jetVecLabel + ":" + CSVVecLabel + ":" + qgLikehoodLabel + ":" + std::to_string(run);
+  std::shared_ptr<TopTagger>& shared = core->tagger(key);
+  if( !shared )
+  {
+    if( run == 1 ) shared = ownTtPtr;
+    else
+    {
+      shared.reset(new TopTagger);
+      shared->setCfgFile(toptaggerCfgFile);
+    }
+  }
+  ttPtr = shared;
+  return core->getTaggerRun(key) == run;
 }
 
 // ===  FUNCTION  ============================================================
@@ -349,21 +438,31 @@ bool BaselineVessel::PassTopTagger()
 {
   int nTopCandSortedCnt = -1;
   bool passTagger = false;
-  vTops = new std::vector<TLorentzVector>();
-  mTopJets = new std::map<int, std::vector<TLorentzVector> >();
+  vTops = &tr->derivedVec<TLorentzVector>("vTops"+firstSpec);
+  mTopJets = &tr->derivedObject<std::map<int, std::vector<TLorentzVector> > >("mTopJets"+firstSpec);
 
   nTopCandSortedCnt = GetnTops();
   passTagger = (incZEROtop || nTopCandSortedCnt >= AnaConsts::low_nTopCandSortedSel); 
 
   tr->registerDerivedVar("nTopCandSortedCnt" + firstSpec, nTopCandSortedCnt);
-  tr->registerDerivedVec("vTops"+firstSpec, vTops);
-  tr->registerDerivedVec("mTopJets"+firstSpec, mTopJets);
 
   return passTagger;
 }       // -----  end of function BaselineVessel::PassTopTagger  -----
 
 void BaselineVessel::PassBaseline()
 {
+  if( core ) core->update(*tr);
+
+  //spec independent results are taken from the core when another vessel already computed them
+  auto sharedFlag = [this](const std::string& key, const std::function<bool()>& calc)
+  {
+    bool value;
+    if( core && core->getFlag(key, value) ) return value;
+    value = calc();
+    if( core ) core->setFlag(key, value);
+    return value;
+  };
+
   // Initial value
   passBaseline          = true;
   passBaselineNoTagMT2  = true;
@@ -375,22 +474,46 @@ void BaselineVessel::PassBaseline()
   metLVec.SetPtEtaPhiM(tr->getVar<float>(METLabel), 0, tr->getVar<float>(METPhiLabel), 0);
 
   // Calculate number of leptons
-  const std::vector<int> & muonsFlagIDVec = muonsFlagIDLabel.empty()? std::vector<int>(tr->getVec<float>("muonsMiniIso").size(), 1):tr->getVec<int>(muonsFlagIDLabel.c_str()); // We have muonsFlagTight as well, but currently use medium ID
-  const std::vector<int> & elesFlagIDVec = elesFlagIDLabel.empty()? std::vector<int>(tr->getVec<float>("elesMiniIso").size(), 1):tr->getVec<int>(elesFlagIDLabel.c_str()); // Fake electrons since we don't have different ID for electrons now, but maybe later
-  int nMuons = AnaFunctions::countMuons(tr->getVec<TLorentzVector>("muonsLVec"), tr->getVec<float>("muonsMiniIso"), tr->getVec<float>("muonsMtw"), muonsFlagIDVec, AnaConsts::muonsMiniIsoArr);
-  int nElectrons = AnaFunctions::countElectrons(tr->getVec<TLorentzVector>("elesLVec"), tr->getVec<float>("elesMiniIso"), tr->getVec<float>("elesMtw"), tr->getVec<unsigned int>("elesisEB"), elesFlagIDVec, AnaConsts::elesMiniIsoArr);
-  int nIsoTrks = AnaFunctions::countIsoTrks(tr->getVec<TLorentzVector>("Tauloose_isoTrksLVec"), tr->getVec<float>("loose_isoTrks_iso"), tr->getVec<float>("loose_isoTrks_mtw"), tr->getVec<int>("loose_isoTrks_pdgId"));
-  int nIsoLepTrks = AnaFunctions::countIsoLepTrks(tr->getVec<TLorentzVector>("Tauloose_isoTrksLVec"), tr->getVec<float>("loose_isoTrks_iso"), tr->getVec<float>("loose_isoTrks_mtw"), tr->getVec<int>("loose_isoTrks_pdgId"));
-  int nIsoPionTrks = AnaFunctions::countIsoPionTrks(tr->getVec<TLorentzVector>("Tauloose_isoTrksLVec"), tr->getVec<float>("loose_isoTrks_iso"), tr->getVec<float>("loose_isoTrks_mtw"), tr->getVec<int>("loose_isoTrks_pdgId"));
+  const std::string leptonKey = muonsFlagIDLabel + ":" + elesFlagIDLabel;
+  const BaselineCore::LeptonCounts* sharedLeptons = core ? core->getLeptons(leptonKey) : nullptr;
+  BaselineCore::LeptonCounts leptons;
+  if( sharedLeptons ) leptons = *sharedLeptons;
+  else
+  {
+    const std::vector<int> & muonsFlagIDVec = muonsFlagIDLabel.empty()? std::vector<int>(tr->getVec<float>("muonsMiniIso").size(), 1):tr->getVec<int>(muonsFlagIDLabel.c_str()); // We have muonsFlagTight as well, but currently use medium ID
+    const std::vector<int> & elesFlagIDVec = elesFlagIDLabel.empty()? std::vector<int>(tr->getVec<float>("elesMiniIso").size(), 1):tr->getVec<int>(elesFlagIDLabel.c_str()); // Fake electrons since we don't have different ID for electrons now, but maybe later
+    // packed once, the three track counts come from a single pass
+    muons.fill(tr->getVec<TLorentzVector>("muonsLVec"));
+    electrons.fill(tr->getVec<TLorentzVector>("elesLVec"));
+    isoTrks.fill(tr->getVec<TLorentzVector>("Tauloose_isoTrksLVec"));
+    leptons.nMuons = AnaFunctions::countMuons(muons, tr->getVec<float>("muonsMiniIso"), tr->getVec<float>("muonsMtw"), muonsFlagIDVec, AnaConsts::muonsMiniIsoArr);
+    leptons.nElectrons = AnaFunctions::countElectrons(electrons, tr->getVec<float>("elesMiniIso"), tr->getVec<float>("elesMtw"), tr->getVec<unsigned int>("elesisEB"), elesFlagIDVec, AnaConsts::elesMiniIsoArr);
+    AnaFunctions::IsoTrkCounts trkCounts;
+    AnaFunctions::countIsoTrks(isoTrks, tr->getVec<float>("loose_isoTrks_iso"), tr->getVec<float>("loose_isoTrks_mtw"), tr->getVec<int>("loose_isoTrks_pdgId"), trkCounts);
+    leptons.nIsoTrks = trkCounts.nIsoTrks;
+    leptons.nIsoLepTrks = trkCounts.nIsoLepTrks;
+    leptons.nIsoPionTrks = trkCounts.nIsoPionTrks;
+    if( core ) core->setLeptons(leptonKey, leptons);
+  }
+  int nMuons = leptons.nMuons;
+  int nElectrons = leptons.nElectrons;
+  int nIsoTrks = leptons.nIsoTrks;
+  int nIsoLepTrks = leptons.nIsoLepTrks;
+  int nIsoPionTrks = leptons.nIsoPionTrks;
 
   // Calculate number of jets and b-tagged jets
-  int cntCSVS = AnaFunctions::countCSVS(tr->getVec<TLorentzVector>(jetVecLabel), tr->getVec<float>(CSVVecLabel), AnaConsts::cutCSVS, AnaConsts::bTagArr);
-  int cntNJetsPt50Eta24 = AnaFunctions::countJets(tr->getVec<TLorentzVector>(jetVecLabel), AnaConsts::pt50Eta24Arr);
-  int cntNJetsPt30Eta24 = AnaFunctions::countJets(tr->getVec<TLorentzVector>(jetVecLabel), AnaConsts::pt30Eta24Arr);
-  int cntNJetsPt20Eta24 = AnaFunctions::countJets(tr->getVec<TLorentzVector>(jetVecLabel), AnaConsts::pt20Eta24Arr);
-  int cntNJetsPt30      = AnaFunctions::countJets(tr->getVec<TLorentzVector>(jetVecLabel), AnaConsts::pt30Arr);
-
-  // Calculate deltaPhi
+  // pt and eta are computed once per jet, the jet counts and HT come from a single pass
+  jets.fill(tr->getVec<TLorentzVector>(jetVecLabel), &tr->getVec<float>(CSVVecLabel));
+  static const AnaFunctions::JetSumCuts jetSumCuts = {{AnaConsts::pt50Eta24Arr, AnaConsts::pt30Eta24Arr, AnaConsts::pt20Eta24Arr, AnaConsts::pt30Arr},
+                                                       AnaConsts::pt20Eta24Arr, false, AnaConsts::pt30Arr, 0, AnaConsts::dphiArr};
+  AnaFunctions::calcJetSums(jets, jetSumCuts, metLVec.Phi(), jetSums);
+  int cntCSVS = AnaFunctions::countCSVS(jets, AnaConsts::cutCSVS, AnaConsts::bTagArr);
+  int cntNJetsPt50Eta24 = jetSums.nJets[0];
+  int cntNJetsPt30Eta24 = jetSums.nJets[1];
+  int cntNJetsPt20Eta24 = jetSums.nJets[2];
+  int cntNJetsPt30      = jetSums.nJets[3];
+
+  // Calculate deltaPhi (from the TLorentzVectors, the cuts are applied on the full precision phi)
   std::vector<float> * dPhiVec = new std::vector<float>();
   (*dPhiVec) = AnaFunctions::calcDPhi(tr->getVec<TLorentzVector>(jetVecLabel), metLVec.Phi(), 3, AnaConsts::dphiArr);
 
@@ -429,7 +552,7 @@ void BaselineVessel::PassBaseline()
   if( debug ) std::cout<<"met : "<<tr->getVar<float>("met")<<"  defaultMETcut : "<<AnaConsts::defaultMETcut<<"  passBaseline : "<<passBaseline<<std::endl;
 
   // Pass the HT cut for trigger?
-  float HT = AnaFunctions::calcHT(tr->getVec<TLorentzVector>(jetVecLabel), AnaConsts::pt20Eta24Arr);
+  float HT = jetSums.ht;
   bool passHT = true;
   if( HT < AnaConsts::defaultHTcut ){ passHT = false; passBaseline = false; passBaselineNoTagMT2 = false; passBaselineNoTag = false; passBaselineNoLepVeto = false; }
   if( debug ) std::cout<<"HT : "<<HT<<"  defaultHTcut : "<<AnaConsts::defaultHTcut<<"  passHT : "<<passHT<<"  passBaseline : "<<passBaseline<<std::endl;
@@ -437,7 +560,8 @@ void BaselineVessel::PassBaseline()
   // Calculate top tagger related variables. 
   // Note that to save speed, only do the calculation after previous base line requirements.
 
-  prepareTopTagger();
+  if( skipTaggerOnFailedCuts && (!passnJets || !passHT || (doMET && !passMET)) ) skipTopTagger();
+  else prepareTopTagger();
   bool passTagger = PassTopTagger();
   //if( !passTagger ){ passBaseline = false; passBaselineNoLepVeto = false; }
 
@@ -447,19 +571,18 @@ void BaselineVessel::PassBaseline()
   //if( MT2 < AnaConsts::defaultMT2cut ){ passBaseline = false; passBaselineNoTag = false; passMT2 = false; passBaselineNoLepVeto = false; }
   if( debug ) std::cout<<"MT2 : "<<MT2 <<"  defaultMT2cut : "<<AnaConsts::defaultMT2cut<<"  passBaseline : "<<passBaseline<<std::endl;
 
-  bool passNoiseEventFilter = true;
-  if( !passNoiseEventFilterFunc() ) { passNoiseEventFilter = false; passBaseline = false; passBaselineNoTagMT2 = false; passBaselineNoTag = false; passBaselineNoLepVeto = false; }
-  if( debug ) std::cout<<"passNoiseEventFilterFunc : "<<passNoiseEventFilterFunc()<<"  passBaseline : "<<passBaseline<<std::endl;
+  bool passNoiseEventFilter = sharedFlag(isfastsim ? "noiseFastsim" : "noise", [this]() { return passNoiseEventFilterFunc(); });
+  if( !passNoiseEventFilter ) { passBaseline = false; passBaselineNoTagMT2 = false; passBaselineNoTag = false; passBaselineNoLepVeto = false; }
+  if( debug ) std::cout<<"passNoiseEventFilterFunc : "<<passNoiseEventFilter<<"  passBaseline : "<<passBaseline<<std::endl;
 
   // pass QCD high MET filter
-  bool passQCDHighMETFilter = true;
-  if( !passQCDHighMETFilterFunc() ) { passQCDHighMETFilter = false; }
+  bool passQCDHighMETFilter = sharedFlag("qcdHighMET", [this]() { return passQCDHighMETFilterFunc(); });
   if( debug ) std::cout<<"passQCDHighMETFilter : "<< passQCDHighMETFilter <<"  passBaseline : "<<passBaseline<<std::endl;
 
   // pass the special filter for fastsim
-  bool passFastsimEventFilter = true;
-  if( !passFastsimEventFilterFunc() ) { passFastsimEventFilter = false; passBaseline = false; passBaselineNoTagMT2 = false; passBaselineNoTag = false; passBaselineNoLepVeto = false; }
-  if( debug ) std::cout<<"passFastsimEventFilterFunc : "<<passFastsimEventFilterFunc()<<"  passBaseline : "<<passBaseline<<std::endl;
+  bool passFastsimEventFilter = sharedFlag(isfastsim ? "fastsimEventFastsim" : "fastsimEvent", [this]() { return passFastsimEventFilterFunc(); });
+  if( !passFastsimEventFilter ) { passBaseline = false; passBaselineNoTagMT2 = false; passBaselineNoTag = false; passBaselineNoLepVeto = false; }
+  if( debug ) std::cout<<"passFastsimEventFilterFunc : "<<passFastsimEventFilter<<"  passBaseline : "<<passBaseline<<std::endl;
 
   // Register all the calculated variables
   //tr->registerDerivedVar("nMuons_CUT" + firstSpec, nMuons);           // error: do not redefine  
@@ -551,7 +674,7 @@ bool BaselineVessel::FlagAK8Jets()
   std::vector<Constituent> AK8constituents;
   myConstAK8Inputs.packageConstituents(AK8constituents);
 
-  vAK8Flag = new std::vector<unsigned>();
+  vAK8Flag = &tr->derivedVec<unsigned>("vAK8Flag"+spec);
 
   for(auto ak8_ : AK8constituents)
   {
@@ -563,8 +686,6 @@ bool BaselineVessel::FlagAK8Jets()
     vAK8Flag->push_back(flag);
   }
 
-  tr->registerDerivedVec("vAK8Flag"+spec, vAK8Flag);
-
   GetWAlone();
   GetISRJet();
   return true;
@@ -819,103 +940,23 @@ std::vector<TLorentzVector>  BaselineVessel::GetAK4NoSubjet(Constituent &ak8, st
 
 bool BaselineVessel::passNoiseEventFilterFunc()
 {
-  // According to https://twiki.cern.ch/twiki/bin/view/CMS/SUSRecommendationsICHEP16#Filters_to_be_applied,
-  // "Do not apply filters to signal monte carlo (fastsim)"
-  if( isfastsim ) return true;
-
-  try
-  {
-    bool cached_rethrow = tr->getReThrow();
-    tr->setReThrow(false);
-
-    bool passDataSpec = true;
-    if( tr->getVar<unsigned int>("run") >= 100000 ){ // hack to know if it's data or MC...
-      int goodVerticesFilter = tr->getVar<int>("goodVerticesFilter");
-      // new filters
-      const int & globalTightHalo2016Filter = tr->getVar<int>("globalTightHalo2016Filter");
-      bool passglobalTightHalo2016Filter = (&globalTightHalo2016Filter) != nullptr? tr->getVar<int>("globalTightHalo2016Filter") !=0 : true;
-
-      //int eeBadScFilter = tr->getVar<int>("eeBadScFilter");
-      int eeBadScFilter = true;
-
-      passDataSpec = goodVerticesFilter && eeBadScFilter && passglobalTightHalo2016Filter;
-    }
-
-    unsigned int hbheNoiseFilter = isfastsim? 1:tr->getVar<unsigned int>("HBHENoiseFilter");
-    unsigned int hbheIsoNoiseFilter = isfastsim? 1:tr->getVar<unsigned int>("HBHEIsoNoiseFilter");
-    int ecalTPFilter = tr->getVar<int>("EcalDeadCellTriggerPrimitiveFilter");
-
-    int jetIDFilter = isfastsim? 1:tr->getVar<unsigned int>("AK4NoLeplooseJetID");
-    // new filters
-    const unsigned int & BadPFMuonFilter = tr->getVar<unsigned int>("BadPFMuonFilter");
-    bool passBadPFMuonFilter = (&BadPFMuonFilter) != nullptr? tr->getVar<unsigned int>("BadPFMuonFilter") !=0 : true;
-
-    const unsigned int & BadChargedCandidateFilter = tr->getVar<unsigned int>("BadChargedCandidateFilter");
-    bool passBadChargedCandidateFilter = (&BadChargedCandidateFilter) != nullptr? tr->getVar<unsigned int>("BadChargedCandidateFilter") !=0 : true;
-
-    bool passMETratioFilter = tr->getVar<float>("calomet")!=0 ? tr->getVar<float>("met")/tr->getVar<float>("calomet") < 5 : true;
-
-    tr->setReThrow(cached_rethrow);
-    return passDataSpec && hbheNoiseFilter && hbheIsoNoiseFilter && ecalTPFilter && jetIDFilter && passBadPFMuonFilter && passBadChargedCandidateFilter && passMETratioFilter;
-  }
-  catch (std::string var)
-  {
-    if(tr->isFirstEvent()) 
-    {
-      printf("NTupleReader::getTupleObj(const std::string var):  Variable not found: \"%s\"!!!\n", var.c_str());
-      printf("Running with PHYS14 Config\n");
-    }
-  }
-  return true;
+  unsigned bits;
+  if( !stopFunctions::EventFilterBits::lookup(*tr, isfastsim, bits, eventFilterBitsLabel) ) bits = stopFunctions::EventFilterBits::noiseBits(*tr, isfastsim);
+  return stopFunctions::EventFilterBits::pass(bits, stopFunctions::EventFilterBits::NoiseMask);
 }
 
 bool BaselineVessel::passQCDHighMETFilterFunc()
 {
-  std::vector<TLorentzVector> jetsLVec = tr->getVec<TLorentzVector>("jetsLVec");
-  std::vector<float> recoJetsmuonEnergyFraction = tr->getVec<float>("recoJetsmuonEnergyFraction");
-  float metphi = tr->getVar<float>("metphi");
-
-  int nJetsLoop = recoJetsmuonEnergyFraction.size();
-  std::vector<float> dPhisVec = AnaFunctions::calcDPhi( jetsLVec, metphi, nJetsLoop, AnaConsts::dphiArr);
-
-  for(int i=0; i<nJetsLoop ; i++)
-  {
-    float thisrecoJetsmuonenergy = recoJetsmuonEnergyFraction.at(i)*(jetsLVec.at(i)).Pt();
-    if( (recoJetsmuonEnergyFraction.at(i)>0.5) && (thisrecoJetsmuonenergy>200) && (std::abs(dPhisVec.at(i)-3.1416)<0.4) ) return false;
-  }
-
-  return true;
+  unsigned bits;
+  if( stopFunctions::EventFilterBits::lookup(*tr, isfastsim, bits, eventFilterBitsLabel) ) return stopFunctions::EventFilterBits::pass(bits, stopFunctions::EventFilterBits::QCDHighMET);
+  return stopFunctions::EventFilterBits::passQCDHighMET(*tr);
 }
 
 bool BaselineVessel::passFastsimEventFilterFunc()
 {
-  bool passFilter = true;
-
-  if( isfastsim ){
-    bool cached_rethrow = tr->getReThrow();
-    tr->setReThrow(false);
-    const std::vector<TLorentzVector> & genjetsLVec = tr->getVec<TLorentzVector>("genjetsLVec");
-    const std::vector<TLorentzVector> & recoJetsLVec = tr->getVec<TLorentzVector>("jetsLVec");
-    const std::vector<float> & recoJetschargedHadronEnergyFraction = tr->getVec<float>("recoJetschargedHadronEnergyFraction");
-
-    if( recoJetschargedHadronEnergyFraction.size() != recoJetsLVec.size() ) std::cout<<"\nWARNING ... Non-equal recoJetschargedHadronEnergyFraction.size : "<<recoJetschargedHadronEnergyFraction.size()<<"  recoJetsLVec.size : "<<recoJetsLVec.size()<<std::endl<<std::endl;
-
-    if( !recoJetsLVec.empty() && (&genjetsLVec) != nullptr ){
-      for(unsigned int ij=0; ij<recoJetsLVec.size(); ij++){
-        //                if( !AnaFunctions::jetPassCuts(recoJetsLVec[ij], AnaConsts::pt20Eta25Arr) ) continue;
-        if( !AnaFunctions::jetPassCuts(recoJetsLVec[ij], AnaConsts::pt30Eta24Arr) ) continue;
-        float mindeltaR = 999.0;
-        int matchedgenJetsIdx = -1;
-        for(unsigned int ig=0; ig<genjetsLVec.size(); ig++){
-          float dR = recoJetsLVec[ij].DeltaR(genjetsLVec[ig]);
-          if( mindeltaR > dR ){ mindeltaR = dR; matchedgenJetsIdx = (int)ig; }
-        }
-        if( matchedgenJetsIdx != -1 && mindeltaR > 0.3 && recoJetschargedHadronEnergyFraction[ij] < 0.1 ) passFilter = false;
-      }
-    }
-    tr->setReThrow(cached_rethrow);
-  }
-  return passFilter;
+  unsigned bits;
+  if( stopFunctions::EventFilterBits::lookup(*tr, isfastsim, bits, eventFilterBitsLabel) ) return stopFunctions::EventFilterBits::pass(bits, stopFunctions::EventFilterBits::FastsimJets);
+  return stopFunctions::EventFilterBits::passFastsimJets(*tr, isfastsim);
 }
 
 // ===  FUNCTION  ============================================================
@@ -924,10 +965,10 @@ bool BaselineVessel::passFastsimEventFilterFunc()
 // ===========================================================================
 float BaselineVessel::CalcMT2() const
 {
+  //shared by all vessels of a thread, so variations evaluating the same tops and MET reuse the result
+  static thread_local MT2Calculator mt2Engine;
+  mt2Engine.setPrecision(mt2Precision);
 
-//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Initial the input ~~~~~
-  TLorentzVector fatJet1LVec(0, 0, 0,0);
-  TLorentzVector fatJet2LVec(0, 0, 0,0);
   //get output of tagger
   const TopTaggerResults& ttr = ttPtr->getResults();
   //Use result for top var
@@ -940,71 +981,36 @@ float BaselineVessel::CalcMT2() const
 
   if (Ntop.size() == 1)
   {
-    fatJet1LVec = Ntop.at(0)->P();
-    fatJet2LVec = ttr.getRsys().P();
-     
-    return coreMT2calc(fatJet1LVec, fatJet2LVec);
+    return mt2Engine.get(Ntop.at(0)->P(), ttr.getRsys().P(), metLVec);
   }
 
-  if (Ntop.size() >= 2)
-  {
-    std::vector<float> cachedMT2vec;
-    for(unsigned int it=0; it<Ntop.size(); it++)
-    {
-       for(unsigned int jt=it+1; jt<Ntop.size(); jt++)
-       {
-          cachedMT2vec.push_back(coreMT2calc(Ntop.at(it)->P(), Ntop.at(jt)->P()));
-       } 
-    }
-    std::sort(cachedMT2vec.begin(), cachedMT2vec.end());
-
-    return cachedMT2vec.front();
-//    return cachedMT2vec.back();
-  }
+  //minimum over all pairs of tops
+  std::vector<TLorentzVector> topLVec;
+  topLVec.reserve(Ntop.size());
+  for(const auto* top : Ntop) topLVec.push_back(top->P());
 
-  return 0.0;
+  return mt2Engine.minOverPairs(topLVec, metLVec);
 }
 
 float BaselineVessel::coreMT2calc(const TLorentzVector & fatJet1LVec, const TLorentzVector & fatJet2LVec) const
 {
-  
-  // The input parameters associated with the particle
-  // (or collection of particles) associated with the
-  // first "side" of the event: 
-  const float massOfSystemA =  fatJet1LVec.M(); // GeV
-  const float pxOfSystemA   =  fatJet1LVec.Px(); // GeV
-  const float pyOfSystemA   =  fatJet1LVec.Py(); // GeV
-  
-  // The input parameters associated with the particle
-  // (or collection of particles) associated with the
-  // second "side" of the event:
-  const float massOfSystemB =  fatJet2LVec.M(); // GeV
-  const float pxOfSystemB   =  fatJet2LVec.Px(); // GeV
-  const float pyOfSystemB   =  fatJet2LVec.Py(); // GeV
-  
-  // The missing transverse momentum:
-  const float pxMiss        = metLVec.Px(); // GeV
-  const float pyMiss        = metLVec.Py(); // GeV
-  
-  // The mass of the "inivisible" particle presumed to have
-  // been produced at the end of the decay chain in each
-  // "half" of the event:    
-  const float invis_mass    = metLVec.M(); // GeV
-
-  float desiredPrecisionOnMt2 = 0; // Must be >=0.  If 0 alg aims for machine precision.  if >0, MT2 computed to supplied absolute precision.
+  MT2Calculator mt2Engine(mt2Precision, 0);
+  return mt2Engine.get(fatJet1LVec, fatJet2LVec, metLVec);
+}       // -----  end of function BaselineVessel::CalcMT2  -----
 
+float MT2Calculator::bisect(const float* in)
+{
   asymm_mt2_lester_bisect::disableCopyrightMessage();
 
-  float mt2 =  asymm_mt2_lester_bisect::get_mT2(
-      massOfSystemA, pxOfSystemA, pyOfSystemA,
-      massOfSystemB, pxOfSystemB, pyOfSystemB,
-      pxMiss, pyMiss,
-      invis_mass, invis_mass,
-      desiredPrecisionOnMt2);
-
-  return mt2;
-
-}       // -----  end of function BaselineVessel::CalcMT2  -----
+  // visible mass, px, py of the two sides, the missing transverse momentum,
+  // the mass of the "inivisible" particle on both sides and the precision
+  return asymm_mt2_lester_bisect::get_mT2(
+      in[0], in[1], in[2],
+      in[3], in[4], in[5],
+      in[6], in[7],
+      in[8], in[8],
+      in[9]);
+}
 
 void BaselineVessel::operator()(NTupleReader& tr_)
 {
@@ -1402,21 +1408,25 @@ void stopFunctions::CleanJets::internalCleanJets(NTupleReader& tr)
     return;
   }
 
-  std::vector<TLorentzVector>* cleanJetVec        = new std::vector<TLorentzVector>(jetsLVec);
-  std::vector<float>* cleanJetBTag               = new std::vector<float>(recoJetsCSVv2);
-  std::vector<TLorentzVector>* cleanJetpt30ArrVec = new std::vector<TLorentzVector>();
-  std::vector<float>* cleanJetpt30ArrBTag        = new std::vector<float>;
-  std::vector<float>* cleanChargedHadEFrac       = new std::vector<float>(chargedHadronEnergyFrac);
-  std::vector<float>* cleanNeutralEMEFrac        = new std::vector<float>(neutralEmEnergyFrac);
-  std::vector<float>* cleanChargedEMEFrac        = new std::vector<float>(chargedEmEnergyFrac);
+  //outputs are reader owned buffers which keep their capacity from event to event
+  std::vector<TLorentzVector>* cleanJetVec        = &tr.derivedVec<TLorentzVector>("cleanJetVec");
+  std::vector<float>* cleanJetBTag               = &tr.derivedVec<float>("cleanJetBTag");
+  std::vector<TLorentzVector>* cleanJetpt30ArrVec = &tr.derivedVec<TLorentzVector>("cleanJetpt30ArrVec");
+  std::vector<float>* cleanJetpt30ArrBTag        = &tr.derivedVec<float>("cleanJetpt30ArrBTag");
+  std::vector<float>* cleanChargedHadEFrac       = &tr.derivedVec<float>("cleanChargedHadEFrac");
+  std::vector<float>* cleanNeutralEMEFrac        = &tr.derivedVec<float>("cleanNeutralEMEFrac");
+  std::vector<float>* cleanChargedEMEFrac        = &tr.derivedVec<float>("cleanChargedEMEFrac");
+
+  std::vector<TLorentzVector>* removedJetVec      = &tr.derivedVec<TLorentzVector>("removedJetVec");
+  std::vector<float>* removedChargedHadEFrac     = &tr.derivedVec<float>("removedChargedHadEFrac");
+  std::vector<float>* removedNeutralEMEFrac      = &tr.derivedVec<float>("removedNeutralEMEFrac");
+  std::vector<float>* removedChargedEMEFrac      = &tr.derivedVec<float>("removedChargedEMEFrac");
 
-  std::vector<TLorentzVector>* removedJetVec      = new std::vector<TLorentzVector>();
-  std::vector<float>* removedChargedHadEFrac     = new std::vector<float>();
-  std::vector<float>* removedNeutralEMEFrac      = new std::vector<float>();
-  std::vector<float>* removedChargedEMEFrac      = new std::vector<float>();
+  std::vector<int>* rejectJetIdx_formuVec = &tr.derivedVec<int>("rejectJetIdx_formuVec");
+  std::vector<int>* rejectJetIdx_foreleVec = &tr.derivedVec<int>("rejectJetIdx_foreleVec");
 
-  std::vector<int>* rejectJetIdx_formuVec = new std::vector<int>();
-  std::vector<int>* rejectJetIdx_foreleVec = new std::vector<int>();
+  //lepton subtraction is done on the copy of the jets, the other clean arrays are filled at the end
+  cleanJetVec->assign(jetsLVec.begin(), jetsLVec.end());
 
   const float jldRMax = 0.15;
 
@@ -1467,61 +1477,200 @@ void stopFunctions::CleanJets::internalCleanJets(NTupleReader& tr)
     }
   }
 
-  int jetsKept = 0;
-  auto iJet = cleanJetVec->begin();
-  auto iOrigJet = jetsLVec.begin();
-  auto iBTag = cleanJetBTag->begin();
-  auto iKeep = keepJetPFCandMatch.begin();
-  auto iCHF = cleanChargedHadEFrac->begin();
-  auto iNEMF = cleanNeutralEMEFrac->begin();
-  auto iCEMF = cleanChargedEMEFrac->begin();
-  for(; iJet != cleanJetVec->end() && iBTag != cleanJetBTag->end() && iKeep != keepJetPFCandMatch.end() && iOrigJet != jetsLVec.end(); ++iKeep, ++iOrigJet)
+  //removed jets are dropped from all clean arrays at once with a mask instead of erase
+  for(unsigned int iJet = 0; iJet < jetsLVec.size(); ++iJet)
   {
-    if(!(*iKeep))
-    {
-      removedJetVec->push_back(*iOrigJet);
-      removedChargedHadEFrac->push_back(*iCHF);
-      removedNeutralEMEFrac->push_back(*iNEMF);
-      removedChargedEMEFrac->push_back(*iCEMF);
-      iJet = cleanJetVec->erase(iJet);
-      iBTag = cleanJetBTag->erase(iBTag);
-      iCHF = cleanChargedHadEFrac->erase(iCHF);
-      iNEMF = cleanNeutralEMEFrac->erase(iNEMF);
-      iCEMF = cleanChargedEMEFrac->erase(iCEMF);
-      continue;
-    }
+    if(keepJetPFCandMatch[iJet]) continue;
+    removedJetVec->push_back(jetsLVec[iJet]);
+    removedChargedHadEFrac->push_back(chargedHadronEnergyFrac[iJet]);
+    removedNeutralEMEFrac->push_back(neutralEmEnergyFrac[iJet]);
+    removedChargedEMEFrac->push_back(chargedEmEnergyFrac[iJet]);
+  }
 
-    ++jetsKept;
-    if(AnaFunctions::jetPassCuts(*iJet, AnaConsts::pt30Arr))
+  JetCollection& cleanJets = cleanJets_;
+  cleanJets.fill(*cleanJetVec, &recoJetsCSVv2, &chargedHadronEnergyFrac, &neutralEmEnergyFrac, &chargedEmEnergyFrac, true);
+  int jetsKept = cleanJets.compact(keepJetPFCandMatch);
+
+  for(int iJet = 0; iJet < jetsKept; ++iJet)
+  {
+    if(AnaFunctions::jetPassCuts(cleanJets, iJet, AnaConsts::pt30Arr))
     {
-      cleanJetpt30ArrVec->push_back(*iJet);
-      cleanJetpt30ArrBTag->push_back(*iBTag);
+      cleanJetpt30ArrVec->push_back(cleanJets.lvec[iJet]);
+      cleanJetpt30ArrBTag->push_back(cleanJets.btag[iJet]);
     }
-    if(iJet->Pt() > HT_jetPtMin && fabs(iJet->Eta()) < HT_jetEtaMax) HT += iJet->Pt();
-    if(iJet->Pt() > MHT_jetPtMin) MHT += *iJet;
-
-    ++iJet;
-    ++iBTag;
-    ++iCHF;
-    ++iNEMF;
-    ++iCEMF;
+    if(cleanJets.pt[iJet] > HT_jetPtMin && fabs(cleanJets.eta[iJet]) < HT_jetEtaMax) HT += cleanJets.pt[iJet];
+    if(cleanJets.pt[iJet] > MHT_jetPtMin) MHT += cleanJets.lvec[iJet];
   }
 
+  cleanJetVec->swap(cleanJets.lvec);
+  cleanJetBTag->swap(cleanJets.btag);
+  cleanChargedHadEFrac->swap(cleanJets.chargedHadEFrac);
+  cleanNeutralEMEFrac->swap(cleanJets.neutralEMEFrac);
+  cleanChargedEMEFrac->swap(cleanJets.chargedEMEFrac);
+
   tr.registerDerivedVar("nJetsRemoved", static_cast<int>(jetsLVec.size() - jetsKept));
   tr.registerDerivedVar("cleanHt", HT);
   tr.registerDerivedVar("cleanMHt", MHT.Pt());
   tr.registerDerivedVar("cleanMHtPhi", MHT.Phi());
-  tr.registerDerivedVec("removedJetVec", removedJetVec);
-  tr.registerDerivedVec("cleanJetVec", cleanJetVec);
-  tr.registerDerivedVec("cleanJetBTag", cleanJetBTag);
-  tr.registerDerivedVec("cleanJetpt30ArrVec", cleanJetpt30ArrVec);
-  tr.registerDerivedVec("cleanJetpt30ArrBTag", cleanJetpt30ArrBTag);
-  tr.registerDerivedVec("cleanChargedHadEFrac", cleanChargedHadEFrac);
-  tr.registerDerivedVec("cleanNeutralEMEFrac", cleanNeutralEMEFrac);
-  tr.registerDerivedVec("cleanChargedEMEFrac", cleanChargedEMEFrac);
-  tr.registerDerivedVec("removedChargedHadEFrac", removedChargedHadEFrac);
-  tr.registerDerivedVec("removedNeutralEMEFrac",  removedNeutralEMEFrac);
-  tr.registerDerivedVec("removedChargedEMEFrac",  removedChargedEMEFrac);
-  tr.registerDerivedVec("rejectJetIdx_formuVec", rejectJetIdx_formuVec);
-  tr.registerDerivedVec("rejectJetIdx_foreleVec", rejectJetIdx_foreleVec);
+}
+
+stopFunctions::EventFilterBits::EventFilterBits(bool fastsim, const std::string& eventListFile, const std::string& name) : fastsim_(fastsim), name_(name), fromTree_(-1)
+{
+  if(eventListFile.size()) eventList_ = std::make_shared<EventListFilter>(eventListFile);
+}
+
+void stopFunctions::EventFilterBits::operator()(NTupleReader& tr)
+{
+  //bits read from a friend tree are used as they are
+  if(fromTree_ < 0) fromTree_ = tr.hasVar(name_) ? 1 : 0;
+  if(fromTree_) return;
+
+  tr.registerDerivedVar(name_, compute(tr, fastsim_, eventList_.get()));
+}
+
+bool stopFunctions::EventFilterBits::lookup(NTupleReader& tr, bool fastsim, unsigned& bits, const std::string& name)
+{
+  if(!tr.hasVar(name)) return false;
+  bits = tr.getVar<unsigned int>(name);
+  return ((bits & Fastsim) != 0) == fastsim;
+}
+
+unsigned stopFunctions::EventFilterBits::compute(NTupleReader& tr, bool fastsim, const EventListFilter* eventList)
+{
+  unsigned bits = noiseBits(tr, fastsim);
+  if(passQCDHighMET(tr)) bits |= QCDHighMET;
+  if(passFastsimJets(tr, fastsim)) bits |= FastsimJets;
+  if(!eventList || eventList->CheckEvent(tr.getVar<unsigned int>("run"), tr.getVar<unsigned int>("lumi"), tr.getVar<unsigned int>("event"))) bits |= EventList;
+  if(fastsim) bits |= Fastsim;
+  return bits;
+}
+
+unsigned stopFunctions::EventFilterBits::noiseBits(NTupleReader& tr, bool fastsim)
+{
+  // According to https://twiki.cern.ch/twiki/bin/view/CMS/SUSRecommendationsICHEP16#Filters_to_be_applied,
+  // "Do not apply filters to signal monte carlo (fastsim)"
+  if( fastsim ) return NoiseMask;
+
+  bool cached_rethrow = tr.getReThrow();
+  try
+  {
+    tr.setReThrow(false);
+
+    //eeBadScFilter is not applied
+    unsigned bits = EEBadSc;
+    if( tr.getVar<unsigned int>("run") >= 100000 ){ // hack to know if it's data or MC...
+      if( tr.getVar<int>("goodVerticesFilter") ) bits |= GoodVertices;
+      // new filters
+      const int & globalTightHalo2016Filter = tr.getVar<int>("globalTightHalo2016Filter");
+      if( (&globalTightHalo2016Filter) == nullptr || globalTightHalo2016Filter != 0 ) bits |= GlobalTightHalo;
+    }
+    else bits |= GoodVertices | GlobalTightHalo;
+
+    if( tr.getVar<unsigned int>("HBHENoiseFilter") ) bits |= HBHENoise;
+    if( tr.getVar<unsigned int>("HBHEIsoNoiseFilter") ) bits |= HBHEIsoNoise;
+    if( tr.getVar<int>("EcalDeadCellTriggerPrimitiveFilter") ) bits |= EcalDeadCellTP;
+    if( tr.getVar<unsigned int>("AK4NoLeplooseJetID") ) bits |= JetID;
+
+    // new filters
+    const unsigned int & BadPFMuonFilter = tr.getVar<unsigned int>("BadPFMuonFilter");
+    if( (&BadPFMuonFilter) == nullptr || BadPFMuonFilter != 0 ) bits |= BadPFMuon;
+    const unsigned int & BadChargedCandidateFilter = tr.getVar<unsigned int>("BadChargedCandidateFilter");
+    if( (&BadChargedCandidateFilter) == nullptr || BadChargedCandidateFilter != 0 ) bits |= BadChargedCandidate;
+
+    if( tr.getVar<float>("calomet") == 0 || tr.getVar<float>("met")/tr.getVar<float>("calomet") < 5 ) bits |= METRatio;
+
+    tr.setReThrow(cached_rethrow);
+    return bits;
+  }
+  catch (std::string var)
+  {
+    tr.setReThrow(cached_rethrow);
+    if(tr.isFirstEvent()) 
+    {
+      printf("NTupleReader::getTupleObj(const std::string var):  Variable not found: \"%s\"!!!\n", var.c_str());
+      printf("Running with PHYS14 Config\n");
+    }
+  }
+  return NoiseMask;
+}
+
+bool stopFunctions::EventFilterBits::passQCDHighMET(NTupleReader& tr)
+{
+  const std::vector<TLorentzVector>& jetsLVec = tr.getVec<TLorentzVector>("jetsLVec");
+  const std::vector<float>& recoJetsmuonEnergyFraction = tr.getVec<float>("recoJetsmuonEnergyFraction");
+  float metphi = tr.getVar<float>("metphi");
+
+  int nJetsLoop = recoJetsmuonEnergyFraction.size();
+  std::vector<float> dPhisVec = AnaFunctions::calcDPhi( jetsLVec, metphi, nJetsLoop, AnaConsts::dphiArr);
+
+  for(int i=0; i<nJetsLoop ; i++)
+  {
+    float thisrecoJetsmuonenergy = recoJetsmuonEnergyFraction.at(i)*(jetsLVec.at(i)).Pt();
+    if( (recoJetsmuonEnergyFraction.at(i)>0.5) && (thisrecoJetsmuonenergy>200) && (std::abs(dPhisVec.at(i)-3.1416)<0.4) ) return false;
+  }
+
+  return true;
+}
+
+bool stopFunctions::EventFilterBits::passFastsimJets(NTupleReader& tr, bool fastsim)
+{
+  bool passFilter = true;
+
+  if( fastsim ){
+    bool cached_rethrow = tr.getReThrow();
+    tr.setReThrow(false);
+    const std::vector<TLorentzVector> & genjetsLVec = tr.getVec<TLorentzVector>("genjetsLVec");
+    const std::vector<TLorentzVector> & recoJetsLVec = tr.getVec<TLorentzVector>("jetsLVec");
+    const std::vector<float> & recoJetschargedHadronEnergyFraction = tr.getVec<float>("recoJetschargedHadronEnergyFraction");
+
+    if( recoJetschargedHadronEnergyFraction.size() != recoJetsLVec.size() ) std::cout<<"\nWARNING ... Non-equal recoJetschargedHadronEnergyFraction.size : "<<recoJetschargedHadronEnergyFraction.size()<<"  recoJetsLVec.size : "<<recoJetsLVec.size()<<std::endl<<std::endl;
+
+    if( !recoJetsLVec.empty() && (&genjetsLVec) != nullptr ){
+      for(unsigned int ij=0; ij<recoJetsLVec.size(); ij++){
+        if( !AnaFunctions::jetPassCuts(recoJetsLVec[ij], AnaConsts::pt30Eta24Arr) ) continue;
+        float mindeltaR = 999.0;
+        int matchedgenJetsIdx = -1;
+        for(unsigned int ig=0; ig<genjetsLVec.size(); ig++){
+          float dR = recoJetsLVec[ij].DeltaR(genjetsLVec[ig]);
+          if( mindeltaR > dR ){ mindeltaR = dR; matchedgenJetsIdx = (int)ig; }
+        }
+        if( matchedgenJetsIdx != -1 && mindeltaR > 0.3 && recoJetschargedHadronEnergyFraction[ij] < 0.1 ) passFilter = false;
+      }
+    }
+    tr.setReThrow(cached_rethrow);
+  }
+  return passFilter;
+}
+
+std::set<std::string> stopFunctions::EventFilterBits::inputBranches()
+{
+  return {"run", "lumi", "event", "goodVerticesFilter", "globalTightHalo2016Filter", "HBHENoiseFilter", "HBHEIsoNoiseFilter",
+          "EcalDeadCellTriggerPrimitiveFilter", "AK4NoLeplooseJetID", "BadPFMuonFilter", "BadChargedCandidateFilter", "met", "calomet", "metphi",
+          "jetsLVec", "recoJetsmuonEnergyFraction", "recoJetschargedHadronEnergyFraction", "genjetsLVec"};
+}
+
+void stopFunctions::EventFilterBits::writeFriendTree(TTree* tree, const std::string& outputFile) const
+{
+  if(!tree) THROW_SATEXCEPTION("EventFilterBits::writeFriendTree(...): null input tree!!!");
+
+  TFile* f = TFile::Open(outputFile.c_str(), "RECREATE");
+  if(!f || f->IsZombie()) THROW_SATEXCEPTION("EventFilterBits::writeFriendTree(...): could not open \"" + outputFile + "\"!!!");
+
+  unsigned int bits = 0;
+  TTree* out = new TTree("eventFilterBits", "eventFilterBits");
+  out->Branch(name_.c_str(), &bits, (name_ + "/i").c_str());
+
+  //one entry per input entry so the tree lines up as a friend.  The reader sets its own branch
+  //addresses, the tree must not be read by another NTupleReader at the same time
+  NTupleReader tr(tree, inputBranches());
+  while(tr.getNextEvent())
+  {
+    bits = compute(tr, fastsim_, eventList_.get());
+    out->Fill();
+  }
+
+  f->cd();
+  out->Write();
+  f->Close();
+  delete f;
 }
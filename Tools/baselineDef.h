@@ -9,9 +9,12 @@
 
 #include <memory>
 #include <iostream>
+#include <map>
+#include <set>
 
 class TFile;
 class TF1;
+class TTree;
 
 enum AK8Flag : unsigned
 {
@@ -24,6 +27,52 @@ enum AK8Flag : unsigned
   NoTagNob,
 };
 
+// Work shared by the BaselineVessels of several specialisations in one event, e.g.
+//
+//   auto core = std::make_shared<BaselineCore>();
+//   BaselineVessel blv(tr), blvJECUp(tr, "jecUp"), blvJECDn(tr, "jecDn");
+//   for(auto* b : {&blv, &blvJECUp, &blvJECDn}) { b->setCore(core); tr.registerFunction(*b); }
+//
+// Results which only depend on the input labels of a vessel (event filters, lepton counts, the
+// top tagger run on a given jet collection) are computed by the first vessel needing them in
+// the event and reused by the others, only vessels with different inputs (e.g. the JEC varied
+// jets) rerun them.  The tagger is keyed by its labels and by whether it ran on the event or on
+// an empty one (skipTaggerOnFailedCuts), each with its own TopTagger, so the results a vessel
+// reads are never replaced by another vessel.  Vessels sharing a core must not be run concurrently.
+class BaselineCore
+{
+public:
+  struct LeptonCounts
+  {
+    int nMuons, nElectrons, nIsoTrks, nIsoLepTrks, nIsoPionTrks;
+  };
+
+  BaselineCore() : tr_(nullptr), evt_(-1) {}
+
+  //Drop the results of the previous event once the reader moved on
+  void update(const NTupleReader& tr);
+
+  bool getFlag(const std::string& key, bool& value) const;
+  void setFlag(const std::string& key, bool value) { flags_[key] = value; }
+
+  const LeptonCounts* getLeptons(const std::string& key) const;
+  void setLeptons(const std::string& key, const LeptonCounts& counts) { leptons_[key] = counts; }
+
+  //Tagger shared by all vessels with the same tagger inputs, null until the first vessel sets it
+  std::shared_ptr<TopTagger>& tagger(const std::string& key) { return taggers_[key]; }
+  //How the tagger of key already ran in this event (0 not yet), set by the vessel running it
+  int getTaggerRun(const std::string& key) const;
+  void setTaggerRun(const std::string& key, int run) { taggerRuns_[key] = run; }
+
+private:
+  const NTupleReader* tr_;
+  int evt_;
+  std::map<std::string, bool> flags_;
+  std::map<std::string, LeptonCounts> leptons_;
+  std::map<std::string, std::shared_ptr<TopTagger>> taggers_;
+  std::map<std::string, int> taggerRuns_;
+};
+
 class BaselineVessel
 {
 private:
@@ -40,15 +89,29 @@ private:
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ TopTagger ~~~~~
     std::shared_ptr<TopTagger> ttPtr;
+    //tagger made by SetupTopTagger, ttPtr may point to a tagger shared through the core
+    std::shared_ptr<TopTagger> ownTtPtr;
 
     //  container
     TLorentzVector metLVec; 
+    JetCollection jets;
+    AnaFunctions::JetSums jetSums;
+    AnaFunctions::LeptonCollection muons, electrons, isoTrks;
     std::vector<TLorentzVector> *jetsLVec_forTagger;
     std::vector<float> *recoJetsBtag_forTagger;
     std::vector<float> *qgLikelihood_forTagger;
     std::vector<TLorentzVector> *vTops;
     std::map<int, std::vector<TLorentzVector> > *mTopJets;
     std::vector<unsigned> * vAK8Flag;
+    //tagger input, reused every event
+    std::vector<Constituent> taggerConstituents;
+    std::shared_ptr<BaselineCore> core;
+
+    //With a core, switch to the tagger shared for these inputs and run mode (1 full, 2 empty event),
+    //true if it already ran this event
+    bool useSharedTagger(const int run, std::string& key);
+    //point the tagger jet inputs at their reader owned buffers, cleared for the event
+    void clearTaggerInputs();
 
     std::vector<TLorentzVector> GetAK4NoSubjet(Constituent &ak8, 
         std::vector<TLorentzVector> &ak4jets) const;
@@ -69,6 +132,8 @@ public:
     std::string elesFlagIDLabel;
     std::string qgLikehoodLabel;
     std::string toptaggerCfgFile;
+    //name of the EventFilterBits variable to use when present
+    std::string eventFilterBitsLabel;
     bool doIsoTrksVeto;
     bool doMuonVeto;
     bool doEleVeto;
@@ -78,6 +143,11 @@ public:
     bool passBaselineNoTagMT2;
     bool passBaselineNoTag;
     bool passBaselineNoLepVeto;
+    //absolute precision (GeV) of the MT2 bisection, 0 for machine precision
+    float mt2Precision;
+    //run the top tagger on an empty event when passnJets, passHT or (with doMET) passMET already
+    //failed, all top variables of such events are empty and passTagger only follows incZEROtop
+    bool skipTaggerOnFailedCuts;
 
 
     BaselineVessel(NTupleReader &tr_, const std::string specialization = "", const std::string filterString = "");
@@ -93,6 +163,9 @@ public:
 
     void operator()(NTupleReader& tr);
 
+    //Share spec independent results with the other vessels of the core, before the first event
+    void setCore(const std::shared_ptr<BaselineCore>& core_) { core = core_; }
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ TopTagger ~~~~~
     bool SetupTopTagger(std::string CfgFile_ = "TopTagger.cfg");
     bool PassTopTagger();
@@ -103,6 +176,7 @@ public:
         std::map<unsigned int, std::pair<unsigned int, unsigned int> > *TypeZLepIdx, 
         const int zMassMin, const int zMassMax) const;
     void prepareTopTagger();
+    void skipTopTagger();
     std::shared_ptr<TopTagger> GetTopTaggerPtr() const {return ttPtr;};
     int GetnTops() const;
     bool GetTopCombs() const;
@@ -182,6 +256,8 @@ namespace stopFunctions
         bool remove_;
         bool disableMuon_, disableElec_;
         bool forceDr_;
+        //working copy of the jets, kept to reuse its buffers
+        JetCollection cleanJets_;
 
         int cleanLeptonFromJet(const TLorentzVector& lep, const int& lepMatchedJetIdx, const std::vector<TLorentzVector>& jetsLVec, const std::vector<float>& jecScaleRawToFull, std::vector<bool>& keepJet, const std::vector<float>& neutralEmEnergyFrac, std::vector<TLorentzVector>* cleanJetVec, const float& jldRMax, const float photoCleanThresh = -999.9);
         void internalCleanJets(NTupleReader& tr);
@@ -192,6 +268,73 @@ namespace stopFunctions
       CleanJets cjh;
       cjh(tr);
     }
+
+    //Packs all event filter decisions into one unsigned int "eventFilterBits" (a set bit means the
+    //filter passes), computed once per event instead of per BaselineVessel:
+    //
+    //   stopFunctions::EventFilterBits filterBits(false, "eventList.txt");
+    //   tr.registerFunction(filterBits);    //before the vessels
+    //
+    //The vessels use the bits when they are present (set BaselineVessel::eventFilterBitsLabel for
+    //another name).  writeFriendTree() stores them in a sidecar tree next to an input file, once
+    //added with chain->AddFriend("eventFilterBits", file) before the NTupleReader is built, the
+    //individual filter branches need not be read (or activated) anymore and no producer is needed.
+    class EventFilterBits
+    {
+    public:
+      enum Bit : unsigned
+      {
+        GoodVertices        = 1u << 0,
+        GlobalTightHalo     = 1u << 1,
+        EEBadSc             = 1u << 2,
+        HBHENoise           = 1u << 3,
+        HBHEIsoNoise        = 1u << 4,
+        EcalDeadCellTP      = 1u << 5,
+        JetID               = 1u << 6,
+        BadPFMuon           = 1u << 7,
+        BadChargedCandidate = 1u << 8,
+        METRatio            = 1u << 9,
+        QCDHighMET          = 1u << 10,
+        FastsimJets         = 1u << 11,
+        EventList           = 1u << 12,
+        //the bits were computed for fastsim
+        Fastsim             = 1u << 31,
+      };
+      //the filters of BaselineVessel::passNoiseEventFilterFunc
+      static const unsigned NoiseMask = GoodVertices | GlobalTightHalo | EEBadSc | HBHENoise | HBHEIsoNoise | EcalDeadCellTP | JetID | BadPFMuon | BadChargedCandidate | METRatio;
+
+      EventFilterBits(bool fastsim = false, const std::string& eventListFile = "", const std::string& name = "eventFilterBits");
+
+      void operator()(NTupleReader& tr);
+
+      //Gets the bits of the current event if a producer or friend tree with the same fastsim mode provides them
+      static bool lookup(NTupleReader& tr, bool fastsim, unsigned& bits, const std::string& name = "eventFilterBits");
+      static unsigned compute(NTupleReader& tr, bool fastsim, const EventListFilter* eventList = nullptr);
+
+      //The filter groups, as evaluated by BaselineVessel when there are no bits
+      static unsigned noiseBits(NTupleReader& tr, bool fastsim);
+      static bool passQCDHighMET(NTupleReader& tr);
+      static bool passFastsimJets(NTupleReader& tr, bool fastsim);
+
+      static bool pass(unsigned bits, unsigned mask) { return (bits & mask) == mask; }
+
+      //Branches read by compute()
+      static std::set<std::string> inputBranches();
+
+      //Write the bits of every entry of tree to a tree "eventFilterBits" in outputFile.  This reads
+      //tree with its own NTupleReader, which resets the branch addresses: pass a tree or chain that
+      //no other NTupleReader is reading and build the analysis reader afterwards
+      void writeFriendTree(TTree* tree, const std::string& outputFile) const;
+
+      const std::string& getName() const { return name_; }
+
+    private:
+      bool fastsim_;
+      std::string name_;
+      std::shared_ptr<EventListFilter> eventList_;
+      //-1 until the first event, 1 if the bits come from the input tree
+      int fromTree_;
+    };
 }
 
 #endif
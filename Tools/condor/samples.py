@@ -1,17 +1,43 @@
 from ctypes import cdll
 from ctypes import c_char_p
 from ctypes import c_double
-from ctypes import POINTER 
+from ctypes import c_int
+from ctypes import c_longlong
+from ctypes import c_void_p
+from ctypes import byref
+from ctypes import POINTER
 
+# The arrays returned by the library belong to the collection handle and are only valid until the
+# next call, so every method copies them into python lists right away
 class SampleCollection:
     def __init__(self, ssfile, scfile):
         self.lib = cdll.LoadLibrary('../obj/samplesModule.so')
-        self.obj = self.lib.SC_new(ssfile, scfile)
+        self.lib.SC_new.restype = c_void_p
+        self.lib.SC_new.argtypes = [c_char_p, c_char_p]
+        self.lib.SC_delete.argtypes = [c_void_p]
+        self.lib.SC_samples_size.argtypes = [c_void_p, c_char_p]
         self.lib.SC_samples.restype = POINTER(c_char_p)
+        self.lib.SC_samples.argtypes = [c_void_p, c_char_p]
         self.lib.SC_samples_names.restype = POINTER(c_char_p)
+        self.lib.SC_samples_names.argtypes = [c_void_p, c_char_p]
+        self.lib.SC_samples_weights.restype = POINTER(c_double)
+        self.lib.SC_samples_weights.argtypes = [c_void_p, c_char_p]
+        self.lib.SC_sample_files.restype = POINTER(c_char_p)
+        self.lib.SC_sample_files.argtypes = [c_void_p, c_char_p, c_int, POINTER(c_int)]
+        self.lib.SC_samplecollection_size.argtypes = [c_void_p]
         self.lib.SC_samplecollection_names.restype = POINTER(c_char_p)
+        self.lib.SC_samplecollection_names.argtypes = [c_void_p]
         self.lib.SC_samplecollection_lumis.restype = POINTER(c_double)
+        self.lib.SC_samplecollection_lumis.argtypes = [c_void_p]
         self.lib.SC_fixed_lumi.restype = c_double
+        self.lib.SC_work_units.restype = POINTER(c_longlong)
+        self.lib.SC_work_units.argtypes = [c_void_p, c_char_p, c_longlong, POINTER(c_int)]
+        self.obj = self.lib.SC_new(ssfile, scfile)
+
+    def __del__(self):
+        if getattr(self, 'obj', None):
+            self.lib.SC_delete(self.obj)
+            self.obj = None
 
     def nSamples(self, name):
         return self.lib.SC_samples_size(self.obj, name)
@@ -20,19 +46,41 @@ class SampleCollection:
         return self.lib.SC_fixed_lumi()
 
     def sampleList(self, name):
+        n = self.lib.SC_samples_size(self.obj, name)
         names = self.lib.SC_samples(self.obj, name)
+        names = [names[i] for i in xrange(n)]
         files = self.lib.SC_samples_names(self.obj, name)
-        list = [(names[i],files[i]) for i in xrange(self.lib.SC_samples_size(self.obj, name))]
+        list = [(names[i],files[i]) for i in xrange(n)]
         return list
 
+    def sampleWeights(self, name):
+        weights = self.lib.SC_samples_weights(self.obj, name)
+        return [weights[i] for i in xrange(self.lib.SC_samples_size(self.obj, name))]
+
+    def sampleFiles(self, name, iSample):
+        # file list of sample iSample of sampleList(name)
+        n = c_int(0)
+        files = self.lib.SC_sample_files(self.obj, name, iSample, byref(n))
+        return [files[i] for i in xrange(n.value)]
+
     def sampleCollectionList(self):
         names = self.lib.SC_samplecollection_names(self.obj)
         list = [names[i] for i in xrange(self.lib.SC_samplecollection_size(self.obj))]
         return list
 
     def sampleCollectionLumiList(self):
-        names = self.lib.SC_samplecollection_names(self.obj)
+        names = self.sampleCollectionList()
         lumis = self.lib.SC_samplecollection_lumis(self.obj)
-        list = [(names[i],lumis[i]) for i in xrange(self.lib.SC_samplecollection_size(self.obj))]
+        list = [(names[i],lumis[i]) for i in xrange(len(names))]
         return dict(list)
 
+    def workUnits(self, name, eventsPerJob):
+        # (sample file list, sample name, startfile, filerun, firstEntry, lastEntry) of jobs of about eventsPerJob events
+        samples = self.sampleList(name)
+        n = c_int(0)
+        units = self.lib.SC_work_units(self.obj, name, c_longlong(eventsPerJob), byref(n))
+        list = []
+        for i in xrange(n.value):
+            s, sname = samples[units[5*i]]
+            list.append((s, sname, units[5*i+1], units[5*i+2], units[5*i+3], units[5*i+4]))
+        return list
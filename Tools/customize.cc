@@ -32,6 +32,115 @@ namespace AnaFunctions
     return cntNJets;
   }
 
+  bool jetPassCuts(const JetCollection& jets, unsigned int ij, const AnaConsts::AccRec& jetCutsArr)
+  {
+    const float minAbsEta = jetCutsArr.minAbsEta, maxAbsEta = jetCutsArr.maxAbsEta, minPt = jetCutsArr.minPt, maxPt = jetCutsArr.maxPt;
+    const float perjetpt = jets.pt[ij], perjeteta = jets.eta[ij];
+    return  ( minAbsEta == -1 || fabs(perjeteta) >= minAbsEta )
+      && ( maxAbsEta == -1 || fabs(perjeteta) < maxAbsEta )
+      && (     minPt == -1 || perjetpt >= minPt )
+      && (     maxPt == -1 || perjetpt < maxPt );
+  }
+
+  // One AccRec cut on a jet.  By default the "no cut" flags are or'ed in rather than short
+  // circuited, so there is no branch and nan behaves as in jetPassCuts
+  static inline unsigned char jetPassCut(const AnaConsts::AccRec& cuts, const float pt, const float eta)
+  {
+    const float absEta = std::fabs(eta);
+#ifdef SAT_SCALAR_JET_KERNELS
+    return  ( cuts.minAbsEta == -1 || absEta >= cuts.minAbsEta )
+      && ( cuts.maxAbsEta == -1 || absEta < cuts.maxAbsEta )
+      && (     cuts.minPt == -1 || pt >= cuts.minPt )
+      && (     cuts.maxPt == -1 || pt < cuts.maxPt );
+#else
+    return ((cuts.minAbsEta == -1) | (absEta >= cuts.minAbsEta))
+         & ((cuts.maxAbsEta == -1) | (absEta <  cuts.maxAbsEta))
+         & ((cuts.minPt     == -1) | (pt     >= cuts.minPt))
+         & ((cuts.maxPt     == -1) | (pt     <  cuts.maxPt));
+#endif
+  }
+
+  void jetPassMask(const JetCollection& jets, const AnaConsts::AccRec& jetCutsArr, std::vector<unsigned char>& mask)
+  {
+    const unsigned int nJets = jets.size();
+    mask.resize(nJets);
+    for(unsigned int ij=0; ij<nJets; ij++) mask[ij] = jetPassCut(jetCutsArr, jets.pt[ij], jets.eta[ij]);
+  }
+
+  int countJets(const JetCollection& jets, const AnaConsts::AccRec& jetCutsArr){
+    int cntNJets =0;
+    for(unsigned int ij=0; ij<jets.size(); ij++) cntNJets += jetPassCut(jetCutsArr, jets.pt[ij], jets.eta[ij]);
+    return cntNJets;
+  }
+
+  int countCSVS(const JetCollection& jets, const float cutCSVS, const AnaConsts::AccRec& jetCutsArr){
+    int cntNJets =0;
+    for(unsigned int ij=0; ij<jets.size(); ij++){
+      if( !jetPassCuts(jets, ij, jetCutsArr) ) continue;
+      if( std::isnan(jets.btag[ij]) ) continue;
+      if( jets.btag[ij] > cutCSVS ) cntNJets ++;
+    }
+    return cntNJets;
+  }
+
+  float calcHT(const JetCollection& jets, const AnaConsts::AccRec& jetCutsArr){
+    // summed in jet order to give the same float rounding as calcHT on the TLorentzVectors
+    float ht = 0;
+    for(unsigned int ij=0; ij<jets.size(); ij++){
+      if( jetPassCut(jetCutsArr, jets.pt[ij], jets.eta[ij]) ) ht += jets.pt[ij];
+    }
+    return ht;
+  }
+
+  TLorentzVector calcMHT(const JetCollection& jets, const AnaConsts::AccRec& jetCutsArr){
+    TLorentzVector mhtLVec;
+    for(unsigned int ij=0; ij<jets.size(); ij++){
+      if( !jetPassCuts(jets, ij, jetCutsArr) ) continue;
+      TLorentzVector tmpLVec;
+      tmpLVec.SetPtEtaPhiM( jets.pt[ij], 0, jets.phi[ij], 0 );
+      mhtLVec -= tmpLVec;
+    }
+    return mhtLVec;
+  }
+
+  std::vector<float> calcDPhi(const JetCollection& jets, const double metphi, const int nDPhi, const AnaConsts::AccRec& jetCutsArr){
+    int cntNJets =0;
+    std::vector<float> outDPhiVec(nDPhi, 999);
+    for(unsigned int ij=0; ij<jets.size(); ij++){
+      if( !jetPassCuts(jets, ij, jetCutsArr) ) continue;
+      if( cntNJets < nDPhi ) outDPhiVec[cntNJets] = fabs(TVector2::Phi_mpi_pi( jets.phi[ij] - metphi ));
+      cntNJets ++;
+    }
+    return outDPhiVec;
+  }
+
+  void calcJetSums(const JetCollection& jets, const JetSumCuts& cuts, const double metphi, JetSums& sums){
+    const unsigned int nJets = jets.size(), nCuts = cuts.count.size();
+    sums.nJets.assign(nCuts, 0);
+    sums.dPhi.assign(cuts.nDPhi, 999);
+    float ht = 0;
+    // the MHT terms are those of SetPtEtaPhiM in calcMHT, summed in the same order
+    double mhtPx = 0, mhtPy = 0;
+    int cntDPhiJets = 0;
+    for(unsigned int ij=0; ij<nJets; ij++){
+      const float pt = jets.pt[ij], eta = jets.eta[ij];
+      for(unsigned int ic=0; ic<nCuts; ic++) sums.nJets[ic] += jetPassCut(cuts.count[ic], pt, eta);
+      if( jetPassCut(cuts.ht, pt, eta) ) ht += pt;
+      // the trigonometric functions are only evaluated for the jets passing
+      if( cuts.doMHT && jetPassCut(cuts.mht, pt, eta) ){
+        const double absPt = std::fabs(pt), phi = jets.phi[ij];
+        mhtPx -= absPt*std::cos(phi);
+        mhtPy -= absPt*std::sin(phi);
+      }
+      if( cntDPhiJets < cuts.nDPhi && jetPassCut(cuts.dPhi, pt, eta) ){
+        sums.dPhi[cntDPhiJets++] = fabs(TVector2::Phi_mpi_pi( jets.phi[ij] - metphi ));
+      }
+    }
+    sums.ht = ht;
+    sums.mhtPx = mhtPx;
+    sums.mhtPy = mhtPy;
+  }
+
   std::vector<float> calcDPhi(const std::vector<TLorentzVector> &inputJets, const double metphi, const int nDPhi, const AnaConsts::AccRec& jetCutsArr){
     const float minAbsEta = jetCutsArr.minAbsEta, maxAbsEta = jetCutsArr.maxAbsEta, minPt = jetCutsArr.minPt, maxPt = jetCutsArr.maxPt;
     int cntNJets =0;
@@ -231,6 +340,75 @@ namespace AnaFunctions
     return cntNIsoTrks;
   }
 
+  void LeptonCollection::fill(const std::vector<TLorentzVector>& leptons){
+    const unsigned int n = leptons.size();
+    pt.resize(n);
+    eta.resize(n);
+    phi.resize(n);
+    for(unsigned int i=0; i<n; i++){
+      pt[i]  = leptons[i].Pt();
+      eta[i] = leptons[i].Eta();
+      phi[i] = leptons[i].Phi();
+    }
+  }
+
+  // Acceptance, isolation and mT cuts of passMuon, passElectron and passIsoTrk, without a branch
+  // unless SAT_SCALAR_JET_KERNELS is defined
+  static inline unsigned char leptonPassCut(const float minAbsEta, const float maxAbsEta, const float minPt, const float maxPt, const float maxIso, const float maxMtw,
+                                            const float pt, const float eta, const float iso, const float mtw)
+  {
+    const float absEta = std::fabs(eta);
+#ifdef SAT_SCALAR_JET_KERNELS
+    return ( minAbsEta == -1 || absEta >= minAbsEta )
+      && ( maxAbsEta == -1 || absEta < maxAbsEta )
+      && (     minPt == -1 || pt >= minPt )
+      && (     maxPt == -1 || pt < maxPt )
+      && (    maxIso == -1 || iso < maxIso )
+      && (    maxMtw == -1 || mtw < maxMtw );
+#else
+    return ((minAbsEta == -1) | (absEta >= minAbsEta))
+         & ((maxAbsEta == -1) | (absEta <  maxAbsEta))
+         & ((minPt     == -1) | (pt     >= minPt))
+         & ((maxPt     == -1) | (pt     <  maxPt))
+         & ((maxIso    == -1) | (iso    <  maxIso))
+         & ((maxMtw    == -1) | (mtw    <  maxMtw));
+#endif
+  }
+
+  int countMuons(const LeptonCollection& muons, const std::vector<float> &muonsRelIso, const std::vector<float> &muonsMtw, const std::vector<int> &muonsFlagID, const AnaConsts::IsoAccRec& muonsArr){
+    int cntNMuons = 0;
+    for(unsigned int im=0; im<muons.size(); im++){
+      cntNMuons += leptonPassCut(muonsArr.minAbsEta, muonsArr.maxAbsEta, muonsArr.minPt, muonsArr.maxPt, muonsArr.maxIso, muonsArr.maxMtw,
+                                 muons.pt[im], muons.eta[im], muonsRelIso[im], muonsMtw[im]) & (muonsFlagID[im] != 0);
+    }
+    return cntNMuons;
+  }
+
+  int countElectrons(const LeptonCollection& electrons, const std::vector<float> &electronsRelIso, const std::vector<float> &electronsMtw, const std::vector<unsigned int>& isEBVec, const std::vector<int> &electronsFlagID, const AnaConsts::ElecIsoAccRec& elesArr){
+    int cntNElectrons = 0;
+    for(unsigned int ie=0; ie<electrons.size(); ie++){
+      const float maxIso = isEBVec[ie] ? elesArr.maxIsoEB : elesArr.maxIsoEE;
+      cntNElectrons += leptonPassCut(elesArr.minAbsEta, elesArr.maxAbsEta, elesArr.minPt, elesArr.maxPt, maxIso, elesArr.maxMtw,
+                                     electrons.pt[ie], electrons.eta[ie], electronsRelIso[ie], electronsMtw[ie]) & (electronsFlagID[ie] != 0);
+    }
+    return cntNElectrons;
+  }
+
+  void countIsoTrks(const LeptonCollection& isoTrks, const std::vector<float> &isoTrksIso, const std::vector<float> &isoTrksMtw, const std::vector<int> &isoTrkspdgId, IsoTrkCounts& counts){
+    const AnaConsts::IsoAccRec& lepArr = AnaConsts::isoLepTrksArr;
+    const AnaConsts::IsoAccRec& hadArr = AnaConsts::isoHadTrksArr;
+    int cntNLep = 0, cntNPion = 0;
+    for(unsigned int is=0; is<isoTrks.size(); is++){
+      const int absId = std::abs(isoTrkspdgId[is]);
+      const float pt = isoTrks.pt[is], eta = isoTrks.eta[is], relIso = isoTrksIso[is]/pt, mtw = isoTrksMtw[is];
+      cntNLep  += ((absId == 11) | (absId == 13)) & leptonPassCut(lepArr.minAbsEta, lepArr.maxAbsEta, lepArr.minPt, lepArr.maxPt, lepArr.maxIso, lepArr.maxMtw, pt, eta, relIso, mtw);
+      cntNPion += (absId == 211) & leptonPassCut(hadArr.minAbsEta, hadArr.maxAbsEta, hadArr.minPt, hadArr.maxPt, hadArr.maxIso, hadArr.maxMtw, pt, eta, relIso, mtw);
+    }
+    counts.nIsoLepTrks = cntNLep;
+    counts.nIsoPionTrks = cntNPion;
+    counts.nIsoTrks = cntNLep + cntNPion;
+  }
+
   void prepareJetsForTagger(const std::vector<TLorentzVector> &inijetsLVec, const std::vector<float> &inirecoJetsBtag, std::vector<TLorentzVector> &jetsLVec_forTagger, std::vector<float> &recoJetsBtag_forTagger, const std::vector<float>& qgLikelihood, std::vector<float>& qgLikelihood_forTagger){
 
     jetsLVec_forTagger.clear(); recoJetsBtag_forTagger.clear();
@@ -331,4 +509,24 @@ namespace AnaFunctions
     else                return -1;
   }
 
+  int jetLepdRMatch(const float lepEta, const float lepPhi, const JetCollection& jets, const float jldRMax)
+  {
+    // squared dR with the phi difference folded into [0, pi], no sqrt or branch in the loop
+    const float pi = TMath::Pi(), twoPi = 2*TMath::Pi();
+    float dR2min = 999.0f*999.0f;
+    int minJMatch = -1;
+
+    for(unsigned int iJet = 0; iJet < jets.size(); ++iJet)
+    {
+      const float dEta = jets.eta[iJet] - lepEta;
+      float dPhi = std::fabs(jets.phi[iJet] - lepPhi);
+      dPhi = (dPhi > pi) ? twoPi - dPhi : dPhi;
+      const float dR2 = dEta*dEta + dPhi*dPhi;
+      minJMatch = (dR2 < dR2min) ? int(iJet) : minJMatch;
+      dR2min = (dR2 < dR2min) ? dR2 : dR2min;
+    }
+    if(dR2min < jldRMax*jldRMax) return minJMatch;
+    else                         return -1;
+  }
+
 }
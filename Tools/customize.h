@@ -7,6 +7,8 @@
 #include "TLorentzVector.h"
 #include "Math/VectorUtil.h"
 
+#include "JetCollection.h"
+
 // Top Tagger
 #include "TopTagger/TopTagger/include/TopTagger.h"
 #include "TopTagger/TopTagger/include/TopTaggerResults.h"
@@ -137,6 +139,55 @@ namespace AnaFunctions{
   bool jetPassCuts(const TLorentzVector& jet, const AnaConsts::AccRec& jetCutsArr);
   int countJets(const std::vector<TLorentzVector> &inputJets, const AnaConsts::AccRec& jetCutsArr);
   int countCSVS(const std::vector<TLorentzVector> &inputJets, const std::vector<float> &inputCSVS, const float cutCSVS, const AnaConsts::AccRec& jetCutsArr);
+  // Same as above on a JetCollection (countCSVS needs jets.btag to be filled)
+  bool jetPassCuts(const JetCollection& jets, unsigned int ij, const AnaConsts::AccRec& jetCutsArr);
+  int countJets(const JetCollection& jets, const AnaConsts::AccRec& jetCutsArr);
+  int countCSVS(const JetCollection& jets, const float cutCSVS, const AnaConsts::AccRec& jetCutsArr);
+  float calcHT(const JetCollection& jets, const AnaConsts::AccRec& jetCutsArr);
+  TLorentzVector calcMHT(const JetCollection& jets, const AnaConsts::AccRec& jetCutsArr);
+  std::vector<float> calcDPhi(const JetCollection& jets, const double metphi, const int nDPhi, const AnaConsts::AccRec& jetCutsArr);
+  // Kernels on packed pt/eta/phi arrays.  The cuts are evaluated without branches so the loops
+  // can be vectorised, define SAT_SCALAR_JET_KERNELS at build time for the short circuited form
+  // of jetPassCuts instead.  Both give the same decisions as the scalar functions on the same
+  // values (nan and the -1 "no cut" values included).  Output buffers belong to the caller
+  void jetPassMask(const JetCollection& jets, const AnaConsts::AccRec& jetCutsArr, std::vector<unsigned char>& mask);
+  struct JetSumCuts
+  {
+    std::vector<AnaConsts::AccRec> count;   // nJets for each of these cut sets
+    AnaConsts::AccRec ht;
+    bool doMHT;
+    AnaConsts::AccRec mht;
+    int nDPhi;                              // 0 skips the dPhis
+    AnaConsts::AccRec dPhi;
+  };
+  struct JetSums
+  {
+    std::vector<int> nJets;   // one count per cut set
+    float ht;                 // same as calcHT
+    double mhtPx, mhtPy;      // same as calcMHT on the collection, 0 without doMHT
+    std::vector<float> dPhi;  // same as calcDPhi on the collection
+  };
+  // nJets for several cut sets, HT, MHT and the leading dPhis to the MET in one pass over the jets
+  void calcJetSums(const JetCollection& jets, const JetSumCuts& cuts, const double metphi, JetSums& sums);
+  // Packed pt, eta and phi of leptons or tracks.  pt and eta are the float values passMuon,
+  // passElectron and passIsoTrk compute from the TLorentzVectors, so the counts below are
+  // the same as those of the TLorentzVector versions
+  struct LeptonCollection
+  {
+    std::vector<float> pt, eta, phi;
+    unsigned int size() const { return pt.size(); }
+    void fill(const std::vector<TLorentzVector>& leptons);
+  };
+  int countMuons(const LeptonCollection& muons, const std::vector<float> &muonsRelIso, const std::vector<float> &muonsMtw, const std::vector<int> &muonsFlagID, const AnaConsts::IsoAccRec& muonsArr);
+  int countElectrons(const LeptonCollection& electrons, const std::vector<float> &electronsRelIso, const std::vector<float> &electronsMtw, const std::vector<unsigned int>& isEBVec, const std::vector<int> &electronsFlagID, const AnaConsts::ElecIsoAccRec& elesArr);
+  struct IsoTrkCounts
+  {
+    int nIsoTrks, nIsoLepTrks, nIsoPionTrks;   // countIsoTrks, countIsoLepTrks, countIsoPionTrks
+  };
+  void countIsoTrks(const LeptonCollection& isoTrks, const std::vector<float> &isoTrksIso, const std::vector<float> &isoTrksMtw, const std::vector<int> &isoTrkspdgId, IsoTrkCounts& counts);
+  // jetLepdRMatch on the packed jets, dR is computed in float from the stored eta and phi, so
+  // jets within float rounding of each other or of jldRMax may be resolved differently
+  int jetLepdRMatch(const float lepEta, const float lepPhi, const JetCollection& jets, const float jldRMax);
   std::vector<float> calcDPhi(const std::vector<TLorentzVector> &inputJets, const double metphi, const int nDPhi, const AnaConsts::AccRec& jetCutsArr);
   float calcDeltaT(unsigned int pickedJetIdx, const std::vector<TLorentzVector> &inputJets, const AnaConsts::AccRec& jetCutsArr);
   std::vector<float> calcDPhiN(const std::vector<TLorentzVector> &inputJets, const TLorentzVector &metLVec, const int nDPhi, const AnaConsts::AccRec& jetCutsArr);
@@ -1,23 +1,35 @@
 #include "samples.h"
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace AnaSamples
 {
+    std::string FileSummary::getFileListPath() const
+    {
+        if(filePath.size() > 0) return filePath + "/" + fileName;
+        else                    return fileName;
+    }
+
     void FileSummary::readFileList() const
     {
         if(filelist_.size()) filelist_.clear();
-        
-        std::string filePathAndName;
-        if(filePath.size() > 0)
-        {
-            filePathAndName = filePath + "/" + fileName;
-        }
-        else
+
+        //the index already holds the file list
+        if(fileIndex_.size())
         {
-            filePathAndName = fileName;
+            for(const auto& entry : fileIndex_) filelist_.push_back(entry.file);
+            return;
         }
+        
+        std::string filePathAndName = getFileListPath();
 
         FILE *f = fopen(filePathAndName.c_str(), "r");
         char buff[1024];
@@ -33,6 +45,289 @@ namespace AnaSamples
         else std::cout << "Filelist file \"" << filePath << "\" not found!!!!!!!" << std::endl;
     }
 
+    bool FileSummary::fileIndexCurrent() const
+    {
+        if(fileIndex_.empty()) return false;
+        for(const auto& entry : fileIndex_)
+        {
+            if(!entry.isCurrent()) return false;
+        }
+        return true;
+    }
+
+    long long FileSummary::getNEntries() const
+    {
+        if(!fileIndexCurrent()) return -1;
+        long long nEntries = 0;
+        for(const auto& entry : fileIndex_) nEntries += entry.entries;
+        return nEntries;
+    }
+
+    std::vector<std::pair<int, int>> FileSummary::splitByEntries(long long entriesPerJob) const
+    {
+        std::vector<std::pair<int, int>> jobs;
+        if(filelist_.size() == 0) readFileList();
+        if(entriesPerJob <= 0 || !fileIndexCurrent())
+        {
+            for(int fn = 0; fn < filelist_.size(); ++fn) jobs.emplace_back(fn, 1);
+            return jobs;
+        }
+
+        int startfile = 0;
+        long long entries = 0;
+        for(int fn = 0; fn < fileIndex_.size(); ++fn)
+        {
+            entries += fileIndex_[fn].entries;
+            if(entries >= entriesPerJob || fn + 1 == fileIndex_.size())
+            {
+                jobs.emplace_back(startfile, fn + 1 - startfile);
+                startfile = fn + 1;
+                entries = 0;
+            }
+        }
+        return jobs;
+    }
+
+    std::vector<WorkUnit> FileSummary::splitByEvents(long long eventsPerJob) const
+    {
+        std::vector<WorkUnit> units;
+        if(filelist_.size() == 0) readFileList();
+        if(eventsPerJob <= 0 || !fileIndexCurrent())
+        {
+            for(int fn = 0; fn < filelist_.size(); ++fn) units.emplace_back(fn, 1);
+            return units;
+        }
+
+        //sample wide entry of the start of each file, the possible cut points are the cluster starts
+        //and the file ends, files without clusters are recorded to be cut anywhere
+        std::vector<long long> offsets(1, 0), cuts;
+        std::vector<bool> anyCut;
+        for(const auto& entry : fileIndex_)
+        {
+            const long long offset = offsets.back();
+            for(const auto& cluster : entry.clusters)
+            {
+                if(cluster > 0 && cluster < entry.entries) cuts.push_back(offset + cluster);
+            }
+            if(entry.entries > 0) cuts.push_back(offset + entry.entries);
+            anyCut.push_back(entry.clusters.empty());
+            offsets.push_back(offset + entry.entries);
+        }
+        std::sort(cuts.begin(), cuts.end());
+
+        //file holding the sample wide entry
+        auto fileOf = [&offsets](long long entry) { return int(std::upper_bound(offsets.begin(), offsets.end(), entry) - offsets.begin()) - 1; };
+
+        const long long nEntries = offsets.back();
+        long long start = 0;
+        while(start < nEntries)
+        {
+            const long long target = start + eventsPerJob;
+            long long end;
+            //a short tail is joined to the last unit
+            if(target + eventsPerJob/2 >= nEntries) end = nEntries;
+            else if(anyCut[fileOf(target)])         end = target;
+            else
+            {
+                //closest cut point after start, there is always one at nEntries
+                auto iter = std::lower_bound(cuts.begin(), cuts.end(), target);
+                end = *iter;
+                if(iter != cuts.begin() && *(iter - 1) > start && target - *(iter - 1) < end - target) end = *(iter - 1);
+            }
+
+            const int startfile = fileOf(start);
+            units.emplace_back(startfile, fileOf(end - 1) + 1 - startfile, start - offsets[startfile], end - offsets[startfile]);
+            start = end;
+        }
+        return units;
+    }
+
+    //modification time of a local file, 0 if it can not be determined
+    static long long fileMTime(const std::string& file)
+    {
+        struct stat st;
+        if(stat(file.c_str(), &st) != 0) return 0;
+        return st.st_mtime;
+    }
+
+    //size and modification time of a regular file, both 0 if it is not one
+    static void fileStamp(const std::string& file, long long& size, long long& mtime)
+    {
+        struct stat st;
+        if(stat(file.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) size = mtime = 0;
+        else
+        {
+            size = st.st_size;
+            mtime = st.st_mtime;
+        }
+    }
+
+    bool FileIndexEntry::stamp()
+    {
+        long long fsize, fmtime;
+        fileStamp(file, fsize, fmtime);
+        if(fsize == 0 && fmtime == 0) return false;
+        size = fsize;
+        mtime = fmtime;
+        return true;
+    }
+
+    bool FileIndexEntry::isCurrent() const
+    {
+        long long fsize, fmtime;
+        fileStamp(file, fsize, fmtime);
+        return (fsize == 0 && fmtime == 0) || (fsize == size && fmtime == mtime);
+    }
+
+    //name of the cache or index belonging to a cfg, sampleSets.cfg -> sampleSets<ext>
+    static std::string cfgSibling(const std::string& cfg, const std::string& ext)
+    {
+        std::string name = cfg;
+        if(name.size() > 4 && name.compare(name.size() - 4, 4, ".cfg") == 0) name.erase(name.size() - 4);
+        return name + ext;
+    }
+
+    //Caches are only used when SAT_SAMPLE_CACHE names a directory to keep them in. The file name
+    //carries a hash of the full cfg path, so cfgs of the same name do not share a cache
+    static std::string cacheLocation(const std::string& cfg)
+    {
+        const char* dir = getenv("SAT_SAMPLE_CACHE");
+        if(!dir || !*dir) return "";
+        char* real = realpath(cfg.c_str(), nullptr);
+        const std::string path = real ? real : cfg;
+        free(real);
+        const size_t slash = path.rfind('/');
+        const std::string base = cfgSibling((slash == std::string::npos) ? path : path.substr(slash + 1), "");
+        return std::string(dir) + "/" + base + "_" + std::to_string(std::hash<std::string>()(path)) + ".cache";
+    }
+
+    // Binary caches start with the magic number, the format version and sizeof(long long) of the writer,
+    // any mismatch makes the cache stale.  Strings and vectors are a length followed by their contents
+    static const unsigned int CACHE_MAGIC = 0x53414331;
+    static const unsigned int CACHE_VERSION = 1;
+
+    class CacheWriter
+    {
+    public:
+        CacheWriter() { put(CACHE_MAGIC); put(CACHE_VERSION); put((unsigned int)sizeof(long long)); }
+
+        template<typename T> void put(const T& t)
+        {
+            const char* p = reinterpret_cast<const char*>(&t);
+            buf_.insert(buf_.end(), p, p + sizeof(T));
+        }
+        void put(const std::string& str)
+        {
+            put((unsigned long long)str.size());
+            buf_.insert(buf_.end(), str.begin(), str.end());
+        }
+        template<typename T> void put(const std::vector<T>& vec)
+        {
+            put((unsigned long long)vec.size());
+            for(const auto& t : vec) put(t);
+        }
+
+        //written to a temporary file which is renamed, so concurrent jobs never see a partial cache
+        bool write(const std::string& file) const
+        {
+            const std::string tmp = file + ".tmp" + std::to_string(getpid());
+            FILE* f = fopen(tmp.c_str(), "wb");
+            if(!f) return false;
+            const bool ok = fwrite(buf_.data(), 1, buf_.size(), f) == buf_.size();
+            if(fclose(f) != 0 || !ok || rename(tmp.c_str(), file.c_str()) != 0)
+            {
+                remove(tmp.c_str());
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        std::vector<char> buf_;
+    };
+
+    class CacheReader
+    {
+    public:
+        CacheReader(const std::string& file) : pos_(0), ok_(false)
+        {
+            FILE* f = fopen(file.c_str(), "rb");
+            if(!f) return;
+            if(fseek(f, 0, SEEK_END) == 0)
+            {
+                long size = ftell(f);
+                if(size > 0 && fseek(f, 0, SEEK_SET) == 0)
+                {
+                    buf_.resize(size);
+                    ok_ = fread(buf_.data(), 1, size, f) == (size_t)size;
+                }
+            }
+            fclose(f);
+            ok_ = ok_ && get<unsigned int>() == CACHE_MAGIC && get<unsigned int>() == CACHE_VERSION && get<unsigned int>() == sizeof(long long);
+        }
+
+        bool good() const { return ok_; }
+        bool atEnd() const { return pos_ == buf_.size(); }
+
+        template<typename T> T get()
+        {
+            T t = T();
+            get(t);
+            return t;
+        }
+        template<typename T> void get(T& t)
+        {
+            if(!ok_ || buf_.size() - pos_ < sizeof(T))
+            {
+                ok_ = false;
+                return;
+            }
+            memcpy(&t, &buf_[pos_], sizeof(T));
+            pos_ += sizeof(T);
+        }
+        void get(std::string& str)
+        {
+            const unsigned long long n = get<unsigned long long>();
+            if(!ok_ || buf_.size() - pos_ < n)
+            {
+                ok_ = false;
+                return;
+            }
+            str.assign(&buf_[pos_], n);
+            pos_ += n;
+        }
+        template<typename T> void get(std::vector<T>& vec)
+        {
+            const unsigned long long n = getCount(minSize(static_cast<T*>(nullptr)));
+            if(!ok_) return;
+            vec.resize(n);
+            for(auto& t : vec) get(t);
+        }
+
+        //Element count of an array whose elements take at least minBytes each in the file, a count
+        //the rest of the file can not hold marks the cache as bad before anything is allocated
+        unsigned long long getCount(size_t minBytes)
+        {
+            const unsigned long long n = get<unsigned long long>();
+            if(!ok_ || n > (buf_.size() - pos_)/minBytes)
+            {
+                ok_ = false;
+                return 0;
+            }
+            return n;
+        }
+
+        //bytes an element takes at least, strings and vectors start with their length
+        template<typename T> static size_t minSize(const T*) { return sizeof(T); }
+        static size_t minSize(const std::string*) { return sizeof(unsigned long long); }
+        template<typename T> static size_t minSize(const std::vector<T>*) { return sizeof(unsigned long long); }
+
+    private:
+        std::vector<char> buf_;
+        size_t pos_;
+        bool ok_;
+    };
+
     void FileSummary::addCollection(const std::string& colName)
     {
         collections_.insert(colName);
@@ -66,9 +361,235 @@ namespace AnaSamples
         return false;            
     }
     
-    SampleSet::SampleSet(std::string file, bool isCondor, double lumi) : isCondor_(isCondor), lumi_(lumi)
+    SampleSet::SampleSet(std::string file, bool isCondor, double lumi) : isCondor_(isCondor), lumi_(lumi), cfgFile_(file)
     {
+        //the index of sampleSets.cfg is sampleSets.idx
+        indexFile_ = cfgSibling(file, ".idx");
+        cacheFile_ = cacheLocation(file);
+        if(!cacheFile_.empty() && readCache(cacheFile_)) return;
+
         readCfg(file);
+        readFileIndex(indexFile_);
+
+        //file lists not given by the index are read when a sample is used
+        if(!cacheFile_.empty()) writeCache(cacheFile_);
+    }
+
+    void SampleSet::setFileIndex(const std::string& tag, const std::vector<FileIndexEntry>& index)
+    {
+        auto iter = sampleSet_.find(tag);
+        if(iter == sampleSet_.end()) return;
+        iter->second.fileIndex_ = index;
+        iter->second.fileListMTime_ = fileMTime(iter->second.getFileListPath());
+        iter->second.readFileList();
+    }
+
+    // Index format, one sample header followed by one line per file
+    //   S <tag> <file list mtime> <number of files>
+    //   F <entries> <size> <mtime> <number of clusters> <cluster starts ...> <tree path> <file>
+    bool SampleSet::readFileIndex(const std::string& file)
+    {
+        std::ifstream fin(file.c_str());
+        if(!fin.is_open()) return false;
+
+        std::string line;
+        FileSummary* fs = nullptr;
+        std::vector<FileIndexEntry> index;
+        long long listMTime = 0;
+        unsigned int nFiles = 0;
+
+        auto finishSample = [&]()
+        {
+            if(!fs) return;
+            long long currentMTime = fileMTime(fs->getFileListPath());
+            if(index.size() != nFiles)
+            {
+                std::cout << "File index for " << fs->tag << " is truncated, it will be ignored" << std::endl;
+            }
+            else if(listMTime != 0 && currentMTime != 0 && listMTime != currentMTime)
+            {
+                std::cout << "File list of " << fs->tag << " changed since the file index was written, the index will be ignored" << std::endl;
+            }
+            else
+            {
+                fs->fileIndex_.swap(index);
+                fs->fileListMTime_ = listMTime;
+                fs->readFileList();
+            }
+            fs = nullptr;
+        };
+
+        while(std::getline(fin, line))
+        {
+            if(line.empty() || line[0] == '#') continue;
+            std::istringstream iss(line);
+            std::string type;
+            iss >> type;
+            if(type == "S")
+            {
+                finishSample();
+                std::string tag;
+                iss >> tag >> listMTime >> nFiles;
+                index.clear();
+                auto iter = sampleSet_.find(tag);
+                if(iter != sampleSet_.end()) fs = &iter->second;
+            }
+            else if(type == "F" && fs)
+            {
+                FileIndexEntry entry;
+                unsigned int nClusters = 0;
+                iss >> entry.entries >> entry.size >> entry.mtime >> nClusters;
+                entry.clusters.resize(nClusters);
+                for(auto& cluster : entry.clusters) iss >> cluster;
+                iss >> entry.treePath;
+                std::getline(iss >> std::ws, entry.file);
+                if(iss.fail() || entry.file.empty())
+                {
+                    std::cout << "Malformed line: " << file << ": " << line << std::endl;
+                    continue;
+                }
+                index.push_back(entry);
+            }
+        }
+        finishSample();
+
+        return true;
+    }
+
+    bool SampleSet::writeFileIndex(const std::string& file) const
+    {
+        std::ofstream fout(file.c_str());
+        if(!fout.is_open()) return false;
+
+        fout << "# S <tag> <file list mtime> <number of files>" << std::endl;
+        fout << "# F <entries> <size> <mtime> <number of clusters> <cluster starts ...> <tree path> <file>" << std::endl;
+        for(const auto& sample : sampleSet_)
+        {
+            const FileSummary& fs = sample.second;
+            if(fs.fileIndex_.empty()) continue;
+            fout << "S " << fs.tag << " " << fs.fileListMTime_ << " " << fs.fileIndex_.size() << "\n";
+            for(const auto& entry : fs.fileIndex_)
+            {
+                fout << "F " << entry.entries << " " << entry.size << " " << entry.mtime << " " << entry.clusters.size();
+                for(const auto& cluster : entry.clusters) fout << " " << cluster;
+                fout << " " << entry.treePath << " " << entry.file << "\n";
+            }
+        }
+        return fout.good();
+    }
+
+    // Cache layout after the header
+    //   <cfg size> <cfg mtime> <index size> <index mtime> <isCondor> <lumi> <number of samples>
+    //   per sample: tag, paths, xsec, lumi, kfactor, nEvts, color, isData, weight, file list size and mtime,
+    //   file list, index list mtime and the file index entries
+    bool SampleSet::readCache(const std::string& file)
+    {
+        long long cfgSize, cfgMTime, idxSize, idxMTime;
+        fileStamp(cfgFile_, cfgSize, cfgMTime);
+        fileStamp(indexFile_, idxSize, idxMTime);
+        if(cfgMTime == 0) return false;
+
+        CacheReader in(file);
+        if(!in.good()) return false;
+        if(in.get<long long>() != cfgSize || in.get<long long>() != cfgMTime || in.get<long long>() != idxSize || in.get<long long>() != idxMTime) return false;
+        if(in.get<bool>() != isCondor_ || in.get<double>() != lumi_) return false;
+
+        std::map<std::string, FileSummary> samples;
+        //every sample takes at least its tag length
+        const unsigned long long nSamples = in.getCount(sizeof(unsigned long long));
+        for(unsigned long long i = 0; i < nSamples && in.good(); ++i)
+        {
+            std::string tag;
+            in.get(tag);
+            FileSummary& fs = samples[tag];
+            fs.tag = tag;
+            in.get(fs.filePath);
+            in.get(fs.fileName);
+            in.get(fs.treePath);
+            in.get(fs.xsec);
+            in.get(fs.lumi);
+            in.get(fs.kfactor);
+            in.get(fs.nEvts);
+            in.get(fs.color);
+            in.get(fs.isData_);
+            in.get(fs.weight_);
+
+            long long listSize, listMTime;
+            fileStamp(fs.getFileListPath(), listSize, listMTime);
+            if(in.get<long long>() != listSize || in.get<long long>() != listMTime) return false;
+            in.get(fs.filelist_);
+            in.get(fs.fileListMTime_);
+
+            //two strings, three numbers and the cluster vector per file
+            const unsigned long long nFiles = in.getCount(3*sizeof(unsigned long long) + 3*sizeof(long long));
+            if(!in.good()) return false;
+            fs.fileIndex_.resize(nFiles);
+            for(auto& entry : fs.fileIndex_)
+            {
+                in.get(entry.file);
+                in.get(entry.treePath);
+                in.get(entry.entries);
+                in.get(entry.size);
+                in.get(entry.mtime);
+                in.get(entry.clusters);
+                if(!in.good()) return false;
+            }
+        }
+        if(!in.good() || !in.atEnd()) return false;
+
+        sampleSet_.swap(samples);
+        return true;
+    }
+
+    bool SampleSet::writeCache(const std::string& file) const
+    {
+        long long cfgSize, cfgMTime, idxSize, idxMTime;
+        fileStamp(cfgFile_, cfgSize, cfgMTime);
+        fileStamp(indexFile_, idxSize, idxMTime);
+        if(cfgMTime == 0) return false;
+
+        CacheWriter out;
+        out.put(cfgSize);
+        out.put(cfgMTime);
+        out.put(idxSize);
+        out.put(idxMTime);
+        out.put(isCondor_);
+        out.put(lumi_);
+        out.put((unsigned long long)sampleSet_.size());
+        for(const auto& sample : sampleSet_)
+        {
+            const FileSummary& fs = sample.second;
+            out.put(sample.first);
+            out.put(fs.filePath);
+            out.put(fs.fileName);
+            out.put(fs.treePath);
+            out.put(fs.xsec);
+            out.put(fs.lumi);
+            out.put(fs.kfactor);
+            out.put(fs.nEvts);
+            out.put(fs.color);
+            out.put(fs.isData_);
+            out.put(fs.weight_);
+
+            long long listSize, listMTime;
+            fileStamp(fs.getFileListPath(), listSize, listMTime);
+            out.put(listSize);
+            out.put(listMTime);
+            out.put(fs.filelist_);
+            out.put(fs.fileListMTime_);
+
+            out.put((unsigned long long)fs.fileIndex_.size());
+            for(const auto& entry : fs.fileIndex_)
+            {
+                out.put(entry.file);
+                out.put(entry.treePath);
+                out.put(entry.entries);
+                out.put(entry.size);
+                out.put(entry.mtime);
+                out.put(entry.clusters);
+            }
+        }
+        return out.write(file);
     }
 
     bool SampleCollection::parseCfgLine(const char* buf)
@@ -97,16 +618,69 @@ namespace AnaSamples
 
         if(sampleSetNames.size())
         {
-            addSampleSet(ss_, collectionName, sampleSetNames);
+            cfgEntries_.emplace_back(collectionName, sampleSetNames);
             return true;
         }
         
         return false;
     }
 
-    SampleCollection::SampleCollection(const std::string& file, SampleSet& samples) : ss_(samples)
+    SampleCollection::SampleCollection(const std::string& file, SampleSet& samples) : ss_(samples), cfgFile_(file)
     {
-        readCfg(file);
+        cacheFile_ = cacheLocation(file);
+        if(cacheFile_.empty() || !readCache(cacheFile_))
+        {
+            cfgEntries_.clear();
+            readCfg(file);
+            if(!cacheFile_.empty()) writeCache(cacheFile_);
+        }
+
+        for(const auto& entry : cfgEntries_) addSampleSet(ss_, entry.first, entry.second);
+    }
+
+    // Cache layout after the header
+    //   <cfg size> <cfg mtime> <number of collections>, then per collection its name and sample sets
+    bool SampleCollection::readCache(const std::string& file)
+    {
+        long long cfgSize, cfgMTime;
+        fileStamp(cfgFile_, cfgSize, cfgMTime);
+        if(cfgMTime == 0) return false;
+
+        CacheReader in(file);
+        if(!in.good()) return false;
+        if(in.get<long long>() != cfgSize || in.get<long long>() != cfgMTime) return false;
+
+        //every entry takes at least the lengths of its name and of its vector
+        std::vector<std::pair<std::string, std::vector<std::string>>> entries(in.getCount(2*sizeof(unsigned long long)));
+        if(!in.good()) return false;
+        for(auto& entry : entries)
+        {
+            in.get(entry.first);
+            in.get(entry.second);
+            if(!in.good()) return false;
+        }
+        if(!in.good() || !in.atEnd()) return false;
+
+        cfgEntries_.swap(entries);
+        return true;
+    }
+
+    bool SampleCollection::writeCache(const std::string& file) const
+    {
+        long long cfgSize, cfgMTime;
+        fileStamp(cfgFile_, cfgSize, cfgMTime);
+        if(cfgMTime == 0) return false;
+
+        CacheWriter out;
+        out.put(cfgSize);
+        out.put(cfgMTime);
+        out.put((unsigned long long)cfgEntries_.size());
+        for(const auto& entry : cfgEntries_)
+        {
+            out.put(entry.first);
+            out.put(entry.second);
+        }
+        return out.write(file);
     }
 
     void SampleCollection::addSampleSet(SampleSet& samples, const std::string& name, const std::vector<std::string>& vss)
@@ -5,6 +5,7 @@
 #include <map>
 #include <vector>
 #include <set>
+#include <utility>
 
 #include <cstring>
 #include <algorithm>
@@ -13,6 +14,32 @@ namespace AnaSamples
 {
   enum COLORS{kRed = 632, kGreen = 416, kBlack = 1, kMagenta = 616, kBlue = 600, kYellow = 400, kTeal = 840, kPink = 900, kOrange = 800, kSpring = 820, kWhite = 0, kGray = 0, kCyan = 432, kAzure = 860, kViolet = 880};
 
+  //Entries and layout of one file of a sample as stored in the file index (see SampleSet::writeFileIndex)
+  struct FileIndexEntry
+  {
+    std::string file, treePath;
+    long long entries, size, mtime;
+    //first entry of every cluster of the tree
+    std::vector<long long> clusters;
+
+    FileIndexEntry() : entries(0), size(0), mtime(0) {}
+
+    //Set size and mtime from the file system, false for a file that is not local
+    bool stamp();
+    //False if the local file changed since it was indexed, remote files can not be checked
+    bool isCurrent() const;
+  };
+
+  //One job of a sample (see FileSummary::splitByEvents): entries [firstEntry, lastEntry) of the chain
+  //made of the files [startfile, startfile + filerun), lastEntry < 0 means until the end of the chain
+  struct WorkUnit
+  {
+    int startfile, filerun;
+    long long firstEntry, lastEntry;
+
+    WorkUnit(int startfile = 0, int filerun = 1, long long firstEntry = 0, long long lastEntry = -1) : startfile(startfile), filerun(filerun), firstEntry(firstEntry), lastEntry(lastEntry) {}
+  };
+
   class FileSummary
   {
    public:
@@ -22,8 +49,8 @@ namespace AnaSamples
     int color;
     bool isData_;
         
-    FileSummary() {}
-    FileSummary(const std::string& tag, const std::string& filePath, const std::string& fileName, const std::string& treePath, double xsec, double lumi, double nEvts, double kfactor, int color = kBlack) : tag(tag), filePath(filePath), fileName(fileName), treePath(treePath), xsec(xsec), lumi(lumi), kfactor(kfactor), nEvts(nEvts), color(color), isData_(false)
+    FileSummary() : fileListMTime_(0) {}
+    FileSummary(const std::string& tag, const std::string& filePath, const std::string& fileName, const std::string& treePath, double xsec, double lumi, double nEvts, double kfactor, int color = kBlack) : tag(tag), filePath(filePath), fileName(fileName), treePath(treePath), xsec(xsec), lumi(lumi), kfactor(kfactor), nEvts(nEvts), color(color), isData_(false), fileListMTime_(0)
     {
       weight_ = xsec * lumi * kfactor / nEvts;
     }
@@ -31,22 +58,49 @@ namespace AnaSamples
     //Constructor which doesn't make a xsec*lumi weighted sample, e.g. for use with data.
     //Initialize xsec, lumi, nEvts to 1 so that the comparison operators still work
     //Need a record of the actual data lumi!
-    FileSummary(const std::string& tag, const std::string& filePath, const std::string& fileName, const std::string& treePath, double lumi, double kfactor, int color = kBlack) : tag(tag), filePath(filePath), fileName(fileName), treePath(treePath), xsec(1), lumi(lumi), kfactor(kfactor), nEvts(1), color(color), isData_(true)
+    FileSummary(const std::string& tag, const std::string& filePath, const std::string& fileName, const std::string& treePath, double lumi, double kfactor, int color = kBlack) : tag(tag), filePath(filePath), fileName(fileName), treePath(treePath), xsec(1), lumi(lumi), kfactor(kfactor), nEvts(1), color(color), isData_(true), fileListMTime_(0)
     {
       weight_ = kfactor;
     }
 
     double getWeight() const {return weight_;}
     const std::vector<std::string>& getFilelist() const {return filelist_;}
+    //With a file index the entry count of each file is handed to the chain, so files are not opened here.
+    //Files whose index entry is stale or has no entries are added plainly and counted by ROOT
     template<class T> void addFilesToChain(T* chain,  int startfile =0, int filerun= -1) const
     {
       if(filelist_.size() == 0) readFileList();
       if(filerun<0)filerun=filelist_.size();
       for(int fn = startfile; fn < startfile+filerun && fn<filelist_.size(); fn++)
       {
-        chain->Add(filelist_[fn].c_str());
+        if(fn < fileIndex_.size() && fileIndex_[fn].entries > 0 && fileIndex_[fn].isCurrent()) chain->Add(filelist_[fn].c_str(), fileIndex_[fn].entries);
+        else chain->Add(filelist_[fn].c_str());
       }
     }
+    //Files of a work unit, the entry range is then set with NTupleReader::setWorkUnit(unit)
+    template<class T> void addFilesToChain(T* chain, const WorkUnit& unit) const
+    {
+      addFilesToChain(chain, unit.startfile, unit.filerun);
+    }
+
+    //File index of the sample, empty unless it was loaded with SampleSet::readFileIndex
+    const std::vector<FileIndexEntry>& getFileIndex() const {return fileIndex_;}
+    bool hasFileIndex() const {return !fileIndex_.empty();}
+    //True if there is a file index and none of its files changed since it was made
+    bool fileIndexCurrent() const;
+    //Total entries from the file index, -1 without a current one
+    long long getNEntries() const;
+    //Groups of consecutive files (startfile, filerun) holding about entriesPerJob entries each,
+    //one file per group without a current file index
+    std::vector<std::pair<int, int>> splitByEntries(long long entriesPerJob) const;
+    //Work units of about eventsPerJob entries each, which may span several files or cut a file.
+    //Units start and stop at cluster boundaries, so no basket is read by two jobs; the boundary
+    //closest to the target is taken, files indexed without clusters are cut at any entry and a tail
+    //shorter than half a job is added to the last unit.
+    //Without a current file index there is one unit per file covering the whole file
+    std::vector<WorkUnit> splitByEvents(long long eventsPerJob) const;
+    //Path of the file list text file
+    std::string getFileListPath() const;
     mutable std::vector<std::string> filelist_;
     void addCollection(const std::string&);
     const std::set<std::string>& getCollections() const
@@ -58,6 +112,11 @@ namespace AnaSamples
    private:
     double weight_;
     std::set<std::string> collections_;
+    std::vector<FileIndexEntry> fileIndex_;
+    //modification time of the file list the index was made from
+    long long fileListMTime_;
+
+    friend class SampleSet;
   };
 
   bool operator< (const FileSummary& lhs, const FileSummary& rhs);
@@ -160,10 +219,30 @@ namespace AnaSamples
         sampleSet_[tag] = FileSummary(tag, filePath, fileName, treePath, lumi, kfactor, color);
     }
 
+    //The file index lists the files of each sample with their entries, size, mtime and clusters.
+    //It lives next to the cfg (sampleSets.cfg -> sampleSets.idx) and is read by the constructor
+    //when present, samples whose file list changed since it was written ignore it.
+    //It is filled once with "nEvts -i", which is the only step opening the files.
+    bool readFileIndex(const std::string& file);
+    bool writeFileIndex(const std::string& file) const;
+    void setFileIndex(const std::string& tag, const std::vector<FileIndexEntry>& index);
+    const std::string& getFileIndexName() const {return indexFile_;}
+
+    //Binary cache of the parsed cfg, the file index and the file lists it holds, only used when the
+    //environment variable SAT_SAMPLE_CACHE names a directory for the caches (getCacheName() is empty
+    //otherwise).  The constructor loads it in place of the text files while the cfg, the index and every
+    //file list keep the size and mtime recorded in it, otherwise it parses them and rewrites the cache.
+    //A cache which can not be written is silently skipped
+    bool readCache(const std::string& file);
+    bool writeCache(const std::string& file) const;
+    const std::string& getCacheName() const {return cacheFile_;}
+
    private:
     std::string fDir_;
     bool isCondor_;
     double lumi_;
+    std::string indexFile_;
+    std::string cfgFile_, cacheFile_;
 
     std::map<std::string, FileSummary>& getMap();
     
@@ -179,10 +258,20 @@ namespace AnaSamples
     {
       return totalLumiMap_[name];
     }
+
+    //Binary cache of the parsed cfg in SAT_SAMPLE_CACHE, used like the SampleSet cache while the cfg
+    //keeps its size and mtime
+    bool readCache(const std::string& file);
+    bool writeCache(const std::string& file) const;
+    const std::string& getCacheName() const {return cacheFile_;}
+
    private:
     std::map<std::string, double> totalLumiMap_;
     std::map<std::string, std::vector<std::string>> nameVec_;
     SampleSet& ss_;
+    std::string cfgFile_, cacheFile_;
+    //collection name and sample sets of every cfg line, in cfg order
+    std::vector<std::pair<std::string, std::vector<std::string>>> cfgEntries_;
     void addSampleSet(SampleSet& samples, const std::string& name, const std::vector<std::string>& vss);
     bool parseCfgLine(const char* buf);
   };
@@ -2,57 +2,100 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
+#include <memory>
+
+//The sample set and collection of one SC_new, with the buffers behind the arrays handed to python.
+//An array stays valid until the next call returning one on the same handle, python copies it at once
+struct SCHandle
+{
+    std::unique_ptr<AnaSamples::SampleSet> ss;
+    std::unique_ptr<AnaSamples::SampleCollection> sc;
+    std::vector<std::string> strings;
+    std::vector<const char*> cstrings;
+    std::vector<double> doubles;
+    std::vector<long long> units;
+
+    const char** setStrings()
+    {
+        cstrings.clear();
+        for(const auto& s : strings) cstrings.push_back(s.c_str());
+        return cstrings.data();
+    }
+};
+
 extern "C" {
     double SC_fixed_lumi(){ return AnaSamples::luminosity; }
-    AnaSamples::SampleCollection* SC_new(char *ssfile, char* scfile)
+    //the sample set and collection come from their binary caches when SAT_SAMPLE_CACHE is set and these are up to date
+    SCHandle* SC_new(char *ssfile, char* scfile)
     {
-        AnaSamples::SampleSet *ss = new AnaSamples::SampleSet(ssfile);
-        return new AnaSamples::SampleCollection(scfile, *ss); 
+        SCHandle* h = new SCHandle;
+        h->ss.reset(new AnaSamples::SampleSet(ssfile));
+        h->sc.reset(new AnaSamples::SampleCollection(scfile, *h->ss));
+        return h;
     }
-    int SC_samples_size(AnaSamples::SampleCollection* sc, char *scn){ return (*sc)[std::string(scn)].size(); }
-    char const ** SC_samples(AnaSamples::SampleCollection* sc, char *scn)
+    void SC_delete(SCHandle* h){ delete h; }
+    int SC_samples_size(SCHandle* h, char *scn){ return (*h->sc)[std::string(scn)].size(); }
+    char const ** SC_samples(SCHandle* h, char *scn)
     {
-        auto& sampleVec = (*sc)[std::string(scn)];
-        const char **array = new const char*[sampleVec.size()];
-        int i = 0;
-        for(auto& sample : sampleVec)
-        {
-            std::string* s = new std::string (sample.filePath + "/" + sample.fileName);
-            array[i++] = s->c_str();
-        }
-        return array;
+        h->strings.clear();
+        for(auto& sample : (*h->sc)[std::string(scn)]) h->strings.push_back(sample.filePath + "/" + sample.fileName);
+        return h->setStrings();
     }
-    char const ** SC_samples_names(AnaSamples::SampleCollection* sc, char *scn)
+    char const ** SC_samples_names(SCHandle* h, char *scn)
     {
-        auto& sampleVec = sc->getSampleLabels(std::string(scn));
-        const char **array = new const char*[sampleVec.size()];
-        int i = 0;
-        for(auto& sample : sampleVec)
-        {
-            array[i++] = sample.c_str();
-        }
-        return array;
+        h->strings = h->sc->getSampleLabels(std::string(scn));
+        return h->setStrings();
+    }
+    double const * SC_samples_weights(SCHandle* h, char *scn)
+    {
+        h->doubles.clear();
+        for(auto& sample : (*h->sc)[std::string(scn)]) h->doubles.push_back(sample.getWeight());
+        return h->doubles.data();
     }
-    int SC_samplecollection_size(AnaSamples::SampleCollection* sc, char *scn){ return sc->size(); }
-    char const ** SC_samplecollection_names(AnaSamples::SampleCollection* sc)
+    //File list of sample iSample of SC_samples, nFiles is set to its length
+    char const ** SC_sample_files(SCHandle* h, char *scn, int iSample, int *nFiles)
     {
-        const char **array = new const char*[sc->size()];
-        int i = 0;
-        for(auto& sample : *sc)
+        h->strings.clear();
+        auto& sampleVec = (*h->sc)[std::string(scn)];
+        if(iSample >= 0 && iSample < int(sampleVec.size()))
         {
-            array[i++] = sample.first.c_str();
+            const auto& fs = sampleVec[iSample];
+            if(fs.getFilelist().empty()) fs.readFileList();
+            h->strings = fs.getFilelist();
         }
-        return array;
+        *nFiles = h->strings.size();
+        return h->setStrings();
+    }
+    int SC_samplecollection_size(SCHandle* h){ return h->sc->size(); }
+    char const ** SC_samplecollection_names(SCHandle* h)
+    {
+        h->strings.clear();
+        for(auto& sample : *h->sc) h->strings.push_back(sample.first);
+        return h->setStrings();
+    }
+    double const * SC_samplecollection_lumis(SCHandle* h)
+    {
+        h->doubles.clear();
+        for(auto& sample : *h->sc) h->doubles.push_back(h->sc->getSampleLumi(sample.first));
+        return h->doubles.data();
     }
-    double const * SC_samplecollection_lumis(AnaSamples::SampleCollection* sc)
+    //Work units of every sample of a collection given as 5 numbers per unit: index of the sample in
+    //SC_samples, startfile, filerun, firstEntry and lastEntry.  nUnits is set to the number of units
+    long long const * SC_work_units(SCHandle* h, char *scn, long long eventsPerJob, int *nUnits)
     {
-        double *array = new double[sc->size()];
-        int i = 0;
-        for(auto& sample : *sc)
+        h->units.clear();
+        long long iSample = 0;
+        for(auto& sample : (*h->sc)[std::string(scn)])
         {
-            array[i++] = sc->getSampleLumi(sample.first);
+            for(const auto& unit : sample.splitByEvents(eventsPerJob))
+            {
+                h->units.insert(h->units.end(), {iSample, unit.startfile, unit.filerun, unit.firstEntry, unit.lastEntry});
+            }
+            ++iSample;
         }
-        return array;
+        *nUnits = h->units.size()/5;
+        return h->units.data();
     }
 
 }
@@ -1,6 +1,8 @@
 #include "searchBins.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include "TLine.h"
 #include "TLatex.h"
 
@@ -31,7 +33,7 @@ bool SearchBins::searchBinDef::compare(const int ibJet, const int iTop, const fl
 }
 
 SearchBins::SearchBins(std::string binEra) :
-  binEra_(binEra)
+  binEra_(binEra), indexed_(false)
 {
     std::cout<<"\nbinEra_ : "<<binEra_.c_str()<<std::endl<<std::endl;
     NSearchRegions_ = 0;
@@ -70,6 +72,108 @@ SearchBins::SearchBins(std::string binEra) :
         std::cout << "Bin era \"" << binEra_ << "\" does not exist" << std::endl;
         std::cout << "!!!!!!!!!!!!!!!!!!!!BINS NOT ADDED!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
     }
+
+    buildIndex();
+}
+
+void SearchBins::buildIndex()
+{
+    indexed_ = false;
+    cellStart_.clear();
+    cellBins_.clear();
+
+    //collect the edges used in each variable, -1 means no boundary
+    for(auto& edges : indexEdges_) edges.clear();
+    for(const auto& bin : searchBins_)
+    {
+        const float edges[nIndexVars_][2] = {{(float)bin.bJet_lo_, (float)bin.bJet_hi_}, {(float)bin.top_lo_, (float)bin.top_hi_}, {bin.MT2_lo_, bin.MT2_hi_}, {bin.met_lo_, bin.met_hi_}, {bin.HT_lo_, bin.HT_hi_}};
+        for(int iVar = 0; iVar < nIndexVars_; ++iVar)
+        {
+            for(const float edge : edges[iVar]) if(edge >= 0) indexEdges_[iVar].push_back(edge);
+        }
+    }
+
+    long long nCells = 1;
+    for(auto& edges : indexEdges_)
+    {
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+        nCells *= edges.size() + 1;
+    }
+
+    //keep the linear scan for pathological binnings
+    if(nCells > 1000000) return;
+
+    //cell k of a variable is [edge[k-1], edge[k]), take its lower edge (or anything below the first edge) as representative
+    std::vector<float> reps[nIndexVars_];
+    for(int iVar = 0; iVar < nIndexVars_; ++iVar)
+    {
+        const std::vector<float>& edges = indexEdges_[iVar];
+        reps[iVar].push_back(edges.empty() ? 0 : edges.front() - 1);
+        for(const float edge : edges) reps[iVar].push_back(edge);
+    }
+
+    cellStart_.reserve(nCells + 1);
+    for(const float ht : reps[4])
+    {
+        for(const float met : reps[3])
+        {
+            for(const float MT2 : reps[2])
+            {
+                for(const float top : reps[1])
+                {
+                    for(const float bJet : reps[0])
+                    {
+                        cellStart_.push_back(cellBins_.size());
+                        for(int iBin = 0; iBin < searchBins_.size(); ++iBin)
+                        {
+                            if(searchBins_[iBin].compare((int)bJet, (int)top, MT2, ht, met)) cellBins_.push_back(iBin);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    cellStart_.push_back(cellBins_.size());
+
+    indexed_ = true;
+}
+
+int SearchBins::findCell(const int ibJet, const int iTop, const float MT2, const float met, const float ht) const
+{
+    const float vals[nIndexVars_] = {(float)ibJet, (float)iTop, MT2, met, ht};
+
+    int cell = 0, stride = 1;
+    for(int iVar = 0; iVar < nIndexVars_; ++iVar)
+    {
+        const std::vector<float>& edges = indexEdges_[iVar];
+        cell += stride * (std::upper_bound(edges.begin(), edges.end(), vals[iVar]) - edges.begin());
+        stride *= edges.size() + 1;
+    }
+    return cell;
+}
+
+int SearchBins::findBins(const int ibJet, const int iTop, const float MT2, const float met, const float ht, std::vector<int>* iBins) const
+{
+    //NaN inputs fail every comparison, which the cell index cannot represent, so those also use the scan
+    if(indexed_ && !std::isnan(MT2) && !std::isnan(met) && !std::isnan(ht))
+    {
+        const int cell = findCell(ibJet, iTop, MT2, met, ht);
+        if(iBins) iBins->assign(cellBins_.begin() + cellStart_[cell], cellBins_.begin() + cellStart_[cell + 1]);
+        return (cellStart_[cell] < cellStart_[cell + 1]) ? cellBins_[cellStart_[cell]] : -1;
+    }
+
+    int first = -1;
+    for(int iBin = 0; iBin < searchBins_.size(); ++iBin)
+    {
+        if(searchBins_[iBin].compare(ibJet, iTop, MT2, ht, met))
+        {
+            if(!iBins) return iBin;
+            if(first < 0) first = iBin;
+            iBins->push_back(iBin);
+        }
+    }
+    return first;
 }
 
 void SearchBins::addNbNtBin_MT2_MET(int bJet_lo, int bJet_hi, int top_lo, int top_hi, const std::vector<float> mt2_lo, const std::vector<float> mt2_hi, const std::vector<float> met_lo, const std::vector<float> met_hi)
@@ -176,26 +280,12 @@ int SearchBins::find_Binning_Index(int ibJet, int iTop, float MT2, float met) co
 {
 //    assert( binEra_.find("2017") == std::string::npos );
     if(binEra_.find("2017") != std::string::npos) THROW_SATEXCEPTION("This function is depricated for 2017 results");
-    for(int iBin = 0; iBin < searchBins_.size(); ++iBin)
-    {
-        if(searchBins_[iBin].compare(ibJet, iTop, MT2, -1, met))
-        {
-            return iBin;
-        }
-    }
-    return -1;
+    return findBins(ibJet, iTop, MT2, met, -1, nullptr);
 }
 
 int SearchBins::find_Binning_Index(int ibJet, int iTop, float MT2, float met, float ht) const
 {
-    for(int iBin = 0; iBin < searchBins_.size(); ++iBin)
-    {
-        if(searchBins_[iBin].compare(ibJet, iTop, MT2, ht, met))
-        {
-            return iBin;
-        }
-    }
-    return -1;
+    return findBins(ibJet, iTop, MT2, met, ht, nullptr);
 }
 
 std::vector<int> SearchBins::find_Binning_Indices(int ibJet, int iTop, float MT2, float met) const
@@ -204,26 +294,14 @@ std::vector<int> SearchBins::find_Binning_Indices(int ibJet, int iTop, float MT2
     if(binEra_.find("2017") != std::string::npos) THROW_SATEXCEPTION("This function is depricated for 2017 results");
 
     std::vector<int> iBins;
-    for(int iBin = 0; iBin < searchBins_.size(); ++iBin)
-    {
-        if(searchBins_[iBin].compare(ibJet, iTop, MT2, -1, met))
-        {
-            iBins.push_back(iBin);
-        }
-    }
+    findBins(ibJet, iTop, MT2, met, -1, &iBins);
     return iBins;
 }
 
 std::vector<int> SearchBins::find_Binning_Indices(int ibJet, int iTop, float MT2, float met, float ht) const
 {
     std::vector<int> iBins;
-    for(int iBin = 0; iBin < searchBins_.size(); ++iBin)
-    {
-        if(searchBins_[iBin].compare(ibJet, iTop, MT2, ht, met))
-        {
-            iBins.push_back(iBin);
-        }
-    }
+    findBins(ibJet, iTop, MT2, met, ht, &iBins);
     return iBins;
 }
 
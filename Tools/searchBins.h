@@ -68,6 +68,19 @@ private:
     void SearchBins_Aggregate_2017();
 
     std::string binEra_;
+
+    //Lookup index for find_Binning_Index(ices).  The bin edges in each variable (Nb, Nt, MT2, met, HT) divide
+    //the space into cells in which every search bin either always or never matches, so a lookup is one binary
+    //search per variable.  The bins matching cell i are cellBins_[cellStart_[i]] to cellBins_[cellStart_[i+1]-1]
+    //in the order of searchBins_, which gives exactly the result of the linear scan
+    static const int nIndexVars_ = 5;
+    std::vector<float> indexEdges_[nIndexVars_];
+    std::vector<int> cellStart_, cellBins_;
+    bool indexed_;
+
+    void buildIndex();
+    int findCell(const int ibJet, const int iTop, const float MT2, const float met, const float ht) const;
+    int findBins(const int ibJet, const int iTop, const float MT2, const float met, const float ht, std::vector<int>* iBins) const;
 };
 
 #endif